@@ -35,11 +35,10 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include <libusb-1.0/libusb.h>
 //#include<openusb.h>
 
-#define APS_DATA_LOG "/tmp/aps_log.bin"
-
 	/*ASCII control codes*/
 	typedef enum {
 		NUL     = 0,
@@ -79,7 +78,7 @@ extern "C" {
 	/* URI routines -------------------------------------------------------------*/
 
 #define URI_MAX         255
-#define OPTS_MAX        8
+#define OPTS_MAX        16
 
 	struct aps_uri {
 		char    buf[URI_MAX+1];
@@ -179,11 +178,13 @@ extern "C" {
 		int             write_timeout;          /*milliseconds*/
 		int             read_timeout;           /*milliseconds*/
 		aps_settings_t  set;
-#if defined(APS_DATA_LOG)
-		//FILE*           data_log_fd;
-#endif
+		struct aps_trace *trace;                /*wire trace, NULL if disabled*/
+		aps_stats_t     stats;
 	} aps_port_t;
 
+	/*statistics counters may be read by another thread*/
+#define STATS_ADD(var,n)        __atomic_fetch_add(&(var),(n),__ATOMIC_RELAXED)
+
 
 	/* Serial port routines -----------------------------------------------------*/
 	int     serial_get_uri(aps_port_t *p,char *uri,int size);
@@ -261,8 +262,10 @@ extern "C" {
 	/* custom for ethernet */
 	/* no specific at this moment */
 
-	typedef struct {
+	typedef struct aps_class {
 		aps_port_t port;
+		/* wrapped port of a layer, NULL for a transport */
+		struct aps_class *lower;
 		/* fonction customisation */
 		int     (*get_uri)(aps_port_t *p,char *uri,int size);
 
@@ -288,21 +291,63 @@ extern "C" {
 	void usb_custom(aps_class_t *p);
 	void ethernet_custom(aps_class_t *p);
 
-	/* data log routines -----------------------------------------------------*/
-
-#if defined(APS_DATA_LOG)
-	int     log_open(aps_port_t *p);
-	int     log_close(aps_port_t *p);
-	int     log_write(aps_port_t *p,const void *buf,int size);
-	int     log_read(aps_port_t *p,void *buf,int size);
-	int     log_flush(aps_port_t *p);
-#else
-#   define log_open(p)           (APS_OK);
-#   define log_close(p)          (APS_OK);
-#   define log_write(p,buf,size) (APS_OK);
-#   define log_read(p,buf,size)  (APS_OK);
-#   define log_flush(p)          (APS_OK);
-#endif
+	/* command disassembler routines -------------------------------------------*/
+
+	long    disasm_size(const unsigned char *p,int n);
+	void    disasm_command(const unsigned char *p,long n,char *s,int size);
+
+	/* port layer routines ------------------------------------------------------*/
+
+	int     layer_wrap_from_uri(aps_class_t **p,struct aps_uri *su);
+	aps_class_t *layer_transport(aps_class_t *p);
+	void    layer_free(aps_class_t *p);
+
+	/* wire trace routines ------------------------------------------------------*/
+
+#define TRACE_MAGIC             0x43525441      /*"ATRC"*/
+#define TRACE_VERSION           1
+#define TRACE_DEFSIZE           256             /*KB*/
+#define TRACE_CAPLEN_MAX        4096            /*bytes captured per record*/
+
+	/*record direction*/
+	typedef enum {
+		TRACE_TX        = 1,    /*aps_write*/
+		TRACE_TX_RT     = 2,    /*aps_write_rt*/
+		TRACE_RX        = 3,    /*aps_read*/
+		TRACE_WRAP      = 4     /*end of ring, next record at start*/
+	} aps_trace_dir_t;
+
+	/*ring file header, followed by ring data*/
+	typedef struct {
+		uint32_t        magic;
+		uint32_t        version;
+		uint32_t        size;           /*ring data size in bytes*/
+		uint32_t        port_type;
+		uint64_t        head;           /*free running offset of next record*/
+		uint64_t        tail;           /*free running offset of oldest record*/
+		uint64_t        records;        /*records written since start*/
+		uint64_t        lost;           /*records overwritten*/
+		char            uri[256];
+	} aps_trace_header_t;
+
+	/*record, followed by caplen data bytes padded to 8 bytes*/
+	typedef struct {
+		uint64_t        time;           /*start of operation, ns since epoch*/
+		uint32_t        latency;        /*duration of operation, us*/
+		uint32_t        size;           /*bytes requested*/
+		uint16_t        caplen;         /*bytes captured*/
+		uint8_t         dir;            /*aps_trace_dir_t*/
+		int8_t          errnum;         /*result of operation*/
+		uint32_t        reserved;
+	} aps_trace_record_t;
+
+#define TRACE_ALIGN(n)          (((n)+7)&~7)
+
+	int     trace_start(aps_port_t *p,const char *path,int size);
+	int     trace_stop(aps_port_t *p);
+	const char *trace_file(aps_port_t *p);
+	void    trace_record(aps_port_t *p,int dir,const void *buf,int size,uint64_t start,int errnum);
+	uint64_t trace_clock(void);
 
 	/* Serial port specific routines --------------------------------------------*/
 
@@ -36,14 +36,95 @@
 #include <string.h>
 #include <netdb.h>
 #include <errno.h>
+#include <unistd.h>
+#include <time.h>
 
 #include <aps/aps.h>
 #include <aps/aps-private.h>
 
 /* PRIVATE DEFINITIONS ------------------------------------------------------*/
 
+#define TRACE_PATH_MAX  255     /*characters*/
+
+static int trace_count;         /*ports traced by APS_TRACE*/
+
 /* PRIVATE FUNCTIONS --------------------------------------------------------*/
 
+/*-----------------------------------------------------------------------------
+Name      :  stats_clock
+Purpose   :  Get monotonic time for latency statistics
+Inputs    :  <>
+Outputs   :  <>
+Return    :  time in microseconds
+-----------------------------------------------------------------------------*/
+static uint64_t stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+
+    return (uint64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stats_latency
+Purpose   :  Account operation in port statistics
+Inputs    :  op     : operation statistics
+             us     : operation latency in microseconds
+             errnum : operation result
+Outputs   :  Statistics are updated
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void stats_latency(aps_op_stats_t *op,uint64_t us,int errnum)
+{
+    int i;
+
+    /*bucket of 2^(i-1) <= us < 2^i*/
+    i = us==0 ? 0 : 64-__builtin_clzll(us);
+    if (i>=APS_STATS_BUCKETS)
+        i = APS_STATS_BUCKETS-1;
+
+    STATS_ADD(op->calls,1);
+    STATS_ADD(op->total_us,us);
+    STATS_ADD(op->hist[i],1);
+
+    if (errnum==APS_WRITE_TIMEOUT || errnum==APS_READ_TIMEOUT) {
+        STATS_ADD(op->timeouts,1);
+    }
+    else if (errnum<0) {
+        STATS_ADD(op->errors,1);
+    }
+
+    if (us>op->max_us)
+        __atomic_store_n(&op->max_us,us,__ATOMIC_RELAXED);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  trace_from_env
+Purpose   :  Start wire trace if APS_TRACE environment variable is set
+Inputs    :  p : port structure
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void trace_from_env(aps_class_t *p)
+{
+    char path[TRACE_PATH_MAX+1];
+    const char *dir;
+    const char *size;
+
+    dir = getenv("APS_TRACE");
+    if (dir==NULL || *dir==0 || p->port.trace!=NULL) {
+        return;
+    }
+
+    size = getenv("APS_TRACE_SIZE");
+
+    snprintf(path,sizeof(path),"%s/aps-trace-%d-%d.bin",dir,(int)getpid(),trace_count++);
+    if (trace_start(&p->port,path,size!=NULL ? atoi(size) : 0)!=APS_OK) {
+        fprintf(stderr,"ERROR: cannot create wire trace %s\n",path);
+    }
+}
+
 /*-----------------------------------------------------------------------------
 Name      :  build_port
 Purpose   :  Build port structure
@@ -287,6 +368,13 @@ printf("build port structure");
     if (p->create_from_uri != NULL)
         p->port.errnum = p->create_from_uri(&p->port,&su);
 
+    /*wrap transport in layers declared in URI*/
+    if (p->port.errnum==APS_OK) {
+        aps_error_t errnum = layer_wrap_from_uri(&p,&su);
+
+        p->port.errnum = errnum;
+    }
+
     return p;
 }
 
@@ -442,7 +530,8 @@ int aps_destroy_port(void *port)
         }
 
         if (errnum==APS_OK) {
-            free(p);
+            trace_stop(&p->port);
+            layer_free(p);
         }
     }
 
@@ -522,6 +611,7 @@ int aps_open(void *port)
             }
             if (errnum==APS_OK) {
                 p->port.is_open = 1;
+                trace_from_env(p);
             }
         }
 
@@ -588,9 +678,18 @@ int aps_write(void *port,const void *buf,int size)
             errnum = APS_PORT_NOT_OPEN;
         }
         else {
-              errnum = p->write(&p->port,buf,size);
-              
-            
+            uint64_t start = stats_clock();
+            uint64_t stamp = p->port.trace!=NULL ? trace_clock() : 0;
+
+            errnum = p->write(&p->port,buf,size);
+
+            stats_latency(&p->port.stats.op[APS_OP_WRITE],stats_clock()-start,errnum);
+            if (errnum==APS_OK) {
+                STATS_ADD(p->port.stats.bytes_written,size);
+            }
+            if (p->port.trace!=NULL) {
+                trace_record(&p->port,TRACE_TX,buf,size,stamp,errnum);
+            }
         }
 
         p->port.errnum = errnum;
@@ -622,12 +721,23 @@ int aps_write_rt(void *port,const void *buf,int size)
             errnum = APS_PORT_NOT_OPEN;
         }
         else {
+            uint64_t start = stats_clock();
+            uint64_t stamp = p->port.trace!=NULL ? trace_clock() : 0;
+
             if  (p->write_rt != NULL) {
                 errnum = p->write_rt(&p->port,buf,size);
             }
             else if (p->write != NULL) {
                 errnum = p->write(&p->port,buf,size);
             }
+
+            stats_latency(&p->port.stats.op[APS_OP_WRITE],stats_clock()-start,errnum);
+            if (errnum==APS_OK) {
+                STATS_ADD(p->port.stats.bytes_written,size);
+            }
+            if (p->port.trace!=NULL) {
+                trace_record(&p->port,TRACE_TX_RT,buf,size,stamp,errnum);
+            }
         }
 
         p->port.errnum = errnum;
@@ -658,9 +768,20 @@ int aps_read(void *port,void *buf,int size)
             errnum = APS_PORT_NOT_OPEN;
         }
         else {
+            uint64_t start = stats_clock();
+            uint64_t stamp = p->port.trace!=NULL ? trace_clock() : 0;
+
             if  (p->read != NULL) {
                 errnum = p->read(&p->port,buf,size);
             }
+
+            stats_latency(&p->port.stats.op[APS_OP_READ],stats_clock()-start,errnum);
+            if (errnum==APS_OK) {
+                STATS_ADD(p->port.stats.bytes_read,size);
+            }
+            if (p->port.trace!=NULL) {
+                trace_record(&p->port,TRACE_RX,buf,size,stamp,errnum);
+            }
         }
 
         p->port.errnum = errnum;
@@ -689,9 +810,13 @@ int aps_sync(void *port)
             errnum = APS_PORT_NOT_OPEN;
         }
         else {
+            uint64_t start = stats_clock();
+
             if  (p->sync != NULL) {
                 errnum = p->sync(&p->port);
             }
+
+            stats_latency(&p->port.stats.op[APS_OP_SYNC],stats_clock()-start,errnum);
         }
 
         p->port.errnum = errnum;
@@ -783,7 +908,7 @@ Return    :  APS_OK or error code
 int aps_serial_set_baudrate(void *port,int baudrate)
 {
     aps_error_t errnum;
-    aps_class_t *p = port;
+    aps_class_t *p = layer_transport(port);
 
     if (p==NULL) {
         errnum = APS_INVALID_PORT;
@@ -817,7 +942,7 @@ Return    :  APS_OK or error code
 int aps_serial_set_handshake(void *port,int handshake)
 {
     aps_error_t errnum;
-    aps_class_t *p = port;
+    aps_class_t *p = layer_transport(port);
 
     if (p==NULL) {
         errnum = APS_INVALID_PORT;
@@ -850,7 +975,7 @@ Return    :  baudrate (aps_baudrate_t) or error code
 int aps_serial_get_baudrate(void *port)
 {
     aps_error_t errnum;
-    aps_class_t *p = port;
+    aps_class_t *p = layer_transport(port);
 
     if (p==NULL) {
         errnum = APS_INVALID_PORT;
@@ -877,7 +1002,7 @@ Return    :  handshake (aps_handshake_t) or error code
 int aps_serial_get_handshake(void *port)
 {
     aps_error_t errnum;
-    aps_class_t *p = port;
+    aps_class_t *p = layer_transport(port);
 
     if (p==NULL) {
         errnum = APS_INVALID_PORT;
@@ -904,7 +1029,7 @@ Return    :  APS_OK or error code
 int aps_parallel_reset(void *port)
 {
     aps_error_t errnum;
-    aps_class_t *p = port;
+    aps_class_t *p = layer_transport(port);
 
     if (p==NULL) {
         errnum = APS_INVALID_PORT;
@@ -937,7 +1062,7 @@ Return    :  APS_OK or error code
 int aps_parallel_set_mode(void *port,int mode)
 {
     aps_error_t errnum;
-    aps_class_t *p = port;
+    aps_class_t *p = layer_transport(port);
 
     if (p==NULL) {
         errnum = APS_INVALID_PORT;
@@ -966,7 +1091,7 @@ Return    :  mode (aps_parallel_mode_t) or error code
 int aps_parallel_get_mode(void *port)
 {
     aps_error_t errnum;
-    aps_class_t *p = port;
+    aps_class_t *p = layer_transport(port);
 
     if (p==NULL) {
         errnum = APS_INVALID_PORT;
@@ -994,7 +1119,7 @@ Return    :  APS_OK or error code
 int aps_usb_control(void *port,aps_usb_ctrltransfer_t *ctrl)
 {
     aps_error_t errnum;
-    aps_class_t *p = port;
+    aps_class_t *p = layer_transport(port);
 
     if (p==NULL) {
         errnum = APS_INVALID_PORT;
@@ -1007,7 +1132,12 @@ int aps_usb_control(void *port,aps_usb_ctrltransfer_t *ctrl)
             errnum = APS_INVALID_PORT_TYPE;
         }
         else {
+            aps_class_t *outer = port;
+            uint64_t start = stats_clock();
+
             errnum = usb_control(&p->port,ctrl);
+
+            stats_latency(&outer->port.stats.op[APS_OP_USB_CONTROL],stats_clock()-start,errnum);
         }
 
         p->port.errnum = errnum;
@@ -1026,7 +1156,7 @@ Return    :  APS_OK or error code
 int aps_usb_kill(void *port)
 {
     aps_error_t errnum;
-    aps_class_t *p = port;
+    aps_class_t *p = layer_transport(port);
 
     if (p==NULL) {
         errnum = APS_INVALID_PORT;
@@ -1157,6 +1287,177 @@ int aps_get_error(void *port)
     return errnum;
 }
 
+/*-----------------------------------------------------------------------------
+Name      :  aps_get_stats
+Purpose   :  Get port statistics (counters since creation or last reset)
+Inputs    :  port  : port structure
+             stats : statistics buffer
+Outputs   :  Fills statistics buffer
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_get_stats(void *port,aps_stats_t *stats)
+{
+    aps_class_t *p = port;
+    aps_class_t *transport;
+
+    if (p==NULL) {
+        return APS_INVALID_PORT;
+    }
+
+    memcpy(stats,&p->port.stats,sizeof(aps_stats_t));
+
+    /*low-level transfers are counted by the transport under the layers*/
+    transport = layer_transport(p);
+    if (transport!=p) {
+        stats->partial_writes += transport->port.stats.partial_writes;
+        stats->retries += transport->port.stats.retries;
+    }
+
+    return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_reset_stats
+Purpose   :  Reset port statistics
+Inputs    :  port : port structure
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_reset_stats(void *port)
+{
+    aps_class_t *p = port;
+
+    if (p==NULL) {
+        return APS_INVALID_PORT;
+    }
+
+    memset(&p->port.stats,0,sizeof(aps_stats_t));
+    memset(&layer_transport(p)->port.stats,0,sizeof(aps_stats_t));
+
+    return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_stats_record
+Purpose   :  Account operation timed by application (status round trip...)
+Inputs    :  port   : port structure
+             op     : operation (aps_op_t)
+             us     : operation latency in microseconds
+             errnum : operation result
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_stats_record(void *port,int op,int us,int errnum)
+{
+    aps_class_t *p = port;
+
+    if (p==NULL) {
+        return APS_INVALID_PORT;
+    }
+    if (op<0 || op>=APS_OP_MAX || us<0) {
+        return APS_NOT_IMPLEMENTED;
+    }
+
+    stats_latency(&p->port.stats.op[op],us,errnum);
+
+    return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_stats_percentile
+Purpose   :  Estimate latency percentile from histogram
+Inputs    :  op      : operation statistics
+             percent : percentile (50 for median...)
+Outputs   :  <>
+Return    :  upper bound of latency percentile in microseconds, 0 if no call
+-----------------------------------------------------------------------------*/
+int aps_stats_percentile(const aps_op_stats_t *op,int percent)
+{
+    unsigned long count = 0;
+    unsigned long rank;
+    int i;
+
+    if (op->calls==0) {
+        return 0;
+    }
+
+    rank = (op->calls*percent+99)/100;
+    if (rank==0)
+        rank = 1;
+
+    for (i = 0; i<APS_STATS_BUCKETS-1; i++) {
+        count += op->hist[i];
+        if (count>=rank)
+            return (unsigned long)(1<<i)<op->max_us ? 1<<i : (int)op->max_us;
+    }
+
+    return op->max_us;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_trace_start
+Purpose   :  Start recording port traffic in a ring file (see apstrace)
+Inputs    :  port : port structure
+             path : ring file, created or truncated
+             size : ring size in KB, 0 for default
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_trace_start(void *port,const char *path,int size)
+{
+    aps_error_t errnum;
+    aps_class_t *p = port;
+
+    if (p==NULL) {
+        errnum = APS_INVALID_PORT;
+    }
+    else {
+        errnum = trace_start(&p->port,path,size);
+    }
+
+    return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_trace_stop
+Purpose   :  Stop recording port traffic. Ring file is kept
+Inputs    :  port : port structure
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_trace_stop(void *port)
+{
+    aps_error_t errnum;
+    aps_class_t *p = port;
+
+    if (p==NULL) {
+        errnum = APS_INVALID_PORT;
+    }
+    else {
+        errnum = trace_stop(&p->port);
+    }
+
+    return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_trace_get_file
+Purpose   :  Get ring file recording port traffic
+Inputs    :  port : port structure
+Outputs   :  <>
+Return    :  file path or NULL if port is not traced
+-----------------------------------------------------------------------------*/
+const char *aps_trace_get_file(void *port)
+{
+    aps_class_t *p = port;
+
+    if (p==NULL) {
+        return NULL;
+    }
+
+    return trace_file(&p->port);
+}
+
 /*-----------------------------------------------------------------------------
 Name      :  aps_strerror
 Purpose   :  Convert error code in printable string
@@ -1274,6 +1575,15 @@ const char *aps_get_strerror_full(int errnum,void* port)
         case APS_USB_DEVICE_BUSY:
             s = "USB device busy (cannot unregister current driver)";
             break;
+        case APS_INVALID_BITMAP:
+            s = "Invalid bitmap size";
+            break;
+        case APS_INVALID_FONT:
+            s = "Invalid font";
+            break;
+        case APS_NO_MEMORY:
+            s = "Not enough memory";
+            break;
         case APS_ETHERNET_EAI_ERROR:
             if (sub_errnum)
                 s = gai_strerror(sub_errnum);
@@ -74,7 +74,10 @@ typedef enum {
         APS_ETHERNET_SOCKET_ERROR       = -29,
         APS_ETHERNET_FCNTL_ERROR        = -30,
         APS_ETHERNET_CONNECT_ERROR      = -31,
-        APS_OPEN_TIMEOUT                = -32
+        APS_OPEN_TIMEOUT                = -32,
+        APS_INVALID_BITMAP              = -33,
+        APS_INVALID_FONT                = -34,
+        APS_NO_MEMORY                   = -35
 
 
 } aps_error_t;
@@ -165,6 +168,56 @@ typedef enum {
         APS_IRQ         = 1
 } aps_parallel_mode_t;
 
+/*port statistics, latency histogram bucket i counts operations taking
+  less than 2^i microseconds (and at least 2^(i-1)), last bucket is open*/
+#define APS_STATS_BUCKETS       24
+
+typedef enum {
+        APS_OP_WRITE            = 0,    /*aps_write, aps_write_rt*/
+        APS_OP_READ             = 1,    /*aps_read*/
+        APS_OP_SYNC             = 2,    /*aps_sync*/
+        APS_OP_USB_CONTROL      = 3,    /*aps_usb_control*/
+        APS_OP_STATUS           = 4,    /*status round trip (aps_stats_record)*/
+        APS_OP_MAX              = 5
+} aps_op_t;
+
+typedef struct {
+        unsigned long           calls;
+        unsigned long           errors;
+        unsigned long           timeouts;
+        unsigned long long      total_us;
+        unsigned long           max_us;
+        unsigned long           hist[APS_STATS_BUCKETS];
+} aps_op_stats_t;
+
+typedef struct {
+        unsigned long long      bytes_written;
+        unsigned long long      bytes_read;
+        unsigned long           partial_writes; /*low-level writes shorter than requested*/
+        unsigned long           retries;        /*low-level transfers repeated*/
+        aps_op_stats_t          op[APS_OP_MAX];
+} aps_stats_t;
+
+/*bitmap encoder flags*/
+typedef enum {
+        APS_BITMAP_TRIM         = 0x01, /*trim blank bytes, shift dotlines*/
+        APS_BITMAP_FEED         = 0x02  /*blank dotlines sent as paper feed*/
+} aps_bitmap_flags_t;
+
+/*dotline encoder state, dotlines are encoded one by one
+  (see aps_encode_dotline) so callers can insert their own commands*/
+typedef struct {
+        int             type;           /*model type*/
+        int             flags;          /*aps_bitmap_flags_t*/
+        int             shift;          /*current dotline shift, -1 if unknown*/
+        int             feed;           /*pending blank dotlines*/
+        unsigned long   shifts;         /*shift commands sent*/
+        unsigned long   trimmed;        /*blank bytes trimmed*/
+} aps_encoder_t;
+
+/*maximum size of an encoded dotline*/
+#define APS_ENCODE_MAX(nbytes)  ((nbytes)+16)
+
 typedef struct {
         unsigned char   bRequestType;
         unsigned char   bRequest;
@@ -181,6 +234,14 @@ int     aps_get_model_width(int model);
 
 int     aps_decode_status(int type,const void *buf,int size,aps_status_t *status);
 
+long    aps_command_size(const void *buf,int size);
+
+int     aps_encoder_init(aps_encoder_t *enc,int type,int flags);
+int     aps_encode_dotline(aps_encoder_t *enc,const unsigned char *line,int nbytes,
+                           unsigned char *out);
+int     aps_encode_shift(aps_encoder_t *enc,int lead,unsigned char *out);
+int     aps_encode_end(aps_encoder_t *enc,unsigned char *out);
+
 int     aps_detect_printers(aps_printer_t *printers,int max);
 
 void *  aps_create_port(const char *uri);
@@ -214,6 +275,15 @@ int     aps_parallel_reset(void *port);
 int     aps_parallel_set_mode(void *port,int mode);
 int     aps_parallel_get_mode(void *port);
 
+int     aps_print_bitmap(void *port,int type,const void *buf,int width,int height,
+                         int stride,int flags);
+
+void *  aps_create_text(void *port,int type,int width,void *font,int flags);
+int     aps_destroy_text(void *text);
+int     aps_set_text_spacing(void *text,int charspacing,int linespacing);
+int     aps_print_text(void *text,const char *s,int size);
+int     aps_flush_text(void *text);
+
 int     aps_usb_control(void *port,aps_usb_ctrltransfer_t *ctrl);
 int     aps_usb_kill(void *port);
 
@@ -223,6 +293,15 @@ int     aps_set_read_timeout(void *port,int ms);
 int     aps_get_error(void *port);
 int     aps_get_sub_error(void *port);
 
+int     aps_get_stats(void *port,aps_stats_t *stats);
+int     aps_reset_stats(void *port);
+int     aps_stats_record(void *port,int op,int us,int errnum);
+int     aps_stats_percentile(const aps_op_stats_t *op,int percent);
+
+int     aps_trace_start(void *port,const char *path,int size);
+int     aps_trace_stop(void *port);
+const char *aps_trace_get_file(void *port);
+
 const char *aps_strerror(int errnum);
 const char *aps_get_strerror_full(int errnum,void *port);
 
@@ -187,6 +187,39 @@ static int load_file(void *fnt,FILE *f)
 }
 
 
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  unload_font
+ * Purpose   :  free the tables and bitmaps of the loaded font, the font
+ *              class is kept for next load
+ *              
+ * Inputs    :  fnt      : pointer to the font class
+ * Outputs   :  <>
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+static void unload_font(void *fnt)
+{
+    if (P(fnt)->conv_tab != NULL)
+        free(P(fnt)->conv_tab);
+    P(fnt)->conv_tab = NULL;
+
+    if (P(fnt)->char_list != NULL)
+    {
+        char_data_t *p = P(fnt)->char_list;
+
+        while (P(fnt)->char_list_size--)
+        {
+            if (*p != NULL)
+                free(*p);
+            p++;
+        }
+        free(P(fnt)->char_list);
+    }
+    P(fnt)->char_list = NULL;
+    P(fnt)->char_list_size = 0;
+}
+
 /* PUBLIC FUNCTIONS --------------------------------------------------------*/
 
 /*
@@ -266,6 +299,8 @@ const char* aps_fnt_error_str (void *fnt)
             return "this character is empty in this font";
         case fntERR_CHAR_BIPMAP_PTR_NULL:
             return "there is no bipmap for this character ?!?!";
+        case fntERR_ALLOC_LINE:
+            return "Can't allocate memorie for the text line";
         default:
             return "Error unknown";
     }
@@ -329,21 +364,8 @@ void aps_fnt_free(void *fnt)
     if (fnt == NULL)
         return; 
 
-    if (P(fnt)->conv_tab != NULL)
-        free(P(fnt)->conv_tab);
-
-    if (P(fnt)->char_list != NULL)
-    {
-        char_data_t *p = P(fnt)->char_list;
-
-        while (P(fnt)->char_list_size--)
-        {
-            if (*p != NULL)
-                free(*p);
-            p++;
-        }
-        free(P(fnt)->char_list);
-    }
+    unload_font(fnt);
+    free(fnt);
 }
 
 /*
@@ -387,7 +409,7 @@ int aps_fnt_load(void* fnt, char *path)
     if (f == NULL)
         return SET_ERR(fntERR_FILE_OPEN);
 
-    aps_fnt_free(fnt);
+    unload_font(fnt);
 
     error = load_file(fnt,f);
 
@@ -472,3 +494,125 @@ int aps_fnt_draw_char(void *fnt, uint8_t *graphic_buf, int* pix, int printer_wid
     return SET_ERR(fntERR_OK);
 }
 
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  aps_fnt_line_init
+ * Purpose   :  allocate a blank text line for the font
+ *              character spacing is 1 dot, set line->charspacing to change it
+ *
+ * Inputs    :  line     : text line
+ *              fnt      : pointer to the font class, kept by the line
+ *              width    : line width in bytes
+ * Outputs   :  <>
+ * Return    :  <0 on error, 0 otherwise
+ * -----------------------------------------------------------------------------
+ */
+fntERROR aps_fnt_line_init(aps_fnt_line_t *line, void *fnt, int width)
+{
+    memset(line,0,sizeof(*line));
+
+    if (fnt == NULL)
+        return fntERR_PTR_NULL;
+
+    line->fnt = fnt;
+    line->width = width;
+    line->high = P(fnt)->height;
+    line->charspacing = 1;
+
+    line->buf = calloc(line->high,width);
+    if (line->buf == NULL)
+        return fntERR_ALLOC_LINE;
+
+    return fntERR_OK;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  aps_fnt_line_free
+ * Purpose   :  free the text line, the font is not freed
+ *
+ * Inputs    :  line     : text line
+ * Outputs   :  <>
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+void aps_fnt_line_free(aps_fnt_line_t *line)
+{
+    free(line->buf);
+    line->buf = NULL;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  aps_fnt_line_draw
+ * Purpose   :  draw a character in the text line
+ *              a character without bitmap ends the line: the caller prints
+ *              and clears the line, then draws the character again, the
+ *              character is dropped if the line is still full
+ *              other errors (line full, empty character) only move to the
+ *              next character position
+ *
+ * Inputs    :  line     : text line
+ *              c        : code of character to draw
+ * Outputs   :  <>
+ * Return    :  fntERR_CHAR_BIPMAP_PTR_NULL if the line must be ended first,
+ *              otherwise result of aps_fnt_draw_char
+ * -----------------------------------------------------------------------------
+ */
+fntERROR aps_fnt_line_draw(aps_fnt_line_t *line, int c)
+{
+    int retry = line->retry;
+    int res;
+    int n;
+
+    line->retry = 0;
+    if (!retry)
+        line->chars++;
+
+    res = aps_fnt_draw_char(line->fnt,line->buf,&line->pix,line->width,c);
+
+    if (res == fntERR_CHAR_BIPMAP_PTR_NULL && !retry)
+    {
+        line->retry = 1;
+        return res;
+    }
+
+    if (res == fntERR_LINE_FULL && retry)
+        return res;
+
+    n = (line->pix + 7) / 8;
+    if (n > line->width)
+        n = line->width;
+    if (n > line->span)
+        line->span = n;
+
+    line->pix += line->charspacing;
+
+    return res;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  aps_fnt_line_clear
+ * Purpose   :  clear the drawn part of the text line for the next line
+ *
+ * Inputs    :  line     : text line
+ * Outputs   :  <>
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+void aps_fnt_line_clear(aps_fnt_line_t *line)
+{
+    uint8_t *p = line->buf;
+    int i;
+
+    if (line->span == line->width)
+        memset(p,0,line->width * line->high);
+    else if (line->span > 0)
+        for (i = 0; i < line->high; i++, p += line->width)
+            memset(p,0,line->span);
+
+    line->pix = 0;
+    line->span = 0;
+    line->chars = 0;
+}
@@ -1,6 +1,8 @@
 #ifndef _APS_FNT_H_
 #define _APS_FNT_H_
 
+#include <stdint.h>
+
 #define FNT_NAME_SIZE       256
 
 typedef enum
@@ -20,6 +22,7 @@ typedef enum
     fntERR_CHAR_VALUE_TO_HIGH   = -12,
     fntERR_CHAR_EMPTY           = -13,
     fntERR_CHAR_BIPMAP_PTR_NULL = -14,
+    fntERR_ALLOC_LINE           = -15,
 }fntERROR;
 
 
@@ -36,6 +39,23 @@ typedef struct
     int         char_list_size;
 }aps_fnt_details_t;
 
+/*
+ * text line built with a font, shared by the text filter and libaps text
+ * printing (see aps_fnt_line_draw)
+ */
+typedef struct
+{
+    void        *fnt;
+    uint8_t     *buf;           /* line bitmap, width*high bytes */
+    int         width;          /* bytes */
+    int         high;           /* dotlines */
+    int         charspacing;    /* dots between characters */
+    int         pix;            /* position of next character in dots */
+    int         span;           /* bytes drawn in line */
+    int         chars;          /* characters put in line */
+    int         retry;          /* last character must be drawn again */
+}aps_fnt_line_t;
+
 
 void*       aps_fnt_create(char *path);
 fntERROR    aps_fnt_load(void* fnt, char *path);
@@ -48,6 +68,11 @@ fntERROR    aps_fnt_draw_char(void *fnt, uint8_t *graphic_buf, int* pix, int pri
 
 fntERROR    aps_fnt_get_details(void *fnt, aps_fnt_details_t *p);
 
+fntERROR    aps_fnt_line_init(aps_fnt_line_t *line, void *fnt, int width);
+void        aps_fnt_line_free(aps_fnt_line_t *line);
+fntERROR    aps_fnt_line_draw(aps_fnt_line_t *line, int c);
+void        aps_fnt_line_clear(aps_fnt_line_t *line);
+
 fntERROR    aps_fnt_error(void *fnt);
 const char* aps_fnt_error_str (void *fnt);
 
@@ -0,0 +1,378 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : apsbench.c
+* DESCRIPTION   : APS library microbenchmarks
+*                 Results are printed one per line in Go benchmark format:
+*                 Benchmark<name> <iterations> <ns/op> <bytes/op> <syscalls/op>
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*
+*   This file is part of libaps.
+*
+*   libaps is free software; you can redistribute it and/or
+*   modify it under the terms of the GNU Lesser General Public
+*   License as published by the Free Software Foundation; either
+*   version 2.1 of the License, or (at your option) any later version.
+*
+*   libaps is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*   Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public
+*   License along with libaps; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <aps/aps.h>
+#include <aps/aps-private.h>
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define BENCH_DEFTIME   1.0     /*seconds per benchmark*/
+#define BENCH_MAXITER   1000000000L
+
+typedef void (*bench_fn_t)(long n);
+
+static double           bench_time;
+static const char *     bench_filter;
+
+static long             bench_bytes;    /*bytes processed by benchmark*/
+static long             bench_syscalls; /*read/write/select issued by libaps*/
+
+/*benchmark parameters*/
+static const char *     cur_uri;
+static int              cur_type;
+static const unsigned char *cur_status;
+static int              cur_status_size;
+static void *           cur_port;
+static unsigned char    cur_buf[4096];
+static int              cur_size;
+
+/*system calls are counted by linking with -Wl,--wrap=read,--wrap=write,--wrap=select*/
+ssize_t __real_read(int fd,void *buf,size_t count);
+ssize_t __real_write(int fd,const void *buf,size_t count);
+int     __real_select(int n,fd_set *r,fd_set *w,fd_set *e,struct timeval *tv);
+ssize_t __wrap_read(int fd,void *buf,size_t count);
+ssize_t __wrap_write(int fd,const void *buf,size_t count);
+int     __wrap_select(int n,fd_set *r,fd_set *w,fd_set *e,struct timeval *tv);
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  now
+Purpose   :  Get monotonic time
+Inputs    :  <>
+Outputs   :  <>
+Return    :  time in seconds
+-----------------------------------------------------------------------------*/
+static double now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+
+        return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  run_bench
+Purpose   :  Run benchmark for at least bench_time seconds and print result
+Inputs    :  name : benchmark name
+             fn   : benchmark function, runs n operations
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void run_bench(const char *name,bench_fn_t fn)
+{
+        double elapsed;
+        long n = 1;
+
+        if (bench_filter!=NULL && strstr(name,bench_filter)==NULL)
+                return;
+
+        for (;;) {
+                double t;
+                long next;
+
+                bench_bytes = 0;
+                bench_syscalls = 0;
+
+                t = now();
+                fn(n);
+                elapsed = now()-t;
+
+                if (elapsed>=bench_time || n>=BENCH_MAXITER)
+                        break;
+
+                /*predict iterations needed, grow at most 100 times*/
+                next = elapsed>0 ? n*1.2*bench_time/elapsed : n*100;
+                if (next>n*100)
+                        next = n*100;
+                if (next<=n)
+                        next = n+1;
+                n = next;
+        }
+
+        printf("Benchmark%s\t%ld\t%.1f ns/op\t%.1f bytes/op\t%.2f syscalls/op\n",
+                        name,n,
+                        elapsed*1e9/n,
+                        (double)bench_bytes/n,
+                        (double)bench_syscalls/n);
+        fflush(stdout);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_uri_split
+Purpose   :  Split URI string
+Inputs    :  n : number of operations
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_uri_split(long n)
+{
+        struct aps_uri su;
+
+        while (n--) {
+                if (uri_split(&su,cur_uri)<0) {
+                        fprintf(stderr,"bench_uri_split: invalid uri %s\n",cur_uri);
+                        exit(1);
+                }
+                bench_bytes += strlen(cur_uri);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_decode_status
+Purpose   :  Decode printer status
+Inputs    :  n : number of operations
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_decode_status(long n)
+{
+        aps_status_t status;
+
+        while (n--) {
+                aps_decode_status(cur_type,cur_status,cur_status_size,&status);
+                bench_bytes += cur_status_size;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_write
+Purpose   :  Write data block to port
+Inputs    :  n : number of operations
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_write(long n)
+{
+        int errnum;
+
+        while (n--) {
+                if ((errnum = aps_write(cur_port,cur_buf,cur_size))<0) {
+                        fprintf(stderr,"bench_write: %s\n",aps_strerror(errnum));
+                        exit(1);
+                }
+                bench_bytes += cur_size;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  start_sink
+Purpose   :  Start loopback TCP server discarding everything it receives
+Inputs    :  pid : child process id
+Outputs   :  <>
+Return    :  TCP port or -1 on error
+-----------------------------------------------------------------------------*/
+static int start_sink(pid_t *pid)
+{
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        int fd;
+
+        fd = socket(AF_INET,SOCK_STREAM,0);
+        if (fd<0)
+                return -1;
+
+        memset(&addr,0,sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+
+        if (bind(fd,(struct sockaddr *)&addr,sizeof(addr))<0
+            || listen(fd,1)<0
+            || getsockname(fd,(struct sockaddr *)&addr,&len)<0) {
+                close(fd);
+                return -1;
+        }
+
+        *pid = fork();
+        if (*pid<0) {
+                close(fd);
+                return -1;
+        }
+
+        if (*pid==0) {
+                char buf[65536];
+                int client;
+
+                while ((client = accept(fd,NULL,NULL))>=0) {
+                        while (__real_read(client,buf,sizeof(buf))>0)
+                                ;
+                        close(client);
+                }
+                _exit(0);
+        }
+
+        close(fd);
+
+        return ntohs(addr.sin_port);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_transport
+Purpose   :  Run ethernet transport benchmarks against a loopback sink
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_transport(void)
+{
+        static const int sizes[] = {5,77,4096};
+        char uri[64];
+        char name[64];
+        pid_t pid;
+        int port;
+        unsigned int i;
+
+        port = start_sink(&pid);
+        if (port<0) {
+                perror("bench_transport: cannot start sink");
+                return;
+        }
+
+        snprintf(uri,sizeof(uri),"aps:127.0.0.1?type=ethernet+port=%d",port);
+
+        cur_port = aps_create_port(uri);
+        if (cur_port==NULL || aps_get_error(cur_port)<0 || aps_open(cur_port)<0) {
+                fprintf(stderr,"bench_transport: cannot open %s\n",uri);
+        }
+        else {
+                aps_set_write_timeout(cur_port,5000);
+
+                /*ESC V header, one 576 dots dotline, a 4 KB block*/
+                memset(cur_buf,0x55,sizeof(cur_buf));
+                for (i = 0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+                        cur_size = sizes[i];
+                        snprintf(name,sizeof(name),"EthernetWrite/%d",cur_size);
+                        run_bench(name,bench_write);
+                }
+
+                aps_close(cur_port);
+        }
+
+        if (cur_port!=NULL)
+                aps_destroy_port(cur_port);
+        cur_port = NULL;
+
+        kill(pid,SIGTERM);
+        waitpid(pid,NULL,0);
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  __wrap_read, __wrap_write, __wrap_select
+Purpose   :  Count system calls issued by libaps
+Inputs    :  see read(2), write(2), select(2)
+Outputs   :  Updates bench_syscalls
+Return    :  see read(2), write(2), select(2)
+-----------------------------------------------------------------------------*/
+ssize_t __wrap_read(int fd,void *buf,size_t count)
+{
+        bench_syscalls++;
+        return __real_read(fd,buf,count);
+}
+
+ssize_t __wrap_write(int fd,const void *buf,size_t count)
+{
+        bench_syscalls++;
+        return __real_write(fd,buf,count);
+}
+
+int __wrap_select(int n,fd_set *r,fd_set *w,fd_set *e,struct timeval *tv)
+{
+        bench_syscalls++;
+        return __real_select(n,r,w,e,tv);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  main
+Purpose   :  Program main function
+Inputs    :  argc : number of command-line arguments
+             argv : array of command-line arguments
+Outputs   :  <>
+Return    :  0 if success, 1 on error
+-----------------------------------------------------------------------------*/
+int main(int argc,char **argv)
+{
+        static const unsigned char status_mrs[] = {0xb0};
+        static const unsigned char status_kcp[] = {0xb0,0x09,0x00};
+        static const unsigned char status_hsp[] = {0x01,0x00,0x00,0x00};
+        const char *s;
+
+        if (argc>2 || (argc==2 && argv[1][0]=='-')) {
+                printf("usage: apsbench [name-filter]\n"
+                       "  BENCH_TIME environment variable sets seconds per benchmark\n");
+                return 0;
+        }
+
+        bench_filter = argc==2 ? argv[1] : NULL;
+
+        s = getenv("BENCH_TIME");
+        bench_time = s!=NULL ? atof(s) : BENCH_DEFTIME;
+        if (bench_time<=0)
+                bench_time = BENCH_DEFTIME;
+
+        cur_uri = "aps:/dev/ttyS0?type=serial+baudrate=115200+handshake=rtscts";
+        run_bench("UriSplit/serial",bench_uri_split);
+        cur_uri = "aps:192.168.1.10?type=ethernet+port=9100";
+        run_bench("UriSplit/ethernet",bench_uri_split);
+        cur_uri = "aps:/dev/bus/usb/001/004?type=usb";
+        run_bench("UriSplit/usb",bench_uri_split);
+
+        cur_type = APS_MRS;
+        cur_status = status_mrs;
+        cur_status_size = sizeof(status_mrs);
+        run_bench("DecodeStatus/mrs",bench_decode_status);
+        cur_type = APS_KCP;
+        cur_status = status_kcp;
+        cur_status_size = sizeof(status_kcp);
+        run_bench("DecodeStatus/kcp",bench_decode_status);
+        cur_type = APS_HSP;
+        cur_status = status_hsp;
+        cur_status_size = sizeof(status_hsp);
+        run_bench("DecodeStatus/hsp",bench_decode_status);
+
+        if (bench_filter==NULL || strstr("EthernetWrite",bench_filter)!=NULL
+            || strstr(bench_filter,"EthernetWrite")!=NULL)
+                bench_transport();
+
+        return 0;
+}
@@ -0,0 +1,923 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : apsemu.c
+* DESCRIPTION   : APS printer emulator
+*                 Accepts print data on a pseudo-terminal (serial URIs) and
+*                 on a TCP socket (ethernet URIs), decodes the commands sent
+*                 by the driver and prints at a modelled paper speed
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*
+*   This file is part of libaps.
+*
+*   libaps is free software; you can redistribute it and/or
+*   modify it under the terms of the GNU Lesser General Public
+*   License as published by the Free Software Foundation; either
+*   version 2.1 of the License, or (at your option) any later version.
+*
+*   libaps is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*   Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public
+*   License along with libaps; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <aps/aps.h>
+#include <aps/aps-private.h>
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define XON     DC1
+#define XOFF    DC3
+
+#define EMU_DOTS_PER_MM         8       /*203 dpi head*/
+#define EMU_DEFSPEED            150     /*mm/s*/
+#define EMU_DEFBUFSIZE          4096    /*bytes*/
+#define EMU_DEFPORT             9100
+#define EMU_DEFLINESPACING      30      /*dotlines*/
+#define EMU_BARCODE_HEIGHT      80      /*dotlines*/
+#define EMU_QR_SCALE            5       /*dots per module*/
+#define EMU_IDLE_TIMEOUT        1.0     /*seconds without data ending a pty job*/
+#define EMU_LOOKAHEAD           0.02    /*seconds of motion queued in the mechanism*/
+
+/*flow control of the receive buffer*/
+typedef enum {
+        FLOW_NONE       = 0,    /*data is read as soon as there is room*/
+        FLOW_XONXOFF    = 1,    /*XOFF/XON sent at high/low water marks*/
+        FLOW_RTSCTS     = 2     /*reception stops at high water mark*/
+} flow_t;
+
+/*command-line options*/
+static int      opt_type;
+static int      opt_speed;
+static int      opt_bufsize;
+static int      opt_tcp;
+static int      opt_pty;
+static int      opt_baudrate;
+static flow_t   opt_flow;
+static long     opt_paper;              /*roll length in mm, 0 if endless*/
+static int      opt_trace;
+
+/*receive buffer*/
+static unsigned char    *rx_buf;
+static int      rx_len;
+static int      rx_stopped;             /*flow control asserted*/
+static double   rx_credit;              /*bytes allowed by line baudrate*/
+static double   rx_time;
+
+/*printer state*/
+static double   busy_until;             /*end of mechanism motion*/
+static int      speed;                  /*mm/s*/
+static int      linespacing;
+static int      barcode_height;
+static int      barcode_module;
+static int      text_len;               /*characters in current text line*/
+static long     paper_used;             /*dotlines*/
+static int      paper_out;
+
+/*job statistics*/
+typedef struct {
+        double  start;                  /*first byte received*/
+        double  first_dotline;          /*first paper motion*/
+        double  last;                   /*last byte received*/
+        long    bytes;
+        long    commands;
+        long    dotlines;
+        long    feeds;
+        long    cuts;
+        long    status;
+        long    unknown;
+        long    stalls;                 /*flow control assertions*/
+} job_stats_t;
+
+static job_stats_t      job;
+
+static volatile sig_atomic_t    quit_flag;
+static volatile sig_atomic_t    reload_flag;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  now
+Purpose   :  Get monotonic time
+Inputs    :  <>
+Outputs   :  <>
+Return    :  time in seconds
+-----------------------------------------------------------------------------*/
+static double now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+
+        return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  signal_handler
+Purpose   :  SIGINT/SIGTERM stop the emulator, SIGUSR1 reloads paper
+Inputs    :  signum : signal number
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void signal_handler(int signum)
+{
+        if (signum==SIGUSR1)
+                reload_flag = 1;
+        else
+                quit_flag = 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  usage
+Purpose   :  Print usage and exit
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void usage(void)
+{
+        printf("apsemu compiled with APS library %d.%d.%d\n",
+                        APS_MAJOR,
+                        APS_MINOR,
+                        APS_BUGFIX);
+
+        printf("usage: apsemu [-t mrs|hrs|kcp|hsp] [-s mm/s] [-b bufsize]\n"
+               "              [-p tcpport] [-n] [-P] [-r baudrate]\n"
+               "              [-f none|xonxoff|rtscts] [-l paper_mm] [-v]\n"
+               "  -p  TCP port for ethernet URIs (default %d)\n"
+               "  -n  no TCP socket\n"
+               "  -P  no pseudo-terminal\n"
+               "  -r  emulated serial line baudrate (pty only, default unlimited)\n"
+               "  -l  paper roll length, end of paper is reported when used up\n"
+               "      (SIGUSR1 loads a new roll)\n"
+               "  -v  trace decoded commands\n",
+               EMU_DEFPORT);
+
+        exit(0);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  parse_options
+Purpose   :  Parse command-line options and update global variables
+Inputs    :  argc : number of command-line arguments
+             argv : array of command-line arguments
+Outputs   :  Update global variables
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void parse_options(int argc,char **argv)
+{
+        int i;
+
+        /*set defaults*/
+        opt_type = APS_MRS;
+        opt_speed = EMU_DEFSPEED;
+        opt_bufsize = EMU_DEFBUFSIZE;
+        opt_tcp = EMU_DEFPORT;
+        opt_pty = 1;
+        opt_baudrate = 0;
+        opt_flow = FLOW_RTSCTS;
+        opt_paper = 0;
+        opt_trace = 0;
+
+        /*parse options*/
+        for (i=1; i<argc; i++) {
+                const char *arg = i+1<argc ? argv[i+1] : NULL;
+
+                if (strcmp(argv[i],"-n")==0) {
+                        opt_tcp = 0;
+                        continue;
+                }
+                else if (strcmp(argv[i],"-P")==0) {
+                        opt_pty = 0;
+                        continue;
+                }
+                else if (strcmp(argv[i],"-v")==0) {
+                        opt_trace = 1;
+                        continue;
+                }
+                else if (strcmp(argv[i],"-h")==0) {
+                        usage();
+                }
+
+                if (arg==NULL) {
+                        fprintf(stderr,"parse_options: missing value (%s)\n",argv[i]);
+                        exit(1);
+                }
+                i++;
+
+                if (strcmp(argv[i-1],"-t")==0) {
+                        if (strcmp(arg,"mrs")==0) {
+                                opt_type = APS_MRS;
+                        }
+                        else if (strcmp(arg,"hrs")==0) {
+                                opt_type = APS_HRS;
+                        }
+                        else if (strcmp(arg,"kcp")==0) {
+                                opt_type = APS_KCP;
+                        }
+                        else if (strcmp(arg,"hsp")==0) {
+                                opt_type = APS_HSP;
+                        }
+                        else {
+                                fprintf(stderr,"parse_options: invalid model type (%s)\n",arg);
+                                exit(1);
+                        }
+                }
+                else if (strcmp(argv[i-1],"-f")==0) {
+                        if (strcmp(arg,"none")==0) {
+                                opt_flow = FLOW_NONE;
+                        }
+                        else if (strcmp(arg,"xonxoff")==0) {
+                                opt_flow = FLOW_XONXOFF;
+                        }
+                        else if (strcmp(arg,"rtscts")==0) {
+                                opt_flow = FLOW_RTSCTS;
+                        }
+                        else {
+                                fprintf(stderr,"parse_options: invalid flow control (%s)\n",arg);
+                                exit(1);
+                        }
+                }
+                else if (strcmp(argv[i-1],"-s")==0) {
+                        opt_speed = atoi(arg);
+                }
+                else if (strcmp(argv[i-1],"-b")==0) {
+                        opt_bufsize = atoi(arg);
+                }
+                else if (strcmp(argv[i-1],"-p")==0) {
+                        opt_tcp = atoi(arg);
+                }
+                else if (strcmp(argv[i-1],"-r")==0) {
+                        opt_baudrate = atoi(arg);
+                }
+                else if (strcmp(argv[i-1],"-l")==0) {
+                        opt_paper = atol(arg);
+                }
+                else {
+                        fprintf(stderr,"parse_options: unrecognized option (%s)\n",argv[i-1]);
+                        exit(1);
+                }
+        }
+
+        if (opt_speed<=0 || opt_bufsize<64) {
+                fprintf(stderr,"parse_options: invalid speed or buffer size\n");
+                exit(1);
+        }
+
+        if (!opt_tcp && !opt_pty) {
+                fprintf(stderr,"parse_options: no input enabled\n");
+                exit(1);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  open_pty
+Purpose   :  Open pseudo-terminal in raw mode
+             The slave side is kept open so the master never sees a hangup
+             when the driver closes the port between jobs
+Inputs    :  slave : slave file descriptor
+Outputs   :  <>
+Return    :  master file descriptor or -1 on error
+-----------------------------------------------------------------------------*/
+static int open_pty(int *slave)
+{
+        struct termios set;
+        const char *name;
+        int fd;
+
+        fd = posix_openpt(O_RDWR|O_NOCTTY);
+        if (fd<0) {
+                return -1;
+        }
+
+        if (grantpt(fd)<0 || unlockpt(fd)<0 || (name = ptsname(fd))==NULL) {
+                close(fd);
+                return -1;
+        }
+
+        *slave = open(name,O_RDWR|O_NOCTTY);
+        if (*slave<0) {
+                close(fd);
+                return -1;
+        }
+
+        if (tcgetattr(*slave,&set)==0) {
+                cfmakeraw(&set);
+                tcsetattr(*slave,TCSANOW,&set);
+        }
+
+        fcntl(fd,F_SETFL,O_NONBLOCK);
+
+        printf("serial: aps:%s?type=serial\n",name);
+
+        return fd;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  open_tcp
+Purpose   :  Open listening TCP socket
+Inputs    :  port : TCP port
+Outputs   :  <>
+Return    :  socket or -1 on error
+-----------------------------------------------------------------------------*/
+static int open_tcp(int port)
+{
+        struct sockaddr_in addr;
+        int fd;
+        int on = 1;
+
+        fd = socket(AF_INET,SOCK_STREAM,0);
+        if (fd<0) {
+                return -1;
+        }
+
+        setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+
+        memset(&addr,0,sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+
+        if (bind(fd,(struct sockaddr *)&addr,sizeof(addr))<0 || listen(fd,1)<0) {
+                close(fd);
+                return -1;
+        }
+
+        printf("ethernet: aps:localhost?type=ethernet+port=%d\n",port);
+
+        return fd;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  get_status
+Purpose   :  Build status answer as decoded by aps_decode_status()
+Inputs    :  buf : status buffer (4 bytes)
+Outputs   :  Fills status buffer
+Return    :  status size in bytes
+-----------------------------------------------------------------------------*/
+static int get_status(unsigned char *buf)
+{
+        int printing = rx_len>0 || busy_until>now();
+
+        memset(buf,0,4);
+
+        switch (opt_type) {
+        case APS_MRS:
+        case APS_HRS:
+                buf[0] = 0x80;                  /*cutter OK*/
+                if (paper_out)
+                        buf[0] |= 0x04;
+                if (printing)
+                        buf[0] |= 0x10;
+                if (!paper_out)
+                        buf[0] |= 0x20;         /*online*/
+                return 1;
+
+        case APS_KCP:
+                buf[0] = 0x80;                  /*presenter OK*/
+                if (paper_out)
+                        buf[0] |= 0x04;
+                if (printing)
+                        buf[0] |= 0x10;
+                if (!paper_out)
+                        buf[0] |= 0x20;
+                return 3;
+
+        default:
+                if (printing)
+                        buf[0] |= 0x01;
+                if (paper_out) {
+                        buf[0] |= 0x40;         /*offline*/
+                        buf[1] |= 0x01;
+                }
+                return 4;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  advance
+Purpose   :  Move paper, mechanism stays busy for the motion time
+Inputs    :  dotlines : paper motion in dotlines
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void advance(long dotlines)
+{
+        double t = now();
+
+        if (dotlines<=0)
+                return;
+
+        if (busy_until<t)
+                busy_until = t;
+        busy_until += (double)dotlines/(speed*EMU_DOTS_PER_MM);
+
+        if (job.first_dotline==0)
+                job.first_dotline = t;
+        job.dotlines += dotlines;
+
+        paper_used += dotlines;
+        if (opt_paper && paper_used>=opt_paper*EMU_DOTS_PER_MM)
+                paper_out = 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  execute
+Purpose   :  Execute command
+Inputs    :  fd : port to send answers to
+             p  : command bytes
+             n  : command size in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void execute(int fd,const unsigned char *p,long n)
+{
+        unsigned char status[4];
+        const char *name = NULL;
+        long t;
+
+        job.commands++;
+
+        if (p[0]!=ESC && p[0]!=GS) {
+                switch (p[0]) {
+                case LF:
+                        advance(linespacing);
+                        text_len = 0;
+                        name = "LF";
+                        break;
+                case CAN:
+                        text_len = 0;
+                        name = "CAN";
+                        break;
+                case CR:
+                case NUL:
+                        break;
+                default:
+                        text_len++;
+                        job.commands--;         /*text is not a command*/
+                        break;
+                }
+        }
+        else if (p[0]==ESC) {
+                switch (p[1]) {
+                case '@':
+                        speed = opt_speed;
+                        linespacing = EMU_DEFLINESPACING;
+                        text_len = 0;
+                        name = "reset";
+                        break;
+                case 'v':
+                        if (write(fd,status,get_status(status))<0)
+                                perror("write");
+                        job.status++;
+                        name = "status";
+                        break;
+                case 'n':
+                        status[0] = paper_out ? 1 : 0;  /*paper roll low*/
+                        if (write(fd,status,1)<0)
+                                perror("write");
+                        job.status++;
+                        name = "NEOP status";
+                        break;
+                case '3':
+                        linespacing = p[2];
+                        name = "line spacing";
+                        break;
+                case 'J':
+                case 'j':
+                        advance(p[2]);
+                        job.feeds++;
+                        name = p[1]=='J' ? "feed" : "backfeed";
+                        break;
+                case 'i':
+                case 'm':
+                        job.cuts++;
+                        name = p[1]=='i' ? "full cut" : "partial cut";
+                        break;
+                case 'V':
+                        advance(1);
+                        name = NULL;            /*too frequent to trace*/
+                        break;
+                case '*':
+                        if (p[7])
+                                advance((n-8)/p[7]);
+                        name = "raster block";
+                        break;
+                case '$':
+                        name = "shift";
+                        break;
+                default:
+                        name = "ESC command";
+                        break;
+                }
+        }
+        else {
+                switch (p[1]) {
+                case 's':
+                        t = (p[2]<<8)|p[3];
+                        if (t>0 && 125000/t<opt_speed)
+                                speed = 125000/t;
+                        else
+                                speed = opt_speed;
+                        name = "max speed";
+                        break;
+                case 'M':
+                        if (p[2]=='2' && p[3] && 2*p[3]<opt_speed)
+                                speed = 2*p[3];
+                        name = "max speed";
+                        break;
+                case 'h':
+                        barcode_height = p[2];
+                        name = "barcode height";
+                        break;
+                case 'w':
+                        barcode_module = p[2];
+                        name = "barcode width";
+                        break;
+                case 'V':
+                        job.cuts++;
+                        name = "cut";
+                        break;
+                case 'v':
+                        advance(p[6]|(p[7]<<8));
+                        name = NULL;
+                        break;
+                case 'k':
+                        if (p[2]==9)
+                                advance((long)p[3]*EMU_QR_SCALE);
+                        else if (p[2]==8)
+                                /*approximate height: rows of 3 modules*/
+                                advance(((n-8)/(p[5] ? p[5] : 1)+1)*3*barcode_module);
+                        else
+                                advance(barcode_height);
+                        name = "barcode";
+                        break;
+                default:
+                        name = "GS command";
+                        break;
+                }
+        }
+
+        if (opt_trace && name!=NULL)
+                fprintf(stderr,"apsemu: %s (%02x %02x, %ld bytes)\n",
+                                name,p[0],n>1 ? p[1] : 0,n);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  process
+Purpose   :  Execute received commands while the mechanism queue has room
+             Without paper, only status requests are answered
+Inputs    :  fd : port to send answers to
+Outputs   :  Updates receive buffer
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void process(int fd)
+{
+        int pos = 0;
+
+        while (pos<rx_len && busy_until<=now()+EMU_LOOKAHEAD) {
+                const unsigned char *p = rx_buf+pos;
+                long size = disasm_size(p,rx_len-pos);
+
+                if (size==0)
+                        break;                  /*incomplete command*/
+
+                if (paper_out && !(size>1 && p[0]==ESC && (p[1]=='v' || p[1]=='n')))
+                        break;
+
+                if (size>opt_bufsize) {
+                        /*command larger than buffer, drop it*/
+                        fprintf(stderr,"apsemu: command %02x %02x too large (%ld bytes)\n",
+                                        rx_buf[pos],rx_buf[pos+1],size);
+                        job.unknown++;
+                        rx_len = 0;
+                        return;
+                }
+
+                if (size>rx_len-pos)
+                        break;
+
+                execute(fd,p,size);
+                pos += size;
+        }
+
+        if (pos>0) {
+                memmove(rx_buf,rx_buf+pos,rx_len-pos);
+                rx_len -= pos;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  update_flow
+Purpose   :  Assert or release flow control from receive buffer level
+Inputs    :  fd : port
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void update_flow(int fd)
+{
+        unsigned char c;
+
+        if (!rx_stopped && rx_len>=opt_bufsize*3/4) {
+                rx_stopped = 1;
+                job.stalls++;
+                c = XOFF;
+        }
+        else if (rx_stopped && rx_len<=opt_bufsize/4) {
+                rx_stopped = 0;
+                c = XON;
+        }
+        else {
+                return;
+        }
+
+        if (opt_flow==FLOW_XONXOFF && write(fd,&c,1)<0)
+                perror("write");
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  rx_room
+Purpose   :  Get number of bytes that can be received now
+Inputs    :  serial : apply serial line flow control and baudrate if true
+Outputs   :  <>
+Return    :  number of bytes
+-----------------------------------------------------------------------------*/
+static int rx_room(int serial)
+{
+        double t = now();
+        int max = opt_bufsize-rx_len;
+
+        if (!serial)
+                return max;
+
+        /*CTS is low, characters stay in the sender queue*/
+        /*(after XOFF, characters already on the line are still received)*/
+        if (rx_stopped && opt_flow==FLOW_RTSCTS)
+                return 0;
+
+        if (opt_baudrate>0) {
+                rx_credit += (t-rx_time)*opt_baudrate/10;
+                if (rx_credit>opt_bufsize)
+                        rx_credit = opt_bufsize;
+                rx_time = t;
+                if (max>(int)rx_credit)
+                        max = rx_credit;
+        }
+
+        return max;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  receive
+Purpose   :  Read data into receive buffer
+Inputs    :  fd     : port
+             serial : apply serial line flow control and baudrate if true
+Outputs   :  Updates receive buffer
+Return    :  number of bytes read, 0 on end of file, -1 if nothing to read
+-----------------------------------------------------------------------------*/
+static int receive(int fd,int serial)
+{
+        double t = now();
+        int max = rx_room(serial);
+        int n;
+
+        if (max<=0)
+                return -1;
+
+        n = read(fd,rx_buf+rx_len,max);
+        if (n<0)
+                return (errno==EAGAIN || errno==EINTR) ? -1 : 0;
+        if (n==0)
+                return 0;
+
+        if (serial && opt_baudrate>0)
+                rx_credit -= n;
+
+        if (job.bytes==0)
+                job.start = t;
+        job.last = t;
+        job.bytes += n;
+        rx_len += n;
+
+        return n;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  report
+Purpose   :  Print job statistics and reset them
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void report(void)
+{
+        double end;
+        double elapsed;
+
+        if (job.bytes==0)
+                return;
+
+        end = busy_until>job.last ? busy_until : job.last;
+        elapsed = end-job.start;
+
+        printf("job: %ld bytes, %ld commands, %ld dotlines (%.1f mm), "
+               "%ld feeds, %ld cuts, %ld status\n",
+               job.bytes,job.commands,job.dotlines,
+               (double)job.dotlines/EMU_DOTS_PER_MM,
+               job.feeds,job.cuts,job.status);
+        printf("job: %.3f s, first dotline after %.3f s, %.1f mm/s, "
+               "%.0f bytes/s, %ld flow stops, %ld errors%s\n",
+               elapsed,
+               job.first_dotline ? job.first_dotline-job.start : 0.0,
+               elapsed>0 ? job.dotlines/(elapsed*EMU_DOTS_PER_MM) : 0.0,
+               elapsed>0 ? job.bytes/elapsed : 0.0,
+               job.stalls,job.unknown,
+               paper_out ? ", end of paper" : "");
+        fflush(stdout);
+
+        memset(&job,0,sizeof(job));
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  main
+Purpose   :  Program main function
+Inputs    :  argc : number of command-line arguments
+             argv : array of command-line arguments
+Outputs   :  <>
+Return    :  0 if success, 1 on error
+-----------------------------------------------------------------------------*/
+int main(int argc,char **argv)
+{
+        struct sigaction sa;
+        int pty = -1;
+        int slave = -1;
+        int server = -1;
+        int client = -1;
+
+        if (argc>1 && strcmp(argv[1],"--help")==0) {
+                usage();
+        }
+
+        parse_options(argc,argv);
+
+        rx_buf = malloc(opt_bufsize);
+        if (rx_buf==NULL) {
+                fprintf(stderr,"main: cannot allocate receive buffer\n");
+                exit(1);
+        }
+
+        memset(&sa,0,sizeof(sa));
+        sa.sa_handler = signal_handler;
+        sigaction(SIGINT,&sa,NULL);
+        sigaction(SIGTERM,&sa,NULL);
+        sigaction(SIGUSR1,&sa,NULL);
+
+        sa.sa_handler = SIG_IGN;
+        sigaction(SIGPIPE,&sa,NULL);
+
+        if (opt_pty && (pty = open_pty(&slave))<0) {
+                perror("main: cannot open pseudo-terminal");
+                exit(1);
+        }
+
+        if (opt_tcp && (server = open_tcp(opt_tcp))<0) {
+                perror("main: cannot open TCP socket");
+                exit(1);
+        }
+
+        fflush(stdout);
+
+        speed = opt_speed;
+        linespacing = EMU_DEFLINESPACING;
+        barcode_height = EMU_BARCODE_HEIGHT;
+        barcode_module = 2;
+        rx_time = now();
+
+        while (!quit_flag) {
+                struct pollfd fds[3];
+                int input;
+                int nfds = 0;
+                int timeout = -1;
+                double t;
+
+                if (reload_flag) {
+                        reload_flag = 0;
+                        paper_used = 0;
+                        paper_out = 0;
+                        fprintf(stderr,"apsemu: paper loaded\n");
+                }
+
+                /*the client connection has priority over the pty*/
+                input = client>=0 ? client : pty;
+
+                process(input);
+                if (client<0)
+                        update_flow(pty);
+
+                /*wake up at end of motion or when line credit is back*/
+                t = now();
+                if (busy_until>t+EMU_LOOKAHEAD && rx_len>0)
+                        timeout = (busy_until-EMU_LOOKAHEAD-t)*1000+1;
+                if (client<0 && rx_room(1)<=0 && rx_len<opt_bufsize && !rx_stopped)
+                        timeout = timeout<0 || timeout>10 ? 10 : timeout;
+                if (job.bytes && client<0 && rx_len==0)
+                        timeout = timeout<0 || timeout>100 ? 100 : timeout;
+
+                if (pty>=0 && client<0) {
+                        fds[nfds].fd = pty;
+                        fds[nfds].events = rx_room(1)>0 ? POLLIN : 0;
+                        nfds++;
+                }
+                if (client>=0) {
+                        fds[nfds].fd = client;
+                        fds[nfds].events = rx_room(0)>0 ? POLLIN : 0;
+                        nfds++;
+                }
+                else if (server>=0) {
+                        fds[nfds].fd = server;
+                        fds[nfds].events = POLLIN;
+                        nfds++;
+                }
+
+                if (poll(fds,nfds,timeout)<0) {
+                        if (errno==EINTR)
+                                continue;
+                        perror("main: poll");
+                        break;
+                }
+
+                if (client>=0) {
+                        if (fds[nfds-1].revents && receive(client,0)==0) {
+                                /*connection closed, finish printing*/
+                                while (rx_len>0 && !paper_out && !quit_flag) {
+                                        process(client);
+                                        if (rx_len>0 && busy_until>now()+EMU_LOOKAHEAD)
+                                                usleep((busy_until-EMU_LOOKAHEAD-now())*1e6+1);
+                                        else if (rx_len>0)
+                                                rx_len = 0;     /*truncated command*/
+                                }
+                                while (busy_until>now())
+                                        usleep((busy_until-now())*1e6+1);
+                                report();
+                                close(client);
+                                client = -1;
+                                rx_stopped = 0;
+                        }
+                        continue;
+                }
+
+                if (server>=0 && (fds[nfds-1].revents & POLLIN)) {
+                        client = accept(server,NULL,NULL);
+                        if (client>=0)
+                                fcntl(client,F_SETFL,O_NONBLOCK);
+                }
+
+                if (pty>=0 && (fds[0].revents & POLLIN)) {
+                        receive(pty,1);
+                }
+
+                /*pty jobs end when the line stays idle*/
+                if (pty>=0 && job.bytes && rx_len==0
+                    && now()-job.last>EMU_IDLE_TIMEOUT && busy_until<=now()) {
+                        report();
+                }
+        }
+
+        report();
+
+        if (client>=0)
+                close(client);
+        if (server>=0)
+                close(server);
+        if (slave>=0)
+                close(slave);
+        if (pty>=0)
+                close(pty);
+
+        free(rx_buf);
+
+        return 0;
+}
@@ -0,0 +1,360 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : apstrace.c
+* DESCRIPTION   : Wire trace decoder
+*                 Prints records of a ring file written by libaps (APS_TRACE
+*                 environment variable or aps_trace_start()) and disassembles
+*                 data sent to the printer into APS commands.
+*                 The ring file may be decoded while the port is in use.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*
+*   This file is part of libaps.
+*
+*   libaps is free software; you can redistribute it and/or
+*   modify it under the terms of the GNU Lesser General Public
+*   License as published by the Free Software Foundation; either
+*   version 2.1 of the License, or (at your option) any later version.
+*
+*   libaps is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*   Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public
+*   License along with libaps; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <aps/aps.h>
+#include <aps/aps-private.h>
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define STREAM_MAX      (1<<20)         /*bytes of pending command*/
+#define TEXT_MAX        64              /*characters of text shown*/
+#define LINE_MAX        128             /*characters*/
+
+static int      opt_hex;                /*hex dump of record data*/
+static int      opt_raw;                /*no disassembly*/
+
+/*disassembler state, commands may span records*/
+static unsigned char    stream[STREAM_MAX];
+static int              stream_len;
+static char             last_line[LINE_MAX];
+static long             last_count;
+static char             text[TEXT_MAX+1];
+static int              text_len;
+static long             text_total;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  usage
+Purpose   :  Print usage and exit
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void usage(void)
+{
+        printf("apstrace compiled with APS library %d.%d.%d\n",
+                        APS_MAJOR,
+                        APS_MINOR,
+                        APS_BUGFIX);
+
+        printf("usage: apstrace [-x] [-r] tracefile\n"
+               "  -x  hex dump of data\n"
+               "  -r  records only, no disassembly\n");
+
+        exit(0);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  hex_dump
+Purpose   :  Print data in hexadecimal
+Inputs    :  buf  : data
+             size : data size in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void hex_dump(const unsigned char *buf,int size)
+{
+        int i;
+
+        for (i = 0; i<size; i++) {
+                printf(i%16==0 ? "        %04x:" : "",i);
+                printf(" %02x",buf[i]);
+                if (i%16==15 || i==size-1)
+                        printf("\n");
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  flush_line, flush_text
+Purpose   :  Print pending repeated command or text
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void flush_line(void)
+{
+        if (last_count==1)
+                printf("        %s\n",last_line);
+        else if (last_count>1)
+                printf("        %s (x%ld)\n",last_line,last_count);
+
+        last_count = 0;
+}
+
+static void flush_text(void)
+{
+        if (text_total>0) {
+                printf("        text \"%s\"%s\n",text,text_total>text_len ? "..." : "");
+        }
+
+        text_len = 0;
+        text_total = 0;
+        text[0] = 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  print_command
+Purpose   :  Print command, repeated commands are printed once
+Inputs    :  p : command bytes
+             n : command size in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void print_command(const unsigned char *p,long n)
+{
+        char line[LINE_MAX];
+
+        if (p[0]>=32 && p[0]<127 && n==1) {
+                flush_line();
+                if (text_len<TEXT_MAX) {
+                        text[text_len++] = p[0];
+                        text[text_len] = 0;
+                }
+                text_total++;
+                return;
+        }
+
+        flush_text();
+
+        disasm_command(p,n,line,sizeof(line));
+        if (last_count>0 && strcmp(line,last_line)==0) {
+                last_count++;
+        }
+        else {
+                flush_line();
+                strcpy(last_line,line);
+                last_count = 1;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  disassemble
+Purpose   :  Disassemble data sent to printer
+Inputs    :  buf  : data
+             size : data size in bytes
+Outputs   :  Disassembler state is updated
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void disassemble(const unsigned char *buf,int size)
+{
+        int pos = 0;
+        long n;
+
+        if (stream_len+size>STREAM_MAX) {
+                printf("        (%d bytes of undecoded command dropped)\n",stream_len);
+                stream_len = 0;
+        }
+        if (size>STREAM_MAX)
+                size = STREAM_MAX;
+
+        memcpy(stream+stream_len,buf,size);
+        stream_len += size;
+
+        while (pos<stream_len) {
+                n = disasm_size(stream+pos,stream_len-pos);
+                if (n==0 || n>stream_len-pos)
+                        break;                  /*command continues in next record*/
+
+                print_command(stream+pos,n);
+                pos += n;
+        }
+
+        memmove(stream,stream+pos,stream_len-pos);
+        stream_len -= pos;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  print_record
+Purpose   :  Print trace record
+Inputs    :  r : record, followed by captured data
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void print_record(const aps_trace_record_t *r)
+{
+        static const char *dirs[] = {"??","TX","RT","RX"};
+        const unsigned char *data = (const unsigned char *)(r+1);
+        time_t sec = r->time/1000000000;
+        char stamp[32];
+
+        flush_line();
+        flush_text();
+
+        strftime(stamp,sizeof(stamp),"%H:%M:%S",localtime(&sec));
+        printf("%s.%06u %s %6u bytes %8u us",
+                        stamp,(unsigned int)(r->time%1000000000/1000),
+                        dirs[r->dir<=TRACE_RX ? r->dir : 0],
+                        r->size,r->latency);
+        if (r->errnum!=APS_OK)
+                printf("  %s",aps_strerror(r->errnum));
+        printf("\n");
+
+        if (opt_hex)
+                hex_dump(data,r->caplen);
+
+        if (r->dir==TRACE_TX || r->dir==TRACE_TX_RT) {
+                if (opt_raw)
+                        return;
+
+                disassemble(data,r->caplen);
+
+                if (r->caplen<r->size) {
+                        flush_line();
+                        flush_text();
+                        printf("        (%u bytes not captured)\n",r->size-r->caplen);
+                        stream_len = 0;
+                }
+        }
+        else if (r->dir==TRACE_RX && !opt_hex && r->errnum==APS_OK) {
+                hex_dump(data,r->caplen);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  decode
+Purpose   :  Decode ring file
+Inputs    :  f : ring file
+Outputs   :  <>
+Return    :  0 if success, 1 on error
+-----------------------------------------------------------------------------*/
+static int decode(FILE *f)
+{
+        aps_trace_header_t h;
+        aps_trace_header_t h2;
+        unsigned char *ring;
+        uint64_t pos;
+
+        if (fread(&h,sizeof(h),1,f)!=1 || h.magic!=TRACE_MAGIC) {
+                fprintf(stderr,"apstrace: not a trace file\n");
+                return 1;
+        }
+        if (h.version!=TRACE_VERSION) {
+                fprintf(stderr,"apstrace: unsupported trace version %u\n",h.version);
+                return 1;
+        }
+
+        ring = malloc(h.size);
+        if (ring==NULL || fread(ring,1,h.size,f)!=h.size) {
+                fprintf(stderr,"apstrace: truncated trace file\n");
+                free(ring);
+                return 1;
+        }
+
+        /*records overwritten while the ring was copied are skipped*/
+        rewind(f);
+        if (fread(&h2,sizeof(h2),1,f)==1 && h2.tail>h.tail) {
+                h.tail = h2.tail>h.head ? h.head : h2.tail;
+                h.lost = h2.lost;
+        }
+
+        printf("port      : %s (type %u)\n",h.uri[0] ? h.uri : "?",h.port_type);
+        printf("ring      : %u bytes\n",h.size);
+        printf("records   : %llu (%llu overwritten)\n\n",
+                        (unsigned long long)h.records,
+                        (unsigned long long)h.lost);
+
+        pos = h.tail;
+        while (pos<h.head) {
+                uint32_t off = pos%h.size;
+                const aps_trace_record_t *r = (const aps_trace_record_t *)(ring+off);
+
+                if (h.size-off<sizeof(aps_trace_record_t) || r->dir==TRACE_WRAP) {
+                        pos += h.size-off;
+                        continue;
+                }
+
+                if (off+sizeof(aps_trace_record_t)+r->caplen>h.size) {
+                        fprintf(stderr,"apstrace: corrupted record at %llu\n",
+                                        (unsigned long long)pos);
+                        break;
+                }
+
+                print_record(r);
+                pos += sizeof(aps_trace_record_t)+TRACE_ALIGN(r->caplen);
+        }
+
+        flush_line();
+        flush_text();
+        if (stream_len>0)
+                printf("        (%d bytes of incomplete command)\n",stream_len);
+
+        free(ring);
+
+        return 0;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  main
+Purpose   :  Program main function
+Inputs    :  argc : number of command-line arguments
+             argv : array of command-line arguments
+Outputs   :  <>
+Return    :  0 if success, 1 on error
+-----------------------------------------------------------------------------*/
+int main(int argc,char **argv)
+{
+        const char *path = NULL;
+        FILE *f;
+        int res;
+        int i;
+
+        for (i = 1; i<argc; i++) {
+                if (strcmp(argv[i],"-x")==0)
+                        opt_hex = 1;
+                else if (strcmp(argv[i],"-r")==0)
+                        opt_raw = 1;
+                else if (argv[i][0]=='-' || path!=NULL)
+                        usage();
+                else
+                        path = argv[i];
+        }
+
+        if (path==NULL)
+                usage();
+
+        f = fopen(path,"rb");
+        if (f==NULL) {
+                perror(path);
+                return 1;
+        }
+
+        res = decode(f);
+        fclose(f);
+
+        return res;
+}
@@ -0,0 +1,362 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : bitmap.c
+* DESCRIPTION   : APS library - dotline encoder and bitmap printing
+*                 Dotlines are encoded with the same technique as the CUPS
+*                 raster filter: blank bytes trimmed on both sides, left
+*                 side replaced by a dotline shift (MRS, HRS, KCP), blank
+*                 dotlines sent as one byte dotlines or as paper feeds.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*
+*   This file is part of libaps.
+*
+*   libaps is free software; you can redistribute it and/or
+*   modify it under the terms of the GNU Lesser General Public
+*   License as published by the Free Software Foundation; either
+*   version 2.1 of the License, or (at your option) any later version.
+*
+*   libaps is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*   Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public
+*   License along with libaps; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aps/aps.h>
+#include <aps/aps-private.h>
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define BITMAP_BUFSIZE  65536   /*bytes sent per write*/
+#define FEED_MAX        255     /*dotlines per feed command*/
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  can_shift
+Purpose   :  Tell if model type supports the dotline shift command
+Inputs    :  type : model type
+Outputs   :  <>
+Return    :  1 if supported, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int can_shift(int type)
+{
+        return type==APS_MRS || type==APS_HRS || type==APS_KCP;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_dotline
+Purpose   :  Encode 'print dotline' command
+Inputs    :  type   : model type
+             buf    : dotline data
+             nbytes : dotline size in bytes
+             out    : output buffer
+Outputs   :  <>
+Return    :  number of bytes written
+-----------------------------------------------------------------------------*/
+static int put_dotline(int type,const unsigned char *buf,int nbytes,unsigned char *out)
+{
+        int n;
+
+        if (type==APS_HSP) {
+                out[0] = GS;
+                out[1] = 'v';
+                out[2] = '0';
+                out[3] = 0;
+                out[4] = nbytes&255;
+                out[5] = (nbytes>>8)&255;
+                out[6] = 1;
+                out[7] = 0;
+                n = 8;
+        }
+        else {
+                out[0] = ESC;
+                out[1] = 'V';
+                out[2] = 0;
+                out[3] = nbytes&255;
+                out[4] = (nbytes>>8)&255;
+                n = 5;
+        }
+
+        if (buf!=NULL)
+                memcpy(out+n,buf,nbytes);
+        else
+                memset(out+n,0,nbytes);
+
+        return n+nbytes;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_shift
+Purpose   :  Encode 'shift dotline' command
+Inputs    :  enc    : encoder
+             nbytes : right shift amount in bytes
+             out    : output buffer
+Outputs   :  Updates encoder shift
+Return    :  number of bytes written
+-----------------------------------------------------------------------------*/
+static int put_shift(aps_encoder_t *enc,int nbytes,unsigned char *out)
+{
+        out[0] = ESC;
+        out[1] = '$';
+        out[2] = nbytes&255;
+        out[3] = (nbytes>>8)&255;
+
+        enc->shift = nbytes;
+        enc->shifts++;
+
+        return 4;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_feed
+Purpose   :  Encode pending blank dotlines as 'feed forward' command
+Inputs    :  enc : encoder
+             out : output buffer
+Outputs   :  Clears pending blank dotlines
+Return    :  number of bytes written
+-----------------------------------------------------------------------------*/
+static int put_feed(aps_encoder_t *enc,unsigned char *out)
+{
+        if (enc->feed==0)
+                return 0;
+
+        out[0] = ESC;
+        out[1] = 'J';
+        out[2] = enc->feed;
+
+        enc->feed = 0;
+
+        return 3;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_encoder_init
+Purpose   :  Initialize dotline encoder
+Inputs    :  enc   : encoder
+             type  : model type
+             flags : encoder flags (aps_bitmap_flags_t)
+Outputs   :  Fills encoder
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_encoder_init(aps_encoder_t *enc,int type,int flags)
+{
+        memset(enc,0,sizeof(aps_encoder_t));
+
+        switch (type) {
+        case APS_MRS:
+        case APS_HRS:
+        case APS_KCP:
+        case APS_HSP:
+                break;
+        default:
+                return APS_INVALID_MODEL_TYPE;
+        }
+
+        enc->type = type;
+        enc->flags = flags;
+        enc->shift = -1;
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_encode_dotline
+Purpose   :  Encode one dotline
+             With APS_BITMAP_FEED, blank dotlines are counted and sent as a
+             feed before the next printed dotline (or by aps_encode_end)
+Inputs    :  enc    : encoder
+             line   : dotline, 8 dots per byte, leftmost dot in MSB
+             nbytes : dotline size in bytes
+             out    : output buffer, at least APS_ENCODE_MAX(nbytes) bytes
+Outputs   :  Updates encoder
+Return    :  number of bytes written
+-----------------------------------------------------------------------------*/
+int aps_encode_dotline(aps_encoder_t *enc,const unsigned char *line,int nbytes,
+                       unsigned char *out)
+{
+        int lead = 0;
+        int trail = 0;
+        int n = 0;
+
+        while (lead<nbytes && line[lead]==0)
+                lead++;
+
+        /*blank dotline*/
+        if (lead==nbytes) {
+                if (enc->flags&APS_BITMAP_FEED) {
+                        if (++enc->feed==FEED_MAX)
+                                return put_feed(enc,out);
+                        return 0;
+                }
+                if (enc->flags&APS_BITMAP_TRIM)
+                        return put_dotline(enc->type,NULL,1,out);
+                return put_dotline(enc->type,NULL,nbytes,out);
+        }
+
+        n += put_feed(enc,out);
+
+        if (enc->flags&APS_BITMAP_TRIM) {
+                if (can_shift(enc->type)) {
+                        if (enc->shift!=lead)
+                                n += put_shift(enc,lead,out+n);
+                }
+                else {
+                        lead = 0;
+                }
+
+                while (line[nbytes-trail-1]==0)
+                        trail++;
+
+                enc->trimmed += lead+trail;
+        }
+        else {
+                lead = 0;
+        }
+
+        n += put_dotline(enc->type,line+lead,nbytes-lead-trail,out+n);
+
+        return n;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_encode_shift
+Purpose   :  Encode pending blank dotlines and dotline shift for a dotline
+             encoded separately: dotlines may be encoded in any order (or in
+             other threads) by encoders whose shift is set to the leading
+             blank bytes of each dotline, shift commands are then encoded
+             in print order with this function
+Inputs    :  enc  : encoder
+             lead : leading blank bytes of dotline
+             out  : output buffer, at least APS_ENCODE_MAX(0) bytes
+Outputs   :  Updates encoder
+Return    :  number of bytes written
+-----------------------------------------------------------------------------*/
+int aps_encode_shift(aps_encoder_t *enc,int lead,unsigned char *out)
+{
+        int n;
+
+        n = put_feed(enc,out);
+
+        if ((enc->flags&APS_BITMAP_TRIM) && can_shift(enc->type) && enc->shift!=lead)
+                n += put_shift(enc,lead,out+n);
+
+        return n;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_encode_end
+Purpose   :  Encode pending blank dotlines and reset dotline shift
+Inputs    :  enc : encoder
+             out : output buffer, at least APS_ENCODE_MAX(0) bytes
+Outputs   :  Updates encoder
+Return    :  number of bytes written
+-----------------------------------------------------------------------------*/
+int aps_encode_end(aps_encoder_t *enc,unsigned char *out)
+{
+        int n;
+
+        n = put_feed(enc,out);
+
+        if (can_shift(enc->type) && enc->shift>0)
+                n += put_shift(enc,0,out+n);
+
+        return n;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_print_bitmap
+Purpose   :  Print bitmap
+             Dotlines are encoded in a buffer sent to the port in large
+             writes; the bitmap must fit the printer head: width is not
+             checked here, callers cut or scale bitmaps wider than
+             aps_get_model_width() of their model
+Inputs    :  port   : port structure
+             type   : model type
+             buf    : bitmap, 8 dots per byte, leftmost dot in MSB
+             width  : bitmap width in dots
+             height : bitmap height in dotlines
+             stride : bytes between two dotlines of bitmap
+             flags  : encoder flags (aps_bitmap_flags_t)
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_print_bitmap(void *port,int type,const void *buf,int width,int height,
+                     int stride,int flags)
+{
+        const unsigned char *bmp = buf;
+        aps_encoder_t enc;
+        unsigned char *out;
+        unsigned char *line = NULL;
+        int nbytes = (width+7)/8;
+        int max;
+        int len = 0;
+        int errnum;
+        int y;
+
+        if (port==NULL)
+                return APS_INVALID_PORT;
+        if (width<=0 || height<0 || stride<nbytes || (buf==NULL && height>0))
+                return APS_INVALID_BITMAP;
+
+        if ((errnum = aps_encoder_init(&enc,type,flags))<0)
+                return errnum;
+
+        max = BITMAP_BUFSIZE;
+        if (max<2*APS_ENCODE_MAX(nbytes))
+                max = 2*APS_ENCODE_MAX(nbytes);
+
+        out = malloc(max);
+        if (out==NULL)
+                return APS_NO_MEMORY;
+
+        /*dots past the bitmap width are cleared*/
+        if (width%8) {
+                line = malloc(nbytes);
+                if (line==NULL) {
+                        free(out);
+                        return APS_NO_MEMORY;
+                }
+        }
+
+        for (y = 0; y<height; y++) {
+                const unsigned char *p = bmp+(long)y*stride;
+
+                if (line!=NULL) {
+                        memcpy(line,p,nbytes);
+                        line[nbytes-1] &= 0xff<<(8-width%8);
+                        p = line;
+                }
+
+                if (len+APS_ENCODE_MAX(nbytes)>max) {
+                        if ((errnum = aps_write(port,out,len))<0)
+                                break;
+                        len = 0;
+                }
+
+                len += aps_encode_dotline(&enc,p,nbytes,out+len);
+        }
+
+        if (errnum==APS_OK) {
+                len += aps_encode_end(&enc,out+len);
+                if (len>0)
+                        errnum = aps_write(port,out,len);
+        }
+
+        free(line);
+        free(out);
+
+        return errnum;
+}
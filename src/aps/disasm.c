@@ -0,0 +1,255 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : disasm.c
+* DESCRIPTION   : APS library - printer command stream disassembler
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*
+*   This file is part of libaps.
+*
+*   libaps is free software; you can redistribute it and/or
+*   modify it under the terms of the GNU Lesser General Public
+*   License as published by the Free Software Foundation; either
+*   version 2.1 of the License, or (at your option) any later version.
+*
+*   libaps is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*   Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public
+*   License along with libaps; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aps/aps.h>
+#include <aps/aps-private.h>
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  esc_name
+Purpose   :  Get name of ESC command
+Inputs    :  c : command character
+Outputs   :  <>
+Return    :  command name
+-----------------------------------------------------------------------------*/
+static const char *esc_name(int c)
+{
+        switch (c) {
+        case '@':       return "reset";
+        case 'f':       return "enter full MRS mode";
+        case 'v':       return "get status";
+        case 'n':       return "get NEOP status";
+        case '%':       return "set font";
+        case 'M':       return "set font";
+        case 'G':       return "set compression";
+        case ' ':       return "set char spacing";
+        case '3':       return "set line spacing";
+        case 'i':       return "full cut";
+        case 'm':       return "partial cut";
+        case 'J':       return "feed forward";
+        case 'j':       return "feed backward";
+        case '$':       return "shift dotline";
+        case 'V':       return "print dotline";
+        case '*':       return "raster block";
+        default:        return "ESC command";
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  gs_name
+Purpose   :  Get name of GS command
+Inputs    :  c : command character
+Outputs   :  <>
+Return    :  command name
+-----------------------------------------------------------------------------*/
+static const char *gs_name(int c)
+{
+        switch (c) {
+        case 'B':       return "set serial options";
+        case '/':       return "set dynamic division";
+        case 'J':       return "set dynamic division/intensity";
+        case 's':       return "set maximum speed";
+        case 'M':       return "set maximum speed";
+        case 'D':       return "set intensity";
+        case 'T':       return "end of ticket";
+        case 'E':       return "calibrate";
+        case 'V':       return "cut";
+        case 'v':       return "print raster";
+        case 'h':       return "set barcode height";
+        case 'w':       return "set barcode width";
+        case 'k':       return "print barcode";
+        default:        return "GS command";
+        }
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  disasm_size
+Purpose   :  Get size of command at start of buffer
+Inputs    :  p : command bytes
+             n : number of bytes available
+Outputs   :  <>
+Return    :  command size in bytes, 0 if more bytes are needed
+-----------------------------------------------------------------------------*/
+long disasm_size(const unsigned char *p,int n)
+{
+        int i;
+
+        if (p[0]!=ESC && p[0]!=GS)
+                return 1;
+        if (n<2)
+                return 0;
+
+        if (p[0]==ESC) {
+                switch (p[1]) {
+                case '%': case ' ': case '3': case 'J': case 'j':
+                case 'G': case 'M':
+                        return 3;
+                case '$':
+                        return 4;
+                case 'n':
+                        return 3;                       /*ESC n s*/
+                case 'V':
+                        if (n<5)
+                                return 0;
+                        return 5+(p[3]|(p[4]<<8));
+                case '*':
+                        if (n<8)
+                                return 0;
+                        return 8+(p[2]|(p[3]<<8)|((long)p[4]<<16));
+                default:
+                        return 2;                       /*ESC @, v, i, m, f...*/
+                }
+        }
+
+        switch (p[1]) {
+        case 'B': case '/': case 'D': case 'h': case 'w':
+                return 3;
+        case 's':
+                return 4;
+        case 'J': case 'M':
+                return 4;                               /*HSP GS J/M n m*/
+        case 'V':
+                if (n<3)
+                        return 0;
+                return p[2]==66 ? 4 : 3;
+        case 'v':
+                if (n<8)
+                        return 0;
+                return 8+(long)(p[4]|(p[5]<<8))*(p[6]|(p[7]<<8));
+        case 'k':
+                if (n<3)
+                        return 0;
+                if (p[2]==9) {
+                        if (n<4)
+                                return 0;
+                        return 4+(long)((p[3]+7)/8)*p[3];
+                }
+                if (p[2]==8) {
+                        if (n<8)
+                                return 0;
+                        return 8+((p[6]<<8)|p[7]);
+                }
+                /*NUL terminated data*/
+                for (i = 3; i<n; i++)
+                        if (p[i]==NUL)
+                                return i+1;
+                return 0;
+        default:
+                return 2;                               /*GS T, GS E...*/
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  disasm_command
+Purpose   :  Describe command in printable form
+Inputs    :  p    : command bytes
+             n    : command size in bytes (see disasm_size)
+             s    : string buffer
+             size : string buffer size (includes trailing zero)
+Outputs   :  Fills string buffer
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void disasm_command(const unsigned char *p,long n,char *s,int size)
+{
+        if (p[0]==ESC && n>=2) {
+                switch (p[1]) {
+                case 'V':
+                        snprintf(s,size,"ESC V  %s, %ld bytes",esc_name(p[1]),n-5);
+                        break;
+                case '*':
+                        snprintf(s,size,"ESC *  %s, %ld bytes, %d dotlines",
+                                        esc_name(p[1]),n-8,p[7] ? (int)((n-8)/p[7]) : 0);
+                        break;
+                default:
+                        if (n==3)
+                                snprintf(s,size,"ESC %c  %s %d",p[1],esc_name(p[1]),p[2]);
+                        else if (n==4)
+                                snprintf(s,size,"ESC %c  %s %d %d",p[1],esc_name(p[1]),p[2],p[3]);
+                        else
+                                snprintf(s,size,"ESC %c  %s",p[1],esc_name(p[1]));
+                        break;
+                }
+        }
+        else if (p[0]==GS && n>=2) {
+                switch (p[1]) {
+                case 'v':
+                        snprintf(s,size,"GS v   %s %dx%d",gs_name(p[1]),
+                                        (p[4]|(p[5]<<8))*8,p[6]|(p[7]<<8));
+                        break;
+                case 'k':
+                        snprintf(s,size,"GS k   %s, symbology %d, %ld bytes",
+                                        gs_name(p[1]),p[2],n-3);
+                        break;
+                default:
+                        if (n==3)
+                                snprintf(s,size,"GS %c   %s %d",p[1],gs_name(p[1]),p[2]);
+                        else if (n==4)
+                                snprintf(s,size,"GS %c   %s %d %d",p[1],gs_name(p[1]),p[2],p[3]);
+                        else
+                                snprintf(s,size,"GS %c   %s",p[1],gs_name(p[1]));
+                        break;
+                }
+        }
+        else if (p[0]==LF) {
+                snprintf(s,size,"LF");
+        }
+        else if (p[0]==CAN) {
+                snprintf(s,size,"CAN");
+        }
+        else if (p[0]>=32 && p[0]<127) {
+                snprintf(s,size,"'%c'",p[0]);
+        }
+        else {
+                snprintf(s,size,"0x%02x",p[0]);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_command_size
+Purpose   :  Get size of printer command at start of buffer
+             Bytes that do not start an ESC or GS command count as one byte
+             commands (text, LF, CAN...)
+Inputs    :  buf  : command stream
+             size : number of bytes available
+Outputs   :  <>
+Return    :  command size in bytes, 0 if more bytes are needed
+-----------------------------------------------------------------------------*/
+long aps_command_size(const void *buf,int size)
+{
+        if (size<=0)
+                return 0;
+
+        return disasm_size(buf,size);
+}
@@ -369,6 +369,10 @@ int ethernet_write(aps_port_t *p,const void *buf,int size)
             break;
         }
         else {
+            if (n<size) {
+                STATS_ADD(p->stats.partial_writes,1);
+                STATS_ADD(p->stats.retries,1);
+            }
             buf += n;
             size -= n;
         }
@@ -430,6 +434,9 @@ int ethernet_read(aps_port_t *p,void *buf,int size)
             break;
         }
         else {
+            if (n<size) {
+                STATS_ADD(p->stats.retries,1);
+            }
             buf += n;
             size -= n;
         }
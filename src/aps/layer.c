@@ -0,0 +1,754 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : layer.c
+* DESCRIPTION   : APS library - port layers
+*                 A layer wraps a port and is itself a port. Layers are
+*                 declared in the URI with one "layer" option each, the first
+*                 one being the closest to the application:
+*
+*                 aps:/dev/ttyS0?type=serial+layer=tee:out=/tmp/w.bin
+*                    +layer=shape:baud=9600,latency=5
+*
+*                 shape : bandwidth and latency shaping
+*                         baud=<bits/s> (10 bits per byte), latency=<ms>,
+*                         chunk=<bytes>
+*                 fault : fault injection
+*                         timeout=<%>, short=<%>, disconnect=<bytes>,
+*                         seed=<n>
+*                 tee   : copy of data written (out=<file>) and read
+*                         (in=<file>)
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*
+*   This file is part of libaps.
+*
+*   libaps is free software; you can redistribute it and/or
+*   modify it under the terms of the GNU Lesser General Public
+*   License as published by the Free Software Foundation; either
+*   version 2.1 of the License, or (at your option) any later version.
+*
+*   libaps is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*   Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public
+*   License along with libaps; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <aps/aps.h>
+#include <aps/aps-private.h>
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define LAYER_ARGS_MAX          127     /*characters*/
+#define LAYER_FILE_MAX          255     /*characters*/
+
+#define SHAPE_DEFCHUNK          64      /*bytes*/
+#define SHAPE_BITS_PER_BYTE     10      /*start + 8 data + stop*/
+
+typedef enum {
+        LAYER_SHAPE     = 0,
+        LAYER_FAULT     = 1,
+        LAYER_TEE       = 2
+} layer_kind_t;
+
+typedef struct {
+        int             baudrate;       /*bits/s, 0 for unlimited*/
+        int             latency;        /*milliseconds*/
+        int             chunk;          /*bytes*/
+        double          busy_until;     /*end of transmission of last byte*/
+} layer_shape_t;
+
+typedef struct {
+        double          timeout;        /*% of operations*/
+        double          short_write;    /*% of writes*/
+        long            disconnect;     /*bytes, 0 for never*/
+        long            written;        /*bytes*/
+        unsigned int    seed;
+        int             disconnected;
+} layer_fault_t;
+
+typedef struct {
+        char            out_path[LAYER_FILE_MAX+1];
+        char            in_path[LAYER_FILE_MAX+1];
+        FILE *          out;
+        FILE *          in;
+} layer_tee_t;
+
+typedef struct {
+        aps_class_t     cls;            /*must be first*/
+        layer_kind_t    kind;
+        union {
+                layer_shape_t   shape;
+                layer_fault_t   fault;
+                layer_tee_t     tee;
+        } set;
+} aps_layer_t;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  now
+Purpose   :  Get monotonic time
+Inputs    :  <>
+Outputs   :  <>
+Return    :  time in seconds
+-----------------------------------------------------------------------------*/
+static double now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+
+        return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  sleep_until
+Purpose   :  Sleep until given time
+Inputs    :  t : monotonic time in seconds
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void sleep_until(double t)
+{
+        double delay = t-now();
+        struct timespec ts;
+
+        if (delay>0) {
+                ts.tv_sec = (time_t)delay;
+                ts.tv_nsec = (long)((delay-ts.tv_sec)*1e9);
+                nanosleep(&ts,NULL);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  lower_of
+Purpose   :  Get wrapped port of layer, copying layer timeouts to it
+Inputs    :  p : layer port structure
+Outputs   :  <>
+Return    :  wrapped port
+-----------------------------------------------------------------------------*/
+static aps_class_t *lower_of(aps_port_t *p)
+{
+        aps_class_t *lower = ((aps_class_t *)p)->lower;
+
+        lower->port.write_timeout = p->write_timeout;
+        lower->port.read_timeout = p->read_timeout;
+
+        return lower;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  lower_result
+Purpose   :  Propagate result of wrapped port operation to layer
+Inputs    :  p      : layer port structure
+             errnum : result of wrapped port operation
+Outputs   :  Layer sub error is updated
+Return    :  errnum
+-----------------------------------------------------------------------------*/
+static int lower_result(aps_port_t *p,int errnum)
+{
+        aps_class_t *lower = ((aps_class_t *)p)->lower;
+
+        lower->port.errnum = errnum;
+        p->sub_errnum = lower->port.sub_errnum;
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  lower_open, lower_close, lower_write, lower_write_rt, lower_read,
+             lower_sync, lower_flush
+Purpose   :  Forward operation to wrapped port
+Inputs    :  see port operations
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int lower_open(aps_port_t *p)
+{
+        aps_class_t *lower = lower_of(p);
+        aps_error_t errnum = APS_OK;
+
+        if (lower->open_!=NULL) {
+                errnum = lower->open_(&lower->port);
+        }
+        if (errnum==APS_OK) {
+                lower->port.is_open = 1;
+        }
+
+        return lower_result(p,errnum);
+}
+
+static int lower_close(aps_port_t *p)
+{
+        aps_class_t *lower = lower_of(p);
+        aps_error_t errnum = APS_OK;
+
+        if (!lower->port.is_open) {
+                return APS_OK;
+        }
+
+        if (lower->close!=NULL) {
+                errnum = lower->close(&lower->port);
+        }
+        if (errnum==APS_OK) {
+                lower->port.is_open = 0;
+        }
+
+        return lower_result(p,errnum);
+}
+
+static int lower_write(aps_port_t *p,const void *buf,int size)
+{
+        aps_class_t *lower = lower_of(p);
+
+        return lower_result(p,lower->write(&lower->port,buf,size));
+}
+
+static int lower_write_rt(aps_port_t *p,const void *buf,int size)
+{
+        aps_class_t *lower = lower_of(p);
+
+        if (lower->write_rt!=NULL) {
+                return lower_result(p,lower->write_rt(&lower->port,buf,size));
+        }
+        else {
+                return lower_result(p,lower->write(&lower->port,buf,size));
+        }
+}
+
+static int lower_read(aps_port_t *p,void *buf,int size)
+{
+        aps_class_t *lower = lower_of(p);
+
+        if (lower->read==NULL) {
+                return APS_NOT_IMPLEMENTED;
+        }
+
+        return lower_result(p,lower->read(&lower->port,buf,size));
+}
+
+static int lower_sync(aps_port_t *p)
+{
+        aps_class_t *lower = lower_of(p);
+
+        if (lower->sync==NULL) {
+                return APS_OK;
+        }
+
+        return lower_result(p,lower->sync(&lower->port));
+}
+
+static int lower_flush(aps_port_t *p)
+{
+        aps_class_t *lower = lower_of(p);
+
+        if (lower->flush==NULL) {
+                return APS_OK;
+        }
+
+        return lower_result(p,lower->flush(&lower->port));
+}
+
+static int lower_get_uri(aps_port_t *p,char *uri,int size)
+{
+        aps_class_t *lower = lower_of(p);
+
+        if (lower->get_uri==NULL) {
+                return APS_NOT_IMPLEMENTED;
+        }
+
+        return lower->get_uri(&lower->port,uri,size);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  shape_transfer
+Purpose   :  Delay transfer of data as a line of given baudrate and latency
+Inputs    :  p      : layer port structure
+             buf    : data buffer
+             size   : data buffer size in bytes
+             is_read: 0 for write, 1 for read
+             rt     : write in real-time
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int shape_transfer(aps_port_t *p,void *buf,int size,int is_read,int rt)
+{
+        layer_shape_t *s = &((aps_layer_t *)p)->set.shape;
+        aps_error_t errnum = APS_OK;
+        double t;
+        int n;
+
+        /*latency is paid once per operation*/
+        t = now();
+        if (s->busy_until<t)
+                s->busy_until = t;
+        s->busy_until += s->latency*1e-3;
+
+        while (size>0 && errnum==APS_OK) {
+                n = size<s->chunk ? size : s->chunk;
+
+                sleep_until(s->busy_until);
+
+                if (is_read) {
+                        errnum = lower_read(p,buf,n);
+                }
+                else if (rt) {
+                        errnum = lower_write_rt(p,buf,n);
+                }
+                else {
+                        errnum = lower_write(p,buf,n);
+                }
+
+                if (s->baudrate>0) {
+                        s->busy_until += (double)n*SHAPE_BITS_PER_BYTE/s->baudrate;
+                }
+
+                buf = (char *)buf+n;
+                size -= n;
+        }
+
+        /*the last chunk is not complete until its last bit is on the line*/
+        sleep_until(s->busy_until);
+
+        return errnum;
+}
+
+static int shape_write(aps_port_t *p,const void *buf,int size)
+{
+        return shape_transfer(p,(void *)buf,size,0,0);
+}
+
+static int shape_write_rt(aps_port_t *p,const void *buf,int size)
+{
+        return shape_transfer(p,(void *)buf,size,0,1);
+}
+
+static int shape_read(aps_port_t *p,void *buf,int size)
+{
+        return shape_transfer(p,buf,size,1,0);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  fault_hit
+Purpose   :  Draw fault
+Inputs    :  f       : fault settings
+             percent : fault probability in %
+Outputs   :  Random seed is updated
+Return    :  1 if fault must be injected, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int fault_hit(layer_fault_t *f,double percent)
+{
+        if (percent<=0) {
+                return 0;
+        }
+
+        f->seed = f->seed*1103515245+12345;
+
+        return ((f->seed>>8)%100000)<percent*1000;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  fault_write_common
+Purpose   :  Write data, injecting timeouts, short writes and disconnection
+Inputs    :  p    : layer port structure
+             buf  : data buffer
+             size : data buffer size in bytes
+             rt   : write in real-time
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int fault_write_common(aps_port_t *p,const void *buf,int size,int rt)
+{
+        layer_fault_t *f = &((aps_layer_t *)p)->set.fault;
+        aps_error_t errnum;
+        int n = size;
+
+        if (f->disconnected) {
+                return APS_IO_ERROR;
+        }
+
+        if (fault_hit(f,f->timeout)) {
+                return APS_WRITE_TIMEOUT;
+        }
+
+        /*short write: only part of data reaches the printer*/
+        if (size>1 && fault_hit(f,f->short_write)) {
+                f->seed = f->seed*1103515245+12345;
+                n = 1+(f->seed>>8)%(size-1);
+        }
+
+        /*disconnection after given number of bytes*/
+        if (f->disconnect>0 && f->written+n>=f->disconnect) {
+                n = f->disconnect-f->written;
+                f->disconnected = 1;
+        }
+
+        errnum = APS_OK;
+        if (n>0) {
+                errnum = rt ? lower_write_rt(p,buf,n) : lower_write(p,buf,n);
+                if (errnum==APS_OK)
+                        f->written += n;
+        }
+
+        if (errnum==APS_OK && f->disconnected) {
+                lower_close(p);
+                errnum = APS_IO_ERROR;
+        }
+        else if (errnum==APS_OK && n<size) {
+                errnum = APS_WRITE_FAILED;
+        }
+
+        return errnum;
+}
+
+static int fault_write(aps_port_t *p,const void *buf,int size)
+{
+        return fault_write_common(p,buf,size,0);
+}
+
+static int fault_write_rt(aps_port_t *p,const void *buf,int size)
+{
+        return fault_write_common(p,buf,size,1);
+}
+
+static int fault_read(aps_port_t *p,void *buf,int size)
+{
+        layer_fault_t *f = &((aps_layer_t *)p)->set.fault;
+
+        if (f->disconnected) {
+                return APS_IO_ERROR;
+        }
+
+        if (fault_hit(f,f->timeout)) {
+                return APS_READ_TIMEOUT;
+        }
+
+        return lower_read(p,buf,size);
+}
+
+static int fault_open(aps_port_t *p)
+{
+        layer_fault_t *f = &((aps_layer_t *)p)->set.fault;
+
+        /*reopening the port reconnects*/
+        f->disconnected = 0;
+        f->written = 0;
+
+        return lower_open(p);
+}
+
+static int fault_sync(aps_port_t *p)
+{
+        if (((aps_layer_t *)p)->set.fault.disconnected) {
+                return APS_IO_ERROR;
+        }
+
+        return lower_sync(p);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  tee_open
+Purpose   :  Open port and tee files
+Inputs    :  p : layer port structure
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int tee_open(aps_port_t *p)
+{
+        layer_tee_t *t = &((aps_layer_t *)p)->set.tee;
+        aps_error_t errnum;
+
+        if (t->out_path[0]!=0 && (t->out = fopen(t->out_path,"wb"))==NULL) {
+                return APS_OPEN_FAILED;
+        }
+        if (t->in_path[0]!=0 && (t->in = fopen(t->in_path,"wb"))==NULL) {
+                if (t->out!=NULL)
+                        fclose(t->out);
+                t->out = NULL;
+                return APS_OPEN_FAILED;
+        }
+
+        errnum = lower_open(p);
+        if (errnum!=APS_OK) {
+                if (t->out!=NULL)
+                        fclose(t->out);
+                if (t->in!=NULL)
+                        fclose(t->in);
+                t->out = NULL;
+                t->in = NULL;
+        }
+
+        return errnum;
+}
+
+static int tee_close(aps_port_t *p)
+{
+        layer_tee_t *t = &((aps_layer_t *)p)->set.tee;
+
+        if (t->out!=NULL)
+                fclose(t->out);
+        if (t->in!=NULL)
+                fclose(t->in);
+        t->out = NULL;
+        t->in = NULL;
+
+        return lower_close(p);
+}
+
+static int tee_write(aps_port_t *p,const void *buf,int size)
+{
+        layer_tee_t *t = &((aps_layer_t *)p)->set.tee;
+        aps_error_t errnum;
+
+        errnum = lower_write(p,buf,size);
+        if (errnum==APS_OK && t->out!=NULL) {
+                fwrite(buf,1,size,t->out);
+                fflush(t->out);
+        }
+
+        return errnum;
+}
+
+static int tee_write_rt(aps_port_t *p,const void *buf,int size)
+{
+        layer_tee_t *t = &((aps_layer_t *)p)->set.tee;
+        aps_error_t errnum;
+
+        errnum = lower_write_rt(p,buf,size);
+        if (errnum==APS_OK && t->out!=NULL) {
+                fwrite(buf,1,size,t->out);
+                fflush(t->out);
+        }
+
+        return errnum;
+}
+
+static int tee_read(aps_port_t *p,void *buf,int size)
+{
+        layer_tee_t *t = &((aps_layer_t *)p)->set.tee;
+        aps_error_t errnum;
+
+        errnum = lower_read(p,buf,size);
+        if (errnum==APS_OK && t->in!=NULL) {
+                fwrite(buf,1,size,t->in);
+                fflush(t->in);
+        }
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  get_arg
+Purpose   :  Get next key=value argument of layer declaration
+Inputs    :  s     : current position in argument list (updated)
+             key   : key buffer
+             value : value buffer
+Outputs   :  Fills key and value buffers
+Return    :  1 if argument found, 0 at end of list, -1 if invalid
+-----------------------------------------------------------------------------*/
+static int get_arg(const char **s,char *key,char *value)
+{
+        const char *eq;
+        const char *end;
+
+        if (**s==0) {
+                return 0;
+        }
+
+        end = strchr(*s,',');
+        if (end==NULL)
+                end = *s+strlen(*s);
+
+        eq = memchr(*s,'=',end-*s);
+        if (eq==NULL || eq==*s || end-eq-1>LAYER_FILE_MAX || eq-*s>LAYER_ARGS_MAX) {
+                return -1;
+        }
+
+        memcpy(key,*s,eq-*s);
+        key[eq-*s] = 0;
+        memcpy(value,eq+1,end-eq-1);
+        value[end-eq-1] = 0;
+
+        *s = *end==',' ? end+1 : end;
+
+        return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  layer_setup
+Purpose   :  Setup layer from its declaration
+Inputs    :  l    : layer
+             decl : declaration (name[:key=value[,key=value...]])
+Outputs   :  Layer is initialized
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int layer_setup(aps_layer_t *l,const char *decl)
+{
+        char key[LAYER_ARGS_MAX+1];
+        char value[LAYER_FILE_MAX+1];
+        const char *args;
+        int len;
+        int res;
+
+        args = strchr(decl,':');
+        len = args!=NULL ? args-decl : (int)strlen(decl);
+        args = args!=NULL ? args+1 : "";
+
+        l->cls.get_uri = lower_get_uri;
+        l->cls.open_ = lower_open;
+        l->cls.close = lower_close;
+        l->cls.write = lower_write;
+        l->cls.write_rt = lower_write_rt;
+        l->cls.read = lower_read;
+        l->cls.sync = lower_sync;
+        l->cls.flush = lower_flush;
+
+        if (len==5 && strncmp(decl,"shape",len)==0) {
+                l->kind = LAYER_SHAPE;
+                l->set.shape.chunk = SHAPE_DEFCHUNK;
+                l->cls.write = shape_write;
+                l->cls.write_rt = shape_write_rt;
+                l->cls.read = shape_read;
+        }
+        else if (len==5 && strncmp(decl,"fault",len)==0) {
+                l->kind = LAYER_FAULT;
+                l->set.fault.seed = 1;
+                l->cls.open_ = fault_open;
+                l->cls.write = fault_write;
+                l->cls.write_rt = fault_write_rt;
+                l->cls.read = fault_read;
+                l->cls.sync = fault_sync;
+        }
+        else if (len==3 && strncmp(decl,"tee",len)==0) {
+                l->kind = LAYER_TEE;
+                l->cls.open_ = tee_open;
+                l->cls.close = tee_close;
+                l->cls.write = tee_write;
+                l->cls.write_rt = tee_write_rt;
+                l->cls.read = tee_read;
+        }
+        else {
+                return APS_INVALID_URI;
+        }
+
+        while ((res = get_arg(&args,key,value))>0) {
+                switch (l->kind) {
+                case LAYER_SHAPE:
+                        if (strcmp(key,"baud")==0)
+                                l->set.shape.baudrate = atoi(value);
+                        else if (strcmp(key,"latency")==0)
+                                l->set.shape.latency = atoi(value);
+                        else if (strcmp(key,"chunk")==0 && atoi(value)>0)
+                                l->set.shape.chunk = atoi(value);
+                        else
+                                return APS_INVALID_URI;
+                        break;
+                case LAYER_FAULT:
+                        if (strcmp(key,"timeout")==0)
+                                l->set.fault.timeout = atof(value);
+                        else if (strcmp(key,"short")==0)
+                                l->set.fault.short_write = atof(value);
+                        else if (strcmp(key,"disconnect")==0)
+                                l->set.fault.disconnect = atol(value);
+                        else if (strcmp(key,"seed")==0)
+                                l->set.fault.seed = strtoul(value,NULL,10);
+                        else
+                                return APS_INVALID_URI;
+                        break;
+                case LAYER_TEE:
+                        if (strcmp(key,"out")==0)
+                                strcpy(l->set.tee.out_path,value);
+                        else if (strcmp(key,"in")==0)
+                                strcpy(l->set.tee.in_path,value);
+                        else
+                                return APS_INVALID_URI;
+                        break;
+                }
+        }
+
+        return res<0 ? APS_INVALID_URI : APS_OK;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  layer_wrap_from_uri
+Purpose   :  Wrap port in layers declared in URI ("layer" options)
+Inputs    :  p  : port structure, replaced by outermost layer
+             su : URI structure
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int layer_wrap_from_uri(aps_class_t **p,struct aps_uri *su)
+{
+        aps_error_t errnum;
+        aps_layer_t *l;
+        int i;
+
+        /*last declared layer is the closest to the transport*/
+        for (i = su->nopts-1; i>=0; i--) {
+                if (strcmp(su->opts[i].key,"layer")!=0)
+                        continue;
+
+                l = calloc(1,sizeof(aps_layer_t));
+                if (l==NULL) {
+                        return APS_IO_ERROR;
+                }
+
+                l->cls.lower = *p;
+                l->cls.port.type = (*p)->port.type;
+                l->cls.port.write_timeout = (*p)->port.write_timeout;
+                l->cls.port.read_timeout = (*p)->port.read_timeout;
+                *p = &l->cls;
+
+                if ((errnum = layer_setup(l,su->opts[i].value))!=APS_OK) {
+                        return errnum;
+                }
+        }
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  layer_transport
+Purpose   :  Get transport port under all layers
+Inputs    :  p : port structure
+Outputs   :  <>
+Return    :  transport port structure
+-----------------------------------------------------------------------------*/
+aps_class_t *layer_transport(aps_class_t *p)
+{
+        while (p!=NULL && p->lower!=NULL)
+                p = p->lower;
+
+        return p;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  layer_free
+Purpose   :  Free port and all its layers (ports must be closed)
+Inputs    :  p : port structure
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void layer_free(aps_class_t *p)
+{
+        aps_class_t *lower;
+
+        while (p!=NULL) {
+                lower = p->lower;
+                free(p);
+                p = lower;
+        }
+}
@@ -837,6 +837,10 @@ int par_write(aps_port_t *p,const void *buf,int size)
                                 break;
                         }
                         else {
+                                if (n<size) {
+                                        STATS_ADD(p->stats.partial_writes,1);
+                                        STATS_ADD(p->stats.retries,1);
+                                }
                                 buf += n;
                                 size -= n;
                                 p->set.par.irq_left += n;
@@ -684,6 +684,10 @@ int serial_write(aps_port_t *p,const void *buf,int size)
                         break;
                 }
                 else {
+                        if (n<size) {
+                                STATS_ADD(p->stats.partial_writes,1);
+                                STATS_ADD(p->stats.retries,1);
+                        }
                         buf += n;
                         size -= n;
                 }
@@ -796,6 +800,9 @@ int serial_read(aps_port_t *p,void *buf,int size)
                         break;
                 }
                 else {
+                        if (n<size) {
+                                STATS_ADD(p->stats.retries,1);
+                        }
                         buf += n;
                         size -= n;
                 }
@@ -0,0 +1,395 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : text.c
+* DESCRIPTION   : APS library - text printing with APS fonts
+*                 Text is drawn with the font engine and text line of the
+*                 CUPS text filter (aps_fnt.c) one line at a time; each line
+*                 is encoded as dotlines (see bitmap.c) and sent to the port
+*                 in large writes. All state is kept in the text object, so
+*                 several objects may print on several ports at the same time.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*
+*   This file is part of libaps.
+*
+*   libaps is free software; you can redistribute it and/or
+*   modify it under the terms of the GNU Lesser General Public
+*   License as published by the Free Software Foundation; either
+*   version 2.1 of the License, or (at your option) any later version.
+*
+*   libaps is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*   Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public
+*   License along with libaps; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <aps/aps.h>
+#include <aps/aps-private.h>
+#include <aps/aps_fnt.h>
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define TEXT_BUFSIZE    65536   /*bytes sent per write*/
+
+/*defaults of the text filter*/
+#define DEF_CHARSPACING 1       /*dots*/
+#define DEF_LINESPACING 3       /*dotlines*/
+
+struct aps_text {
+        void *          port;
+        aps_encoder_t   enc;
+        aps_fnt_line_t  line;           /*text line and drawing position*/
+        int             linespacing;    /*blank dotlines between lines*/
+        int             code;           /*UTF-8 sequence being decoded*/
+        int             more;           /*bytes missing in UTF-8 sequence*/
+        unsigned char   seq[4];         /*bytes of UTF-8 sequence*/
+        int             seqlen;
+        unsigned char * out;            /*encoded dotlines*/
+        int             len;
+        int             max;
+};
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  send_buffer
+Purpose   :  Send encoded dotlines to port
+Inputs    :  t : text object
+Outputs   :  Empties output buffer
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int send_buffer(struct aps_text *t)
+{
+        int errnum = APS_OK;
+
+        if (t->len>0)
+                errnum = aps_write(t->port,t->out,t->len);
+
+        t->len = 0;
+
+        return errnum < 0 ? errnum : APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_dotline
+Purpose   :  Encode dotline in output buffer, buffer is sent when full
+Inputs    :  t      : text object
+             buf    : dotline
+             nbytes : dotline size in bytes
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int put_dotline(struct aps_text *t,const unsigned char *buf,int nbytes)
+{
+        int errnum;
+
+        if (t->len+APS_ENCODE_MAX(nbytes)>t->max) {
+                if ((errnum = send_buffer(t))<0)
+                        return errnum;
+        }
+
+        t->len += aps_encode_dotline(&t->enc,buf,nbytes,t->out+t->len);
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  new_line
+Purpose   :  Encode text line followed by line spacing and clear text line
+             Only the drawn span of the line is encoded when blank bytes are
+             trimmed, as in the text filter
+Inputs    :  t : text object
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int new_line(struct aps_text *t)
+{
+        aps_fnt_line_t *line = &t->line;
+        int nbytes = (t->enc.flags&APS_BITMAP_TRIM) ? line->span : line->width;
+        unsigned char *p = line->buf;
+        int errnum = APS_OK;
+        int i;
+
+        for (i = 0; i<line->high && errnum==APS_OK; i++, p += line->width)
+                errnum = put_dotline(t,p,nbytes);
+
+        /*first dotline of cleared line is then used for line spacing*/
+        aps_fnt_line_clear(line);
+
+        for (i = 0; i<t->linespacing && errnum==APS_OK; i++)
+                errnum = put_dotline(t,line->buf,line->width);
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  draw_char
+Purpose   :  Draw character in text line
+             Characters past the end of the line are dropped and a missing
+             glyph ends the line, as in the text filter (aps_fnt_line_draw)
+Inputs    :  t : text object
+             c : character code
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int draw_char(struct aps_text *t,int c)
+{
+        int errnum;
+
+        if (aps_fnt_line_draw(&t->line,c)==fntERR_CHAR_BIPMAP_PTR_NULL) {
+                if ((errnum = new_line(t))<0)
+                        return errnum;
+
+                /*try again*/
+                aps_fnt_line_draw(&t->line,c);
+        }
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_char
+Purpose   :  Put character in text line, LF and CR end the line
+Inputs    :  t : text object
+             c : character code
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int put_char(struct aps_text *t,int c)
+{
+        if (c==LF || c==CR)
+                return new_line(t);
+
+        return draw_char(t,c);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_sequence
+Purpose   :  Put bytes of an incomplete UTF-8 sequence as ISO-8859-1
+             characters
+Inputs    :  t : text object
+Outputs   :  Empties UTF-8 sequence
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int put_sequence(struct aps_text *t)
+{
+        int errnum = APS_OK;
+        int i;
+
+        for (i = 0; i<t->seqlen && errnum==APS_OK; i++)
+                errnum = put_char(t,t->seq[i]);
+
+        t->more = 0;
+        t->seqlen = 0;
+
+        return errnum;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_create_text
+Purpose   :  Create text object
+             The font is not copied and must be kept until the text object
+             is destroyed. Font error codes are stored in the font, so
+             objects used by different threads need their own font
+Inputs    :  port  : port structure, opened by caller
+             type  : model type
+             width : printer head width in dots
+             font  : font handle (aps_fnt_create)
+             flags : encoder flags (aps_bitmap_flags_t)
+Outputs   :  <>
+Return    :  text object or NULL on error
+-----------------------------------------------------------------------------*/
+void *aps_create_text(void *port,int type,int width,void *font,int flags)
+{
+        struct aps_text *t;
+
+        if (port==NULL || font==NULL || aps_fnt_error(font)<0 || width<8)
+                return NULL;
+
+        if (aps_fnt_get_high(font)<=0)
+                return NULL;
+
+        t = calloc(1,sizeof(struct aps_text));
+        if (t==NULL)
+                return NULL;
+
+        if (aps_encoder_init(&t->enc,type,flags)<0) {
+                free(t);
+                return NULL;
+        }
+
+        t->port = port;
+        t->linespacing = DEF_LINESPACING;
+
+        t->max = TEXT_BUFSIZE;
+        if (t->max<2*APS_ENCODE_MAX(width/8))
+                t->max = 2*APS_ENCODE_MAX(width/8);
+
+        t->out = malloc(t->max);
+        if (aps_fnt_line_init(&t->line,font,width/8)<0 || t->out==NULL) {
+                aps_destroy_text(t);
+                return NULL;
+        }
+
+        return t;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_destroy_text
+Purpose   :  Destroy text object. Pending text is not sent (see aps_flush_text)
+Inputs    :  text : text object
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_destroy_text(void *text)
+{
+        struct aps_text *t = text;
+
+        if (t==NULL)
+                return APS_INVALID_FONT;
+
+        aps_fnt_line_free(&t->line);
+        free(t->out);
+        free(t);
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_set_text_spacing
+Purpose   :  Set character and line spacing, used from next character
+Inputs    :  text        : text object
+             charspacing : dots between characters, -1 for default (1)
+             linespacing : blank dotlines between lines, -1 for default (3)
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_set_text_spacing(void *text,int charspacing,int linespacing)
+{
+        struct aps_text *t = text;
+
+        if (t==NULL)
+                return APS_INVALID_FONT;
+
+        t->line.charspacing = charspacing<0 ? DEF_CHARSPACING : charspacing;
+        t->linespacing = linespacing<0 ? DEF_LINESPACING : linespacing;
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_print_text
+Purpose   :  Print UTF-8 text
+             Lines end with LF or CR and are sent to the port in large
+             writes; the last line is kept until it ends or until
+             aps_flush_text. A UTF-8 sequence may be split between calls,
+             invalid bytes, including those of a truncated sequence, are
+             printed as ISO-8859-1 characters
+Inputs    :  text : text object
+             s    : UTF-8 text
+             size : text size in bytes, -1 if text ends with a zero
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_print_text(void *text,const char *s,int size)
+{
+        struct aps_text *t = text;
+        const unsigned char *p = (const unsigned char *)s;
+        int errnum = APS_OK;
+        int c;
+        int i;
+
+        if (t==NULL)
+                return APS_INVALID_FONT;
+
+        if (size<0)
+                size = strlen(s);
+
+        for (i = 0; i<size && errnum==APS_OK; i++) {
+                c = p[i];
+
+                if (t->more>0) {
+                        if ((c&0xC0)==0x80) {
+                                t->code = (t->code<<6)|(c&0x3F);
+                                t->seq[t->seqlen++] = c;
+                                if (--t->more==0) {
+                                        t->seqlen = 0;
+                                        errnum = put_char(t,t->code);
+                                }
+                                continue;
+                        }
+                        /*truncated sequence*/
+                        if ((errnum = put_sequence(t))<0)
+                                break;
+                }
+
+                if ((c&0xE0)==0xC0) {
+                        t->code = c&0x1F;
+                        t->more = 1;
+                }
+                else if ((c&0xF0)==0xE0) {
+                        t->code = c&0x0F;
+                        t->more = 2;
+                }
+                else if ((c&0xF8)==0xF0) {
+                        t->code = c&0x07;
+                        t->more = 3;
+                }
+                else {
+                        errnum = put_char(t,c);
+                        continue;
+                }
+                t->seq[0] = c;
+                t->seqlen = 1;
+        }
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  aps_flush_text
+Purpose   :  Print pending text line and send encoded dotlines to port
+             Bytes of an incomplete UTF-8 sequence are printed first, as
+             ISO-8859-1 characters. Dotline shift is reset, so other
+             commands may follow
+Inputs    :  text : text object
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int aps_flush_text(void *text)
+{
+        struct aps_text *t = text;
+        int errnum;
+
+        if (t==NULL)
+                return APS_INVALID_FONT;
+
+        if ((errnum = put_sequence(t))<0)
+                return errnum;
+
+        if (t->line.chars>0) {
+                if ((errnum = new_line(t))<0)
+                        return errnum;
+        }
+
+        if (t->len+APS_ENCODE_MAX(0)>t->max) {
+                if ((errnum = send_buffer(t))<0)
+                        return errnum;
+        }
+        t->len += aps_encode_end(&t->enc,t->out+t->len);
+
+        return send_buffer(t);
+}
@@ -0,0 +1,289 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : trace.c
+* DESCRIPTION   : APS library - wire trace
+*                 Every write and read on a port can be recorded in a ring
+*                 mapped on a file. The ring is written without locks by the
+*                 thread using the port; records are published by updating
+*                 the ring head last, so the file can be copied or decoded
+*                 (apstrace) at any time, even after the process died.
+*
+*                 Tracing starts automatically when a port is opened if the
+*                 APS_TRACE environment variable names a directory; ring size
+*                 is set by APS_TRACE_SIZE in KB (default 256 KB).
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*
+*   This file is part of libaps.
+*
+*   libaps is free software; you can redistribute it and/or
+*   modify it under the terms of the GNU Lesser General Public
+*   License as published by the Free Software Foundation; either
+*   version 2.1 of the License, or (at your option) any later version.
+*
+*   libaps is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+*   Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public
+*   License along with libaps; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <aps/aps.h>
+#include <aps/aps-private.h>
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define TRACE_PATH_MAX          255     /*characters*/
+
+struct aps_trace {
+        aps_trace_header_t *    header;
+        unsigned char *         ring;
+        size_t                  map_size;
+        char                    path[TRACE_PATH_MAX+1];
+};
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  record_length
+Purpose   :  Get length of record at ring offset
+Inputs    :  t   : trace
+             pos : free running offset of record
+Outputs   :  <>
+Return    :  record length in bytes, up to next ring start for wrap records
+-----------------------------------------------------------------------------*/
+static uint64_t record_length(struct aps_trace *t,uint64_t pos)
+{
+        uint32_t size = t->header->size;
+        uint32_t off = pos%size;
+        aps_trace_record_t *r;
+
+        /*no room for a record before end of ring*/
+        if (size-off<sizeof(aps_trace_record_t))
+                return size-off;
+
+        r = (aps_trace_record_t *)(t->ring+off);
+        if (r->dir==TRACE_WRAP)
+                return size-off;
+
+        return sizeof(aps_trace_record_t)+TRACE_ALIGN(r->caplen);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  reserve
+Purpose   :  Move ring tail until given bytes after head are free
+Inputs    :  t   : trace
+             end : free running offset of end of new record
+Outputs   :  Ring tail is updated
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void reserve(struct aps_trace *t,uint64_t end)
+{
+        aps_trace_header_t *h = t->header;
+        uint64_t tail = h->tail;
+
+        while (end-tail>h->size && tail<h->head) {
+                tail += record_length(t,tail);
+                h->lost++;
+        }
+        if (end-tail>h->size)
+                tail = end-h->size;
+
+        /*readers must see the new tail before records are overwritten*/
+        __atomic_store_n(&h->tail,tail,__ATOMIC_RELEASE);
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  trace_clock
+Purpose   :  Get trace time stamp
+Inputs    :  <>
+Outputs   :  <>
+Return    :  nanoseconds since epoch
+-----------------------------------------------------------------------------*/
+uint64_t trace_clock(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME,&ts);
+
+        return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  trace_start
+Purpose   :  Start tracing port into ring file
+Inputs    :  p    : port structure
+             path : ring file, created or truncated
+             size : ring size in KB, 0 for default
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int trace_start(aps_port_t *p,const char *path,int size)
+{
+        struct aps_trace *t;
+        size_t map_size;
+        void *map;
+        int fd;
+
+        if (p->trace!=NULL) {
+                trace_stop(p);
+        }
+
+        if (strlen(path)>TRACE_PATH_MAX) {
+                return APS_NAME_TOO_LONG;
+        }
+        if (size<=0) {
+                size = TRACE_DEFSIZE;
+        }
+
+        map_size = sizeof(aps_trace_header_t)+(size_t)size*1024;
+
+        fd = open(path,O_RDWR|O_CREAT|O_TRUNC,0644);
+        if (fd<0) {
+                return APS_OPEN_FAILED;
+        }
+        if (ftruncate(fd,map_size)<0) {
+                close(fd);
+                return APS_OPEN_FAILED;
+        }
+
+        map = mmap(NULL,map_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+        close(fd);
+        if (map==MAP_FAILED) {
+                return APS_OPEN_FAILED;
+        }
+
+        t = malloc(sizeof(struct aps_trace));
+        if (t==NULL) {
+                munmap(map,map_size);
+                return APS_OPEN_FAILED;
+        }
+
+        t->header = map;
+        t->ring = (unsigned char *)map+sizeof(aps_trace_header_t);
+        t->map_size = map_size;
+        strcpy(t->path,path);
+
+        /*file is zero filled by ftruncate*/
+        t->header->version = TRACE_VERSION;
+        t->header->size = size*1024;
+        t->header->port_type = p->type;
+        if (((aps_class_t *)p)->get_uri!=NULL) {
+                ((aps_class_t *)p)->get_uri(p,t->header->uri,sizeof(t->header->uri));
+        }
+        __atomic_store_n(&t->header->magic,TRACE_MAGIC,__ATOMIC_RELEASE);
+
+        p->trace = t;
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  trace_stop
+Purpose   :  Stop tracing port. Ring file is kept
+Inputs    :  p : port structure
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int trace_stop(aps_port_t *p)
+{
+        struct aps_trace *t = p->trace;
+
+        if (t!=NULL) {
+                msync(t->header,t->map_size,MS_ASYNC);
+                munmap(t->header,t->map_size);
+                free(t);
+                p->trace = NULL;
+        }
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  trace_file
+Purpose   :  Get ring file of port
+Inputs    :  p : port structure
+Outputs   :  <>
+Return    :  file path or NULL if port is not traced
+-----------------------------------------------------------------------------*/
+const char *trace_file(aps_port_t *p)
+{
+        return p->trace!=NULL ? p->trace->path : NULL;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  trace_record
+Purpose   :  Append record to ring
+Inputs    :  p      : port structure
+             dir    : direction (aps_trace_dir_t)
+             buf    : data buffer
+             size   : data buffer size in bytes
+             start  : start of operation (trace_clock)
+             errnum : result of operation
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void trace_record(aps_port_t *p,int dir,const void *buf,int size,uint64_t start,int errnum)
+{
+        struct aps_trace *t = p->trace;
+        aps_trace_header_t *h = t->header;
+        aps_trace_record_t *r;
+        uint64_t head = h->head;
+        uint64_t len;
+        uint32_t off;
+        int caplen;
+
+        caplen = size;
+        if (caplen>TRACE_CAPLEN_MAX)
+                caplen = TRACE_CAPLEN_MAX;
+        if (caplen>(int)(h->size/4))
+                caplen = h->size/4;
+        if (caplen<0)
+                caplen = 0;
+
+        len = sizeof(aps_trace_record_t)+TRACE_ALIGN(caplen);
+
+        /*records never cross the end of the ring*/
+        off = head%h->size;
+        if (h->size-off<len) {
+                reserve(t,head+(h->size-off));
+                if (h->size-off>=sizeof(aps_trace_record_t)) {
+                        ((aps_trace_record_t *)(t->ring+off))->dir = TRACE_WRAP;
+                }
+                head += h->size-off;
+                off = 0;
+        }
+
+        reserve(t,head+len);
+
+        r = (aps_trace_record_t *)(t->ring+off);
+        r->time = start;
+        r->latency = (trace_clock()-start)/1000;
+        r->size = size;
+        r->caplen = caplen;
+        r->dir = dir;
+        r->errnum = errnum;
+        r->reserved = 0;
+        if (caplen>0)
+                memcpy(r+1,buf,caplen);
+
+        h->records++;
+
+        /*publish record*/
+        __atomic_store_n(&h->head,head+len,__ATOMIC_RELEASE);
+}
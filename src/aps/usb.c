@@ -816,6 +816,10 @@ int usb_write(aps_port_t *p,const void *buf,int size)
 			break;
 		}
 		else {
+			if (xferred<size) {
+				STATS_ADD(p->stats.partial_writes,1);
+				STATS_ADD(p->stats.retries,1);
+			}
 			size -= xferred;
 			buf += xferred;
 		}
@@ -0,0 +1,110 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : aps-print.c
+* DESCRIPTION   : Print a raster or text ticket without CUPS
+*
+*                 Options are read from a PPD file as by the filters, the
+*                 job is encoded and sent to the printer port by this
+*                 process (see direct.c).
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aps/aps.h>
+
+#include "direct.h"
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  usage
+Purpose   :  Print usage and exit
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void usage(void)
+{
+        printf("aps-print compiled with APS library %d.%d.%d\n",
+                        APS_MAJOR,
+                        APS_MINOR,
+                        APS_BUGFIX);
+
+        printf("usage: aps-print -d uri [-p ppd] [-o options] [-n copies] [-t] [file]\n"
+               "  -d  printer URI (default: DEVICE_URI environment variable)\n"
+               "  -p  PPD file (default: PPD environment variable)\n"
+               "  -o  job options, e.g. \"finalcut=2 optprint=True\"\n"
+               "  -n  number of copies\n"
+               "  -t  text input (default: CUPS raster)\n");
+
+        exit(0);
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  main
+Purpose   :  Program main function
+Inputs    :  argc : number of command-line arguments
+             argv : array of command-line arguments
+Outputs   :  <>
+Return    :  0 if success, 1 on error
+-----------------------------------------------------------------------------*/
+int main(int argc,char **argv)
+{
+        const char *uri = getenv("DEVICE_URI");
+        const char *options = "";
+        const char *file = NULL;
+        int format = DIRECT_RASTER;
+        int copies = 1;
+        int errnum;
+        int i;
+
+        for (i = 1; i<argc; i++) {
+                if (strcmp(argv[i],"-d")==0 && i+1<argc)
+                        uri = argv[++i];
+                else if (strcmp(argv[i],"-p")==0 && i+1<argc)
+                        setenv("PPD",argv[++i],1);
+                else if (strcmp(argv[i],"-o")==0 && i+1<argc)
+                        options = argv[++i];
+                else if (strcmp(argv[i],"-n")==0 && i+1<argc)
+                        copies = atoi(argv[++i]);
+                else if (strcmp(argv[i],"-t")==0)
+                        format = DIRECT_TEXT;
+                else if (argv[i][0]=='-' || file!=NULL)
+                        usage();
+                else
+                        file = argv[i];
+        }
+
+        if (uri==NULL || getenv("PPD")==NULL)
+                usage();
+
+        errnum = direct_print(uri,format,file,copies<1 ? 1 : copies,options);
+        if (errnum<0) {
+                fprintf(stderr,"aps-print: %s\n",aps_strerror(errnum));
+                return 1;
+        }
+
+        return 0;
+}
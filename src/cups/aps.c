@@ -44,19 +44,24 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <cups/cups.h>
+#include <cups/backend.h>
 
 #include <aps/aps.h>
 
 #include "command.h"
 #include "options.h"
+#include "stream.h"
 
 #undef DEBUG_DUMP
 #define DEBUG_DUMP_FILE         "/tmp/aps"
@@ -72,6 +77,8 @@ static  sig_atomic_t    cancel_flag;
 
 static unsigned char    print_buf[PRINT_BUFSIZE];
 
+#define JOB_BUFSIZE     (4096*1024)     /*bytes of job data sent at once*/
+
 static void *   port;
 
 static aps_serial_baudrate_t    defbaudrate;
@@ -80,6 +87,30 @@ static aps_parallel_mode_t      defparmode;
 
 static int      printer_ready;
 
+static int      stream_error;           /*job stream is corrupted*/
+
+/*job phases, in backend order*/
+enum {
+    JOB_SETUP,                          /*port open and setup*/
+    JOB_WAIT,                           /*wait for printer ready*/
+    JOB_PRINT,                          /*data transfer, until port sync*/
+    JOB_DRAIN,                          /*wait for end of printing*/
+    JOB_FINISH,
+    JOB_PHASES
+};
+
+/*job timing, milliseconds from monotonic clock*/
+static struct {
+    double      start;                  /*port creation*/
+    double      mark;                   /*start of current phase*/
+    double      first_byte;             /*first write to port, 0 if none*/
+    double      ms[JOB_PHASES];
+    long long   bytes;                  /*bytes written to port*/
+    long        blocks;                 /*blocks read from filters*/
+} job;
+
+#define METRICS_ENV     "APS_METRICS_SOCKET"    /*unix datagram socket path*/
+
 #ifdef DEBUG_DUMP
 static int dump;
 #endif /*DEBUG_DUMP*/
@@ -632,6 +663,8 @@ static int poll_status(void)
     aps_error_t errnum;
     aps_status_t status;
     unsigned char buf[4];
+    struct timespec start;
+    struct timespec end;
     int size;
     int type;
 
@@ -644,6 +677,8 @@ static int poll_status(void)
     }
 
     /*query printer status*/
+    clock_gettime(CLOCK_MONOTONIC,&start);
+
     switch (type) {
         case APS_ETHERNET:
         case APS_SERIAL:
@@ -658,6 +693,11 @@ static int poll_status(void)
             break;
     }
 
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    aps_stats_record(port,APS_OP_STATUS,
+                     (end.tv_sec-start.tv_sec)*1000000+(end.tv_nsec-start.tv_nsec)/1000,
+                     size<0 ? size : APS_OK);
+
     if (size<0) {
         return size;
     }
@@ -701,6 +741,160 @@ static int poll_status(void)
     return APS_OK;
 }
 
+/*-----------------------------------------------------------------------------
+Name      :  report_port_stats
+Purpose   :  Report port counters and latency percentiles to CUPS log
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void report_port_stats(void)
+{
+    static const char *names[APS_OP_MAX] = {"write","read","sync","usb_control","status"};
+    aps_stats_t stats;
+    int i;
+
+    if (aps_get_stats(port,&stats)<0) {
+        return;
+    }
+
+    fprintf(stderr,"DEBUG: APS port: %llu bytes written, %llu bytes read, "
+                   "%lu partial writes, %lu retries\n",
+                   stats.bytes_written,stats.bytes_read,
+                   stats.partial_writes,stats.retries);
+
+    for (i = 0; i<APS_OP_MAX; i++) {
+        const aps_op_stats_t *op = &stats.op[i];
+
+        if (op->calls==0)
+            continue;
+
+        fprintf(stderr,"DEBUG: APS port: %s %lu calls, %lu errors, %lu timeouts, "
+                       "p50 %d us, p99 %d us, max %lu us\n",
+                       names[i],op->calls,op->errors,op->timeouts,
+                       aps_stats_percentile(op,50),
+                       aps_stats_percentile(op,99),
+                       op->max_us);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  job_clock
+Purpose   :  Get monotonic time for job timing
+Inputs    :  <>
+Outputs   :  <>
+Return    :  time in milliseconds
+-----------------------------------------------------------------------------*/
+static double job_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+
+    return ts.tv_sec*1000.0+ts.tv_nsec/1000000.0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  job_phase_begin, job_phase_end
+Purpose   :  Time job phase
+Inputs    :  phase : job phase (JOB_xxx), time is added to previous runs
+Outputs   :  Updates global job timing
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void job_phase_begin(void)
+{
+    job.mark = job_clock();
+}
+
+static void job_phase_end(int phase)
+{
+    job.ms[phase] += job_clock()-job.mark;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  send_metrics
+Purpose   :  Send job summary line to local metrics socket, if any
+             Socket path is set by APS_METRICS_SOCKET environment variable,
+             errors are ignored and the job is never delayed
+Inputs    :  line : summary line
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void send_metrics(const char *line)
+{
+    struct sockaddr_un addr;
+    const char *path;
+    int s;
+
+    path = getenv(METRICS_ENV);
+    if (path==NULL || *path==0 || strlen(path)>=sizeof(addr.sun_path)) {
+        return;
+    }
+
+    if ((s = socket(AF_UNIX,SOCK_DGRAM,0))<0) {
+        return;
+    }
+
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path,path);
+
+    if (sendto(s,line,strlen(line),MSG_DONTWAIT,
+               (struct sockaddr *)&addr,sizeof(addr))<0) {
+        fprintf(stderr,"DEBUG: APS job: metrics socket %s unavailable\n",path);
+    }
+
+    close(s);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  report_job_timing
+Purpose   :  Report job phase timing and throughput to CUPS log and metrics
+             socket
+Inputs    :  jobid  : CUPS job ID
+             errnum : job result
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void report_job_timing(const char *jobid,int errnum)
+{
+    char line[512];
+    double ttfb;
+    double rate;
+    const char *printer;
+
+    ttfb = job.first_byte>0 ? job.first_byte-job.start : 0;
+    rate = job.ms[JOB_PRINT]>0 ? job.bytes/job.ms[JOB_PRINT]*1000.0/1024.0 : 0;
+
+    fprintf(stderr,"DEBUG: APS job: setup %.1f ms, ready wait %.1f ms, "
+                   "first byte %.1f ms, %lld bytes in %ld blocks, %.1f KB/s, "
+                   "drain %.1f ms, finish %.1f ms\n",
+                   job.ms[JOB_SETUP],job.ms[JOB_WAIT],ttfb,
+                   job.bytes,job.blocks,rate,
+                   job.ms[JOB_DRAIN],job.ms[JOB_FINISH]);
+
+    fprintf(stderr,"ATTR: aps-job-setup-ms=%.0f aps-job-wait-ms=%.0f "
+                   "aps-job-ttfb-ms=%.0f aps-job-bytes=%lld aps-job-blocks=%ld "
+                   "aps-job-rate-kbps=%.1f aps-job-drain-ms=%.0f aps-job-finish-ms=%.0f\n",
+                   job.ms[JOB_SETUP],job.ms[JOB_WAIT],ttfb,
+                   job.bytes,job.blocks,rate,
+                   job.ms[JOB_DRAIN],job.ms[JOB_FINISH]);
+
+    if ((printer = getenv("PRINTER"))==NULL) {
+        printer = "-";
+    }
+
+    snprintf(line,sizeof(line),"aps-job printer=%s job=%s status=%d "
+                   "setup-ms=%.1f wait-ms=%.1f ttfb-ms=%.1f bytes=%lld blocks=%ld "
+                   "rate-kbps=%.1f print-ms=%.1f drain-ms=%.1f finish-ms=%.1f\n",
+                   printer,jobid,errnum,
+                   job.ms[JOB_SETUP],job.ms[JOB_WAIT],ttfb,
+                   job.bytes,job.blocks,rate,job.ms[JOB_PRINT],
+                   job.ms[JOB_DRAIN],job.ms[JOB_FINISH]);
+
+    send_metrics(line);
+}
+
 /*-----------------------------------------------------------------------------
 Name      :  state_setup
 Purpose   :  Setup port settings for printing
@@ -840,6 +1034,31 @@ static int state_wait_usb(void)
     return 0;
 }
 
+/*-----------------------------------------------------------------------------
+Name      :  print_write
+Purpose   :  Write job data to printer, update job counters
+Inputs    :  buf  : data buffer
+             size : data size in bytes
+Outputs   :  Updates global job timing
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int print_write(const void *buf,int size)
+{
+	aps_error_t errnum;
+
+	if (job.first_byte==0) {
+		job.first_byte = job_clock();
+	}
+
+	if ((errnum = aps_write(port,buf,size))<0) {
+		return errnum;
+	}
+
+	job.bytes += size;
+
+	return APS_OK;
+}
+
 /*-----------------------------------------------------------------------------
 Name      :  write_raw
 Purpose   :  Write raw data to printer
@@ -854,7 +1073,9 @@ static int write_raw(int fd)
 
 	/*write until end of input pipe*/
 	while ((n = read(fd,print_buf,sizeof(print_buf)))>0) {
-		if ((errnum = aps_write(port,print_buf,n))<0) {
+		job.blocks++;
+
+		if ((errnum = print_write(print_buf,n))<0) {
 			return errnum;
 		}
 
@@ -897,7 +1118,7 @@ static int write_block(int fd,int size)
 		}
 
 		/*write data to printer*/
-		if ((errnum = aps_write(port,print_buf,n))<0) {
+		if ((errnum = print_write(print_buf,n))<0) {
 			return errnum;
 		}
 
@@ -914,9 +1135,123 @@ static int write_block(int fd,int size)
 	return APS_OK;
 }
 
+/*-----------------------------------------------------------------------------
+Name      :  print_stream
+Purpose   :  Print framed stream written by the filters
+             DATA records are gathered and sent in large writes, a cut
+             flushes gathered data so the ticket is printed without delay
+             A bad or truncated stream stops the job, data gathered since
+             the last cut is not sent
+Inputs    :  fd     : input file descriptor
+             prefix : bytes already read from stream
+             n      : number of bytes already read
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int print_stream(int fd,const void *prefix,int n)
+{
+	stream_reader_t r;
+	const unsigned char *payload;
+	unsigned char *xbuf;
+	aps_error_t errnum;
+	uint32_t size;
+	int type;
+	int total = 0;
+	int page = 0;
+	int copy = 1;
+	int end = 0;
+	int res = 0;
+
+	if ((errnum = stream_reader_init(&r,fd,prefix,n))<0) {
+		debug("Unsupported job stream header",port);
+		return errnum;
+	}
+
+	xbuf = malloc(JOB_BUFSIZE);
+	if (xbuf==NULL) {
+		stream_reader_free(&r);
+		return APS_IO_ERROR;
+	}
+
+	errnum = APS_OK;
+
+	while (!cancel_flag && !end && errnum==APS_OK &&
+	       (res = stream_read(&r,&type,&payload,&size))>0) {
+		job.blocks++;
+
+		switch (type) {
+		case STREAM_DATA:
+			/*flush gathered data if record does not fit*/
+			if (total+size>JOB_BUFSIZE) {
+				errnum = print_write(xbuf,total);
+				total = 0;
+			}
+			if (errnum!=APS_OK) {
+				break;
+			}
+			if (size>JOB_BUFSIZE) {
+				errnum = print_write(payload,size);
+			}
+			else {
+				memcpy(xbuf+total,payload,size);
+				total += size;
+			}
+			break;
+
+		case STREAM_CUT:
+			if (total>0) {
+				errnum = print_write(xbuf,total);
+				total = 0;
+			}
+			break;
+
+		case STREAM_PAGE:
+			page = stream_value(payload,size);
+			break;
+
+		case STREAM_COPY:
+			copy = stream_value(payload,size);
+			break;
+
+		case STREAM_END:
+			end = 1;
+			break;
+
+		default:
+			/*records added by later stream versions*/
+			break;
+		}
+	}
+
+	if (res<0) {
+		/*corrupted data is never sent to printer*/
+		fprintf(stderr,"ERROR: APS stream: bad record %ld (copy %d, page %d)\n",
+				r.records+1,copy,page);
+		stream_error = 1;
+		errnum = APS_IO_ERROR;
+	}
+	else if (!end && !cancel_flag && errnum==APS_OK) {
+		fprintf(stderr,"ERROR: APS stream: truncated after record %ld (copy %d, page %d)\n",
+				r.records,copy,page);
+		stream_error = 1;
+		errnum = APS_IO_ERROR;
+	}
+	else if (errnum==APS_OK && total>0) {
+		/*flush data to printer*/
+		errnum = print_write(xbuf,total);
+	}
+
+	free(xbuf);
+	stream_reader_free(&r);
+
+	return errnum;
+}
+
 /*-----------------------------------------------------------------------------
 Name      :  state_print
 Purpose   :  Print data
+             Filters send a framed stream (see stream.h), or a legacy stream
+             of size prefixed blocks, or -1 followed by raw data
 Inputs    :  fd : input file descriptor
 Outputs   :  <>
 Return    :  APS_OK or error code
@@ -939,7 +1274,13 @@ static int state_print(int fd)
 		return APS_IO_ERROR;
 	}
 
-	if (size==-1) {
+	if (stream_is_framed(&size,sizeof(int))) {
+		/*write framed stream*/
+		if ((errnum = print_stream(fd,&size,sizeof(int)))<0) {
+			return errnum;
+		}
+	}
+	else if (size==-1) {
 		/*write raw data*/
 		if ((errnum = write_raw(fd))<0) {
 			return errnum;
@@ -947,22 +1288,46 @@ static int state_print(int fd)
 	}
 	else {
 		total = 0;
-		p = xbuf = malloc(4096 * 1024);
+		p = xbuf = malloc(JOB_BUFSIZE);
 		if (!p)
 			return APS_IO_ERROR;
 		while (!cancel_flag) {
-			if (read(fd,p,size) < size) {
+			if (size<0) {
+				free(xbuf);
 				return APS_IO_ERROR;
 			}
-			total += size;
-			p += size;
+			/*flush gathered data if block does not fit*/
+			if (total+size>JOB_BUFSIZE) {
+				if ((errnum = print_write(xbuf,total))<0) {
+					free(xbuf);
+					return errnum;
+				}
+				total = 0;
+				p = xbuf;
+			}
+			if (size>JOB_BUFSIZE) {
+				if ((errnum = write_block(fd,size))<0) {
+					free(xbuf);
+					return errnum;
+				}
+			}
+			else {
+				if (read(fd,p,size) < size) {
+					free(xbuf);
+					return APS_IO_ERROR;
+				}
+				total += size;
+				p += size;
+			}
+			job.blocks++;
 			/*read next block size, exit if end of file*/
 			if (read(fd,&size,sizeof(int))<(int)sizeof(int)) {
 				break;
 			}
 		}
 		/* flush data to printer */
-		if ((errnum = aps_write(port,xbuf,total))<0) {
+		if ((errnum = print_write(xbuf,total))<0) {
+			free(xbuf);
 			return errnum;
 		}
 		free(xbuf);
@@ -976,6 +1341,79 @@ static int state_print(int fd)
 	return APS_OK;
 }
 
+/*-----------------------------------------------------------------------------
+Name      :  write_copy_cut
+Purpose   :  Cut paper between two copies of a job file, as set by finalcut
+Inputs    :  <>
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int write_copy_cut(void)
+{
+	aps_error_t errnum;
+	command_t cmd;
+
+	if (ticketmode!=0) {
+		return APS_OK;
+	}
+
+	switch (finalcut) {
+	case FINALCUT_PARTIAL:
+		errnum = cmd_partial_cut(printer_type,&cmd);
+		break;
+	case FINALCUT_FULL:
+		errnum = cmd_full_cut(printer_type,&cmd);
+		break;
+	default:
+		return APS_OK;
+	}
+
+	if (errnum<0) {
+		return errnum;
+	}
+
+	if ((errnum = print_write(cmd.buf,cmd.size))<0) {
+		return errnum;
+	}
+
+	return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  state_print_copies
+Purpose   :  Print job file several times
+             The job file is encoded once by the filters, it is read again
+             from the start for every copy
+Inputs    :  fd     : input file descriptor
+             copies : number of copies
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int state_print_copies(int fd,int copies)
+{
+	aps_error_t errnum;
+	int i;
+
+	for (i = 0; i<copies && !cancel_flag; i++) {
+		if (i>0) {
+			if (lseek(fd,0,SEEK_SET)<0) {
+				debug("Job file cannot be rewound, printing one copy",port);
+				break;
+			}
+
+			if ((errnum = write_copy_cut())<0) {
+				return errnum;
+			}
+		}
+
+		if ((errnum = state_print(fd))<0) {
+			return errnum;
+		}
+	}
+
+	return APS_OK;
+}
+
 /*-----------------------------------------------------------------------------
 Name      :  state_finish
 Purpose   :  Finish printing, revert printer state to default
@@ -1022,6 +1460,7 @@ int main(int argc,char** argv)
 {
     struct sigaction sa;
     aps_error_t errnum;
+    int copies;
     int fd;
 
 #ifdef DEBUG_DUMP
@@ -1067,14 +1506,22 @@ int main(int argc,char** argv)
     dump_options();
 
     /*open input file*/
+    /*copies are only handled here for job files, filters replay
+      their own output when the job is piped*/
     if (argc==7) {
         if ((fd = open(argv[6],O_RDONLY))==-1) {
             error("Unable to open input file");
         }
+
+        copies = atoi(argv[4]);
+        if (copies<1) {
+            copies = 1;
+        }
     }
     else
     {
         fd = 0; /*stdin*/
+        copies = 1;
     }
 
     /*ignore SIGPIPE signals*/
@@ -1091,6 +1538,8 @@ int main(int argc,char** argv)
 
     /*create printer port*/
     fprintf(stderr, "DEBUG: Create port :%s\n", getenv("DEVICE_URI"));
+    job.start = job_clock();
+    job_phase_begin();
     port = aps_create_port(getenv("DEVICE_URI"));
 
     if (port==NULL) {
@@ -1114,30 +1563,48 @@ int main(int argc,char** argv)
         debug("Setup Printer...",port);
         errnum = state_setup();
     }
+    job_phase_end(JOB_SETUP);
 
     if (errnum==APS_OK) {
         debug("Wait Printer...",port);
+        job_phase_begin();
         errnum = state_wait();
+        job_phase_end(JOB_WAIT);
     }
 
     if (errnum==APS_OK) {
         debug("Print in Printer...",port);
-        errnum = state_print(fd);
+        job_phase_begin();
+        errnum = state_print_copies(fd,copies);
+        job_phase_end(JOB_PRINT);
     }
 
     if (errnum==APS_OK) {
         debug("Wait Printer...",port);
+        job_phase_begin();
         errnum = state_wait();
+        job_phase_end(JOB_DRAIN);
     }
 
     if (errnum==APS_OK) {
         debug("Wait usb ...",port);
+        job_phase_begin();
         errnum = state_wait_usb();
+        job_phase_end(JOB_DRAIN);
     }
 
     if (errnum==APS_OK) {
         debug("finish ...",port);
+        job_phase_begin();
         errnum = state_finish();
+        job_phase_end(JOB_FINISH);
+    }
+
+    report_job_timing(argv[1],errnum);
+
+    /*keep pointer to wire trace (APS_TRACE) in CUPS log*/
+    if (errnum<0 && aps_trace_get_file(port)!=NULL) {
+        fprintf(stderr,"ERROR: APS backend => wire trace in %s\n",aps_trace_get_file(port));
     }
 
     /*reset printer in case of timeout*/
@@ -1161,6 +1628,8 @@ int main(int argc,char** argv)
         fprintf(stderr,"INFO: %s.\n",aps_get_strerror_full(errnum,port));
     }
 
+    report_port_stats();
+
     debug("Close Port ...",port);
     /*close port*/
     /*ignore errors (in case of port already closed, for example)*/
@@ -1197,6 +1666,11 @@ int main(int argc,char** argv)
     }
 #endif /*DEBUG_DUMP*/
 
+    /*a corrupted job would print the same way again*/
+    if (stream_error) {
+        return CUPS_BACKEND_CANCEL;
+    }
+
     return 0;
 }
 
@@ -0,0 +1,463 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : apsopt.c
+* DESCRIPTION   : CUPS filter for APS printers
+*                 Optimizes APS command streams (see optimize.c): output of
+*                 the APS filters, or of any other producer sending
+*                 application/vnd.aps-commands documents.
+*                 Input is either a raw stream (starting with -1) or a
+*                 stream of blocks (size + data) as written by write_command();
+*                 output uses the same mode. Streams which are neither, e.g.
+*                 ESC/POS files from other applications, are taken as raw.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <cups/cups.h>
+
+#include <aps/aps.h>
+
+#include "options.h"
+#include "optimize.h"
+#include "stream.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define READ_BUFSIZE    65536   /*bytes*/
+
+/*header and data of a block are written at once (PIPE_BUF)*/
+#define BLOCK_MAX       (4096-(int)sizeof(int))     /*bytes*/
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  read_all
+Purpose   :  Read input file until end of file
+Inputs    :  fd     : input file descriptor
+             prefix : bytes already read from input file
+             n      : number of bytes already read
+             size   : number of bytes read
+Outputs   :  <>
+Return    :  input data, to be freed by caller, or NULL on error
+-----------------------------------------------------------------------------*/
+static unsigned char *read_all(int fd,const void *prefix,int n,long *size)
+{
+        unsigned char *buf;
+        unsigned char *p;
+        long max = READ_BUFSIZE;
+
+        buf = malloc(max);
+        if (buf==NULL)
+                return NULL;
+
+        memcpy(buf,prefix,n);
+        *size = n;
+
+        for (;;) {
+                if (*size+READ_BUFSIZE>max) {
+                        max = max ? 2*max : READ_BUFSIZE;
+                        p = realloc(buf,max);
+                        if (p==NULL) {
+                                free(buf);
+                                return NULL;
+                        }
+                        buf = p;
+                }
+
+                n = read(fd,buf+*size,max-*size);
+                if (n<0) {
+                        free(buf);
+                        return NULL;
+                }
+                if (n==0)
+                        break;
+
+                *size += n;
+        }
+
+        return buf;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  add_stats
+Purpose   :  Add optimizer statistics of a stream segment to job totals
+Inputs    :  total : job totals
+             stats : segment statistics
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void add_stats(optimize_stats_t *total,const optimize_stats_t *stats)
+{
+        total->in_bytes += stats->in_bytes;
+        total->out_bytes += stats->out_bytes;
+        total->blank += stats->blank;
+        total->feeds += stats->feeds;
+        total->shifts_in += stats->shifts_in;
+        total->shifts_out += stats->shifts_out;
+        total->settings_dropped += stats->settings_dropped;
+        total->compressed += stats->compressed;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  optimize_segment
+Purpose   :  Optimize commands found between two markers of a framed stream
+             and write them to standard output
+Inputs    :  flags : optimizer flags
+             buf   : command stream
+             size  : command stream size in bytes
+             total : job statistics
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void optimize_segment(int flags,const unsigned char *buf,long size,
+                             optimize_stats_t *total)
+{
+        optimize_stats_t stats;
+        unsigned char *out;
+        long outsize;
+        int errnum;
+
+        if (size==0)
+                return;
+
+        /*unknown segments are sent unchanged*/
+        errnum = optimize_stream(printer_type,flags,buf,size,&out,&outsize,&stats);
+        if (errnum<0) {
+                fprintf(stderr,"DEBUG: apsopt: %s, segment not optimized\n",aps_strerror(errnum));
+                total->in_bytes += size;
+                total->out_bytes += size;
+                stream_data(stdout,buf,size);
+                return;
+        }
+
+        add_stats(total,&stats);
+        stream_data(stdout,out,outsize);
+        free(out);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  optimize_framed
+Purpose   :  Optimize framed stream (see stream.h)
+             Commands are optimized between markers, markers are kept
+Inputs    :  fd     : input file descriptor
+             prefix : bytes already read from input file
+             n      : number of bytes already read
+             flags  : optimizer flags
+             stats  : job statistics
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int optimize_framed(int fd,const void *prefix,int n,int flags,
+                           optimize_stats_t *stats)
+{
+        stream_reader_t r;
+        const unsigned char *payload;
+        unsigned char *seg = NULL;
+        unsigned char *p;
+        long len = 0;
+        long max = 0;
+        uint32_t size;
+        int type;
+        int res;
+
+        if ((res = stream_reader_init(&r,fd,prefix,n))<0)
+                return res;
+
+        stream_start(stdout,r.flags);
+
+        while ((res = stream_read(&r,&type,&payload,&size))>0 && type!=STREAM_END) {
+                if (type==STREAM_DATA) {
+                        if (len+size>max) {
+                                max = 2*(len+size);
+                                p = realloc(seg,max);
+                                if (p==NULL) {
+                                        res = APS_IO_ERROR;
+                                        break;
+                                }
+                                seg = p;
+                        }
+                        memcpy(seg+len,payload,size);
+                        len += size;
+                        continue;
+                }
+
+                optimize_segment(flags,seg,len,stats);
+                len = 0;
+
+                if (type==STREAM_PAGE || type==STREAM_CUT || type==STREAM_COPY)
+                        stream_mark(stdout,type,stream_value(payload,size));
+        }
+
+        if (res>=0) {
+                optimize_segment(flags,seg,len,stats);
+                stream_end(stdout);
+                res = ferror(stdout) ? APS_IO_ERROR : APS_OK;
+        }
+
+        free(seg);
+        stream_reader_free(&r);
+
+        return res;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  unframe
+Purpose   :  Remove block headers, data is moved in place
+             A stream which does not parse as blocks is taken as raw, so
+             commands from other producers are printed unchanged
+Inputs    :  buf  : input stream
+             size : input stream size in bytes
+             raw  : set to 1 if stream is raw
+Outputs   :  <>
+Return    :  size of command stream in bytes
+-----------------------------------------------------------------------------*/
+static long unframe(unsigned char *buf,long size,int *raw)
+{
+        long in = 0;
+        long out = 0;
+        int n;
+
+        *raw = 0;
+
+        if (size<(long)sizeof(int))
+                return 0;
+
+        memcpy(&n,buf,sizeof(int));
+        if (n==-1) {
+                *raw = 1;
+                memmove(buf,buf+sizeof(int),size-sizeof(int));
+                return size-sizeof(int);
+        }
+
+        /*block sizes must cover the stream exactly*/
+        while (in+(long)sizeof(int)<=size) {
+                memcpy(&n,buf+in,sizeof(int));
+                in += sizeof(int);
+
+                if (n<0 || n>size-in) {
+                        in = -1;
+                        break;
+                }
+                in += n;
+        }
+
+        if (in!=size) {
+                *raw = 1;
+                return size;
+        }
+
+        in = 0;
+        while (in<size) {
+                memcpy(&n,buf+in,sizeof(int));
+                in += sizeof(int);
+
+                memmove(buf+out,buf+in,n);
+                in += n;
+                out += n;
+        }
+
+        return out;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_all
+Purpose   :  Write buffer to output file
+Inputs    :  fd   : output file descriptor
+             buf  : data
+             size : data size in bytes
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int write_all(int fd,const void *buf,long size)
+{
+        const unsigned char *p = buf;
+        long n;
+
+        while (size>0) {
+                n = write(fd,p,size);
+                if (n<=0)
+                        return APS_IO_ERROR;
+                p += n;
+                size -= n;
+        }
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_stream
+Purpose   :  Write command stream to standard output, in raw mode or in
+             blocks
+Inputs    :  buf  : command stream
+             size : command stream size in bytes
+             raw  : raw mode flag
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int write_stream(const unsigned char *buf,long size,int raw)
+{
+        unsigned char block[sizeof(int)+BLOCK_MAX];
+        int errnum;
+        int n;
+
+        if (raw) {
+                n = -1;
+                if ((errnum = write_all(1,&n,sizeof(int)))<0)
+                        return errnum;
+                return write_all(1,buf,size);
+        }
+
+        while (size>0) {
+                n = size>BLOCK_MAX ? BLOCK_MAX : size;
+
+                memcpy(block,&n,sizeof(int));
+                memcpy(block+sizeof(int),buf,n);
+                if ((errnum = write_all(1,block,sizeof(int)+n))<0)
+                        return errnum;
+
+                buf += n;
+                size -= n;
+        }
+
+        return APS_OK;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  main
+Purpose   :  Program main function
+Inputs    :  argc : number of command-line arguments (including program name)
+             argv : array of command-line arguments
+Outputs   :  <>
+Return    :  0 if successful, 1 if program failed
+-----------------------------------------------------------------------------*/
+int main(int argc,char** argv)
+{
+        optimize_stats_t stats;
+        unsigned char prefix[STREAM_MAGIC_SIZE];
+        unsigned char *in;
+        unsigned char *out;
+        long size;
+        long outsize;
+        int errnum;
+        int flags;
+        int raw;
+        int fd;
+        int n;
+
+        setbuf(stderr,NULL);
+
+        debug("apsopt filter started",NULL);
+
+        /*check arguments*/
+        if (argc<6 || argc>7) {
+                fputs("ERROR: apsopt job-id user title copies options [file]\n",stderr);
+                return 1;
+        }
+
+        /*retrieve options*/
+        get_options(argv[5]);
+
+        /*open command stream*/
+        if (argc==7) {
+                if ((fd = open(argv[6],O_RDONLY))==-1) {
+                        error("Unable to open command file");
+                }
+        }
+        else
+                fd = 0; /*stdin*/
+
+        flags = OPTIMIZE_TRIM;
+        if (compress==1) {
+                flags |= OPTIMIZE_COMPRESS;
+        }
+
+        /*read stream magic*/
+        for (n = 0; n<STREAM_MAGIC_SIZE; n += size) {
+                size = read(fd,prefix+n,STREAM_MAGIC_SIZE-n);
+                if (size<=0)
+                        break;
+        }
+
+        if (stream_is_framed(prefix,n)) {
+                memset(&stats,0,sizeof(stats));
+                errnum = optimize_framed(fd,prefix,n,flags,&stats);
+                if (errnum<0) {
+                        error("Corrupted command stream");
+                }
+
+                if (fd!=0) {
+                        close(fd);
+                }
+        }
+        else {
+                in = read_all(fd,prefix,n,&size);
+                if (in==NULL) {
+                        error("Unable to read command stream");
+                }
+
+                if (fd!=0) {
+                        close(fd);
+                }
+
+                size = unframe(in,size,&raw);
+
+                /*unknown streams are sent unchanged*/
+                errnum = optimize_stream(printer_type,flags,in,size,&out,&outsize,&stats);
+                if (errnum<0) {
+                        fprintf(stderr,"DEBUG: apsopt: %s, stream not optimized\n",aps_strerror(errnum));
+                        memset(&stats,0,sizeof(stats));
+                        stats.in_bytes = stats.out_bytes = size;
+                        errnum = write_stream(in,size,raw);
+                }
+                else {
+                        errnum = write_stream(out,outsize,raw);
+                        free(out);
+                }
+
+                free(in);
+
+                if (errnum<0) {
+                        error(aps_strerror(errnum));
+                }
+        }
+
+        fprintf(stderr,"DEBUG: apsopt: %ld bytes in, %ld bytes out, "
+                       "%ld blank dotlines in %ld feeds, %ld/%ld shifts, "
+                       "%ld settings dropped, %ld dotlines compressed\n",
+                       stats.in_bytes,stats.out_bytes,
+                       stats.blank,stats.feeds,
+                       stats.shifts_out,stats.shifts_in,
+                       stats.settings_dropped,stats.compressed);
+
+        free_options();
+
+        debug("apsopt filter finished",NULL);
+
+        return 0;
+}
@@ -0,0 +1,651 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : barcode.c
+* DESCRIPTION   : Host rasterization of barcodes
+*
+*                 Used for printers that cannot print a barcode symbology
+*                 natively (see cmd_barcode_native).
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aps/aps.h>
+
+#include "command.h"
+#include "barcode.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define QUIET_ZONE      10              /*modules*/
+#define ELEMENTS_MAX    1024
+
+/*element widths of a 1D barcode, first element is a bar*/
+typedef struct {
+        int     n;
+        int     w[ELEMENTS_MAX];        /*modules*/
+} elements_t;
+
+/*Code 39 characters and patterns (9 elements, bit set for wide element)*/
+static const char code39_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-. $/+%*";
+
+static const unsigned short code39_table[] = {
+        0x034,0x121,0x061,0x160,0x031,0x130,0x070,0x025,0x124,0x064,
+        0x109,0x049,0x148,0x019,0x118,0x058,0x00d,0x10c,0x04c,0x01c,
+        0x103,0x043,0x142,0x013,0x112,0x052,0x007,0x106,0x046,0x016,
+        0x181,0x0c1,0x1c0,0x091,0x190,0x0d0,0x085,0x184,0x0c4,0x0a8,
+        0x0a2,0x08a,0x02a,0x094
+};
+
+/*EAN left-hand odd parity (L) and even parity (G) digit patterns*/
+static const unsigned char ean_l[10] = {
+        0x0d,0x19,0x13,0x3d,0x23,0x31,0x2f,0x3b,0x37,0x0b
+};
+static const unsigned char ean_g[10] = {
+        0x27,0x33,0x1b,0x21,0x1d,0x39,0x05,0x11,0x09,0x17
+};
+
+/*EAN-13 parity of left-hand digits (bit set for G) per first digit*/
+static const unsigned char ean_parity[10] = {
+        0x00,0x0b,0x0d,0x0e,0x13,0x19,0x1c,0x15,0x16,0x1a
+};
+
+/*UPC-E parity of digits (bit set for G) per check digit, number system 0
+  (number system 1 uses the inverted parity)*/
+static const unsigned char upce_parity[10] = {
+        0x38,0x34,0x32,0x31,0x2c,0x26,0x23,0x2a,0x29,0x25
+};
+
+/*Interleaved 2 of 5 digit patterns (5 elements, bit set for wide)*/
+static const unsigned char itf_table[10] = {
+        0x06,0x11,0x09,0x18,0x05,0x14,0x0c,0x03,0x12,0x0a
+};
+
+/*Codabar characters and patterns (7 elements, bit set for wide element)*/
+static const char codabar_chars[] = "0123456789-$:/.+ABCD";
+
+static const unsigned char codabar_table[] = {
+        0x03,0x06,0x09,0x60,0x12,0x42,0x21,0x24,0x30,0x48,
+        0x0c,0x18,0x45,0x51,0x54,0x15,0x1a,0x29,0x0b,0x0e
+};
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  add_element
+Purpose   :  Append element to barcode
+             Consecutive elements of the same color are merged
+Inputs    :  e     : element list
+             black : color of element
+             w     : width of element in modules
+Outputs   :  Updates element list
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void add_element(elements_t *e,int black,int w)
+{
+        /*even elements are bars*/
+        if (e->n>0 && ((e->n-1)%2==0)==black) {
+                e->w[e->n-1] += w;
+        }
+        else if (e->n<ELEMENTS_MAX) {
+                if (e->n==0 && !black)
+                        e->w[e->n++] = 0;
+                e->w[e->n++] = w;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  add_bits
+Purpose   :  Append modules described by a bit pattern (MSB first,
+             bit set for black module)
+Inputs    :  e     : element list
+             bits  : pattern
+             n     : number of modules in pattern
+Outputs   :  Updates element list
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void add_bits(elements_t *e,unsigned int bits,int n)
+{
+        while (n--)
+                add_element(e,(bits>>n)&1,1);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  digits_only
+Purpose   :  Check that data only contains decimal digits
+Inputs    :  data : barcode data
+             len  : data length
+Outputs   :  <>
+Return    :  1 if true, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int digits_only(const char *data,int len)
+{
+        while (len--)
+                if (data[len]<'0' || data[len]>'9')
+                        return 0;
+
+        return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  ean_check_digit
+Purpose   :  Compute EAN/UPC check digit
+Inputs    :  d : digits (without check digit)
+             n : number of digits
+Outputs   :  <>
+Return    :  check digit
+-----------------------------------------------------------------------------*/
+static int ean_check_digit(const char *d,int n)
+{
+        int sum = 0;
+        int i;
+
+        /*weight 3 for the digit next to the check digit, alternating*/
+        for (i = 0; i<n; i++)
+                sum += (d[n-1-i]-'0') * (i%2==0 ? 3 : 1);
+
+        return (10 - sum%10) % 10;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encode_code39
+Purpose   :  Build Code 39 elements
+Inputs    :  data : barcode data
+             len  : data length
+Outputs   :  e    : element list
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int encode_code39(const char *data,int len,elements_t *e)
+{
+        int i;
+
+        for (i = -1; i<=len; i++) {
+                const char *p;
+                int c;
+                int k;
+
+                /*start and stop characters*/
+                c = (i<0 || i==len) ? '*' : data[i];
+                if (c>='a' && c<='z')
+                        c -= 'a'-'A';
+
+                p = strchr(code39_chars,c);
+                if (p==NULL || c==0)
+                        return APS_NOT_IMPLEMENTED;
+
+                for (k = 8; k>=0; k--)
+                        add_element(e,k%2==0,((code39_table[p-code39_chars]>>k)&1) ? 3 : 1);
+
+                /*inter-character gap*/
+                add_element(e,0,1);
+        }
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  add_codabar
+Purpose   :  Append Codabar character and inter-character gap
+Inputs    :  e     : element list
+             c     : character
+Outputs   :  Updates element list
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int add_codabar(elements_t *e,int c)
+{
+        const char *p;
+        int k;
+
+        if (c>='a' && c<='d')
+                c -= 'a'-'A';
+
+        p = strchr(codabar_chars,c);
+        if (p==NULL || c==0)
+                return APS_NOT_IMPLEMENTED;
+
+        for (k = 6; k>=0; k--)
+                add_element(e,k%2==0,((codabar_table[p-codabar_chars]>>k)&1) ? 3 : 1);
+
+        add_element(e,0,1);
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  is_codabar_guard
+Purpose   :  Check if character is a Codabar start or stop character
+Inputs    :  c : character
+Outputs   :  <>
+Return    :  1 if true, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int is_codabar_guard(int c)
+{
+        return (c>='A' && c<='D') || (c>='a' && c<='d');
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encode_codabar
+Purpose   :  Build Codabar elements
+Inputs    :  data : barcode data, with or without start and stop characters
+                    (A to D); A is used when they are missing
+             len  : data length
+Outputs   :  e    : element list
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int encode_codabar(const char *data,int len,elements_t *e)
+{
+        int guards;
+        int errnum;
+        int i;
+
+        guards = len>=2 && is_codabar_guard(data[0]) &&
+                 is_codabar_guard(data[len-1]);
+
+        errnum = guards ? APS_OK : add_codabar(e,'A');
+
+        for (i = 0; i<len && errnum==APS_OK; i++) {
+                /*start and stop characters only at both ends*/
+                if (is_codabar_guard(data[i]) && (!guards || (i>0 && i<len-1)))
+                        return APS_NOT_IMPLEMENTED;
+
+                errnum = add_codabar(e,data[i]);
+        }
+
+        if (!guards && errnum==APS_OK)
+                errnum = add_codabar(e,'A');
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encode_itf
+Purpose   :  Build Interleaved 2 of 5 elements
+Inputs    :  data : barcode data (odd length is padded with a leading 0)
+             len  : data length
+Outputs   :  e    : element list
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int encode_itf(const char *data,int len,elements_t *e)
+{
+        char d[256];
+        int i;
+        int k;
+
+        if (len>=(int)sizeof(d)-1 || !digits_only(data,len))
+                return APS_NOT_IMPLEMENTED;
+
+        i = 0;
+        if (len%2)
+                d[i++] = '0';
+        memcpy(&d[i],data,len);
+        len += i;
+
+        /*start: narrow bar, narrow space, narrow bar, narrow space*/
+        add_bits(e,0x0a,4);
+
+        for (i = 0; i<len; i += 2) {
+                int bars = itf_table[d[i]-'0'];
+                int spaces = itf_table[d[i+1]-'0'];
+
+                for (k = 4; k>=0; k--) {
+                        add_element(e,1,((bars>>k)&1) ? 3 : 1);
+                        add_element(e,0,((spaces>>k)&1) ? 3 : 1);
+                }
+        }
+
+        /*stop: wide bar, narrow space, narrow bar*/
+        add_element(e,1,3);
+        add_element(e,0,1);
+        add_element(e,1,1);
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encode_ean
+Purpose   :  Build EAN-13, EAN-8 and UPC-A elements
+Inputs    :  symbology : barcode symbology
+             data      : barcode data (check digit is optional)
+             len       : data length
+Outputs   :  e         : element list
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int encode_ean(int symbology,const char *data,int len,elements_t *e)
+{
+        char d[14];
+        int n;
+        int half;
+        int parity;
+        int i;
+
+        if (!digits_only(data,len))
+                return APS_NOT_IMPLEMENTED;
+
+        switch (symbology) {
+        case BARCODE_EAN8:
+                n = 8;
+                break;
+        case BARCODE_UPCA:
+                /*UPC-A is EAN-13 with a leading 0*/
+                if (len<11 || len>12)
+                        return APS_NOT_IMPLEMENTED;
+                d[0] = '0';
+                memcpy(&d[1],data,len);
+                data = d;
+                len++;
+                n = 13;
+                break;
+        default:
+                n = 13;
+                break;
+        }
+
+        if (len<n-1 || len>n)
+                return APS_NOT_IMPLEMENTED;
+
+        if (data!=d)
+                memcpy(d,data,len);
+
+        if (len==n-1)
+                d[n-1] = '0'+ean_check_digit(d,n-1);
+        else if (d[n-1]!='0'+ean_check_digit(d,n-1))
+                return APS_NOT_IMPLEMENTED;
+
+        /*first EAN-13 digit is encoded in left-hand parity*/
+        if (n==13) {
+                parity = ean_parity[d[0]-'0'];
+                i = 1;
+        }
+        else {
+                parity = 0;
+                i = 0;
+        }
+        half = (n-i)/2;
+
+        add_bits(e,0x5,3);                              /*start guard*/
+
+        for (n = 0; n<half; n++, i++) {
+                if ((parity>>(half-1-n))&1)
+                        add_bits(e,ean_g[d[i]-'0'],7);
+                else
+                        add_bits(e,ean_l[d[i]-'0'],7);
+        }
+
+        add_bits(e,0x0a,5);                             /*center guard*/
+
+        for (n = 0; n<half; n++, i++)
+                add_bits(e,~ean_l[d[i]-'0'] & 0x7f,7);  /*R patterns*/
+
+        add_bits(e,0x5,3);                              /*end guard*/
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encode_upce
+Purpose   :  Build UPC-E elements
+Inputs    :  data : barcode data, 6 digits (number system 0) or number
+                    system digit (0 or 1) and 6 digits, check digit is
+                    optional
+             len  : data length
+Outputs   :  e    : element list
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int encode_upce(const char *data,int len,elements_t *e)
+{
+        char a[11];
+        const char *d;
+        int ns;
+        int check;
+        int parity;
+        int i;
+
+        if (len<6 || len>8 || !digits_only(data,len))
+                return APS_NOT_IMPLEMENTED;
+
+        if (len==6) {
+                ns = 0;
+                d = data;
+        }
+        else {
+                ns = data[0]-'0';
+                d = data+1;
+        }
+
+        if (ns>1)
+                return APS_NOT_IMPLEMENTED;
+
+        /*check digit is computed on the UPC-A form*/
+        memset(a,'0',sizeof(a));
+        a[0] = '0'+ns;
+        a[1] = d[0];
+        a[2] = d[1];
+        switch (d[5]) {
+        case '0':
+        case '1':
+        case '2':
+                a[3] = d[5];
+                memcpy(&a[8],&d[2],3);
+                break;
+        case '3':
+                memcpy(&a[3],&d[2],1);
+                memcpy(&a[9],&d[3],2);
+                break;
+        case '4':
+                memcpy(&a[3],&d[2],2);
+                a[10] = d[4];
+                break;
+        default:
+                memcpy(&a[3],&d[2],3);
+                a[10] = d[5];
+                break;
+        }
+
+        check = ean_check_digit(a,11);
+        if (len==8 && data[7]!='0'+check)
+                return APS_NOT_IMPLEMENTED;
+
+        parity = upce_parity[check];
+        if (ns==1)
+                parity ^= 0x3f;
+
+        add_bits(e,0x5,3);                              /*start guard*/
+
+        for (i = 0; i<6; i++) {
+                if ((parity>>(5-i))&1)
+                        add_bits(e,ean_g[d[i]-'0'],7);
+                else
+                        add_bits(e,ean_l[d[i]-'0'],7);
+        }
+
+        add_bits(e,0x15,6);                             /*end guard*/
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  set_dots
+Purpose   :  Set black dots in dotline
+Inputs    :  buf   : dotline buffer
+             x     : first dot
+             n     : number of dots
+Outputs   :  Updates dotline buffer
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void set_dots(unsigned char *buf,int x,int n)
+{
+        while (n--) {
+                buf[x/8] |= 0x80>>(x%8);
+                x++;
+        }
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  barcode_default_opt
+Purpose   :  Set barcode parameters to default values
+Inputs    :  opt : barcode parameters
+Outputs   :  Fills barcode parameters
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void barcode_default_opt(barcode_opt_t *opt)
+{
+        opt->height = -1;
+        opt->module = -1;
+        opt->ecc = -1;
+        opt->cols = -1;
+        opt->version = 0;
+        opt->mode = -1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  barcode_raster_1d
+Purpose   :  Rasterize 1D barcode
+Inputs    :  symbology : barcode symbology
+             data      : barcode data
+             len       : data length
+             opt       : barcode parameters
+Outputs   :  bmp       : barcode bitmap (free with barcode_bitmap_free)
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int barcode_raster_1d(int symbology,const char *data,int len,
+                      const barcode_opt_t *opt,barcode_bitmap_t *bmp)
+{
+        elements_t *e;
+        int module;
+        int height;
+        int errnum;
+        int x;
+        int i;
+
+        memset(bmp,0,sizeof(barcode_bitmap_t));
+
+        module = opt->module>0 ? opt->module : BARCODE_MODULE;
+        height = opt->height>0 ? opt->height : BARCODE_HEIGHT;
+
+        e = calloc(1,sizeof(elements_t));
+        if (e==NULL)
+                return APS_NO_MEMORY;
+
+        add_element(e,0,QUIET_ZONE);
+
+        switch (symbology) {
+        case BARCODE_UPCA:
+        case BARCODE_EAN13:
+        case BARCODE_EAN8:
+                errnum = encode_ean(symbology,data,len,e);
+                break;
+        case BARCODE_UPCE:
+                errnum = encode_upce(data,len,e);
+                break;
+        case BARCODE_CODABAR:
+                errnum = encode_codabar(data,len,e);
+                break;
+        case BARCODE_CODE39:
+                errnum = encode_code39(data,len,e);
+                break;
+        case BARCODE_ITF:
+                errnum = encode_itf(data,len,e);
+                break;
+        default:
+                errnum = APS_NOT_IMPLEMENTED;
+                break;
+        }
+
+        add_element(e,0,QUIET_ZONE);
+
+        if (errnum!=APS_OK || e->n>=ELEMENTS_MAX) {
+                free(e);
+                return APS_NOT_IMPLEMENTED;
+        }
+
+        for (x = 0, i = 0; i<e->n; i++)
+                x += e->w[i]*module;
+
+        bmp->width = (x+7)/8;
+        bmp->height = height;
+        bmp->buf = calloc(bmp->width,height);
+        if (bmp->buf==NULL) {
+                free(e);
+                return APS_NO_MEMORY;
+        }
+
+        /*draw first dotline then copy it*/
+        for (x = 0, i = 0; i<e->n; i++) {
+                if (i%2==0)
+                        set_dots(bmp->buf,x,e->w[i]*module);
+                x += e->w[i]*module;
+        }
+
+        for (i = 1; i<height; i++)
+                memcpy(bmp->buf+i*bmp->width,bmp->buf,bmp->width);
+
+        free(e);
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  barcode_raster_qrcode
+Purpose   :  Rasterize QR code from its module bitmap
+Inputs    :  modules : module bitmap, 1 bit per module, MSB first,
+                       (width+7)/8 bytes per row
+             width   : number of modules per row
+             scale   : dots per module
+Outputs   :  bmp     : barcode bitmap (free with barcode_bitmap_free)
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int barcode_raster_qrcode(const unsigned char *modules,int width,int scale,
+                          barcode_bitmap_t *bmp)
+{
+        int errnum;
+
+        memset(bmp,0,sizeof(barcode_bitmap_t));
+
+        bmp->width = (width*scale+7)/8;
+        bmp->height = width*scale;
+        bmp->buf = malloc(bmp->width*bmp->height);
+        if (bmp->buf==NULL)
+                return APS_NO_MEMORY;
+
+        errnum = cmd_scale_bitmap(modules,width,width,scale,bmp->buf);
+        if (errnum!=APS_OK)
+                barcode_bitmap_free(bmp);
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  barcode_bitmap_free
+Purpose   :  Free barcode bitmap
+Inputs    :  bmp : barcode bitmap
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void barcode_bitmap_free(barcode_bitmap_t *bmp)
+{
+        free(bmp->buf);
+        bmp->buf = NULL;
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : barcode.h
+* DESCRIPTION   : Host rasterization of barcodes
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _BARCODE_H
+#define _BARCODE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*barcode parameters, -1 selects the default value*/
+typedef struct {
+        int     height;                 /*1D barcode height in dotlines*/
+        int     module;                 /*module width in dots*/
+        int     ecc;                    /*PDF417 error level, QR level*/
+        int     cols;                   /*PDF417 data columns*/
+        int     version;                /*QR version (0 for automatic)*/
+        int     mode;                   /*QR encoding mode*/
+} barcode_opt_t;
+
+/*rasterized barcode, 1 bit per dot, MSB first*/
+typedef struct {
+        unsigned char   *buf;
+        int             width;          /*bytes per dotline*/
+        int             height;         /*dotlines*/
+} barcode_bitmap_t;
+
+#define BARCODE_HEIGHT  80              /*dotlines*/
+#define BARCODE_MODULE  2               /*dots*/
+#define BARCODE_PDF417_ECC      5
+#define BARCODE_PDF417_COLS     10
+
+void    barcode_default_opt(barcode_opt_t *opt);
+
+int     barcode_raster_1d(int symbology,const char *data,int len,
+                          const barcode_opt_t *opt,barcode_bitmap_t *bmp);
+int     barcode_raster_qrcode(const unsigned char *modules,int width,int scale,
+                              barcode_bitmap_t *bmp);
+void    barcode_bitmap_free(barcode_bitmap_t *bmp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_BARCODE_H*/
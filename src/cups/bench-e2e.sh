@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# End-to-end benchmark of the CUPS filters and backend
+#
+# Prints the receipt corpus written by "filterbench -w" through
+# filter | aps backend into apsemu, a software printer listening on a
+# local TCP port. Results are printed in Go benchmark format.
+#
+# Environment:
+#   BENCH_RUNS  number of jobs per benchmark (default 5)
+#   BENCH_PORT  apsemu TCP port (default 19100)
+#   BENCH_SPEED emulated paper speed in mm/s (default 100000, i.e. unlimited)
+#   PPD         printer PPD file (default ../drv/ppd/cp324hrs.ppd)
+
+RUNS=${BENCH_RUNS:-5}
+PORT=${BENCH_PORT:-19100}
+SPEED=${BENCH_SPEED:-100000}
+
+PPD=${PPD:-../drv/ppd/cp324hrs.ppd}
+DEVICE_URI="aps:localhost?type=ethernet+port=$PORT"
+export PPD DEVICE_URI
+
+DIR=`mktemp -d /tmp/bench-e2e.XXXXXX` || exit 1
+
+../aps/apsemu -P -p $PORT -s $SPEED -t hrs >/dev/null &
+EMU=$!
+
+trap 'kill $EMU 2>/dev/null; rm -rf $DIR' 0 1 2 15
+
+./filterbench -w $DIR || exit 1
+sleep 1
+
+# bench name filter copies options file
+bench()
+{
+        name=$1
+        filter=$2
+        copies=$3
+        options=$4
+        file=$5
+
+        bytes=0
+        start=`date +%s%N`
+        i=0
+        while [ $i -lt $RUNS ]; do
+                ./$filter 1 bench bench $copies "$options" $file 2>/dev/null >$DIR/job || exit 1
+                # the filter already made the copies
+                ./aps 1 bench bench 1 "$options" $DIR/job 2>/dev/null || exit 1
+                bytes=$(($bytes+`wc -c <$DIR/job`))
+                i=$(($i+1))
+        done
+        end=`date +%s%N`
+
+        printf "BenchmarkE2E/%s\t%d\t%d ns/op\t%d bytes/op\n" \
+                $name $RUNS $((($end-$start)/$RUNS)) $(($bytes/$RUNS))
+}
+
+bench raster rastertoaps 1 "" $DIR/receipt.ras
+bench raster-3copies rastertoaps 3 "" $DIR/receipt.ras
+bench text texttoaps 1 "font_path=$DIR/bench.aft textcache=False" $DIR/receipt.txt
+bench text-cache texttoaps 1 "font_path=$DIR/bench.aft textcache=True" $DIR/receipt.txt
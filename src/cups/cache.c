@@ -0,0 +1,708 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : cache.c
+* DESCRIPTION   : Cache of encoded command data
+*
+*                 Entries are looked up by an arbitrary binary key and kept
+*                 in memory in LRU order. When a directory is given, entries
+*                 are also stored on disk (one file per key hash) so that
+*                 following jobs of the same queue can reuse them.
+*                 The on-disk store may be bounded in size: file times are
+*                 updated on each hit and least recently used files are
+*                 removed first.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define FNV_OFFSET      0xcbf29ce484222325ULL
+#define FNV_PRIME       0x100000001b3ULL
+
+#define WIDE_PRIME1     0x9e3779b185ebca87ULL
+#define WIDE_PRIME2     0xc2b2ae3d27d4eb4fULL
+#define WIDE_PRIME3     0x165667b19e3779f9ULL
+#define WIDE_STRIPE     32              /*bytes hashed per step*/
+
+#define FILE_MAGIC      0x43535041      /*"APSC"*/
+
+typedef struct entry {
+        uint64_t        hash;
+        struct entry    *next;          /*hash bucket chain*/
+        struct entry    *prev_lru;
+        struct entry    *next_lru;
+        int             keylen;
+        int             size;
+        unsigned char   *key;
+        unsigned char   *data;
+} entry_t;
+
+struct cache {
+        entry_t         **table;
+        unsigned int    mask;
+        entry_t         *head;          /*most recently used*/
+        entry_t         *tail;          /*least recently used*/
+        int             count;
+        long            bytes;
+        int             max_entries;
+        long            max_bytes;
+        char            *dir;
+        long            max_disk;       /*bytes on disk, 0 for no limit*/
+};
+
+typedef struct {
+        uint32_t        magic;
+        uint32_t        keylen;
+        uint32_t        size;
+} file_header_t;
+
+typedef struct {
+        char            name[32];
+        long            size;
+        time_t          mtime;
+} disk_file_t;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  wide_round
+Purpose   :  Mix 64-bit word into hash lane
+Inputs    :  acc : hash lane
+             w   : data word
+Outputs   :  <>
+Return    :  new hash lane
+-----------------------------------------------------------------------------*/
+static uint64_t wide_round(uint64_t acc,uint64_t w)
+{
+        acc += w*WIDE_PRIME2;
+        acc = (acc<<31)|(acc>>33);
+
+        return acc*WIDE_PRIME1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  lru_unlink
+Purpose   :  Remove entry from LRU list
+Inputs    :  c : cache
+             e : entry
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void lru_unlink(cache_t *c,entry_t *e)
+{
+        if (e->prev_lru!=NULL)
+                e->prev_lru->next_lru = e->next_lru;
+        else
+                c->head = e->next_lru;
+
+        if (e->next_lru!=NULL)
+                e->next_lru->prev_lru = e->prev_lru;
+        else
+                c->tail = e->prev_lru;
+
+        e->prev_lru = e->next_lru = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  lru_push
+Purpose   :  Insert entry at the most recently used end of LRU list
+Inputs    :  c : cache
+             e : entry
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void lru_push(cache_t *c,entry_t *e)
+{
+        e->prev_lru = NULL;
+        e->next_lru = c->head;
+
+        if (c->head!=NULL)
+                c->head->prev_lru = e;
+        else
+                c->tail = e;
+
+        c->head = e;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  find_entry
+Purpose   :  Find entry in memory
+Inputs    :  c      : cache
+             hash   : key hash
+             key    : key buffer
+             keylen : key size in bytes
+Outputs   :  <>
+Return    :  entry or NULL if not found
+-----------------------------------------------------------------------------*/
+static entry_t *find_entry(cache_t *c,uint64_t hash,const void *key,int keylen)
+{
+        entry_t *e;
+
+        for (e = c->table[hash & c->mask]; e!=NULL; e = e->next) {
+                if (e->hash==hash && e->keylen==keylen &&
+                    memcmp(e->key,key,keylen)==0)
+                        return e;
+        }
+
+        return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  remove_entry
+Purpose   :  Remove entry from memory and free it
+Inputs    :  c : cache
+             e : entry
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void remove_entry(cache_t *c,entry_t *e)
+{
+        entry_t **pe;
+
+        for (pe = &c->table[e->hash & c->mask]; *pe!=e; pe = &(*pe)->next)
+                ;
+        *pe = e->next;
+
+        lru_unlink(c,e);
+
+        c->count--;
+        c->bytes -= e->keylen + e->size;
+
+        free(e->key);
+        free(e);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  insert_entry
+Purpose   :  Insert entry in memory, evict least recently used entries
+Inputs    :  c      : cache
+             hash   : key hash
+             key    : key buffer
+             keylen : key size in bytes
+             data   : data buffer
+             size   : data size in bytes
+Outputs   :  <>
+Return    :  new entry or NULL if out of memory
+-----------------------------------------------------------------------------*/
+static entry_t *insert_entry(cache_t *c,uint64_t hash,const void *key,int keylen,
+                             const void *data,int size)
+{
+        entry_t *e;
+
+        e = find_entry(c,hash,key,keylen);
+        if (e!=NULL)
+                remove_entry(c,e);
+
+        /*entry larger than the whole cache is not kept*/
+        if (keylen+size>c->max_bytes)
+                return NULL;
+
+        while (c->tail!=NULL &&
+               (c->count>=c->max_entries || c->bytes+keylen+size>c->max_bytes))
+                remove_entry(c,c->tail);
+
+        e = malloc(sizeof(entry_t));
+        if (e==NULL)
+                return NULL;
+
+        /*key and data share the same allocation*/
+        e->key = malloc(keylen+size);
+        if (e->key==NULL) {
+                free(e);
+                return NULL;
+        }
+        e->data = e->key+keylen;
+
+        memcpy(e->key,key,keylen);
+        memcpy(e->data,data,size);
+        e->hash = hash;
+        e->keylen = keylen;
+        e->size = size;
+
+        e->next = c->table[hash & c->mask];
+        c->table[hash & c->mask] = e;
+        lru_push(c,e);
+
+        c->count++;
+        c->bytes += keylen+size;
+
+        return e;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  entry_path
+Purpose   :  Build on-disk file name of entry
+Inputs    :  c    : cache
+             hash : key hash
+             path : output buffer
+             n    : output buffer size
+Outputs   :  path
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void entry_path(cache_t *c,uint64_t hash,char *path,int n)
+{
+        snprintf(path,n,"%s/%016llx",c->dir,(unsigned long long)hash);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  disk_load
+Purpose   :  Load entry from disk into memory
+Inputs    :  c      : cache
+             hash   : key hash
+             key    : key buffer
+             keylen : key size in bytes
+Outputs   :  <>
+Return    :  new entry or NULL if not found
+-----------------------------------------------------------------------------*/
+static entry_t *disk_load(cache_t *c,uint64_t hash,const void *key,int keylen)
+{
+        char path[1024];
+        file_header_t hdr;
+        unsigned char *buf;
+        entry_t *e;
+        FILE *f;
+
+        entry_path(c,hash,path,sizeof(path));
+
+        f = fopen(path,"rb");
+        if (f==NULL)
+                return NULL;
+
+        e = NULL;
+        buf = NULL;
+
+        if (fread(&hdr,sizeof(hdr),1,f)!=1 || hdr.magic!=FILE_MAGIC ||
+            (int)hdr.keylen!=keylen || hdr.size>(uint32_t)c->max_bytes)
+                goto out;
+
+        buf = malloc(hdr.keylen+hdr.size);
+        if (buf==NULL)
+                goto out;
+
+        if (fread(buf,1,hdr.keylen+hdr.size,f)!=hdr.keylen+hdr.size)
+                goto out;
+
+        /*different key with the same hash*/
+        if (memcmp(buf,key,keylen)!=0)
+                goto out;
+
+        e = insert_entry(c,hash,key,keylen,buf+keylen,hdr.size);
+
+        /*file time orders entries for disk_evict*/
+        if (e!=NULL && c->max_disk>0)
+                utime(path,NULL);
+
+out:
+        free(buf);
+        fclose(f);
+
+        return e;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  disk_store
+Purpose   :  Store entry on disk
+             File is written under a temporary name then renamed so that
+             concurrent jobs never read partial entries
+Inputs    :  c : cache
+             e : entry
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void disk_store(cache_t *c,const entry_t *e)
+{
+        char path[1024];
+        char tmp[1024];
+        file_header_t hdr;
+        int fd;
+        int ok;
+
+        entry_path(c,e->hash,path,sizeof(path));
+        snprintf(tmp,sizeof(tmp),"%s/.tmpXXXXXX",c->dir);
+
+        fd = mkstemp(tmp);
+        if (fd<0)
+                return;
+
+        hdr.magic = FILE_MAGIC;
+        hdr.keylen = e->keylen;
+        hdr.size = e->size;
+
+        ok = write(fd,&hdr,sizeof(hdr))==(ssize_t)sizeof(hdr) &&
+             write(fd,e->key,e->keylen+e->size)==(ssize_t)(e->keylen+e->size);
+
+        close(fd);
+
+        if (!ok || rename(tmp,path)<0)
+                unlink(tmp);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  compare_mtime
+Purpose   :  Order on-disk files from least to most recently used
+Inputs    :  a, b : files
+Outputs   :  <>
+Return    :  qsort comparison result
+-----------------------------------------------------------------------------*/
+static int compare_mtime(const void *a,const void *b)
+{
+        time_t ta = ((const disk_file_t *)a)->mtime;
+        time_t tb = ((const disk_file_t *)b)->mtime;
+
+        return ta<tb ? -1 : ta>tb;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  disk_evict
+Purpose   :  Remove least recently used files until on-disk store fits its
+             size limit
+             Files being written (temporary names) are ignored
+Inputs    :  c : cache
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void disk_evict(cache_t *c)
+{
+        char path[1024];
+        disk_file_t *files = NULL;
+        disk_file_t *p;
+        struct dirent *d;
+        struct stat st;
+        long total = 0;
+        int count = 0;
+        int max = 0;
+        int i;
+        DIR *dir;
+
+        dir = opendir(c->dir);
+        if (dir==NULL)
+                return;
+
+        while ((d = readdir(dir))!=NULL) {
+                if (d->d_name[0]=='.' || strlen(d->d_name)>=sizeof(files->name))
+                        continue;
+
+                snprintf(path,sizeof(path),"%s/%s",c->dir,d->d_name);
+                if (stat(path,&st)<0 || !S_ISREG(st.st_mode))
+                        continue;
+
+                if (count==max) {
+                        max = max ? 2*max : 64;
+                        p = realloc(files,max*sizeof(disk_file_t));
+                        if (p==NULL)
+                                break;
+                        files = p;
+                }
+
+                strcpy(files[count].name,d->d_name);
+                files[count].size = st.st_size;
+                files[count].mtime = st.st_mtime;
+                total += st.st_size;
+                count++;
+        }
+
+        closedir(dir);
+
+        if (total>c->max_disk) {
+                qsort(files,count,sizeof(disk_file_t),compare_mtime);
+
+                for (i = 0; i<count && total>c->max_disk; i++) {
+                        snprintf(path,sizeof(path),"%s/%s",c->dir,files[i].name);
+                        if (unlink(path)==0)
+                                total -= files[i].size;
+                }
+        }
+
+        free(files);
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  cache_hash
+Purpose   :  Compute FNV-1a hash of buffer
+Inputs    :  buf  : data buffer
+             size : data size in bytes
+             h    : previous hash value (0 to start a new hash)
+Outputs   :  <>
+Return    :  hash value
+-----------------------------------------------------------------------------*/
+uint64_t cache_hash(const void *buf,int size,uint64_t h)
+{
+        const unsigned char *p = buf;
+
+        if (h==0)
+                h = FNV_OFFSET;
+
+        while (size--) {
+                h ^= *p++;
+                h *= FNV_PRIME;
+        }
+
+        return h;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cache_hash_wide
+Purpose   :  Compute hash of large buffer
+             Four independent lanes take 8 bytes each per step, so hashing
+             runs several times faster than cache_hash; remaining bytes are
+             hashed as in cache_hash
+Inputs    :  buf  : data buffer
+             size : data size in bytes
+             h    : previous hash value (0 to start a new hash)
+Outputs   :  <>
+Return    :  hash value
+-----------------------------------------------------------------------------*/
+uint64_t cache_hash_wide(const void *buf,int size,uint64_t h)
+{
+        const unsigned char *p = buf;
+        uint64_t v[4];
+        uint64_t w;
+        int i;
+
+        if (h==0)
+                h = FNV_OFFSET;
+
+        if (size>=WIDE_STRIPE) {
+                v[0] = h+WIDE_PRIME1+WIDE_PRIME2;
+                v[1] = h+WIDE_PRIME2;
+                v[2] = h;
+                v[3] = h-WIDE_PRIME1;
+
+                for (; size>=WIDE_STRIPE; size -= WIDE_STRIPE, p += WIDE_STRIPE) {
+                        for (i = 0; i<4; i++) {
+                                memcpy(&w,p+8*i,8);
+                                v[i] = wide_round(v[i],w);
+                        }
+                }
+
+                for (i = 0; i<4; i++) {
+                        h ^= wide_round(0,v[i]);
+                        h = h*WIDE_PRIME1+WIDE_PRIME3;
+                }
+        }
+
+        return cache_hash(p,size,h);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cache_create
+Purpose   :  Create cache
+Inputs    :  max_entries : maximum number of entries kept in memory
+             max_bytes   : maximum size of entries kept in memory
+             dir         : on-disk store directory (NULL for memory only)
+Outputs   :  <>
+Return    :  cache or NULL if out of memory
+-----------------------------------------------------------------------------*/
+cache_t *cache_create(int max_entries,long max_bytes,const char *dir)
+{
+        cache_t *c;
+        unsigned int n;
+
+        c = calloc(1,sizeof(cache_t));
+        if (c==NULL)
+                return NULL;
+
+        /*hash table size is a power of two, twice the number of entries*/
+        for (n = 16; n<2*(unsigned int)max_entries; n <<= 1)
+                ;
+
+        c->table = calloc(n,sizeof(entry_t *));
+        if (c->table==NULL) {
+                free(c);
+                return NULL;
+        }
+
+        c->mask = n-1;
+        c->max_entries = max_entries;
+        c->max_bytes = max_bytes;
+
+        if (dir!=NULL)
+                c->dir = strdup(dir);
+
+        return c;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cache_free
+Purpose   :  Free cache and all its entries (on-disk entries are kept)
+Inputs    :  c : cache
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void cache_free(cache_t *c)
+{
+        if (c==NULL)
+                return;
+
+        while (c->tail!=NULL)
+                remove_entry(c,c->tail);
+
+        free(c->table);
+        free(c->dir);
+        free(c);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cache_lookup
+Purpose   :  Look up entry, in memory first then on disk
+Inputs    :  c      : cache
+             key    : key buffer
+             keylen : key size in bytes
+Outputs   :  data   : entry data (valid until next cache call)
+             size   : entry data size in bytes
+Return    :  1 if entry was found, 0 otherwise
+-----------------------------------------------------------------------------*/
+int cache_lookup(cache_t *c,const void *key,int keylen,
+                 const unsigned char **data,int *size)
+{
+        uint64_t hash;
+        entry_t *e;
+
+        if (c==NULL)
+                return 0;
+
+        hash = cache_hash(key,keylen,0);
+
+        e = find_entry(c,hash,key,keylen);
+
+        if (e!=NULL) {
+                lru_unlink(c,e);
+                lru_push(c,e);
+        }
+        else if (c->dir!=NULL) {
+                e = disk_load(c,hash,key,keylen);
+        }
+
+        if (e==NULL)
+                return 0;
+
+        *data = e->data;
+        *size = e->size;
+
+        return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cache_store
+Purpose   :  Store entry in memory and on disk
+Inputs    :  c      : cache
+             key    : key buffer
+             keylen : key size in bytes
+             data   : data buffer
+             size   : data size in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void cache_store(cache_t *c,const void *key,int keylen,const void *data,int size)
+{
+        entry_t *e;
+
+        if (c==NULL)
+                return;
+
+        e = insert_entry(c,cache_hash(key,keylen,0),key,keylen,data,size);
+
+        if (e!=NULL && c->dir!=NULL) {
+                disk_store(c,e);
+
+                if (c->max_disk>0)
+                        disk_evict(c);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cache_set_disk_limit
+Purpose   :  Bound size of on-disk store
+             Least recently used files are removed when an entry is stored
+Inputs    :  c         : cache
+             max_bytes : maximum size of on-disk files (0 for no limit)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void cache_set_disk_limit(cache_t *c,long max_bytes)
+{
+        if (c!=NULL)
+                c->max_disk = max_bytes;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cache_queue_dir
+Purpose   :  Build and create on-disk cache directory of current queue
+             (<base>/<queue>/<name>, queue is taken from PRINTER variable)
+Inputs    :  base : base cache directory
+             name : cache name
+Outputs   :  <>
+Return    :  allocated directory path or NULL if it cannot be created
+-----------------------------------------------------------------------------*/
+char *cache_queue_dir(const char *base,const char *name)
+{
+        const char *queue;
+        char *path;
+        char *p;
+        int n;
+
+        queue = getenv("PRINTER");
+        if (queue==NULL || *queue==0 || strchr(queue,'/')!=NULL)
+                return NULL;
+
+        n = strlen(base)+strlen(queue)+strlen(name)+3;
+
+        path = malloc(n);
+        if (path==NULL)
+                return NULL;
+
+        snprintf(path,n,"%s/%s/%s",base,queue,name);
+
+        /*create each missing path component*/
+        for (p = path+1; ; p++) {
+                if (*p=='/' || *p==0) {
+                        char c = *p;
+
+                        *p = 0;
+                        if (mkdir(path,0700)<0 && errno!=EEXIST) {
+                                free(path);
+                                return NULL;
+                        }
+                        *p = c;
+
+                        if (c==0)
+                                break;
+                }
+        }
+
+        return path;
+}
@@ -0,0 +1,59 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : cache.h
+* DESCRIPTION   : Cache of encoded command data (memory LRU + disk store)
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*default base directory of on-disk caches*/
+#define CACHE_DIR       "/var/cache/aps"
+
+typedef struct cache cache_t;
+
+uint64_t cache_hash(const void *buf,int size,uint64_t h);
+uint64_t cache_hash_wide(const void *buf,int size,uint64_t h);
+
+cache_t *cache_create(int max_entries,long max_bytes,const char *dir);
+void    cache_free(cache_t *c);
+
+int     cache_lookup(cache_t *c,const void *key,int keylen,
+                     const unsigned char **data,int *size);
+void    cache_store(cache_t *c,const void *key,int keylen,
+                    const void *data,int size);
+void    cache_set_disk_limit(cache_t *c,long max_bytes);
+
+char    *cache_queue_dir(const char *base,const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_CACHE_H*/
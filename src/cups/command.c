@@ -50,8 +50,78 @@
 #define APS_HARD_RESET          2
 #define APS_ACK_ERROR           3
 
+/*QR code module scaling*/
+#define QR_SCALE                5       /*default dots per module*/
+#define QR_SCALE_MAX            8
+#define QR_DOTS_PER_SCALE       128     /*head width per scale step*/
+
+/*byte expansion tables, one per scale, built on first use*/
+static unsigned char    *scale_lut[QR_SCALE_MAX+1];
+
 /* PRIVATE FUNCTIONS --------------------------------------------------------*/
 
+/*-----------------------------------------------------------------------------
+Name      :  get_scale_lut
+Purpose   :  Get byte expansion table of scale
+             Entry b holds the 'scale' bytes obtained by repeating each bit
+             of b 'scale' times (MSB first)
+Inputs    :  scale : dots per bit (1 to QR_SCALE_MAX)
+Outputs   :  <>
+Return    :  expansion table or NULL if out of memory
+-----------------------------------------------------------------------------*/
+static const unsigned char *get_scale_lut(int scale)
+{
+        unsigned char *lut;
+        int b;
+        int k;
+
+        if (scale_lut[scale]!=NULL)
+                return scale_lut[scale];
+
+        lut = calloc(256,scale);
+        if (lut==NULL)
+                return NULL;
+
+        for (b = 0; b<256; b++) {
+                unsigned char *p = lut+b*scale;
+
+                for (k = 0; k<8*scale; k++)
+                        if (b & (0x80>>(k/scale)))
+                                p[k/8] |= 0x80>>(k%8);
+        }
+
+        scale_lut[scale] = lut;
+
+        return lut;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  qr_pack
+Purpose   :  Pack QR code modules, 1 bit per module, MSB first
+Inputs    :  qr  : QR code (1 byte per module, bit 0 set for black)
+             dst : output bitmap, (width+7)/8 bytes per row
+Outputs   :  Fills output bitmap
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void qr_pack(const QRcode *qr,unsigned char *dst)
+{
+        const unsigned char *src = qr->data;
+        int x;
+        int y;
+
+        for (y = 0; y<qr->width; y++) {
+                unsigned char cb = 0;
+
+                for (x = 0; x<qr->width; x++) {
+                        cb = (cb<<1) | (*src++ & 1);
+                        if (x%8==7)
+                                *dst++ = cb;
+                }
+                if (x%8)
+                        *dst++ = cb<<(8-x%8);
+        }
+}
+
 /* PUBLIC FUNCTIONS ---------------------------------------------------------*/
 
 /*-----------------------------------------------------------------------------
@@ -765,6 +835,171 @@ int cmd_print_dotline(int type,command_t *cmd,int nbytes)
         return errnum;
 }
 
+/*-----------------------------------------------------------------------------
+Name      :  cmd_barcode_native
+Purpose   :  Tell if barcode symbology is printed natively by model type
+             (other symbologies must be rasterized by host)
+Inputs    :  type      : model type
+             symbology : barcode symbology (see barcode_t)
+Outputs   :  <>
+Return    :  1 if symbology is supported by printer, 0 otherwise
+-----------------------------------------------------------------------------*/
+int cmd_barcode_native(int type,int symbology)
+{
+        switch (type) {
+        case APS_MRS:
+                /*QR code module bitmap only (GS k 9)*/
+                return symbology==BARCODE_QRCODE;
+        case APS_HRS:
+                switch (symbology) {
+                case BARCODE_UPCA:
+                case BARCODE_UPCE:
+                case BARCODE_EAN13:
+                case BARCODE_EAN8:
+                case BARCODE_CODE39:
+                case BARCODE_ITF:
+                case BARCODE_CODABAR:
+                case BARCODE_PDF417:
+                case BARCODE_QRCODE:
+                        return 1;
+                default:
+                        return 0;
+                }
+        default:
+                return 0;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cmd_set_barcode_height
+Purpose   :  Build 'set barcode height' command based on model type
+Inputs    :  type : model type
+             cmd  : command structure
+             n    : barcode height (see printer specification)
+Outputs   :  Fills command structure
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int cmd_set_barcode_height(int type,command_t *cmd,int n)
+{
+        aps_error_t errnum = APS_OK;
+
+        memset(cmd,0,sizeof(command_t));
+
+        switch (type) {
+        case APS_MRS:
+        case APS_HRS:
+                cmd->size = 3;
+                cmd->buf[0] = GS;
+                cmd->buf[1] = 'h';
+                cmd->buf[2] = n;
+                break;
+        default:
+                errnum = APS_INVALID_MODEL_TYPE;
+                break;
+        }
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cmd_set_barcode_width
+Purpose   :  Build 'set barcode width' command based on model type
+Inputs    :  type : model type
+             cmd  : command structure
+             n    : barcode module width (see printer specification)
+Outputs   :  Fills command structure
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int cmd_set_barcode_width(int type,command_t *cmd,int n)
+{
+        aps_error_t errnum = APS_OK;
+
+        memset(cmd,0,sizeof(command_t));
+
+        switch (type) {
+        case APS_MRS:
+        case APS_HRS:
+                cmd->size = 3;
+                cmd->buf[0] = GS;
+                cmd->buf[1] = 'w';
+                cmd->buf[2] = n;
+                break;
+        default:
+                errnum = APS_INVALID_MODEL_TYPE;
+                break;
+        }
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cmd_print_barcode
+Purpose   :  Build 'print 1D barcode' command header based on model type
+             Command is followed by barcode data and a NUL terminator
+Inputs    :  type      : model type
+             cmd       : command structure
+             symbology : 1D barcode symbology (see barcode_t)
+             len       : length of barcode data in bytes
+Outputs   :  Fills command structure
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int cmd_print_barcode(int type,command_t *cmd,int symbology,int len)
+{
+        aps_error_t errnum = APS_OK;
+
+        memset(cmd,0,sizeof(command_t));
+
+        if (!cmd_barcode_native(type,symbology) || symbology>BARCODE_CODABAR)
+                return APS_INVALID_MODEL_TYPE;
+
+        if (len<=0 || len>255)
+                return APS_NOT_IMPLEMENTED;
+
+        cmd->size = 3;
+        cmd->buf[0] = GS;
+        cmd->buf[1] = 'k';
+        cmd->buf[2] = symbology;
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cmd_print_pdf417
+Purpose   :  Build 'print PDF417 barcode' command header based on model type
+             Command is followed by barcode data
+Inputs    :  type : model type
+             cmd  : command structure
+             ecc  : error correction level (0 to 8)
+             cols : number of data columns (1 to 30)
+             len  : length of barcode data in bytes
+Outputs   :  Fills command structure
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int cmd_print_pdf417(int type,command_t *cmd,int ecc,int cols,int len)
+{
+        aps_error_t errnum = APS_OK;
+
+        memset(cmd,0,sizeof(command_t));
+
+        if (!cmd_barcode_native(type,BARCODE_PDF417))
+                return APS_INVALID_MODEL_TYPE;
+
+        if (ecc<0 || ecc>8 || cols<1 || cols>30 || len<=0 || len>0xffff)
+                return APS_NOT_IMPLEMENTED;
+
+        cmd->size = 8;
+        cmd->buf[0] = GS;
+        cmd->buf[1] = 'k';
+        cmd->buf[2] = BARCODE_PDF417;
+        cmd->buf[3] = 2;                        /*byte compaction*/
+        cmd->buf[4] = ecc;
+        cmd->buf[5] = cols;
+        cmd->buf[6] = (len>>8)&255;             /*MSB*/
+        cmd->buf[7] = len&255;                  /*LSB*/
+
+        return errnum;
+}
+
 /*-----------------------------------------------------------------------------
 Name      :  cmd_usb_get_status
 Purpose   :  Build 'get status' USB request based on model type
@@ -861,10 +1096,94 @@ int cmd_lpm_calibrate(int type,command_t *cmd)
 
 
 
+/*-----------------------------------------------------------------------------
+Name      :  cmd_qrcode_scale
+Purpose   :  Choose QR code module size from width of model TPH
+Inputs    :  model : model number
+Outputs   :  <>
+Return    :  module size in dots (1 to 8)
+-----------------------------------------------------------------------------*/
+int cmd_qrcode_scale(int model)
+{
+        int width;
+        int scale;
+
+        width = aps_get_model_width(model);
+        if (width<0)
+                return QR_SCALE;
+
+        /*640 dots head gives the historical module size of 5 dots*/
+        scale = width/QR_DOTS_PER_SCALE;
+
+        if (scale<1)
+                scale = 1;
+        if (scale>QR_SCALE_MAX)
+                scale = QR_SCALE_MAX;
+
+        return scale;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  cmd_scale_bitmap
+Purpose   :  Scale up 1 bit per dot bitmap using byte expansion tables
+             Every output byte is written, no clearing is needed
+Inputs    :  src    : source bitmap, (width+7)/8 bytes per row, unused bits
+                      of last byte must be 0
+             width  : source width in dots
+             height : source height in dots
+             scale  : scale factor (1 to 8)
+             dst    : output bitmap, (width*scale+7)/8 bytes per row,
+                      height*scale rows
+Outputs   :  Fills output bitmap
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int cmd_scale_bitmap(const unsigned char *src,int width,int height,int scale,
+                     unsigned char *dst)
+{
+        const unsigned char *lut;
+        int sstride;
+        int dstride;
+        int x;
+        int y;
+        int i;
+
+        if (scale<1 || scale>QR_SCALE_MAX)
+                return APS_NOT_IMPLEMENTED;
+
+        lut = get_scale_lut(scale);
+        if (lut==NULL)
+                return APS_NOT_IMPLEMENTED;
+
+        sstride = (width+7)/8;
+        dstride = (width*scale+7)/8;
+
+        for (y = 0; y<height; y++, src += sstride) {
+                unsigned char *row = dst;
+                int n;
+
+                /*last source byte may expand past the end of row*/
+                for (x = 0; x<sstride; x++) {
+                        n = dstride-x*scale;
+                        if (n>scale)
+                                n = scale;
+                        memcpy(row+x*scale,lut+src[x]*scale,n);
+                }
+                dst += dstride;
+
+                for (i = 1; i<scale; i++, dst += dstride)
+                        memcpy(dst,row,dstride);
+        }
+
+        return APS_OK;
+}
+
 /*!
- *	\fn	int cmd_mrs_qrcode(int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len)
+ *	\fn	static int mrs_qrcode(int head, int scale, int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len)
  *	\brief	formats a qrcode barcode for mrs printers
  *
+ *	\param	head		width of the printer head, in dots
+ *	\param	scale		size of a qr module, in dots (1 to QR_SCALE_MAX);
+ *				reduced if the symbol would be wider than head
  *	\param	version		the version to use for the qr barcode; if 0, then
  *				the minimum suitable version will be selected
  *				automatically
@@ -885,15 +1204,11 @@ int cmd_lpm_calibrate(int type,command_t *cmd)
  *				buffer by using free()
  *	\param	qrbuf_len	the size of the qrbuf above, in bytes
  *	\param	cmd		command to set
- *	\return		APS_OK on success, APS_NOT_IMPLEMENTED on error
+ *	\return		APS_OK on success, APS_INVALID_BITMAP if the symbol does
+ *			not fit the head, APS_NOT_IMPLEMENTED on other errors
  *	*/
-int cmd_mrs_qrcode(int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len, command_t * cmd)
-{
-/*! \todo	make this a configurable parameter */
-enum
+static int mrs_qrcode(int head, int scale, int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len, command_t * cmd)
 {
-	QR_SCALE = 5,
-};
 	aps_error_t errnum = APS_OK;
 	memset(cmd,0,sizeof(command_t));
 
@@ -1001,60 +1316,57 @@ enum
 	* qrbuf_len = 0;
 
 	{
-		int i, j, x, bcnt, len;
-		char * qrbuf;
-		int idx;
+		int x, len, stride;
 		QRcode *qrcode;
-		unsigned char * p, cb;
-		qrbuf = data;
-		idx = strlen(qrbuf);
-#if 1
-		qrcode = QRcode_encodeString(qrbuf, version, level, mode, casesensitivity);
+		unsigned char * p, * modules;
+
+		if (scale < 1 || scale > QR_SCALE_MAX)
+		{
+			return APS_NOT_IMPLEMENTED;
+		}
+
+		qrcode = QRcode_encodeString(data, version, level, mode, casesensitivity);
 		if (!qrcode)
 		{
 			return APS_NOT_IMPLEMENTED;
 		}
 
-		//p = malloc(len = ((qrcode->width + 7) / 8) * 8);
-		len = (qrcode->width * QR_SCALE + 7) / 8;
-		p = malloc(len * qrcode->width * QR_SCALE);
-		memset(p, 0x5a, len * qrcode->width * QR_SCALE);
-		* qr_data_buf = p;
-		* qrbuf_len = len * qrcode->width * QR_SCALE;
+		/* smaller modules if the symbol is wider than the head */
+		if (qrcode->width * scale > head)
+			scale = head / qrcode->width;
+		if (scale < 1)
+		{
+			QRcode_free(qrcode);
+			return APS_INVALID_BITMAP;
+		}
 
-		for (idx = x = i = 0; i < qrcode->width; i ++)
+		/* pack modules then expand them with the lookup table */
+		stride = (qrcode->width + 7) / 8;
+		len = (qrcode->width * scale + 7) / 8;
+		modules = malloc(stride * qrcode->width);
+		p = malloc(len * qrcode->width * scale);
+		if (!modules || !p)
 		{
-			int xx;
-			int ii;
-
-			xx = x;
-			for (ii = 0; ii < QR_SCALE; ii ++)
-			{
-				x = xx;
-				for (bcnt = cb = j = 0; j < qrcode->width; j ++, x ++)
-				{
-					int sc;
-					for (sc = 0; sc < QR_SCALE; sc ++)
-					{
-						cb <<= 1;
-						if (qrcode->data[x] & 1)
-							cb |= 1;
-						if (++ bcnt == 8)
-						{
-							p[idx ++] = cb;
-							cb = 0;
-							bcnt = 0;
-						}
-					}
-				}
-				if (bcnt)
-				{
-					cb <<= 8 - bcnt;
-					p[idx ++] = cb;
-				}
-			}
+			free(modules);
+			free(p);
+			QRcode_free(qrcode);
+			return APS_NOT_IMPLEMENTED;
+		}
+
+		qr_pack(qrcode, modules);
+		errnum = cmd_scale_bitmap(modules, qrcode->width, qrcode->width, scale, p);
+		free(modules);
+
+		if (errnum != APS_OK)
+		{
+			free(p);
+			QRcode_free(qrcode);
+			return errnum;
 		}
 
+		* qr_data_buf = (char *) p;
+		* qrbuf_len = len * qrcode->width * scale;
+
 		cmd->size = 8;
 		cmd->buf[0] = ESC;
 		cmd->buf[1] = '*';
@@ -1062,14 +1374,14 @@ enum
 		cmd->buf[3] = qrbuf_len[0] >> 8;
 		cmd->buf[4] = qrbuf_len[0] >> 16;
 		cmd->buf[5] = 0;
-		x = (640 - len) / 16;
+		x = (head - len) / 16;
+		if (x + len > head / 8)
+			x = (head / 8 - len) / 2;
 		if (x >= 0)
 			cmd->buf[6] = x;
 		else
 			cmd->buf[6] = 0;
 		cmd->buf[7] = len;
-#endif
-		//write_command(0, &cmd, p, idx);
 		QRcode_free(qrcode);
 
 	}
@@ -1077,6 +1389,42 @@ enum
 	return errnum;
 }
 
+/*!
+ *	\fn	int cmd_mrs_qrcode(int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len, command_t * cmd)
+ *	\brief	formats a qrcode barcode for mrs printers, for a 640 dots head
+ *		and a module size of QR_SCALE dots
+ *
+ *	see mrs_qrcode() for parameters
+ *	*/
+int cmd_mrs_qrcode(int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len, command_t * cmd)
+{
+	return mrs_qrcode(640, QR_SCALE, version, level, mode, casesensitivity, data, qr_data_buf, qrbuf_len, cmd);
+}
+
+/*!
+ *	\fn	int cmd_mrs_qrcode_scaled(int model, int scale, int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len, command_t * cmd)
+ *	\brief	formats a qrcode barcode for mrs printers, for the head of a model
+ *
+ *	\param	model		printer model number
+ *	\param	scale		size of a qr module, in dots (1 to 8); if 0, it is
+ *				chosen from the head width (see cmd_qrcode_scale())
+ *
+ *	see mrs_qrcode() for other parameters
+ *	*/
+int cmd_mrs_qrcode_scaled(int model, int scale, int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len, command_t * cmd)
+{
+	int head;
+
+	head = aps_get_model_width(model);
+	if (head < 0)
+		head = 640;
+
+	if (scale <= 0)
+		scale = cmd_qrcode_scale(model);
+
+	return mrs_qrcode(head, scale, version, level, mode, casesensitivity, data, qr_data_buf, qrbuf_len, cmd);
+}
+
 
 /*!
  *	\n	int cmd_mrs_qrcode_bindata(int version, int level, int mode, char * data, int dlen, char ** qr_data_buf, int * qrbuf_len, command_t * cmd, int * qr_width)
@@ -1217,13 +1565,9 @@ int cmd_mrs_qrcode_bindata(int version, int level, int mode, char * data, int dl
 	* qr_width = 0;
 
 	{
-		int i, j, x, bcnt, len;
-		char * qrbuf;
-		int idx;
+		int len;
 		QRcode *qrcode;
-		unsigned char * p, cb;
-		qrbuf = data;
-		idx = strlen(qrbuf);
+		unsigned char * p;
 #if 1
 		stream = QRinput_new();
 		if (!stream)
@@ -1244,33 +1588,17 @@ int cmd_mrs_qrcode_bindata(int version, int level, int mode, char * data, int dl
 		}
 		* qr_width = qrcode->width;
 
-		//p = malloc(len = ((qrcode->width + 7) / 8) * 8);
 		len = (qrcode->width + 7) / 8;
 		p = malloc(len * qrcode->width);
-		memset(p, 0x5a, len * qrcode->width);
-		* qr_data_buf = p;
-		* qrbuf_len = len * qrcode->width;
-
-		for (idx = x = i = 0; i < qrcode->width; i ++)
+		if (!p)
 		{
-			for (bcnt = cb = j = 0; j < qrcode->width; j ++, x ++)
-			{
-				cb <<= 1;
-				if (qrcode->data[x] & 1)
-					cb |= 0x80 >> 7;
-				if (++ bcnt == 8)
-				{
-					p[idx ++] = cb;
-					cb = 0;
-					bcnt = 0;
-				}
-			}
-			if (bcnt)
-			{
-				cb <<= 8 - bcnt;
-				p[idx ++] = cb;
-			}
+			QRcode_free(qrcode);
+			QRinput_free(stream);
+			return APS_NOT_IMPLEMENTED;
 		}
+		qr_pack(qrcode, p);
+		* qr_data_buf = (char *) p;
+		* qrbuf_len = len * qrcode->width;
 
 		cmd->size = 4;
 		cmd->buf[0] = GS;
@@ -71,6 +71,19 @@ typedef enum {
         US      = 31
 } control_code_t;
 
+/*barcode symbologies (values of native 'print barcode' command)*/
+typedef enum {
+        BARCODE_UPCA    = 0,
+        BARCODE_UPCE    = 1,
+        BARCODE_EAN13   = 2,
+        BARCODE_EAN8    = 3,
+        BARCODE_CODE39  = 4,
+        BARCODE_ITF     = 5,
+        BARCODE_CODABAR = 6,
+        BARCODE_PDF417  = 8,
+        BARCODE_QRCODE  = 9
+} barcode_t;
+
 #define CMD_BUFSIZE     8       /*bytes*/
 
 typedef struct {
@@ -108,11 +121,23 @@ int     cmd_print_dotline(int type,command_t *cmd,int nbytes);
 
 int cmd_lpm_calibrate(int type,command_t *cmd);
 
+int     cmd_barcode_native(int type,int symbology);
+int     cmd_set_barcode_height(int type,command_t *cmd,int n);
+int     cmd_set_barcode_width(int type,command_t *cmd,int n);
+int     cmd_print_barcode(int type,command_t *cmd,int symbology,int len);
+int     cmd_print_pdf417(int type,command_t *cmd,int ecc,int cols,int len);
+
 /*USB control requests*/
 int     cmd_usb_get_status(int type,aps_usb_ctrltransfer_t *ctrl);
 int     cmd_usb_hard_reset(int type,aps_usb_ctrltransfer_t *ctrl);
+int     cmd_qrcode_scale(int model);
+int     cmd_scale_bitmap(const unsigned char *src,int width,int height,int scale,
+                         unsigned char *dst);
+
 int cmd_mrs_qrcode(int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len, command_t * cmd);
 
+int cmd_mrs_qrcode_scaled(int model, int scale, int version, int level, int mode, int casesensitivity, char * data, char ** qr_data_buf, int * qrbuf_len, command_t * cmd);
+
 int cmd_mrs_qrcode_bindata(int version, int level, int mode, char * data, int dlen, char ** qr_data_buf, int * qrbuf_len, command_t * cmd, int * qr_width);
 
 #ifdef __cplusplus
@@ -32,6 +32,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "compress.h"
+
 /* PRIVATE DEFINITIONS ------------------------------------------------------*/
 
 /*this is the worst compression factor we can get*/
@@ -41,8 +43,6 @@
 
 /* PRIVATE FUNCTIONS --------------------------------------------------------*/
 
-/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
-
 /*-----------------------------------------------------------------------------
 Name      :  emit_raw
 Purpose   :  Emit raw bytes to compression buffer
@@ -94,6 +94,8 @@ static int emit_compressed(unsigned char *buf,int max,int byte,int count)
         }
 }
 
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
 /*-----------------------------------------------------------------------------
 Name      :  compress_dotline
 Purpose   :  Compress dotline data using HRS/KCP compression algorithm
@@ -102,9 +104,9 @@ Inputs    :  dotline   : dotline buffer
              buf       : compression buffer
              max       : compression buffer size in bytes
 Outputs   :  Fills buf with compressed dotline
-Return    :  Number of compressed bytes
+Return    :  Number of compressed bytes or -1 if buffer is too small
 -----------------------------------------------------------------------------*/
-static int compress_dotline(unsigned char *dotline,int num_bytes,unsigned char *buf,int max)
+int compress_dotline(const unsigned char *dotline,int num_bytes,unsigned char *buf,int max)
 {
         int i;
         int size;
@@ -122,7 +124,8 @@ static int compress_dotline(unsigned char *dotline,int num_bytes,unsigned char *
                 repbyte = dotline[i];
                 repcount = 1;
 
-                while (repcount<256 && i+repcount<num_bytes) {
+                /*count byte holds 255 repetitions, 0 marks raw bytes*/
+                while (repcount<255 && i+repcount<num_bytes) {
                         if (repbyte==dotline[i+repcount]) {
                                 repcount++;
                         }
@@ -153,6 +156,19 @@ static int compress_dotline(unsigned char *dotline,int num_bytes,unsigned char *
                 else {
                         int n;
 
+                        /*raw bytes come first*/
+                        if (rawsize!=0) {
+                                if ((n=emit_raw(buf,max,rawbuf,rawsize))<0) {
+                                        return -1;
+                                }
+
+                                size += n;
+                                buf += n;
+                                max -= n;
+
+                                rawsize = 0;
+                        }
+
                         if ((n=emit_compressed(buf,max,repbyte,repcount))<0) {
                                 return -1;
                         }
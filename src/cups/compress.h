@@ -35,6 +35,13 @@
 extern "C" {
 #endif
 
+/*size of compression buffer that always holds a compressed dotline*/
+/*(worst compression factor is below 2)*/
+#define COMPRESS_BUFSIZE(n)     (2*(n)+2)
+
+int     compress_dotline(const unsigned char *dotline,int num_bytes,
+                         unsigned char *buf,int max);
+
 #ifdef __cplusplus
 }
 #endif
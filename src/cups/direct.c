@@ -0,0 +1,275 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : direct.c
+* DESCRIPTION   : Direct printing, filter and port in one process
+*
+*                 The raster_job and text_job encoders write to stdout;
+*                 here the ticket output is set to a stream whose writes go
+*                 to the printer port buffer, so commands are sent without a
+*                 pipe, without block headers and without a backend.
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <aps/aps.h>
+
+#include "command.h"
+#include "options.h"
+#include "barcode.h"
+#include "ticket.h"
+#include "rasterjob.h"
+#include "textjob.h"
+#include "direct.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define DIRECT_BUFSIZE  16384   /*bytes gathered before a port write*/
+
+static void *           port = NULL;
+static FILE *           port_file = NULL;       /*ticket output while printing*/
+static FILE *           saved_output = NULL;
+static int              port_errnum;            /*first write error*/
+
+static unsigned char    port_buf[DIRECT_BUFSIZE];
+static int              port_len;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  port_flush
+Purpose   :  Write gathered commands to printer port
+Inputs    :  <>
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int port_flush(void)
+{
+        int errnum;
+
+        if (port_len>0 && port_errnum==APS_OK) {
+                if ((errnum = aps_write(port,port_buf,port_len))<0)
+                        port_errnum = errnum;
+        }
+        port_len = 0;
+
+        return port_errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  port_write
+Purpose   :  Stream write function, commands are copied in port buffer
+             The stream is unbuffered so the encoders write straight here
+Inputs    :  cookie : unused
+             buf    : command bytes
+             size   : number of bytes
+Outputs   :  <>
+Return    :  number of bytes written or -1 on error
+-----------------------------------------------------------------------------*/
+static ssize_t port_write(void *cookie,const char *buf,size_t size)
+{
+        size_t n;
+        size_t done = 0;
+
+        (void)cookie;
+
+        while (done<size) {
+                if (port_len==DIRECT_BUFSIZE && port_flush()<0)
+                        return -1;
+
+                n = size-done;
+                if (n>(size_t)(DIRECT_BUFSIZE-port_len))
+                        n = DIRECT_BUFSIZE-port_len;
+
+                memcpy(port_buf+port_len,buf+done,n);
+                port_len += n;
+                done += n;
+        }
+
+        return port_errnum==APS_OK ? (ssize_t)size : -1;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  direct_open
+Purpose   :  Open printer port and redirect ticket output to it
+             Options must have been read (get_options) for port settings
+Inputs    :  uri : printer URI
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int direct_open(const char *uri)
+{
+        cookie_io_functions_t io;
+        int errnum;
+        int type;
+
+        port = aps_create_port(uri);
+        if (port==NULL)
+                return APS_INVALID_URI;
+
+        if ((errnum = aps_get_error(port))<0 ||
+            (errnum = aps_open(port))<0) {
+                aps_destroy_port(port);
+                port = NULL;
+                return errnum;
+        }
+
+        /*port settings, printer is expected to match them*/
+        type = aps_get_port_type(port);
+        errnum = APS_OK;
+
+        if (type==APS_SERIAL) {
+                if (prbaudrate!=-1 && errnum==APS_OK)
+                        errnum = aps_serial_set_baudrate(port,prbaudrate);
+                if (prhandshake!=-1 && errnum==APS_OK)
+                        errnum = aps_serial_set_handshake(port,prhandshake);
+        }
+        else if (type==APS_PARALLEL) {
+                if (parmode!=-1)
+                        errnum = aps_parallel_set_mode(port,parmode);
+        }
+
+        if (errnum==APS_OK && prtimeout!=-1)
+                errnum = aps_set_write_timeout(port,prtimeout);
+
+        memset(&io,0,sizeof(io));
+        io.write = port_write;
+
+        if (errnum==APS_OK) {
+                port_file = fopencookie(NULL,"w",io);
+                if (port_file==NULL)
+                        errnum = APS_OPEN_FAILED;
+        }
+
+        if (errnum<0) {
+                aps_close(port);
+                aps_destroy_port(port);
+                port = NULL;
+                return errnum;
+        }
+
+        setvbuf(port_file,NULL,_IONBF,0);
+
+        port_len = 0;
+        port_errnum = APS_OK;
+
+        saved_output = set_ticket_output(port_file);
+
+        enter_direct_mode(1);
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  direct_close
+Purpose   :  Send remaining commands, wait until they are sent, close port
+             and restore ticket output
+Inputs    :  <>
+Outputs   :  <>
+Return    :  APS_OK or error code (first error of the job)
+-----------------------------------------------------------------------------*/
+int direct_close(void)
+{
+        int errnum;
+
+        if (port==NULL)
+                return APS_PORT_NOT_OPEN;
+
+        enter_direct_mode(0);
+
+        set_ticket_output(saved_output);
+        fclose(port_file);
+        port_file = NULL;
+
+        errnum = port_flush();
+        if (errnum==APS_OK)
+                errnum = aps_sync(port);
+
+        aps_close(port);
+        aps_destroy_port(port);
+        port = NULL;
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  direct_print
+Purpose   :  Encode a job and send it to the printer in this process
+             Options are read as by the filters: PPD file named by the PPD
+             environment variable, overridden by the options string
+             Errors are returned, the port is closed and the job state is
+             released in every case, so jobs may follow in the same process
+             (one at a time, the encoders keep global state)
+Inputs    :  uri     : printer URI
+             format  : input format (direct_format_t)
+             file    : input file, NULL for stdin
+             copies  : number of copies
+             options : job options ("name=value ..."), may be empty
+Outputs   :  <>
+Return    :  APS_OK or error code (job error first, then port error)
+-----------------------------------------------------------------------------*/
+int direct_print(const char *uri,int format,const char *file,int copies,
+                 const char *options)
+{
+        int fd;
+        int res;
+        int errnum;
+
+        /*port settings come from the printer options*/
+        if ((errnum = read_options(options))<0)
+                return errnum;
+
+        if ((errnum = direct_open(uri))<0) {
+                free_options();
+                return errnum;
+        }
+
+        if (file==NULL)
+                fd = 0; /*stdin*/
+        else if ((fd = open(file,O_RDONLY))==-1) {
+                direct_close();
+                free_options();
+                return APS_OPEN_FAILED;
+        }
+
+        if (format==DIRECT_TEXT)
+                res = text_job(fd,copies);
+        else
+                res = raster_job(fd,copies);
+
+        if (fd!=0)
+                close(fd);
+
+        errnum = direct_close();
+        if (res<0)
+                errnum = res;
+
+        free_options();
+
+        return errnum;
+}
@@ -0,0 +1,50 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : direct.h
+* DESCRIPTION   : Direct printing, filter and port in one process
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _DIRECT_H
+#define _DIRECT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*input formats*/
+typedef enum {
+        DIRECT_RASTER   = 0,    /*CUPS raster, see raster_job*/
+        DIRECT_TEXT     = 1     /*text, see text_job*/
+} direct_format_t;
+
+int     direct_open(const char *uri);
+int     direct_close(void);
+
+int     direct_print(const char *uri,int format,const char *file,int copies,
+                     const char *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_DIRECT_H*/
@@ -0,0 +1,166 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : encstats.c
+* DESCRIPTION   : Filter encoding statistics
+*
+*                 Filters count what the dotline optimizations (blank
+*                 collapsing, leading/trailing blank trimming, dotline shift)
+*                 bought on each page. Page and job totals are written to
+*                 stderr as DEBUG: lines, job totals also as ATTR: lines.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "encstats.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+static encstats_t       job_stats;      /*totals of finished pages*/
+static double           page_start;     /*CPU time at start of page*/
+
+/* PUBLIC DEFINITIONS -------------------------------------------------------*/
+
+encstats_t      enc_stats;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  cpu_clock
+Purpose   :  Get CPU time used by process
+Inputs    :  <>
+Outputs   :  <>
+Return    :  CPU time in milliseconds
+-----------------------------------------------------------------------------*/
+static double cpu_clock(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+
+        return ts.tv_sec*1000.0+ts.tv_nsec/1000000.0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  add_stats
+Purpose   :  Add counters
+Inputs    :  to   : counters updated
+             from : counters added
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void add_stats(encstats_t *to,const encstats_t *from)
+{
+        to->dotlines += from->dotlines;
+        to->blank += from->blank;
+        to->trimmed += from->trimmed;
+        to->shifts += from->shifts;
+        to->saved += from->saved;
+        to->cached += from->cached;
+        to->bytes += from->bytes;
+        to->cpu_ms += from->cpu_ms;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  print_stats
+Purpose   :  Write counters to stderr as DEBUG: line
+Inputs    :  what : "page N" or "job"
+             s    : counters
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void print_stats(const char *what,const encstats_t *s)
+{
+        fprintf(stderr,"DEBUG: APS %s: %ld dotlines, %ld blank, %ld bytes trimmed, "
+                       "%ld shifts, %ld bytes saved, %ld cached lines, "
+                       "%ld bytes written, cpu %.1f ms\n",
+                       what,s->dotlines,s->blank,s->trimmed,
+                       s->shifts,s->saved,s->cached,
+                       s->bytes,s->cpu_ms);
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  encstats_page_begin
+Purpose   :  Start page counters
+             Commands written between pages (prolog, epilog) are counted in
+             the job totals only
+Inputs    :  <>
+Outputs   :  Updates global enc_stats
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void encstats_page_begin(void)
+{
+        add_stats(&job_stats,&enc_stats);
+        memset(&enc_stats,0,sizeof(enc_stats));
+
+        page_start = cpu_clock();
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encstats_page_end
+Purpose   :  Report page counters and add them to job totals
+Inputs    :  page : page number
+Outputs   :  Updates global enc_stats
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void encstats_page_end(int page)
+{
+        char what[32];
+
+        enc_stats.cpu_ms = cpu_clock()-page_start;
+
+        snprintf(what,sizeof(what),"page %d",page);
+        print_stats(what,&enc_stats);
+
+        add_stats(&job_stats,&enc_stats);
+        memset(&enc_stats,0,sizeof(enc_stats));
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encstats_job_end
+Purpose   :  Report job totals as DEBUG: and ATTR: lines
+             CPU time of the job is the CPU time of the whole filter process
+Inputs    :  filter : filter name, prefix of attribute names
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void encstats_job_end(const char *filter)
+{
+        add_stats(&job_stats,&enc_stats);
+        memset(&enc_stats,0,sizeof(enc_stats));
+
+        job_stats.cpu_ms = cpu_clock();
+
+        print_stats("job",&job_stats);
+
+        fprintf(stderr,"ATTR: %s-dotlines=%ld %s-blank-dotlines=%ld "
+                       "%s-bytes-trimmed=%ld %s-shifts=%ld %s-bytes-saved=%ld "
+                       "%s-cached-lines=%ld %s-bytes=%ld %s-cpu-ms=%.0f\n",
+                       filter,job_stats.dotlines,filter,job_stats.blank,
+                       filter,job_stats.trimmed,filter,job_stats.shifts,
+                       filter,job_stats.saved,filter,job_stats.cached,
+                       filter,job_stats.bytes,filter,job_stats.cpu_ms);
+}
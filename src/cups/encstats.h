@@ -0,0 +1,55 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : encstats.h
+* DESCRIPTION   : Filter encoding statistics
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _ENCSTATS_H
+#define _ENCSTATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+        long    dotlines;       /*dotlines encoded*/
+        long    blank;          /*blank dotlines*/
+        long    trimmed;        /*bytes removed by leading/trailing blank trimming*/
+        long    shifts;         /*shift commands issued*/
+        long    saved;          /*bytes saved by blank dotline collapsing*/
+        long    cached;         /*text lines or dotlines replayed from cache*/
+        long    bytes;          /*command bytes written*/
+        double  cpu_ms;         /*CPU time in milliseconds*/
+} encstats_t;
+
+extern encstats_t       enc_stats;      /*counters of current page*/
+
+void    encstats_page_begin(void);
+void    encstats_page_end(int page);
+void    encstats_job_end(const char *filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_ENCSTATS_H*/
@@ -0,0 +1,831 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : filterbench.c
+* DESCRIPTION   : CUPS filters microbenchmarks
+*                 Results are printed one per line in Go benchmark format:
+*                 Benchmark<name> <iterations> <ns/op> <bytes/op> <syscalls/op>
+*
+*                 The corpus (receipt rasters, receipt text and a test font)
+*                 is generated from a fixed seed, so runs are comparable.
+*                 Real CUPS raster files can be added with BENCH_CORPUS.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+
+#include <cups/cups.h>
+#include <cups/raster.h>
+
+#include <aps/aps.h>
+#include <aps/aps_fnt.h>
+
+#include "command.h"
+#include "barcode.h"
+#include "compress.h"
+#include "options.h"
+#include "rasterjob.h"
+#include "ticket.h"
+#include "text.h"
+#include "utf8.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define BENCH_DEFTIME   1.0     /*seconds per benchmark*/
+#define BENCH_MAXITER   1000000000L
+#define BENCH_SEED      12345
+
+#define CORPUS_WIDTH    72      /*bytes, 576 dots*/
+#define CORPUS_HEIGHT   1200    /*dotlines*/
+#define CORPUS_LINES    60      /*receipt text lines*/
+
+#define FONT_WIDTH      12
+#define FONT_HEIGHT     24
+
+typedef void (*bench_fn_t)(long n);
+
+/*test font file header, see aps_fnt.c*/
+#pragma pack(4)
+typedef struct {
+        char    header[16];
+        int32_t version;
+        char    name[FNT_NAME_SIZE+1];
+        int32_t nbrcar;
+        int32_t width;
+        int32_t height;
+        int32_t downstroke;
+        int32_t compression;
+} font_header_t;
+#pragma pack()
+
+static double           bench_time;
+static const char *     bench_filter;
+
+static FILE *           results;        /*real standard output*/
+static FILE *           quiet;          /*job messages, not printed*/
+static long             bench_bytes;    /*bytes produced by benchmark*/
+static long             bench_syscalls; /*read/write issued by driver code*/
+
+static uint32_t         seed;
+
+/*benchmark parameters*/
+static int              cur_fd;
+static unsigned char *  cur_dotlines;
+static int              cur_ndotlines;
+static const char *     cur_text;
+static int              cur_textlen;
+static void *           cur_fnt;
+static const char *     cur_qrdata;
+
+static char             corpus_dir[256];
+static char             font_file[300];
+
+/*system calls are counted by linking with -Wl,--wrap=read,--wrap=write*/
+ssize_t __real_read(int fd,void *buf,size_t count);
+ssize_t __real_write(int fd,const void *buf,size_t count);
+ssize_t __wrap_read(int fd,void *buf,size_t count);
+ssize_t __wrap_write(int fd,const void *buf,size_t count);
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  now
+Purpose   :  Get monotonic time
+Inputs    :  <>
+Outputs   :  <>
+Return    :  time in seconds
+-----------------------------------------------------------------------------*/
+static double now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+
+        return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  rnd
+Purpose   :  Deterministic pseudo-random generator (same corpus everywhere)
+Inputs    :  <>
+Outputs   :  <>
+Return    :  pseudo-random number (0 to 32767)
+-----------------------------------------------------------------------------*/
+static int rnd(void)
+{
+        seed = seed*1103515245+12345;
+
+        return (seed>>16)&0x7fff;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  sink_write
+Purpose   :  Standard output sink, counts flushes as write system calls
+Inputs    :  cookie : <>
+             buf    : data
+             size   : data size in bytes
+Outputs   :  <>
+Return    :  size
+-----------------------------------------------------------------------------*/
+static ssize_t sink_write(void *cookie,const char *buf,size_t size)
+{
+        (void)cookie;
+        (void)buf;
+
+        bench_bytes += size;
+        bench_syscalls++;
+
+        return size;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  run_bench
+Purpose   :  Run benchmark for at least bench_time seconds and print result
+Inputs    :  name : benchmark name
+             fn   : benchmark function, runs n operations
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void run_bench(const char *name,bench_fn_t fn)
+{
+        double elapsed;
+        long n = 1;
+
+        if (bench_filter!=NULL && strstr(name,bench_filter)==NULL)
+                return;
+
+        for (;;) {
+                double t;
+                long next;
+
+                fflush(stdout);
+                bench_bytes = 0;
+                bench_syscalls = 0;
+
+                t = now();
+                fn(n);
+                fflush(stdout);
+                elapsed = now()-t;
+
+                if (elapsed>=bench_time || n>=BENCH_MAXITER)
+                        break;
+
+                /*predict iterations needed, grow at most 100 times*/
+                next = elapsed>0 ? n*1.2*bench_time/elapsed : n*100;
+                if (next>n*100)
+                        next = n*100;
+                if (next<=n)
+                        next = n+1;
+                n = next;
+        }
+
+        fprintf(results,"Benchmark%s\t%ld\t%.1f ns/op\t%.1f bytes/op\t%.2f syscalls/op\n",
+                        name,n,
+                        elapsed*1e9/n,
+                        (double)bench_bytes/n,
+                        (double)bench_syscalls/n);
+        fflush(results);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  make_dotlines
+Purpose   :  Generate synthetic raster
+Inputs    :  kind : "blank", "black", "noise" or "receipt"
+Outputs   :  <>
+Return    :  dotlines, CORPUS_WIDTH bytes each, CORPUS_HEIGHT dotlines
+-----------------------------------------------------------------------------*/
+static unsigned char *make_dotlines(const char *kind)
+{
+        unsigned char *buf;
+        int len = 0;
+        int x;
+        int y;
+
+        buf = calloc(CORPUS_WIDTH,CORPUS_HEIGHT);
+        if (buf==NULL) {
+                error("Cannot allocate corpus");
+        }
+
+        seed = BENCH_SEED;
+
+        for (y = 0; y<CORPUS_HEIGHT; y++) {
+                unsigned char *row = buf+y*CORPUS_WIDTH;
+
+                if (strcmp(kind,"black")==0) {
+                        memset(row,0xff,CORPUS_WIDTH);
+                }
+                else if (strcmp(kind,"noise")==0) {
+                        for (x = 0; x<CORPUS_WIDTH; x++)
+                                row[x] = rnd();
+                }
+                else if (strcmp(kind,"receipt")==0) {
+                        /*logo, text lines with leading margin, barcode*/
+                        if (y<120) {
+                                for (x = 16; x<56; x++)
+                                        row[x] = (x+y/8)%3 ? 0xff : 0x0f;
+                        }
+                        else if (y>=1000 && y<1080) {
+                                for (x = 8; x<64; x++)
+                                        row[x] = (x*37)%7<3 ? 0xe7 : 0x18;
+                        }
+                        else if (y%36<FONT_HEIGHT) {
+                                if (y%36==0)
+                                        len = 12+rnd()%44;
+                                for (x = 2; x<2+len; x++)
+                                        row[x] = rnd()%3==0 ? rnd() : 0;
+                        }
+                }
+        }
+
+        return buf;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  make_raster
+Purpose   :  Write dotlines as a one page CUPS raster file
+Inputs    :  dotlines : raster
+             path     : output file, or NULL for an anonymous temporary file
+Outputs   :  <>
+Return    :  file descriptor, positioned at start of file
+-----------------------------------------------------------------------------*/
+static int make_raster(const unsigned char *dotlines,const char *path)
+{
+        cups_page_header_t header;
+        cups_raster_t *ras;
+        FILE *f;
+        int fd;
+        int y;
+
+        f = path!=NULL ? fopen(path,"w+") : tmpfile();
+        if (f==NULL) {
+                error("Cannot create raster file");
+        }
+        fd = dup(fileno(f));
+        fclose(f);
+
+        memset(&header,0,sizeof(header));
+        header.cupsWidth = CORPUS_WIDTH*8;
+        header.cupsHeight = CORPUS_HEIGHT;
+        header.cupsBitsPerColor = 1;
+        header.cupsBitsPerPixel = 1;
+        header.cupsBytesPerLine = CORPUS_WIDTH;
+        header.cupsColorSpace = CUPS_CSPACE_K;
+        header.HWResolution[0] = 203;
+        header.HWResolution[1] = 203;
+
+        ras = cupsRasterOpen(fd,CUPS_RASTER_WRITE);
+        if (ras==NULL || !cupsRasterWriteHeader(ras,&header)) {
+                error("Cannot write raster file");
+        }
+
+        for (y = 0; y<CORPUS_HEIGHT; y++) {
+                cupsRasterWritePixels(ras,(unsigned char *)dotlines+y*CORPUS_WIDTH,CORPUS_WIDTH);
+        }
+
+        cupsRasterClose(ras);
+        lseek(fd,0,SEEK_SET);
+
+        return fd;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  make_text
+Purpose   :  Generate receipt text
+Inputs    :  utf8 : use accented UTF-8 words if true
+Outputs   :  <>
+Return    :  text (NUL terminated)
+-----------------------------------------------------------------------------*/
+static char *make_text(int utf8)
+{
+        static const char *ascii_words[] = {
+                "COFFEE","SANDWICH","WATER","SALAD","TEA","CAKE","JUICE","SOUP"
+        };
+        static const char *utf8_words[] = {
+                "CAF\xc3\x89","CR\xc3\x88ME","GR\xc3\x96SSE","\xc3\x91" "AND\xc3\x9a",
+                "TH\xc3\x89","G\xc3\x82TEAU","JUS","SOUPE"
+        };
+        const char **words = utf8 ? utf8_words : ascii_words;
+        char *text;
+        int len = 0;
+        int i;
+
+        text = malloc(CORPUS_LINES*64);
+        if (text==NULL) {
+                error("Cannot allocate corpus");
+        }
+
+        seed = BENCH_SEED;
+
+        for (i = 0; i<CORPUS_LINES; i++) {
+                int qty = 1+rnd()%9;
+                int price = rnd()%5000;
+
+                len += sprintf(text+len,"%d x %-10s %3d.%02d EUR  #%05d\n",
+                                qty,words[rnd()%8],price/100,price%100,rnd());
+        }
+
+        return text;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  make_font
+Purpose   :  Write test font file (glyphs for 32-126 and 160-255)
+Inputs    :  path : font file
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void make_font(const char *path)
+{
+        font_header_t fh;
+        uint32_t idx;
+        int32_t count = 0;
+        unsigned char glyph[FONT_WIDTH*FONT_HEIGHT];
+        FILE *f;
+        int c;
+        int i;
+
+        f = fopen(path,"w");
+        if (f==NULL) {
+                error("Cannot create font file");
+        }
+
+        memset(&fh,0,sizeof(fh));
+        strcpy(fh.header,"_APS_FONT_TOOL_");
+        strcpy(fh.name,"bench");
+        fh.version = 1;
+        fh.nbrcar = 256;
+        fh.width = FONT_WIDTH;
+        fh.height = FONT_HEIGHT;
+        fwrite(&fh,sizeof(fh),1,f);
+
+        for (c = 0; c<256; c++) {
+                idx = (c>=32 && c<127) || c>=160 ? (uint32_t)count++ : (uint32_t)-1;
+                fwrite(&idx,sizeof(idx),1,f);
+        }
+
+        fwrite(&count,sizeof(count),1,f);
+
+        seed = BENCH_SEED;
+        for (i = 0; i<count; i++) {
+                for (c = 0; c<(int)sizeof(glyph); c++)
+                        glyph[c] = i && rnd()%3==0;     /*space is blank*/
+                fwrite(glyph,sizeof(glyph),1,f);
+        }
+
+        fclose(f);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_raster_job
+Purpose   :  Convert raster file to APS commands, as rastertoaps does
+Inputs    :  n : number of operations (whole file)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_raster_job(long n)
+{
+        FILE *err = stderr;
+        int errnum;
+
+        while (n--) {
+                lseek(cur_fd,0,SEEK_SET);
+
+                /*page accounting and debug lines of every job*/
+                stderr = quiet;
+                errnum = raster_job(cur_fd,1);
+                stderr = err;
+
+                if (errnum<0) {
+                        error(aps_strerror(errnum));
+                }
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_compress_dotline
+Purpose   :  Compress dotline
+Inputs    :  n : number of operations (one dotline)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_compress_dotline(long n)
+{
+        unsigned char buf[2*CORPUS_WIDTH+16];
+        int y = 0;
+
+        while (n--) {
+                int size = compress_dotline(cur_dotlines+y*CORPUS_WIDTH,CORPUS_WIDTH,
+                                            buf,sizeof(buf));
+
+                if (size>0)
+                        bench_bytes += size;
+                if (++y==cur_ndotlines)
+                        y = 0;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_draw_char
+Purpose   :  Draw text character in line buffer
+Inputs    :  n : number of operations (one character)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_draw_char(long n)
+{
+        uint8_t *buf;
+        int pix = 0;
+        int i = 0;
+
+        buf = calloc(CORPUS_WIDTH,FONT_HEIGHT);
+        if (buf==NULL) {
+                error("Cannot allocate line buffer");
+        }
+
+        while (n--) {
+                int c = (unsigned char)cur_text[i];
+
+                /*new line on line feed or when the line buffer is full*/
+                if (c=='\n' || aps_fnt_draw_char(cur_fnt,buf,&pix,CORPUS_WIDTH,c)!=fntERR_OK)
+                        pix = 0;
+                else
+                        pix++;
+
+                if (++i==cur_textlen)
+                        i = 0;
+        }
+
+        free(buf);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_text_putc
+Purpose   :  Render receipt text to APS commands
+Inputs    :  n : number of operations (whole receipt)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_text_putc(long n)
+{
+        int i;
+
+        while (n--) {
+                lseek(cur_fd,0,SEEK_SET);
+                utf8_set_file(cur_fd,1);
+
+                while ((i = utf8_get_code())>=0)
+                        text_putc(i);
+                text_flush();
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_utf8_get_code
+Purpose   :  Decode UTF-8 input
+Inputs    :  n : number of operations (one code point)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_utf8_get_code(long n)
+{
+        lseek(cur_fd,0,SEEK_SET);
+        utf8_set_file(cur_fd,1);
+
+        while (n--) {
+                if (utf8_get_code()<0) {
+                        lseek(cur_fd,0,SEEK_SET);
+                        utf8_set_file(cur_fd,1);
+                        utf8_get_code();
+                }
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_qrcode
+Purpose   :  Encode QR code and write APS commands
+Inputs    :  n : number of operations (one symbol)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_qrcode(long n)
+{
+        command_t cmd;
+        char *buf;
+        int size;
+
+        while (n--) {
+                buf = NULL;
+                if (cmd_mrs_qrcode(0,1,2,1,(char *)cur_qrdata,&buf,&size,&cmd)!=APS_OK) {
+                        error("cmd_mrs_qrcode failed");
+                }
+                write_command(0,&cmd,buf,size);
+                free(buf);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  text_file
+Purpose   :  Store text in anonymous temporary file
+Inputs    :  text : text
+Outputs   :  <>
+Return    :  file descriptor
+-----------------------------------------------------------------------------*/
+static int text_file(const char *text)
+{
+        FILE *f;
+        int fd;
+
+        f = tmpfile();
+        if (f==NULL) {
+                error("Cannot create text file");
+        }
+        fd = dup(fileno(f));
+        fclose(f);
+
+        if (__real_write(fd,text,strlen(text))!=(ssize_t)strlen(text)) {
+                error("Cannot write text file");
+        }
+
+        return fd;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_rasters
+Purpose   :  Run raster benchmarks
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_rasters(void)
+{
+        static const char *kinds[] = {"blank","black","noise","receipt"};
+        const char *dir;
+        char name[300];
+        unsigned int i;
+
+        for (i = 0; i<sizeof(kinds)/sizeof(kinds[0]); i++) {
+                cur_dotlines = make_dotlines(kinds[i]);
+                cur_ndotlines = CORPUS_HEIGHT;
+                cur_fd = make_raster(cur_dotlines,NULL);
+
+                optprint = 0;
+                snprintf(name,sizeof(name),"RasterJob/%s",kinds[i]);
+                run_bench(name,bench_raster_job);
+
+                optprint = 1;
+                snprintf(name,sizeof(name),"RasterJob/%s-optprint",kinds[i]);
+                run_bench(name,bench_raster_job);
+
+                snprintf(name,sizeof(name),"CompressDotline/%s",kinds[i]);
+                run_bench(name,bench_compress_dotline);
+
+                close(cur_fd);
+                free(cur_dotlines);
+        }
+
+        /*real receipts, one benchmark per CUPS raster file*/
+        dir = getenv("BENCH_CORPUS");
+        if (dir!=NULL) {
+                struct dirent *e;
+                DIR *d;
+
+                d = opendir(dir);
+                while (d!=NULL && (e = readdir(d))!=NULL) {
+                        char path[512];
+
+                        if (strstr(e->d_name,".ras")==NULL)
+                                continue;
+
+                        snprintf(path,sizeof(path),"%s/%s",dir,e->d_name);
+                        cur_fd = open(path,O_RDONLY);
+                        if (cur_fd<0)
+                                continue;
+
+                        optprint = 1;
+                        snprintf(name,sizeof(name),"RasterJob/%s",e->d_name);
+                        run_bench(name,bench_raster_job);
+
+                        close(cur_fd);
+                }
+                if (d!=NULL)
+                        closedir(d);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  bench_text
+Purpose   :  Run text benchmarks
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void bench_text(void)
+{
+        static const char *kinds[] = {"ascii","utf8"};
+        char name[64];
+        char *text;
+        int i;
+
+        for (i = 0; i<2; i++) {
+                text = make_text(i);
+                cur_text = text;
+                cur_textlen = strlen(text);
+                cur_fd = text_file(text);
+
+                snprintf(name,sizeof(name),"Utf8GetCode/%s",kinds[i]);
+                run_bench(name,bench_utf8_get_code);
+
+                snprintf(name,sizeof(name),"FntDrawChar/%s",kinds[i]);
+                run_bench(name,bench_draw_char);
+
+                textcache = 0;
+                text_create(1,font_file);
+                snprintf(name,sizeof(name),"TextPutc/%s",kinds[i]);
+                run_bench(name,bench_text_putc);
+                text_free();
+
+                textcache = 1;
+                text_create(1,font_file);
+                snprintf(name,sizeof(name),"TextPutc/%s-cache",kinds[i]);
+                run_bench(name,bench_text_putc);
+                text_free();
+
+                close(cur_fd);
+                free(text);
+        }
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  __wrap_read, __wrap_write
+Purpose   :  Count system calls issued by driver code
+Inputs    :  see read(2), write(2)
+Outputs   :  Updates bench_syscalls
+Return    :  see read(2), write(2)
+-----------------------------------------------------------------------------*/
+ssize_t __wrap_read(int fd,void *buf,size_t count)
+{
+        bench_syscalls++;
+        return __real_read(fd,buf,count);
+}
+
+ssize_t __wrap_write(int fd,const void *buf,size_t count)
+{
+        bench_syscalls++;
+        return __real_write(fd,buf,count);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  main
+Purpose   :  Program main function
+Inputs    :  argc : number of command-line arguments
+             argv : array of command-line arguments
+Outputs   :  <>
+Return    :  0 if success, 1 on error
+-----------------------------------------------------------------------------*/
+int main(int argc,char **argv)
+{
+        cookie_io_functions_t io = {NULL,sink_write,NULL,NULL};
+        const char *s;
+        FILE *sink;
+
+        if (argc==3 && strcmp(argv[1],"-w")==0) {
+                /*write corpus for end-to-end runs*/
+                unsigned char *dotlines;
+                char path[300];
+                char *text;
+                FILE *f;
+
+                snprintf(path,sizeof(path),"%s/receipt.ras",argv[2]);
+                dotlines = make_dotlines("receipt");
+                close(make_raster(dotlines,path));
+                free(dotlines);
+
+                snprintf(path,sizeof(path),"%s/receipt.txt",argv[2]);
+                text = make_text(1);
+                f = fopen(path,"w");
+                if (f==NULL) {
+                        error("Cannot write text corpus");
+                }
+                fputs(text,f);
+                fclose(f);
+                free(text);
+
+                snprintf(path,sizeof(path),"%s/bench.aft",argv[2]);
+                make_font(path);
+
+                return 0;
+        }
+
+        if (argc>2 || (argc==2 && argv[1][0]=='-')) {
+                printf("usage: filterbench [name-filter]\n"
+                       "       filterbench -w dir    (write corpus)\n"
+                       "  BENCH_TIME environment variable sets seconds per benchmark\n"
+                       "  BENCH_CORPUS directory holds extra CUPS raster files (*.ras)\n");
+                return 0;
+        }
+
+        bench_filter = argc==2 ? argv[1] : NULL;
+
+        s = getenv("BENCH_TIME");
+        bench_time = s!=NULL ? atof(s) : BENCH_DEFTIME;
+        if (bench_time<=0)
+                bench_time = BENCH_DEFTIME;
+
+        /*printer configuration of a 576 dots MRS printer*/
+        printer_model = MODEL_CP290MRS;
+        printer_type = APS_MRS;
+        printer_width = CORPUS_WIDTH;
+        optprint = 1;
+        maxlength = 1<<30;
+        maxlengthmm = 0;
+        rmtop = 0;
+        charspacing = -1;
+        linespacing = -1;
+        textcachedisk = 0;
+
+        /*options left to the printer, raster jobs write prolog and epilog*/
+        dynadiv = -1;
+        maxspeed = -1;
+        intensity = -1;
+        font = -1;
+        sparsespeed = -1;
+        sparsedynadiv = -1;
+        sparselimit = -1;
+        finalcut = FINALCUT_NONE;
+
+        /*filters write to stdout, replace it with a counting sink*/
+        results = stdout;
+        sink = fopencookie(NULL,"w",io);
+        if (sink==NULL) {
+                error("Cannot create output sink");
+        }
+        setvbuf(sink,NULL,_IOFBF,BUFSIZ);
+        stdout = sink;
+
+        quiet = fopen("/dev/null","w");
+        if (quiet==NULL) {
+                error("Cannot open /dev/null");
+        }
+
+        /*test font*/
+        snprintf(corpus_dir,sizeof(corpus_dir),"/tmp/filterbench.XXXXXX");
+        if (mkdtemp(corpus_dir)==NULL) {
+                error("Cannot create corpus directory");
+        }
+        snprintf(font_file,sizeof(font_file),"%s/bench.aft",corpus_dir);
+        make_font(font_file);
+
+        cur_fnt = aps_fnt_create(font_file);
+        if (aps_fnt_error(cur_fnt)<0) {
+                error("Cannot load test font");
+        }
+
+        bench_rasters();
+        bench_text();
+
+        cur_qrdata = "https://www.example.com/store/0042";
+        run_bench("MrsQrcode/url",bench_qrcode);
+        cur_qrdata = "RECEIPT 2006-06-08 STORE 0042 TILL 3 TOTAL 123.45 EUR "
+                     "VAT 20.58 EUR CARD ****1234 AUTH 998877 THANK YOU FOR "
+                     "YOUR VISIT - RETURNS WITHIN 30 DAYS WITH THIS RECEIPT";
+        run_bench("MrsQrcode/receipt",bench_qrcode);
+
+        aps_fnt_free(cur_fnt);
+        unlink(font_file);
+        rmdir(corpus_dir);
+
+        stdout = results;
+        fclose(sink);
+        fclose(quiet);
+
+        return 0;
+}
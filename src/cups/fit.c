@@ -0,0 +1,223 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : fit.c
+* DESCRIPTION   : Fitting of raster pages to the printer head width
+*
+*                 Packed dotlines are resampled by area: every source dot
+*                 is counted into the destination dot that covers it (a
+*                 lookup table built per page). On line art a destination
+*                 dot is printed when its area holds at least as many black
+*                 dots as a one dot line crossing it, so rules, hairlines
+*                 and thin strokes are kept at any ratio; on pages
+*                 halftoned by the filter it is printed when at least half
+*                 of its area is black, which keeps their tone. With
+*                 vertical scaling, source dotlines are summed the same way
+*                 into destination dotlines. The result is placed at a dot
+*                 offset on the head, which also centers narrow pages.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "fit.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+static int              src_width;              /*dots*/
+static int              dst_width;              /*dots*/
+static int              offset;                 /*dots left of page*/
+static int              height;                 /*source dotlines in page*/
+static int              vertical;               /*scale dotlines too*/
+static int              row;                    /*source dotlines done*/
+static int              rows;                   /*source dotlines summed*/
+static int              lines;                  /*keep one dot lines*/
+
+static uint16_t         *dst_of = NULL;         /*destination dot of source dot*/
+static uint16_t         *span = NULL;           /*source dots of destination dot*/
+static uint16_t         *count = NULL;          /*black source dots summed*/
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  dst_row
+Purpose   :  Get destination dotline of source dotline
+Inputs    :  y : source dotline
+Outputs   :  <>
+Return    :  destination dotline
+-----------------------------------------------------------------------------*/
+static long dst_row(long y)
+{
+        return vertical ? y*dst_width/src_width : y;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  add_line
+Purpose   :  Count black dots of source dotline
+             Blank bytes are skipped, set bits are found from the left
+Inputs    :  src : packed source dotline
+Outputs   :  Updates global count
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void add_line(const unsigned char *src)
+{
+        int nbytes = (src_width+7)/8;
+        int i;
+
+        for (i = 0; i<nbytes; i++) {
+                unsigned int b = src[i];
+
+                while (b) {
+                        int bit = __builtin_clz(b)-(sizeof(unsigned int)*8-8);
+                        int x = i*8+bit;
+
+                        if (x<src_width)
+                                count[dst_of[x]]++;
+                        b &= ~(0x80u>>bit);
+                }
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_line
+Purpose   :  Build destination dotline from summed dots
+             With lines set, a dot is printed when it holds at least the
+             black dots of a one dot line crossing it (the smaller of its
+             width and height in source dots), otherwise when at least half
+             of its area is black
+Inputs    :  dst : packed destination dotline, cleared by caller
+Outputs   :  Clears global count
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void put_line(unsigned char *dst)
+{
+        int j;
+
+        for (j = 0; j<dst_width; j++) {
+                int min;
+
+                if (lines)
+                        min = span[j]<rows ? span[j] : rows;
+                else
+                        min = (span[j]*rows+1)/2;
+
+                if (count[j] && count[j]>=min) {
+                        int x = offset+j;
+
+                        dst[x/8] |= 0x80>>(x%8);
+                }
+        }
+
+        memset(count,0,dst_width*sizeof(uint16_t));
+        rows = 0;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  fit_start
+Purpose   :  Prepare fitting of a page
+Inputs    :  _src_width : page width in dots
+             _dst_width : scaled width in dots, at most _src_width
+             _offset    : dots left of scaled page on destination dotline
+             _height    : page height in dotlines
+             _vertical  : 1 to scale height by the same ratio
+             _lines     : 1 to keep one dot lines (line art), 0 to keep
+                          tone (halftoned pages)
+Outputs   :  <>
+Return    :  0 if successful, -1 on error
+-----------------------------------------------------------------------------*/
+int fit_start(int _src_width,int _dst_width,int _offset,int _height,int _vertical,
+              int _lines)
+{
+        int x;
+
+        fit_end();
+
+        if (_dst_width<=0 || _dst_width>_src_width || _dst_width>UINT16_MAX)
+                return -1;
+
+        src_width = _src_width;
+        dst_width = _dst_width;
+        offset = _offset;
+        height = _height;
+        vertical = _vertical;
+        lines = _lines;
+        row = 0;
+        rows = 0;
+
+        dst_of = malloc(src_width*sizeof(uint16_t));
+        span = calloc(dst_width,sizeof(uint16_t));
+        count = calloc(dst_width,sizeof(uint16_t));
+        if (dst_of==NULL || span==NULL || count==NULL)
+                return -1;
+
+        for (x = 0; x<src_width; x++) {
+                dst_of[x] = (long)x*dst_width/src_width;
+                span[dst_of[x]]++;
+        }
+
+        return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  fit_line
+Purpose   :  Fit next dotline of page
+             With vertical scaling, a destination dotline is returned once
+             its last source dotline is added
+Inputs    :  src : packed source dotline
+             dst : packed destination dotline, cleared by caller
+Outputs   :  <>
+Return    :  1 if dst holds a dotline, 0 otherwise
+-----------------------------------------------------------------------------*/
+int fit_line(const unsigned char *src,unsigned char *dst)
+{
+        long y = row++;
+
+        add_line(src);
+        rows++;
+
+        if (row<height && dst_row(row)==dst_row(y))
+                return 0;
+
+        put_line(dst);
+
+        return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  fit_end
+Purpose   :  Free fitting buffers
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void fit_end(void)
+{
+        free(dst_of);
+        dst_of = NULL;
+        free(span);
+        span = NULL;
+        free(count);
+        count = NULL;
+}
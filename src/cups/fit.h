@@ -0,0 +1,48 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : fit.h
+* DESCRIPTION   : Fitting of raster pages to the printer head width
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _FIT_H
+#define _FIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*fitwidth option*/
+#define FIT_NONE                0       /*dots past head width are lost*/
+#define FIT_WIDTH               1       /*scale width down to head width*/
+#define FIT_ASPECT              2       /*scale height too, keep aspect ratio*/
+
+int     fit_start(int src_width,int dst_width,int offset,int height,int vertical,
+                  int lines);
+int     fit_line(const unsigned char *src,unsigned char *dst);
+void    fit_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_FIT_H*/
@@ -0,0 +1,309 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : halftone.c
+* DESCRIPTION   : Halftoning of grayscale rasters
+*
+*                 8-bit grayscale dotlines are turned into packed dotlines
+*                 (8 dots per byte, leftmost dot in MSB) by ordered dither
+*                 or by serpentine error diffusion. Gray levels first go
+*                 through a tone curve that makes up for the dot gain of
+*                 thermal heads, where dots spread into their neighbours
+*                 and midtones print darker than on paper proofs.
+*                 Ordered dither compares 16 pixels at once with SSE2.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "halftone.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define DOT_GAIN        1.6             /*tone curve exponent*/
+#define MATRIX_SIZE     8
+
+/*dispersed dot matrix, levels 0 to 63*/
+static const unsigned char bayer[MATRIX_SIZE][MATRIX_SIZE] = {
+        {  0, 32,  8, 40,  2, 34, 10, 42 },
+        { 48, 16, 56, 24, 50, 18, 58, 26 },
+        { 12, 44,  4, 36, 14, 46,  6, 38 },
+        { 60, 28, 52, 20, 62, 30, 54, 22 },
+        {  3, 35, 11, 43,  1, 33,  9, 41 },
+        { 51, 19, 59, 27, 49, 17, 57, 25 },
+        { 15, 47,  7, 39, 13, 45,  5, 37 },
+        { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+static int              method;
+static int              width;                  /*dots*/
+static int              white_zero;             /*0 is white (K color space)*/
+static int              row;                    /*dotlines done in page*/
+static unsigned char    tone[256];              /*ink level to printed level*/
+static unsigned char    reverse[256];           /*bit order reversed*/
+
+/*ordered dither: threshold rows in gray levels, padded to 16 pixels*/
+static unsigned char    *thresholds = NULL;
+static int              stride;
+
+/*error diffusion: errors of current and next dotline, one pixel margin*/
+static int              *err_cur = NULL;
+static int              *err_next = NULL;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  ink
+Purpose   :  Get ink level of gray pixel
+Inputs    :  g : gray pixel
+Outputs   :  <>
+Return    :  ink level, 255 for black
+-----------------------------------------------------------------------------*/
+static int ink(int g)
+{
+        return white_zero ? g : 255-g;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  build_tables
+Purpose   :  Build tone curve, bit reversal table and dither thresholds
+             A dot is printed where the toned ink level is above the matrix
+             level; thresholds are turned back into gray levels so the dither
+             loop compares raw pixels
+Inputs    :  <>
+Outputs   :  Updates global tables
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void build_tables(void)
+{
+        int i;
+        int b;
+        int x;
+        int y;
+
+        for (i = 0; i<256; i++) {
+                tone[i] = (unsigned char)(255.0*pow(i/255.0,DOT_GAIN)+0.5);
+
+                reverse[i] = 0;
+                for (b = 0; b<8; b++)
+                        if (i&(1<<b))
+                                reverse[i] |= 0x80>>b;
+        }
+
+        if (thresholds==NULL)
+                return;
+
+        for (y = 0; y<MATRIX_SIZE; y++) {
+                unsigned char *p = thresholds+y*stride;
+
+                for (x = 0; x<MATRIX_SIZE; x++) {
+                        int level = (2*bayer[y][x]+1)*255/128;
+                        int t = 0;
+
+                        /*smallest ink level printed, tone[255] is 255*/
+                        while (tone[t]<=level)
+                                t++;
+
+                        p[x] = white_zero ? t : 255-t;
+                }
+                for (x = MATRIX_SIZE; x<stride; x++)
+                        p[x] = p[x%MATRIX_SIZE];
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  dot
+Purpose   :  Tell if pixel is printed by ordered dither
+Inputs    :  g : gray pixel
+             t : threshold in gray levels
+Outputs   :  <>
+Return    :  1 if printed, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int dot(int g,int t)
+{
+        return white_zero ? g>=t : g<=t;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  dither_line
+Purpose   :  Halftone dotline with ordered dither
+Inputs    :  gray : grayscale dotline
+             dots : packed dotline
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void dither_line(const unsigned char *gray,unsigned char *dots)
+{
+        const unsigned char *t = thresholds+(row%MATRIX_SIZE)*stride;
+        int x = 0;
+        int i;
+
+#ifdef __SSE2__
+        for (; x+16<=width; x += 16) {
+                __m128i g = _mm_loadu_si128((const __m128i *)(gray+x));
+                __m128i th = _mm_loadu_si128((const __m128i *)(t+x));
+                __m128i m;
+                int bits;
+
+                if (white_zero)
+                        m = _mm_cmpeq_epi8(_mm_max_epu8(g,th),g);       /*g>=t*/
+                else
+                        m = _mm_cmpeq_epi8(_mm_min_epu8(g,th),g);       /*g<=t*/
+
+                /*first pixel in bit 0 of mask, in MSB of dotline byte*/
+                bits = _mm_movemask_epi8(m);
+                dots[x/8] = reverse[bits&0xff];
+                dots[x/8+1] = reverse[bits>>8];
+        }
+#endif
+
+        for (; x<width; x += 8) {
+                unsigned char byte = 0;
+
+                for (i = 0; i<8 && x+i<width; i++)
+                        if (dot(gray[x+i],t[x+i]))
+                                byte |= 0x80>>i;
+
+                dots[x/8] = byte;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  diffuse_line
+Purpose   :  Halftone dotline with Floyd-Steinberg error diffusion
+             Even dotlines are scanned left to right, odd ones right to left
+Inputs    :  gray : grayscale dotline
+             dots : packed dotline
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void diffuse_line(const unsigned char *gray,unsigned char *dots)
+{
+        int dir = (row&1) ? -1 : 1;
+        int x = (row&1) ? width-1 : 0;
+        int *tmp;
+        int i;
+
+        memset(dots,0,(width+7)/8);
+
+        for (i = 0; i<width; i++, x += dir) {
+                int v = tone[ink(gray[x])]+err_cur[x+1];
+                int e;
+
+                if (v>=128) {
+                        dots[x/8] |= 0x80>>(x%8);
+                        e = v-255;
+                }
+                else {
+                        e = v;
+                }
+
+                err_cur[x+1+dir] += e*7/16;
+                err_next[x+1-dir] += e*3/16;
+                err_next[x+1] += e*5/16;
+                err_next[x+1+dir] += e/16;
+        }
+
+        tmp = err_cur;
+        err_cur = err_next;
+        err_next = tmp;
+        memset(err_next,0,(width+2)*sizeof(int));
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  halftone_start
+Purpose   :  Prepare halftoning of a page
+Inputs    :  _method        : halftoning method (HALFTONE_ORDERED...)
+             _width         : page width in pixels
+             _white_is_zero : 1 if 0 is white (K color space), 0 if 0 is
+                              black (W color space)
+Outputs   :  <>
+Return    :  0 if successful, -1 on error
+-----------------------------------------------------------------------------*/
+int halftone_start(int _method,int _width,int _white_is_zero)
+{
+        halftone_end();
+
+        method = _method==HALFTONE_DIFFUSION ? HALFTONE_DIFFUSION : HALFTONE_ORDERED;
+        width = _width;
+        white_zero = _white_is_zero;
+        row = 0;
+
+        if (method==HALFTONE_ORDERED) {
+                stride = (width+15)&~15;
+                thresholds = malloc(MATRIX_SIZE*stride);
+                if (thresholds==NULL)
+                        return -1;
+        }
+        else {
+                err_cur = calloc(width+2,sizeof(int));
+                err_next = calloc(width+2,sizeof(int));
+                if (err_cur==NULL || err_next==NULL)
+                        return -1;
+        }
+
+        build_tables();
+
+        return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  halftone_line
+Purpose   :  Halftone next dotline of page
+Inputs    :  gray : grayscale dotline, one byte per pixel
+             dots : packed dotline, (width+7)/8 bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void halftone_line(const unsigned char *gray,unsigned char *dots)
+{
+        if (method==HALFTONE_ORDERED)
+                dither_line(gray,dots);
+        else
+                diffuse_line(gray,dots);
+
+        row++;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  halftone_end
+Purpose   :  Free halftoning buffers
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void halftone_end(void)
+{
+        free(thresholds);
+        thresholds = NULL;
+        free(err_cur);
+        err_cur = NULL;
+        free(err_next);
+        err_next = NULL;
+}
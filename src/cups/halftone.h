@@ -0,0 +1,46 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : halftone.h
+* DESCRIPTION   : Halftoning of grayscale rasters
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _HALFTONE_H
+#define _HALFTONE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*halftoning methods (halftone option)*/
+#define HALFTONE_ORDERED        0       /*8x8 ordered dither*/
+#define HALFTONE_DIFFUSION      1       /*serpentine error diffusion*/
+
+int     halftone_start(int method,int width,int white_is_zero);
+void    halftone_line(const unsigned char *gray,unsigned char *dots);
+void    halftone_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_HALFTONE_H*/
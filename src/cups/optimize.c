@@ -0,0 +1,517 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : optimize.c
+* DESCRIPTION   : Peephole optimizer of printer command streams
+*
+*                 Rewrites a command stream (filter output, or data of any
+*                 other producer) into an equivalent cheaper one:
+*                 - runs of blank dotlines and feeds are merged into feeds
+*                 - shift commands are sent only when a printed dotline
+*                   needs them, leading blank bytes may be moved into the
+*                   shift (OPTIMIZE_TRIM), trailing blank bytes are dropped
+*                 - settings repeating the current value are dropped
+*                   (prolog of every copy)
+*                 - HRS/KCP dotlines may be sent compressed (OPTIMIZE_COMPRESS)
+*                 Commands the optimizer does not know are kept as is and
+*                 act as barriers: pending feed, shift and compression
+*                 state are sent before them.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aps/aps.h>
+
+#include "command.h"
+#include "compress.h"
+#include "optimize.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define OUT_BUFSIZE     65536   /*initial output buffer size in bytes*/
+#define SETTINGS_MAX    16
+#define FEED_MAX        255     /*dotlines per feed command*/
+#define SHIFT_SIZE      4       /*size of shift command in bytes*/
+#define COMPRESS_SIZE   4       /*size of 'set compression' command in bytes*/
+
+typedef struct {
+        unsigned char   buf[4];
+        int             size;
+} setting_t;
+
+typedef struct {
+        int             type;
+        int             flags;
+        int             errnum;
+        unsigned char   *out;
+        long            size;
+        long            max;
+        long            feed;           /*dotlines to feed*/
+        int             shift;          /*shift set by stream, -1 if unknown*/
+        int             printer_shift;  /*shift set on printer, -1 if unknown*/
+        int             in_compressed;  /*stream sends compressed dotlines*/
+        int             out_compressed; /*compression enabled by optimizer*/
+        int             text;           /*text waiting in printer line buffer*/
+        setting_t       settings[SETTINGS_MAX];
+        int             nsettings;
+        unsigned char   *zbuf;          /*compression buffer*/
+        int             zmax;
+        optimize_stats_t *stats;
+} optimizer_t;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  emit
+Purpose   :  Append bytes to output stream
+Inputs    :  o    : optimizer
+             buf  : bytes
+             size : number of bytes
+Outputs   :  Output buffer grows as needed, errnum is set if out of memory
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void emit(optimizer_t *o,const void *buf,long size)
+{
+        if (o->errnum!=APS_OK || size<=0)
+                return;
+
+        if (o->size+size>o->max) {
+                long max = o->max ? o->max : OUT_BUFSIZE;
+                unsigned char *p;
+
+                while (o->size+size>max)
+                        max *= 2;
+
+                p = realloc(o->out,max);
+                if (p==NULL) {
+                        o->errnum = APS_IO_ERROR;
+                        return;
+                }
+                o->out = p;
+                o->max = max;
+        }
+
+        memcpy(o->out+o->size,buf,size);
+        o->size += size;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  emit_command
+Purpose   :  Append command to output stream
+Inputs    :  o      : optimizer
+             errnum : result of command builder (cmd_xxx)
+             cmd    : command structure
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void emit_command(optimizer_t *o,int errnum,const command_t *cmd)
+{
+        if (errnum<0) {
+                if (o->errnum==APS_OK)
+                        o->errnum = errnum;
+                return;
+        }
+
+        emit(o,cmd->buf,cmd->size);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  has_shift
+Purpose   :  Tell if model type has the 'shift dotline' command
+Inputs    :  type : model type
+Outputs   :  <>
+Return    :  1 if shift command is supported, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int has_shift(int type)
+{
+        return type==APS_MRS || type==APS_HRS || type==APS_KCP;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  flush_feed
+Purpose   :  Send pending feed
+Inputs    :  o : optimizer
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void flush_feed(optimizer_t *o)
+{
+        command_t cmd;
+
+        while (o->feed>0) {
+                int n = o->feed>FEED_MAX ? FEED_MAX : o->feed;
+
+                emit_command(o,cmd_feed_forward(o->type,&cmd,n),&cmd);
+                o->stats->feeds++;
+                o->feed -= n;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  set_shift
+Purpose   :  Set dotline shift on printer
+Inputs    :  o     : optimizer
+             shift : shift amount in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void set_shift(optimizer_t *o,int shift)
+{
+        command_t cmd;
+
+        if (shift<0 || shift==o->printer_shift)
+                return;
+
+        emit_command(o,cmd_shift_dotline(o->type,&cmd,shift),&cmd);
+        o->stats->shifts_out++;
+        o->printer_shift = shift;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  set_compression
+Purpose   :  Enable or disable dotline compression on printer
+Inputs    :  o    : optimizer
+             flag : compression flag
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void set_compression(optimizer_t *o,int flag)
+{
+        command_t cmd;
+
+        if (flag==o->out_compressed)
+                return;
+
+        emit_command(o,cmd_set_compression(o->type,&cmd,flag),&cmd);
+        o->out_compressed = flag;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  barrier
+Purpose   :  Send pending state before a command the optimizer keeps as is
+Inputs    :  o : optimizer
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void barrier(optimizer_t *o)
+{
+        flush_feed(o);
+        set_shift(o,o->shift);
+        set_compression(o,0);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  setting
+Purpose   :  Tell if setting command repeats current value, remember value
+             Settings that cannot be remembered make all values unknown
+Inputs    :  o : optimizer
+             p : command bytes
+             n : command size in bytes
+Outputs   :  <>
+Return    :  1 if command can be dropped, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int setting(optimizer_t *o,const unsigned char *p,long n)
+{
+        setting_t *s;
+        int i;
+
+        if (n>(long)sizeof(s->buf)) {
+                o->nsettings = 0;
+                return 0;
+        }
+
+        for (i = 0; i<o->nsettings; i++) {
+                s = &o->settings[i];
+                if (s->buf[0]==p[0] && s->buf[1]==p[1])
+                        break;
+        }
+
+        if (i<o->nsettings) {
+                if (s->size==n && memcmp(s->buf,p,n)==0)
+                        return 1;
+        }
+        else if (o->nsettings<SETTINGS_MAX) {
+                s = &o->settings[o->nsettings++];
+        }
+        else {
+                o->nsettings = 0;
+                return 0;
+        }
+
+        memcpy(s->buf,p,n);
+        s->size = n;
+
+        return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  dotline
+Purpose   :  Send dotline, blank dotlines are turned into feeds
+Inputs    :  o      : optimizer
+             data   : dotline data, printed at current stream shift
+             nbytes : dotline size in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void dotline(optimizer_t *o,const unsigned char *data,int nbytes)
+{
+        command_t cmd;
+        int lead;
+        int trail;
+        int skip;
+        int z;
+
+        lead = 0;
+        while (lead<nbytes && data[lead]==0)
+                lead++;
+
+        if (lead==nbytes) {
+                o->feed++;
+                o->stats->blank++;
+                return;
+        }
+
+        trail = 0;
+        while (data[nbytes-trail-1]==0)
+                trail++;
+
+        flush_feed(o);
+
+        /*leading blank bytes stay in data unless shifting is cheaper*/
+        skip = 0;
+        if (has_shift(o->type) && o->shift>=0 && (o->flags&OPTIMIZE_TRIM)) {
+                int cost = (o->printer_shift!=o->shift ? SHIFT_SIZE : 0)+lead;
+                int cost_trim = o->printer_shift!=o->shift+lead ? SHIFT_SIZE : 0;
+
+                if (cost_trim<cost)
+                        skip = lead;
+        }
+        if (o->shift>=0)
+                set_shift(o,o->shift+skip);
+
+        data += skip;
+        nbytes -= skip+trail;
+
+        if (o->flags&OPTIMIZE_COMPRESS) {
+                z = compress_dotline(data,nbytes,o->zbuf,o->zmax);
+
+                /*switching compression on and off costs two commands*/
+                if (z>=0 && !o->out_compressed && z+2*COMPRESS_SIZE<nbytes)
+                        set_compression(o,1);
+                else if (z<0 || z>nbytes+2*COMPRESS_SIZE)
+                        set_compression(o,0);
+
+                /*every dotline is compressed while compression is enabled*/
+                if (o->out_compressed) {
+                        emit_command(o,cmd_print_dotline(o->type,&cmd,z),&cmd);
+                        emit(o,o->zbuf,z);
+                        o->stats->compressed++;
+                        return;
+                }
+        }
+
+        emit_command(o,cmd_print_dotline(o->type,&cmd,nbytes),&cmd);
+        emit(o,data,nbytes);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  process
+Purpose   :  Process one command of input stream
+Inputs    :  o : optimizer
+             p : command bytes
+             n : command size in bytes (aps_command_size)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void process(optimizer_t *o,const unsigned char *p,long n)
+{
+        if (p[0]==ESC && n>=2) {
+                switch (p[1]) {
+                case 'V':
+                        if (has_shift(o->type) && n>=5 && !o->in_compressed && !o->text) {
+                                dotline(o,p+5,n-5);
+                                return;
+                        }
+                        break;
+                case '$':
+                        if (n==4 && has_shift(o->type)) {
+                                o->shift = p[2]|(p[3]<<8);
+                                o->stats->shifts_in++;
+                                return;
+                        }
+                        break;
+                case 'J':
+                        if (n==3 && !o->text) {
+                                o->feed += p[2];
+                                return;
+                        }
+                        break;
+                case '%': case 'M': case ' ': case '3':
+                        if (setting(o,p,n)) {
+                                o->stats->settings_dropped++;
+                                return;
+                        }
+                        barrier(o);
+                        emit(o,p,n);
+                        return;
+                case '@':
+                        barrier(o);
+                        emit(o,p,n);
+                        o->shift = -1;
+                        o->printer_shift = -1;
+                        o->in_compressed = 0;
+                        o->text = 0;
+                        o->nsettings = 0;
+                        return;
+                case 'G':
+                        barrier(o);
+                        emit(o,p,n);
+                        o->in_compressed = n==3 && p[2]!=0;
+                        return;
+                default:
+                        break;
+                }
+        }
+        else if (p[0]==GS && n>=2) {
+                switch (p[1]) {
+                case 'v':
+                        /*single dotline raster image*/
+                        if (o->type==APS_HSP && n>=8 && p[2]=='0' && p[3]==0 &&
+                            p[6]==1 && p[7]==0 && !o->text) {
+                                dotline(o,p+8,n-8);
+                                return;
+                        }
+                        break;
+                case '/': case 'D': case 's': case 'J': case 'M':
+                        if (setting(o,p,n)) {
+                                o->stats->settings_dropped++;
+                                return;
+                        }
+                        barrier(o);
+                        emit(o,p,n);
+                        return;
+                default:
+                        break;
+                }
+        }
+
+        barrier(o);
+        emit(o,p,n);
+
+        /*settings are unknown after a command that may change them
+          (characters, dotlines, shifts and feeds cannot)*/
+        if (n>1 &&
+            !(p[0]==ESC && (p[1]=='V' || p[1]=='$' || p[1]=='J')) &&
+            !(p[0]==GS && p[1]=='v'))
+                o->nsettings = 0;
+
+        if (n==1) {
+                if (p[0]>=32)
+                        o->text = 1;
+                else if (p[0]==LF || p[0]==CAN)
+                        o->text = 0;
+        }
+        else if (p[0]==ESC && p[1]=='J') {
+                o->text = 0;
+        }
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  optimize_stream
+Purpose   :  Rewrite command stream into an equivalent cheaper one
+             The printer is assumed to be in the state left by the previous
+             job; the output leaves it in the same state as the input
+Inputs    :  type    : model type
+             flags   : OPTIMIZE_xxx flags
+             in      : command stream (no block headers)
+             size    : command stream size in bytes
+             out     : optimized stream, to be freed by caller
+             outsize : optimized stream size in bytes
+             stats   : optimizer counters, may be NULL
+Outputs   :  Fills out, outsize and stats
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int optimize_stream(int type,int flags,const unsigned char *in,long size,
+                    unsigned char **out,long *outsize,optimize_stats_t *stats)
+{
+        optimize_stats_t dummy;
+        optimizer_t o;
+        long pos;
+
+        if (type!=APS_MRS && type!=APS_HRS && type!=APS_KCP && type!=APS_HSP)
+                return APS_INVALID_MODEL_TYPE;
+
+        memset(&o,0,sizeof(o));
+        o.type = type;
+        o.flags = flags;
+        o.errnum = APS_OK;
+        o.shift = -1;
+        o.printer_shift = -1;
+        o.stats = stats!=NULL ? stats : &dummy;
+        memset(o.stats,0,sizeof(optimize_stats_t));
+
+        /*compression is only available on HRS/KCP*/
+        if (type!=APS_HRS && type!=APS_KCP)
+                o.flags &= ~OPTIMIZE_COMPRESS;
+        if (o.flags&OPTIMIZE_COMPRESS) {
+                o.zmax = COMPRESS_BUFSIZE(65535);
+                o.zbuf = malloc(o.zmax);
+                if (o.zbuf==NULL)
+                        o.flags &= ~OPTIMIZE_COMPRESS;
+        }
+
+        pos = 0;
+        while (pos<size && o.errnum==APS_OK) {
+                long n = aps_command_size(in+pos,size-pos>0x7fffffff ? 0x7fffffff : size-pos);
+
+                /*truncated command at end of stream is kept as is*/
+                if (n<=0 || n>size-pos) {
+                        barrier(&o);
+                        emit(&o,in+pos,size-pos);
+                        break;
+                }
+
+                process(&o,in+pos,n);
+                pos += n;
+        }
+
+        barrier(&o);
+
+        free(o.zbuf);
+
+        if (o.errnum!=APS_OK) {
+                free(o.out);
+                return o.errnum;
+        }
+
+        o.stats->in_bytes = size;
+        o.stats->out_bytes = o.size;
+
+        *out = o.out;
+        *outsize = o.size;
+
+        return APS_OK;
+}
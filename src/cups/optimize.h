@@ -0,0 +1,56 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : optimize.h
+* DESCRIPTION   : Peephole optimizer of printer command streams
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _OPTIMIZE_H
+#define _OPTIMIZE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*optimizer flags*/
+#define OPTIMIZE_TRIM           1       /*move leading blank bytes into dotline shift*/
+#define OPTIMIZE_COMPRESS       2       /*send HRS/KCP dotlines compressed*/
+
+typedef struct {
+        long    in_bytes;
+        long    out_bytes;
+        long    blank;                  /*blank dotlines merged into feeds*/
+        long    feeds;                  /*feed commands sent*/
+        long    shifts_in;              /*shift commands of input stream*/
+        long    shifts_out;             /*shift commands sent*/
+        long    settings_dropped;       /*repeated settings removed*/
+        long    compressed;             /*dotlines sent compressed*/
+} optimize_stats_t;
+
+int     optimize_stream(int type,int flags,const unsigned char *in,long size,
+                        unsigned char **out,long *outsize,optimize_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_OPTIMIZE_H*/
@@ -78,7 +78,24 @@ int     maxlengthmm;              /*dotlines*/
 int     checkneop;
 int     charspacing;            /*pixels*/
 int     linespacing;            /*dotlines*/
+int     textcache;
+int     textcachedisk;
+int     symbolcachedisk;
+int     rasterthreads;
+int     halftone;
+int     fitwidth;
+int     centerpage;
+int     rotate;
+int     sparsespeed;            /*mm/s*/
+int     sparsedynadiv;          /*black bytes*/
+int     sparselimit;            /*%*/
+int     pagecache;              /*MB*/
 char*   font_path; /*path of aps font file*/
+char*   cache_dir; /*base directory of on-disk caches*/
+char*   template_dir; /*directory of receipt templates*/
+
+/*first error of current job (see job_error)*/
+int     job_errnum = APS_OK;
 
 /* PRIVATE FUNCTIONS --------------------------------------------------------*/
 
@@ -170,18 +187,42 @@ void error(const char *s)
 }
 
 /*-----------------------------------------------------------------------------
-Name      :  get_options
+Name      :  job_error
+Purpose   :  Log error as error() does, without exiting: the first error is
+             kept in job_errnum and the job functions (raster_job, text_job)
+             stop and return it, so that direct_print() can close the port
+Inputs    :  s      : custom error string
+             errnum : error code
+Outputs   :  Updates global job_errnum
+Return    :  errnum
+-----------------------------------------------------------------------------*/
+int job_error(const char *s,int errnum)
+{
+	fprintf(stderr,"ERROR: APS backend => %s (cups:%s)\n",s,
+                        ippErrorString(cupsLastError()));
+
+	fprintf(stderr,"ERROR: APS backend => errno: %s \n",strerror(errno));
+
+        if (job_errnum==APS_OK)
+                job_errnum = errnum;
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  read_options
 
 Purpose   :  Retrieve current printing options
              Retrieve marked options from PPD file
              Override options with command-line string
+             Errors are logged (see job_error)
 
 Inputs    :  opt : command-line options
              
 Outputs   :  <>
-Return    :  <>
+Return    :  APS_OK or error code
 -----------------------------------------------------------------------------*/
-void get_options(const char *opt)
+int read_options(const char *opt)
 {
         const char *ppd_name;
         ppd_file_t *ppd;
@@ -192,11 +233,11 @@ void get_options(const char *opt)
         /*open printer PPD file and mark options*/
         ppd_name = getenv("PPD");
         if (ppd_name == NULL)
-                error("PPD environment variable not set");
+                return job_error("PPD environment variable not set",APS_INVALID_MODEL);
 
         ppd = ppdOpenFile(ppd_name);
         if (ppd==NULL)
-                error("ppdOpenFile failed");
+                return job_error("ppdOpenFile failed",APS_OPEN_FAILED);
 
         ppdMarkDefaults(ppd);
 
@@ -209,9 +250,16 @@ void get_options(const char *opt)
             font_path = NULL;
             if (p!= NULL)
             {
-                font_path = malloc(strlen(p));
-                strcpy(font_path,p);
+                font_path = strdup(p);
             }
+            p = cupsGetOption("cache_dir",num_options,options);
+            cache_dir = NULL;
+            if (p!= NULL)
+                cache_dir = strdup(p);
+            p = cupsGetOption("template_dir",num_options,options);
+            template_dir = NULL;
+            if (p!= NULL)
+                template_dir = strdup(p);
             cupsMarkOptions(ppd,num_options,options);
             cupsFreeOptions(num_options,options);
         }
@@ -220,16 +268,18 @@ void get_options(const char *opt)
         printer_model = ppd->model_number;
         
         errnum = aps_get_model_type(printer_model);
-        if (errnum<0)
-                error(aps_strerror(errnum));
-        else
-                printer_type = errnum;
+        if (errnum<0) {
+                ppdClose(ppd);
+                return job_error(aps_strerror(errnum),errnum);
+        }
+        printer_type = errnum;
 
         errnum = aps_get_model_width(printer_model);
-        if (errnum<0)
-                error(aps_strerror(errnum));
-        else
-                printer_width = errnum/8;
+        if (errnum<0) {
+                ppdClose(ppd);
+                return job_error(aps_strerror(errnum),errnum);
+        }
+        printer_width = errnum/8;
         
         /*retrieve common options*/
         prbaudrate      = get_opt_int(ppd,"prbaudrate");
@@ -240,7 +290,7 @@ void get_options(const char *opt)
         maxspeed        = get_opt_int(ppd,"maxspeed");
         intensity       = get_opt_int(ppd,"intensity");
         optprint        = get_opt_bool(ppd,"optprint");
-        //compress        = get_opt_bool(ppd,"compress");
+        compress        = get_opt_bool(ppd,"compress");
         finalcut        = get_opt_int(ppd,"finalcut");
         font            = get_opt_int(ppd,"APS_font");
         process         = get_opt_bool(ppd,"process");
@@ -254,12 +304,39 @@ void get_options(const char *opt)
         checkneop       = get_opt_bool(ppd,"checkneop");
         charspacing     = get_opt_int(ppd,"charspacing");
         linespacing     = get_opt_int(ppd,"linespacing");
+        textcache       = get_opt_bool(ppd,"textcache");
+        textcachedisk   = get_opt_bool(ppd,"textcachedisk");
+        symbolcachedisk = get_opt_bool(ppd,"symbolcachedisk");
+        rasterthreads   = get_opt_int(ppd,"rasterthreads");
+        halftone        = get_opt_int(ppd,"halftone");
+        fitwidth        = get_opt_int(ppd,"fitwidth");
+        centerpage      = get_opt_bool(ppd,"centerpage");
+        rotate          = get_opt_int(ppd,"rotate");
+        sparsespeed     = get_opt_int(ppd,"sparsespeed");
+        sparsedynadiv   = get_opt_int(ppd,"sparsedynadiv");
+        sparselimit     = get_opt_int(ppd,"sparselimit");
+        pagecache       = get_opt_int(ppd,"pagecache");
 
         /*retrieve printer-specific options*/
         /*TODO: not implemented!*/
         
         ppdClose(ppd);
 
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  get_options
+Purpose   :  Retrieve current printing options (see read_options)
+             Exit program on error
+Inputs    :  opt : command-line options
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void get_options(const char *opt)
+{
+        if (read_options(opt)<0)
+                exit(1);
 }
 
 /*-----------------------------------------------------------------------------
@@ -274,6 +351,17 @@ void 	free_options(void)
 	if (font_path != NULL)
 	{
 		free(font_path);
+		font_path = NULL;
+	}
+	if (cache_dir != NULL)
+	{
+		free(cache_dir);
+		cache_dir = NULL;
+	}
+	if (template_dir != NULL)
+	{
+		free(template_dir);
+		template_dir = NULL;
 	}
 }
 
@@ -296,7 +384,7 @@ void dump_options(void)
         fprintf(stderr,"DEBUG: maxspeed     = %d\n",maxspeed);
         fprintf(stderr,"DEBUG: intensity    = %d\n",intensity);
         fprintf(stderr,"DEBUG: optprint     = %d\n",optprint);
-        //fprintf(stderr,"DEBUG: compress   = %d\n",compress);
+        fprintf(stderr,"DEBUG: compress   = %d\n",compress);
         fprintf(stderr,"DEBUG: font         = %d\n",font);
         fprintf(stderr,"DEBUG: process      = %d\n",process);
         fprintf(stderr,"DEBUG: finalcut     = %d\n",finalcut);
@@ -308,6 +396,18 @@ void dump_options(void)
         fprintf(stderr,"DEBUG: checkneop    = %d\n",checkneop);
         fprintf(stderr,"DEBUG: charspacing  = %d\n",charspacing);
         fprintf(stderr,"DEBUG: linespacing  = %d\n",linespacing);
+        fprintf(stderr,"DEBUG: textcache    = %d\n",textcache);
+        fprintf(stderr,"DEBUG: textcachedisk= %d\n",textcachedisk);
+        fprintf(stderr,"DEBUG: symbolcachedisk= %d\n",symbolcachedisk);
+        fprintf(stderr,"DEBUG: rasterthreads= %d\n",rasterthreads);
+        fprintf(stderr,"DEBUG: halftone     = %d\n",halftone);
+        fprintf(stderr,"DEBUG: fitwidth     = %d\n",fitwidth);
+        fprintf(stderr,"DEBUG: centerpage   = %d\n",centerpage);
+        fprintf(stderr,"DEBUG: rotate       = %d\n",rotate);
+        fprintf(stderr,"DEBUG: sparsespeed  = %d\n",sparsespeed);
+        fprintf(stderr,"DEBUG: sparsedynadiv= %d\n",sparsedynadiv);
+        fprintf(stderr,"DEBUG: sparselimit  = %d\n",sparselimit);
+        fprintf(stderr,"DEBUG: pagecache    = %d\n",pagecache);
 
         fprintf(stderr,"DEBUG: printer_width= %d bytes\n",printer_width);
         if (font_path != NULL)
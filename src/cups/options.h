@@ -71,11 +71,29 @@ extern int      maxlengthmm;            /*dotlines*/
 extern int      checkneop;
 extern int      charspacing;            /*pixels*/
 extern int      linespacing;            /*dotlines*/
+extern int      textcache;
+extern int      textcachedisk;
+extern int      symbolcachedisk;
+extern int      rasterthreads;          /*0 for one per processor*/
+extern int      halftone;               /*HALFTONE_ORDERED...*/
+extern int      fitwidth;               /*FIT_NONE...*/
+extern int      centerpage;
+extern int      rotate;                 /*ROTATE_NONE...*/
+extern int      sparsespeed;            /*mm/s*/
+extern int      sparsedynadiv;          /*black bytes*/
+extern int      sparselimit;            /*%*/
+extern int      pagecache;              /*MB*/
 extern char     *font_path; 		/*path of aps font file*/
+extern char     *cache_dir;             /*base directory of on-disk caches*/
+extern char     *template_dir;          /*directory of receipt templates*/
+
+extern int      job_errnum;             /*first error of current job*/
 
 void    debug(const char *s,void *port);
 void    error(const char *s);
+int     job_error(const char *s,int errnum);
 
+int     read_options(const char *opt);
 void    get_options(const char *opt);
 void 	free_options(void);
 void    dump_options(void);
@@ -0,0 +1,1508 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : rasterjob.c
+*
+* DESCRIPTION   : Page pipeline of the rastertoaps filter
+*                 Converts CUPS internal RIP format into APS commands
+*                 APS command set is selected depending on cupsModelNumber
+*                 attribute of the PPD file
+*                 raster_job() encodes a whole job to the ticket output and
+*                 returns on errors, it is shared by rastertoaps and by
+*                 aps-print (see direct.c)
+*
+* CVS           : $Id: rastertoaps.c,v 1.14 2008/07/09 14:22:29 pierre Exp $
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*******************************************************************************
+* HISTORY       :
+*   31jan2006   nico    Initial revision
+*   19may2006   nico    Added HRS/KCP bitmap compression support
+*   08jun2006   nico    Added blank dotlines compression and ticket/page mode
+*   12jun2006   nico    Added cancel support
+*   16aug2006   nico    Reset dotline shift amount at end of ticket
+*   11oct2006   nico    Added maximum ticket length option
+*                       (full cut after maxlength dotlines)
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <cups/cups.h>
+#include <cups/raster.h>
+
+#include <aps/aps.h>
+
+#include "command.h"
+#include "compress.h"
+#include "options.h"
+#include "barcode.h"
+#include "cache.h"
+#include "encstats.h"
+#include "halftone.h"
+#include "fit.h"
+#include "rotate.h"
+#include "stream.h"
+#include "ticket.h"
+#include "rasterjob.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+static  sig_atomic_t    cancel_flag;
+
+#define BLANK_BUFSIZE   256             /*bytes*/
+
+static unsigned char    blank_buf[BLANK_BUFSIZE];
+
+static  int     dotlines_counter;
+static  int     blank_counter;
+
+/*dotline encoder shared with libaps (aps_print_bitmap)*/
+static aps_encoder_t    encoder;
+static unsigned char    *encoded = NULL;
+static int              encoded_max = 0;
+
+#define BAND_MIN        10              /*dotlines read at once*/
+#define BAND_MAX        512
+#define L2_DEFSIZE      (256*1024)      /*bytes, if unknown*/
+#define WORKERS_MAX     8               /*encoding threads*/
+#define BANDS_PER_WORKER 2
+#define RING_SIZE       32              /*more than bands of pipeline*/
+#define REGION_LINES    64              /*dotlines per density region*/
+#define PAGE_ENTRIES    16              /*encoded pages kept in memory*/
+#define PAGE_BYTES      (16*1024*1024)
+#define PAGE_RASTER_MAX (16*1024*1024)  /*bytes of raster hashed per page*/
+#define PAGE_CHUNK      (32*1024)       /*bytes read and hashed at once*/
+#define PAGE_CACHE_VERSION 1            /*bumped when page encoding changes*/
+
+/*band of dotlines, read from CUPS, encoded and emitted at once*/
+typedef struct {
+        unsigned char   *buf;           /*CUPS dotlines*/
+        int             lines;          /*dotlines in band*/
+        int             *lead;          /*leading blank bytes, nbytes if blank*/
+        int             *size;          /*encoded dotline sizes*/
+        int             *black;         /*black bytes per dotline*/
+        unsigned char   *out;           /*encoded dotlines, without shift*/
+        unsigned long   trimmed;        /*blank bytes trimmed*/
+} band_t;
+
+/*single-producer/single-consumer ring of bands*/
+typedef struct {
+        band_t          *slot[RING_SIZE];
+        unsigned int    head;           /*written by producer only*/
+        unsigned int    tail;           /*written by consumer only*/
+        sem_t           items;          /*queued bands*/
+} ring_t;
+
+typedef struct {
+        ring_t          in;             /*bands from reader*/
+        ring_t          out;            /*encoded bands to main thread*/
+        pthread_t       thread;
+} worker_t;
+
+/*page pipeline (see process_page)*/
+static worker_t         workers[WORKERS_MAX];
+static int              num_workers;
+static ring_t           free_ring;      /*emitted bands back to reader*/
+static band_t           end_band;       /*end of page*/
+static cups_raster_t    *pipe_ras;
+static int              pipe_bpl;
+static int              pipe_nbytes;
+static int              pipe_height;
+static int              band_height;
+
+/*speed and dynamic division follow print density (see set_density)*/
+static int              density_ctl = 0;        /*black bytes are counted*/
+static int              sparse_mode = 0;        /*sparse settings sent*/
+
+/*bands are kept from page to page, grown when a page needs more*/
+static band_t           *bands = NULL;
+static int              num_bands = 0;
+static int              band_lines = 0;         /*dotlines allocated*/
+static int              band_bufsize = 0;       /*bytes allocated*/
+static int              band_outsize = 0;       /*bytes allocated*/
+
+/*8-bit grayscale pages are read here and halftoned into bands*/
+static int              gray_bpl = 0;           /*0 for 1-bit pages*/
+static unsigned char    *gray_buf = NULL;
+static int              gray_bufsize = 0;
+
+/*pages fitted to the head are read here and scaled into bands*/
+static int              fit_bpl = 0;            /*0 if page is not fitted*/
+static unsigned char    *fit_buf = NULL;
+static int              fit_bufsize = 0;
+
+/*rotated pages are read whole, turned here and then read from memory*/
+static int              rotated = 0;            /*0 if page is not rotated*/
+static unsigned char    *rot_src = NULL;
+static long             rot_srcsize = 0;
+static unsigned char    *rot_page = NULL;
+static long             rot_pagesize = 0;
+static long             rot_len = 0;            /*bytes of rotated page*/
+static long             rot_pos = 0;            /*bytes of rot_page read*/
+
+/*
+ * page cache: pages are read whole and hashed, identical pages encoded from
+ * the same state are replayed from the cache
+ */
+typedef struct {
+        int             cache_version;  /*PAGE_CACHE_VERSION*/
+        uint64_t        hash;           /*page header and raster*/
+        long            size;           /*raster bytes*/
+        int             printer_type;
+        int             printer_width;
+        int             optprint;
+        int             rmtop;
+        int             halftone;
+        int             fitwidth;
+        int             centerpage;
+        int             rotate;
+        int             maxspeed;
+        int             dynadiv;
+        int             sparsespeed;
+        int             sparsedynadiv;
+        int             sparselimit;
+        int             blank_counter;  /*state before page*/
+        int             shift;
+        int             feed;
+} page_key_t;
+
+/*cached page, followed by its commands*/
+typedef struct {
+        int             blank_counter;  /*state after page*/
+        int             shift;
+        int             feed;
+        long            dotlines;       /*page statistics*/
+        long            blank;
+        long            trimmed;
+        long            shifts;
+        long            saved;
+} page_entry_t;
+
+static cache_t          *page_cache = NULL;
+static int              buffered = 0;           /*0 if page is read from CUPS*/
+static unsigned char    *raw_page = NULL;
+static long             raw_pagesize = 0;
+static long             raw_len = 0;            /*bytes of buffered page*/
+static long             raw_pos = 0;            /*bytes of raw_page read*/
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  job_stopped
+Purpose   :  Tell if job was cancelled or failed (see job_error)
+Inputs    :  <>
+Outputs   :  <>
+Return    :  1 if job is stopped, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int job_stopped(void)
+{
+        return cancel_flag || job_errnum<0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  next_dotline
+Purpose   :  Increment dotlines counter, perform full cut if necessary
+Inputs    :  <>
+Outputs   :  Updates global dotlines_counter
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void next_dotline(void)
+{
+        if (dotlines_counter==maxlength + maxlengthmm) {
+                aps_error_t errnum;
+                command_t cmd;
+
+                /*reset dotlines counter*/
+                dotlines_counter = 0;
+		if (ticketmode != 0)
+		{
+			cmd_lpm_end_of_ticket(printer_type, &cmd);
+			write_command(0,&cmd,NULL,0);
+		}
+		else
+		{
+
+			/*perform full cut*/
+			errnum = cmd_full_cut(printer_type,&cmd);
+
+			if (errnum<0) {
+				job_error(aps_strerror(errnum),errnum);
+			}
+			else {
+				write_command(0,&cmd,NULL,0);
+				write_marker(STREAM_CUT,0);
+			}
+		}
+        }
+        else {
+                dotlines_counter++;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_dotline
+Purpose   :  Encode dotline and write APS commands
+             Blank bytes are trimmed and dotlines shifted if optprint is set
+             (see aps_encode_dotline)
+Inputs    :  buf    : dotline buffer
+             nbytes : width of dotline in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void write_dotline(const unsigned char *buf,int nbytes)
+{
+        unsigned long shifts = encoder.shifts;
+        unsigned long trimmed = encoder.trimmed;
+        int n;
+
+        if (APS_ENCODE_MAX(nbytes)>encoded_max) {
+                free(encoded);
+                encoded_max = APS_ENCODE_MAX(nbytes);
+                encoded = malloc(encoded_max);
+                if (encoded==NULL) {
+                        encoded_max = 0;
+                        job_error("Cannot allocate dotline buffer",APS_NO_MEMORY);
+                        return;
+                }
+        }
+
+        n = aps_encode_dotline(&encoder,buf,nbytes,encoded);
+        write_data(0,encoded,n);
+
+        enc_stats.shifts += encoder.shifts-shifts;
+        enc_stats.trimmed += encoder.trimmed-trimmed;
+
+        fflush(stdout);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  print_blank
+Purpose   :  Write APS commands to print blank dotlines
+Inputs    :  n      : number of dotlines to print
+             nbytes : width of dotline in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void print_blank(int n,int nbytes)
+{
+        while (n--) {
+                next_dotline();
+
+                if (optprint) {
+                        enc_stats.saved += nbytes-1;
+                }
+
+                write_dotline(blank_buf,nbytes);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  count_leading_blank
+Purpose   :  Count number of leading blank bytes in dotline
+Inputs    :  buf    : dotline buffer
+             nbytes : width of dotline in bytes
+Outputs   :  <>
+Return    :  Number of leading blank bytes
+-----------------------------------------------------------------------------*/
+static int count_leading_blank(const unsigned char *buf,int nbytes)
+{
+        int n = 0;
+
+        while (n<nbytes && buf[n]==0) {
+                n++;
+        }
+
+        return n;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  count_black_bytes
+Purpose   :  Count number of non-blank bytes in dotline
+             Bytes are tested 8 at a time: the top bit of each byte is set
+             if the byte is not zero, then the top bits are counted
+Inputs    :  buf    : dotline buffer
+             nbytes : width of dotline in bytes
+Outputs   :  <>
+Return    :  Number of non-blank bytes
+-----------------------------------------------------------------------------*/
+static int count_black_bytes(const unsigned char *buf,int nbytes)
+{
+        const uint64_t low7 = 0x7f7f7f7f7f7f7f7fULL;
+        uint64_t x;
+        int n = 0;
+        int i = 0;
+
+        for (; i+8<=nbytes; i += 8) {
+                memcpy(&x,buf+i,8);
+                n += __builtin_popcountll((((x&low7)+low7)|x)&~low7);
+        }
+
+        for (; i<nbytes; i++) {
+                n += buf[i]!=0;
+        }
+
+        return n;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  set_density
+Purpose   :  Switch print speed and dynamic division to region density
+             Dense regions use the maxspeed and dynadiv options, sparse
+             regions the sparsespeed and sparsedynadiv options. Settings
+             without both values are never switched
+Inputs    :  sparse : 1 before a sparse region, 0 before a dense one
+Outputs   :  Updates global sparse_mode
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void set_density(int sparse)
+{
+        command_t cmd;
+
+        if (sparse==sparse_mode)
+                return;
+
+        if (maxspeed!=-1 && sparsespeed!=-1) {
+                cmd_set_maximum_speed(printer_type,&cmd,sparse ? sparsespeed : maxspeed);
+                write_command(0,&cmd,NULL,0);
+        }
+        if (dynadiv!=-1 && sparsedynadiv!=-1) {
+                cmd_set_dynamic_division(printer_type,&cmd,sparse ? sparsedynadiv : dynadiv);
+                write_command(0,&cmd,NULL,0);
+        }
+
+        sparse_mode = sparse;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  read_raster
+Purpose   :  Read CUPS raster data, from buffered page if any
+Inputs    :  ras  : CUPS raster structure
+             buf  : buffer
+             size : number of bytes to read
+Outputs   :  Fills buf
+Return    :  number of bytes read
+-----------------------------------------------------------------------------*/
+static int read_raster(cups_raster_t *ras,unsigned char *buf,int size)
+{
+        if (!buffered)
+                return cupsRasterReadPixels(ras,buf,size);
+
+        if (size>raw_len-raw_pos)
+                size = raw_len-raw_pos;
+        memcpy(buf,raw_page+raw_pos,size);
+        raw_pos += size;
+
+        return size;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  read_pixels
+Purpose   :  Read CUPS raster data, from rotated page if any
+Inputs    :  ras  : CUPS raster structure
+             buf  : buffer
+             size : number of bytes to read
+Outputs   :  Fills buf
+Return    :  number of bytes read
+-----------------------------------------------------------------------------*/
+static int read_pixels(cups_raster_t *ras,unsigned char *buf,int size)
+{
+        if (!rotated)
+                return read_raster(ras,buf,size);
+
+        if (size>rot_len-rot_pos)
+                size = rot_len-rot_pos;
+        memcpy(buf,rot_page+rot_pos,size);
+        rot_pos += size;
+
+        return size;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  rotate_raster
+Purpose   :  Read whole page and rotate it to the head orientation
+             Grayscale dotlines are halftoned first
+Inputs    :  ras       : CUPS raster structure
+             width     : page width in dots
+             height    : page height in dotlines
+             bpl       : bytes per 1-bit dotline
+             direction : ROTATE_CW or ROTATE_CCW
+Outputs   :  Fills rot_page, rotated page has ROTATE_BPL(height) bytes per
+             dotline
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int rotate_raster(cups_raster_t *ras,int width,int height,int bpl,int direction)
+{
+        int dst_bpl = ROTATE_BPL(height);
+        long size = (long)height*bpl;
+        int n;
+        int y;
+
+        if (size>rot_srcsize) {
+                free(rot_src);
+                rot_srcsize = size;
+                rot_src = malloc(rot_srcsize);
+                if (rot_src==NULL) {
+                        rot_srcsize = 0;
+                        return job_error("Cannot allocate rotation buffer",APS_NO_MEMORY);
+                }
+        }
+        if ((long)width*dst_bpl>rot_pagesize) {
+                free(rot_page);
+                rot_pagesize = (long)width*dst_bpl;
+                rot_page = malloc(rot_pagesize);
+                if (rot_page==NULL) {
+                        rot_pagesize = 0;
+                        return job_error("Cannot allocate rotation buffer",APS_NO_MEMORY);
+                }
+        }
+        if (gray_bpl>gray_bufsize) {
+                free(gray_buf);
+                gray_bufsize = gray_bpl;
+                gray_buf = malloc(gray_bufsize);
+                if (gray_buf==NULL) {
+                        gray_bufsize = 0;
+                        return job_error("Cannot allocate dotline buffer",APS_NO_MEMORY);
+                }
+        }
+
+        for (y = 0; y<height && !cancel_flag; y++) {
+                if (gray_bpl==0) {
+                        n = read_raster(ras,rot_src+(long)y*bpl,bpl);
+
+                        if (n!=bpl) {
+                                return job_error("cupsRasterReadPixels did not read enough data",APS_IO_ERROR);
+                        }
+                }
+                else {
+                        n = read_raster(ras,gray_buf,gray_bpl);
+
+                        if (n!=gray_bpl) {
+                                return job_error("cupsRasterReadPixels did not read enough data",APS_IO_ERROR);
+                        }
+
+                        halftone_line(gray_buf,rot_src+(long)y*bpl);
+                }
+        }
+
+        if (rotate_page(rot_src,width,height,bpl,rot_page,dst_bpl,direction)<0) {
+                return job_error("Cannot rotate page",APS_NO_MEMORY);
+        }
+
+        rotated = 1;
+        rot_len = (long)width*dst_bpl;
+        rot_pos = 0;
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  read_band
+Purpose   :  Read band of CUPS dotlines
+             Grayscale dotlines are halftoned and fitted pages are scaled,
+             so bands are read in page order
+Inputs    :  ras   : CUPS raster structure
+             band  : band, buf is filled
+             lines : number of dotlines to read
+             bpl   : bytes per 1-bit dotline of band
+Outputs   :  <>
+Return    :  APS_OK or error code (band is then empty)
+-----------------------------------------------------------------------------*/
+static int read_band(cups_raster_t *ras,band_t *band,int lines,int bpl)
+{
+        unsigned char *in = fit_bpl ? fit_buf : band->buf;
+        int in_bpl = fit_bpl ? fit_bpl : bpl;
+        unsigned char *out;
+        int n;
+        int i;
+
+        if (gray_bpl==0) {
+                n = read_pixels(ras,in,lines*in_bpl);
+
+                if (n!=lines*in_bpl) {
+                        band->lines = 0;
+                        return job_error("cupsRasterReadPixels did not read enough data",APS_IO_ERROR);
+                }
+        }
+        else {
+                n = read_raster(ras,gray_buf,lines*gray_bpl);
+
+                if (n!=lines*gray_bpl) {
+                        band->lines = 0;
+                        return job_error("cupsRasterReadPixels did not read enough data",APS_IO_ERROR);
+                }
+
+                for (i = 0; i<lines; i++)
+                        halftone_line(gray_buf+i*gray_bpl,in+i*in_bpl);
+        }
+
+        if (fit_bpl==0) {
+                band->lines = lines;
+                return APS_OK;
+        }
+
+        /*scaled pages may give fewer dotlines than read*/
+        band->lines = 0;
+        out = band->buf;
+        memset(out,0,bpl);
+        for (i = 0; i<lines; i++) {
+                if (fit_line(in+i*in_bpl,out)) {
+                        band->lines++;
+                        out += bpl;
+                        if (i<lines-1)
+                                memset(out,0,bpl);
+                }
+        }
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encode_band
+Purpose   :  Find blank dotlines of band and encode the others
+             Dotlines are encoded without their shift command, which depends
+             on the previous dotlines and is added by emit_band
+Inputs    :  band   : band read by read_band
+             nbytes : width of dotline in bytes
+             bpl    : bytes per 1-bit dotline
+Outputs   :  Fills band lead, size, out and trimmed
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void encode_band(band_t *band,int nbytes,int bpl)
+{
+        aps_encoder_t enc;
+        unsigned char *p = band->buf;
+        unsigned char *out = band->out;
+        int i;
+
+        aps_encoder_init(&enc,printer_type,encoder.flags);
+
+        for (i = 0; i<band->lines; i++, p += bpl) {
+                band->lead[i] = count_leading_blank(p,nbytes);
+                band->size[i] = 0;
+                band->black[i] = 0;
+
+                if (band->lead[i]==nbytes)
+                        continue;
+
+                if (density_ctl) {
+                        band->black[i] = count_black_bytes(p+band->lead[i],nbytes-band->lead[i]);
+                }
+
+                /*shift is already set, only the dotline is encoded*/
+                enc.shift = band->lead[i];
+                band->size[i] = aps_encode_dotline(&enc,p,nbytes,out);
+                out += band->size[i];
+        }
+
+        band->trimmed = enc.trimmed;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  emit_band
+Purpose   :  Write APS commands of encoded band
+             Blank dotlines are queued and printed before the next printed
+             dotline, as dotline counting (maxlength) and top blank removal
+             (rmtop) need the dotlines in page order
+             Band is cut in regions of REGION_LINES dotlines, and speed and
+             dynamic division follow the density of each region
+Inputs    :  band       : band encoded by encode_band
+             nbytes     : width of dotline in bytes
+             rmtop_once : set while top blank dotlines are removed
+Outputs   :  Updates global blank_counter, rmtop_once and sparse_mode
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void emit_band(const band_t *band,int nbytes,int *rmtop_once)
+{
+        unsigned char shift[APS_ENCODE_MAX(0)];
+        const unsigned char *out = band->out;
+        unsigned long shifts;
+        int i;
+
+        for (i = 0; i<band->lines; i++) {
+                /*sparse region if black bytes are at most sparselimit % of it*/
+                if (density_ctl && i%REGION_LINES==0) {
+                        int end = i+REGION_LINES<band->lines ? i+REGION_LINES : band->lines;
+                        long black = 0;
+                        int k;
+
+                        for (k = i; k<end; k++)
+                                black += band->black[k];
+
+                        set_density(black*100<=(long)sparselimit*nbytes*(end-i));
+                }
+
+                enc_stats.dotlines++;
+
+                if (band->lead[i]==nbytes) {
+                        blank_counter++;
+                        enc_stats.blank++;
+                        continue;
+                }
+
+                /*print queued blank dotlines*/
+                if (blank_counter && !*rmtop_once) {
+                        print_blank(blank_counter,nbytes);
+                        blank_counter = 0;
+                }
+                *rmtop_once = 0;
+
+                /*print dotline*/
+                next_dotline();
+
+                shifts = encoder.shifts;
+                write_data(0,shift,aps_encode_shift(&encoder,band->lead[i],shift));
+                enc_stats.shifts += encoder.shifts-shifts;
+
+                write_data(0,out,band->size[i]);
+                out += band->size[i];
+        }
+
+        enc_stats.trimmed += band->trimmed;
+
+        fflush(stdout);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  ring_init, ring_push, ring_pop
+Purpose   :  Single-producer/single-consumer ring of bands
+             The ring holds every band of the pipeline so it is never full;
+             the semaphore counts queued bands and orders the memory
+             accesses of both threads
+Inputs    :  r    : ring
+             band : band to queue
+Outputs   :  <>
+Return    :  ring_pop: next band
+-----------------------------------------------------------------------------*/
+static void ring_init(ring_t *r)
+{
+        r->head = 0;
+        r->tail = 0;
+        sem_init(&r->items,0,0);
+}
+
+static void ring_push(ring_t *r,band_t *band)
+{
+        r->slot[r->head%RING_SIZE] = band;
+        r->head++;
+        sem_post(&r->items);
+}
+
+static band_t *ring_pop(ring_t *r)
+{
+        band_t *band;
+
+        while (sem_wait(&r->items)<0)
+                ;                       /*interrupted by SIGTERM*/
+
+        band = r->slot[r->tail%RING_SIZE];
+        r->tail++;
+
+        return band;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  read_thread
+Purpose   :  Pipeline stage reading bands of the page
+             Bands are handed to workers in turn; the end of page band is
+             queued to every worker, starting with the next one in turn
+             Reading stops when the job is cancelled or fails
+Inputs    :  arg : <>
+Outputs   :  <>
+Return    :  NULL
+-----------------------------------------------------------------------------*/
+static void *read_thread(void *arg)
+{
+        int k = 0;
+        int y;
+        int i;
+
+        (void)arg;
+
+        for (y = 0; y<pipe_height && !job_stopped(); y += band_height, k++) {
+                band_t *band = ring_pop(&free_ring);
+                int lines = pipe_height-y;
+
+                if (lines>band_height)
+                        lines = band_height;
+
+                read_band(pipe_ras,band,lines,pipe_bpl);
+                ring_push(&workers[k%num_workers].in,band);
+        }
+
+        for (i = 0; i<num_workers; i++)
+                ring_push(&workers[(k+i)%num_workers].in,&end_band);
+
+        return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encode_thread
+Purpose   :  Pipeline stage encoding bands
+Inputs    :  arg : worker
+Outputs   :  <>
+Return    :  NULL
+-----------------------------------------------------------------------------*/
+static void *encode_thread(void *arg)
+{
+        worker_t *w = arg;
+        band_t *band;
+
+        do {
+                band = ring_pop(&w->in);
+                if (band!=&end_band)
+                        encode_band(band,pipe_nbytes,pipe_bpl);
+                ring_push(&w->out,band);
+        } while (band!=&end_band);
+
+        return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  get_workers
+Purpose   :  Get number of encoding threads (rasterthreads option)
+Inputs    :  <>
+Outputs   :  <>
+Return    :  number of threads, 0 to encode in main thread
+-----------------------------------------------------------------------------*/
+static int get_workers(void)
+{
+        long n = rasterthreads;
+
+        /*automatic: one thread per processor*/
+        if (n<=0)
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (n<=1)
+                return 0;
+        if (n>WORKERS_MAX)
+                n = WORKERS_MAX;
+
+        return n;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  free_bands
+Purpose   :  Free bands
+Inputs    :  <>
+Outputs   :  Updates global bands
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void free_bands(void)
+{
+        int i;
+
+        for (i = 0; i<num_bands; i++) {
+                free(bands[i].buf);
+                free(bands[i].out);
+                free(bands[i].lead);
+                free(bands[i].size);
+                free(bands[i].black);
+        }
+        free(bands);
+
+        bands = NULL;
+        num_bands = 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  get_band_height
+Purpose   :  Get number of dotlines read at once
+             A band and its encoded commands fill half of the L2 cache; in
+             the pipeline every worker gets at least two bands of the page
+Inputs    :  bpl    : bytes per 1-bit dotline and grayscale dotline
+             nbytes : width of dotline in bytes
+             height : page height in dotlines
+Outputs   :  <>
+Return    :  band height in dotlines
+-----------------------------------------------------------------------------*/
+static int get_band_height(int bpl,int nbytes,int height)
+{
+        long l2;
+        long h;
+
+        l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        if (l2<=0)
+                l2 = L2_DEFSIZE;
+
+        h = l2/2/(bpl+APS_ENCODE_MAX(nbytes));
+
+        if (num_workers && h>height/(BANDS_PER_WORKER*num_workers))
+                h = height/(BANDS_PER_WORKER*num_workers);
+
+        if (h>BAND_MAX)
+                h = BAND_MAX;
+        if (h<BAND_MIN)
+                h = BAND_MIN;
+
+        return h;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  alloc_bands
+Purpose   :  Make sure bands of previous pages are large enough
+Inputs    :  count  : number of bands
+             lines  : dotlines per band
+             bpl    : bytes per 1-bit dotline
+             nbytes : width of dotline in bytes
+Outputs   :  Updates global bands, gray_buf and fit_buf
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int alloc_bands(int count,int lines,int bpl,int nbytes)
+{
+        int bufsize = lines*bpl;
+        int outsize = lines*APS_ENCODE_MAX(nbytes);
+        int i;
+
+        if (lines*fit_bpl>fit_bufsize) {
+                free(fit_buf);
+                fit_bufsize = lines*fit_bpl;
+                fit_buf = malloc(fit_bufsize);
+                if (fit_buf==NULL) {
+                        fit_bufsize = 0;
+                        return job_error("Cannot allocate dotline buffer",APS_NO_MEMORY);
+                }
+        }
+
+        if (lines*gray_bpl>gray_bufsize) {
+                free(gray_buf);
+                gray_bufsize = lines*gray_bpl;
+                gray_buf = malloc(gray_bufsize);
+                if (gray_buf==NULL) {
+                        gray_bufsize = 0;
+                        return job_error("Cannot allocate dotline buffer",APS_NO_MEMORY);
+                }
+        }
+
+        if (count<=num_bands && lines<=band_lines &&
+            bufsize<=band_bufsize && outsize<=band_outsize)
+                return APS_OK;
+
+        if (count<num_bands)
+                count = num_bands;
+        if (lines<band_lines)
+                lines = band_lines;
+        if (bufsize<band_bufsize)
+                bufsize = band_bufsize;
+        if (outsize<band_outsize)
+                outsize = band_outsize;
+
+        free_bands();
+
+        bands = calloc(count,sizeof(band_t));
+        if (bands==NULL) {
+                return job_error("Cannot allocate dotline buffer",APS_NO_MEMORY);
+        }
+
+        /*bands allocated so far are freed by next allocation*/
+        num_bands = count;
+        band_lines = 0;
+        band_bufsize = 0;
+        band_outsize = 0;
+
+        for (i = 0; i<count; i++) {
+                band_t *band = &bands[i];
+
+                band->buf = malloc(bufsize);
+                band->out = malloc(outsize);
+                band->lead = malloc(lines*sizeof(int));
+                band->size = malloc(lines*sizeof(int));
+                band->black = malloc(lines*sizeof(int));
+                if (band->buf==NULL || band->out==NULL || band->lead==NULL ||
+                    band->size==NULL || band->black==NULL) {
+                        return job_error("Cannot allocate dotline buffer",APS_NO_MEMORY);
+                }
+        }
+
+        band_lines = lines;
+        band_bufsize = bufsize;
+        band_outsize = outsize;
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  end_encoding
+Purpose   :  Restore dense region settings for next page, free halftoning
+             and fitting buffers of page
+Inputs    :  <>
+Outputs   :  Updates global sparse_mode
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void end_encoding(void)
+{
+        /*next page starts with dense region settings*/
+        set_density(0);
+
+        if (gray_bpl) {
+                halftone_end();
+        }
+        if (fit_bpl) {
+                fit_end();
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encode_page
+Purpose   :  Encode one CUPS page
+             Bands of dotlines are read, encoded and emitted in turn, or by
+             a pipeline: a thread reads bands, a pool of threads encodes
+             them and the main thread emits them in page order
+             Band height follows the page width (see get_band_height) and
+             bands are kept for the next pages
+             8-bit grayscale pages are halftoned (halftone option), other
+             pages are 1-bit
+             Pages may be rotated by 90 degrees first (rotate option)
+             Pages wider than the head are scaled down (fitwidth option)
+             or truncated, narrower pages may be centered (centerpage)
+             Sparse regions may print faster (see set_density)
+             Errors are recorded by job_error, the page is then left
+Inputs    :  ras    : CUPS raster structure
+             header : CUPS page header structure
+Outputs   :  Updates global blank_counter
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void encode_page(cups_raster_t *ras,cups_page_header_t *header)
+{
+        pthread_t reader;
+        band_t *band;
+        int count;
+        int nbytes;
+        int bpl = header->cupsBytesPerLine;
+        int height = header->cupsHeight;
+        int width = header->cupsWidth;
+        int head = printer_width*8;
+        int rmtop_once;
+        int started;
+        int reading;
+        int i;
+        int k;
+
+        rmtop_once = rmtop;
+
+        /*halftone 8-bit grayscale pages, 0 is white in K color space*/
+        gray_bpl = 0;
+        fit_bpl = 0;
+        if (header->cupsBitsPerColor==8 && header->cupsBitsPerPixel==8) {
+                gray_bpl = bpl;
+                bpl = (header->cupsWidth+7)/8;
+
+                if (halftone_start(halftone,header->cupsWidth,
+                                   header->cupsColorSpace==CUPS_CSPACE_K)<0) {
+                        job_error("Cannot allocate halftoning buffers",APS_NO_MEMORY);
+                        return;
+                }
+        }
+
+        if (width<=0 || width>bpl*8)
+                width = bpl*8;
+
+        /*turn landscape pages to the head orientation*/
+        rotated = 0;
+        if (rotate>ROTATE_NONE) {
+                if (rotate_raster(ras,width,height,bpl,rotate)<0) {
+                        end_encoding();
+                        return;
+                }
+
+                bpl = ROTATE_BPL(height);
+                height = width;
+                width = header->cupsHeight;
+
+                if (gray_bpl) {
+                        halftone_end();
+                        gray_bpl = 0;
+                }
+        }
+
+        /*scale wide pages down to head width, center narrow pages*/
+        if (fitwidth>FIT_NONE && width>head) {
+                if (fit_start(width,head,0,height,fitwidth==FIT_ASPECT,
+                              gray_bpl==0)<0) {
+                        job_error("Cannot allocate fitting buffers",APS_NO_MEMORY);
+                        end_encoding();
+                        return;
+                }
+                fit_bpl = bpl;
+                bpl = printer_width;
+        }
+        else if (centerpage>0 && width<head) {
+                if (fit_start(width,width,(head-width)/2,height,0,1)<0) {
+                        job_error("Cannot allocate fitting buffers",APS_NO_MEMORY);
+                        end_encoding();
+                        return;
+                }
+                fit_bpl = bpl;
+                bpl = printer_width;
+        }
+
+        /*compute printer dotline size*/
+        if (bpl>printer_width)
+                nbytes = printer_width;
+        else
+                nbytes = bpl;
+
+        /*black bytes are only counted if settings can be switched*/
+        density_ctl = sparselimit>=0 &&
+                      ((maxspeed!=-1 && sparsespeed!=-1) ||
+                       (dynadiv!=-1 && sparsedynadiv!=-1));
+
+        num_workers = get_workers();
+        count = num_workers ? BANDS_PER_WORKER*num_workers+2 : 1;
+        band_height = get_band_height(bpl+gray_bpl+fit_bpl,nbytes,height);
+        if (density_ctl) {
+                /*regions never cross bands, whatever the number of threads*/
+                band_height = (band_height+REGION_LINES-1)/REGION_LINES*REGION_LINES;
+        }
+
+        if (alloc_bands(count,band_height,bpl,nbytes)<0) {
+                end_encoding();
+                return;
+        }
+
+        if (num_workers==0) {
+                /*read dotlines and print APS commands to stdout*/
+                band = &bands[0];
+                for (k = 0; k<height && !job_stopped(); k += band_height) {
+                        if (read_band(ras,band,height-k<band_height ? height-k : band_height,bpl)<0)
+                                break;
+                        encode_band(band,nbytes,bpl);
+                        emit_band(band,nbytes,&rmtop_once);
+                }
+        }
+        else {
+                pipe_ras = ras;
+                pipe_bpl = bpl;
+                pipe_nbytes = nbytes;
+                pipe_height = height;
+
+                ring_init(&free_ring);
+                for (i = 0; i<count; i++)
+                        ring_push(&free_ring,&bands[i]);
+
+                for (started = 0; started<num_workers; started++) {
+                        worker_t *w = &workers[started];
+
+                        ring_init(&w->in);
+                        ring_init(&w->out);
+                        if (pthread_create(&w->thread,NULL,encode_thread,w)!=0) {
+                                sem_destroy(&w->in.items);
+                                sem_destroy(&w->out.items);
+                                job_error("Cannot create encoding thread",APS_NO_MEMORY);
+                                break;
+                        }
+                }
+
+                reading = started==num_workers &&
+                          pthread_create(&reader,NULL,read_thread,NULL)==0;
+                if (started==num_workers && !reading)
+                        job_error("Cannot create reading thread",APS_NO_MEMORY);
+
+                if (reading) {
+                        /*emit bands in page order, then give them back to the reader*/
+                        for (k = 0; ; k++) {
+                                band = ring_pop(&workers[k%num_workers].out);
+                                if (band==&end_band)
+                                        break;
+
+                                emit_band(band,nbytes,&rmtop_once);
+                                ring_push(&free_ring,band);
+                        }
+
+                        pthread_join(reader,NULL);
+                }
+                else {
+                        /*workers started without a reader are stopped*/
+                        for (i = 0; i<started; i++)
+                                ring_push(&workers[i].in,&end_band);
+                }
+
+                for (i = 0; i<started; i++) {
+                        pthread_join(workers[i].thread,NULL);
+                        sem_destroy(&workers[i].in.items);
+                        sem_destroy(&workers[i].out.items);
+                }
+                sem_destroy(&free_ring.items);
+        }
+
+        end_encoding();
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  buffer_page
+Purpose   :  Read whole page in memory and build its page cache key
+             The raster is hashed as it is read, in chunks small enough to
+             be hashed from the data cache
+Inputs    :  ras    : CUPS raster structure
+             header : CUPS page header structure
+Outputs   :  key    : page cache key
+Return    :  1 if page was buffered, 0 if it is too large or on error
+-----------------------------------------------------------------------------*/
+static int buffer_page(cups_raster_t *ras,cups_page_header_t *header,page_key_t *key)
+{
+        long size = (long)header->cupsBytesPerLine*header->cupsHeight;
+        uint64_t hash;
+        long pos;
+        int n;
+
+        if (size<=0 || size>PAGE_RASTER_MAX)
+                return 0;
+
+        if (size>raw_pagesize) {
+                free(raw_page);
+                raw_pagesize = size;
+                raw_page = malloc(raw_pagesize);
+                if (raw_page==NULL) {
+                        raw_pagesize = 0;
+                        job_error("Cannot allocate page buffer",APS_NO_MEMORY);
+                        return 0;
+                }
+        }
+
+        hash = cache_hash(header,sizeof(cups_page_header_t),0);
+
+        for (pos = 0; pos<size && !cancel_flag; pos += n) {
+                n = size-pos<PAGE_CHUNK ? size-pos : PAGE_CHUNK;
+
+                if (cupsRasterReadPixels(ras,raw_page+pos,n)!=(unsigned int)n) {
+                        job_error("cupsRasterReadPixels did not read enough data",APS_IO_ERROR);
+                        return 0;
+                }
+
+                hash = cache_hash_wide(raw_page+pos,n,hash);
+        }
+
+        /*same raster, settings and encoder state give the same commands*/
+        memset(key,0,sizeof(page_key_t));
+        key->cache_version = PAGE_CACHE_VERSION;
+        key->hash = hash;
+        key->size = size;
+        key->printer_type = printer_type;
+        key->printer_width = printer_width;
+        key->optprint = optprint;
+        key->rmtop = rmtop;
+        key->halftone = halftone;
+        key->fitwidth = fitwidth;
+        key->centerpage = centerpage;
+        key->rotate = rotate;
+        key->maxspeed = maxspeed;
+        key->dynadiv = dynadiv;
+        key->sparsespeed = sparsespeed;
+        key->sparsedynadiv = sparsedynadiv;
+        key->sparselimit = sparselimit;
+        key->blank_counter = blank_counter;
+        key->shift = encoder.shift;
+        key->feed = encoder.feed;
+
+        buffered = 1;
+        raw_len = size;
+        raw_pos = 0;
+
+        return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  replay_page
+Purpose   :  Write commands of cached page
+Inputs    :  data : page cache entry
+             size : page cache entry size in bytes
+Outputs   :  Updates global blank_counter and encoder state
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void replay_page(const unsigned char *data,int size)
+{
+        page_entry_t e;
+
+        memcpy(&e,data,sizeof(e));
+
+        write_captured(data+sizeof(e),size-sizeof(e));
+        fflush(stdout);
+
+        blank_counter = e.blank_counter;
+        encoder.shift = e.shift;
+        encoder.feed = e.feed;
+
+        enc_stats.dotlines += e.dotlines;
+        enc_stats.blank += e.blank;
+        enc_stats.trimmed += e.trimmed;
+        enc_stats.shifts += e.shifts;
+        enc_stats.saved += e.saved;
+        enc_stats.cached += e.dotlines;
+        enc_stats.bytes += size-sizeof(e);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  store_page
+Purpose   :  Store commands of encoded page in page cache
+Inputs    :  key  : page cache key
+             buf  : page commands
+             size : page commands size in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void store_page(const page_key_t *key,const char *buf,long size)
+{
+        page_entry_t *e;
+
+        if (size>PAGE_BYTES)
+                return;
+
+        e = malloc(sizeof(page_entry_t)+size);
+        if (e==NULL)
+                return;
+
+        /*statistics are counted from the start of the page*/
+        e->blank_counter = blank_counter;
+        e->shift = encoder.shift;
+        e->feed = encoder.feed;
+        e->dotlines = enc_stats.dotlines;
+        e->blank = enc_stats.blank;
+        e->trimmed = enc_stats.trimmed;
+        e->shifts = enc_stats.shifts;
+        e->saved = enc_stats.saved;
+        memcpy(e+1,buf,size);
+
+        cache_store(page_cache,key,sizeof(page_key_t),e,sizeof(page_entry_t)+size);
+
+        free(e);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  process_page
+Purpose   :  Process one CUPS page
+             With a page cache, the page is read and hashed first: a page
+             already encoded is replayed, others are encoded (see
+             encode_page) and their commands are kept
+Inputs    :  ras    : CUPS raster structure
+             header : CUPS page header structure
+Outputs   :  Updates global blank_counter
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void process_page(cups_raster_t *ras,cups_page_header_t *header)
+{
+        const unsigned char *data;
+        page_key_t key;
+        char *buf = NULL;
+        size_t len = 0;
+        FILE *old = NULL;
+        FILE *f = NULL;
+        int size;
+
+        buffered = 0;
+
+        if (page_cache!=NULL && buffer_page(ras,header,&key)) {
+                if (cache_lookup(page_cache,&key,sizeof(key),&data,&size)) {
+                        replay_page(data,size);
+                        buffered = 0;
+                        return;
+                }
+
+                /*commands are captured, then written and stored*/
+                f = open_memstream(&buf,&len);
+                if (f!=NULL)
+                        old = set_ticket_output(f);
+        }
+        else if (job_errnum<0) {
+                /*page could not be read*/
+                return;
+        }
+
+        encode_page(ras,header);
+
+        if (f!=NULL) {
+                set_ticket_output(old);
+                fclose(f);
+
+                write_captured(buf,len);
+                fflush(stdout);
+
+                if (!job_stopped())
+                        store_page(&key,buf,len);
+        }
+
+        free(buf);
+        buffered = 0;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  raster_cancel
+Purpose   :  Cancel current job, the job function returns as soon as
+             possible; may be called from a signal handler
+Inputs    :  <>
+Outputs   :  Updates global cancel_flag
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void raster_cancel(void)
+{
+        cancel_flag = 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  raster_job
+Purpose   :  Encode CUPS raster job to the ticket output (stdout or the
+             output set by set_ticket_output)
+             Options must have been read (get_options, read_options); the
+             job is encoded once and replayed for every copy
+             Errors are logged and the job is left at the first one, the
+             ticket output is then flushed and restored; buffers are freed
+             before returning, so jobs may follow in the same process
+Inputs    :  fd     : CUPS raster stream
+             copies : number of copies
+Outputs   :  <>
+Return    :  APS_OK (also when cancelled) or error code
+-----------------------------------------------------------------------------*/
+int raster_job(int fd,int copies)
+{
+    cups_raster_t *ras;
+    cups_page_header_t header;
+    int page;
+    int errnum;
+
+    job_errnum = APS_OK;
+
+    /*open CUPS raster stream*/
+    ras = cupsRasterOpen(fd,CUPS_RASTER_READ);
+    if (ras==NULL) {
+        return job_error("cupsRasterOpen failed",APS_IO_ERROR);
+    }
+
+    /*framed stream header is sent once, before the spooled copies*/
+    start_stream(STREAM_CRC);
+
+    /*encode job once, it is replayed for every copy*/
+    if (start_copies(copies)<0) {
+        debug("Cannot spool job, printing one copy",NULL);
+        copies = 1;
+    }
+
+    /*write ticket prolog*/
+    write_prolog(0);
+
+    /*read and process pages*/
+    memset(blank_buf,0,sizeof(blank_buf));
+
+    dotlines_counter = 0;
+    blank_counter = 0;
+    if ((errnum = aps_encoder_init(&encoder,printer_type,optprint ? APS_BITMAP_TRIM : 0))<0) {
+        job_error(aps_strerror(errnum),errnum);
+    }
+
+    /*encoded pages are kept if no dotline counting cuts them*/
+    if (pagecache>0 && maxlength+maxlengthmm<0 && !job_stopped()) {
+        char *dir = cache_queue_dir(cache_dir!=NULL ? cache_dir : CACHE_DIR,"page");
+
+        page_cache = cache_create(PAGE_ENTRIES,PAGE_BYTES,dir);
+        cache_set_disk_limit(page_cache,(long)pagecache*1024*1024);
+        free(dir);
+    }
+
+    page = 0;
+
+    while (cupsRasterReadHeader(ras,&header) && !job_stopped()) {
+
+        /*do page accounting*/
+        page++;
+        fprintf(stderr,"PAGE: %d %d\n",page,copies);
+        write_marker(STREAM_PAGE,page);
+
+        /*process page*/
+        encstats_page_begin();
+        process_page(ras,&header);
+        encstats_page_end(page);
+    }
+
+    /*reset dotline shift amount, also left by cached pages*/
+    if (encoded!=NULL || encoder.shift>0) {
+        unsigned char end[APS_ENCODE_MAX(0)];
+        unsigned long shifts = encoder.shifts;
+
+        write_data(0,end,aps_encode_end(&encoder,end));
+        enc_stats.shifts += encoder.shifts-shifts;
+        fflush(stdout);
+    }
+
+    if (job_errnum<0) {
+        debug("Print job failed",NULL);
+    }
+    else if (cancel_flag) {
+        debug("Print job was cancelled",NULL);
+    }
+    else {
+        /*print trailing blank dotlines in page mode*/
+        if (blank_counter && pagemode) {
+            print_blank(blank_counter,printer_width);
+        }
+
+        /*write ticket epilog*/
+        write_epilog(0);
+    }
+
+    /*send all copies, a cancelled or failed job is sent once*/
+    if (end_copies(job_stopped() ? 1 : copies)<0) {
+        debug("Cannot replay spooled job",NULL);
+    }
+    end_stream();
+
+    /*report what dotline optimizations saved*/
+    encstats_job_end("rastertoaps");
+
+    /*close CUPS raster stream*/
+    cupsRasterClose(ras);
+
+    /*next job starts with new buffers*/
+    free(encoded);
+    encoded = NULL;
+    encoded_max = 0;
+    free_bands();
+    band_lines = 0;
+    band_bufsize = 0;
+    band_outsize = 0;
+    free(gray_buf);
+    gray_buf = NULL;
+    gray_bufsize = 0;
+    free(fit_buf);
+    fit_buf = NULL;
+    fit_bufsize = 0;
+    free(rot_src);
+    rot_src = NULL;
+    rot_srcsize = 0;
+    free(rot_page);
+    rot_page = NULL;
+    rot_pagesize = 0;
+    free(raw_page);
+    raw_page = NULL;
+    raw_pagesize = 0;
+    cache_free(page_cache);
+    page_cache = NULL;
+
+    /*a cancel stops the current job only*/
+    cancel_flag = 0;
+
+    return job_errnum;
+}
@@ -0,0 +1,204 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : rotate.c
+* DESCRIPTION   : Rotation of raster pages to the printer head orientation
+*
+*                 A packed page is turned by 90 degrees with bit transposes:
+*                 8 source dotlines by 8 dots give 8 bytes of 8 rotated
+*                 dotlines (16 source dotlines at once with SSE2). Pages are
+*                 walked in blocks of dotlines and byte columns small enough
+*                 for the source bytes and the rotated dotlines they write
+*                 to stay in the L1 cache.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "rotate.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define BLOCK_ROWS      64              /*source dotlines per block*/
+#define BLOCK_BYTES     16              /*source bytes per block dotline*/
+
+#ifdef __SSE2__
+#define GROUP           16              /*source dotlines per transpose*/
+#else
+#define GROUP           8
+#endif
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  transpose8
+Purpose   :  Transpose 8x8 bit matrix
+Inputs    :  in  : 8 bytes, first row first, first column in MSB
+             out : 8 bytes
+Outputs   :  Fills out, byte k holds column k of in
+Return    :  <>
+-----------------------------------------------------------------------------*/
+#ifndef __SSE2__
+static void transpose8(const unsigned char *in,unsigned char *out)
+{
+        uint64_t x = 0;
+        uint64_t t;
+        int i;
+
+        for (i = 0; i<8; i++)
+                x = (x<<8)|in[i];
+
+        t = (x^(x>>7))&0x00aa00aa00aa00aaULL;
+        x = x^t^(t<<7);
+        t = (x^(x>>14))&0x0000cccc0000ccccULL;
+        x = x^t^(t<<14);
+        t = (x^(x>>28))&0x00000000f0f0f0f0ULL;
+        x = x^t^(t<<28);
+
+        for (i = 7; i>=0; i--) {
+                out[i] = x&0xff;
+                x >>= 8;
+        }
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+Name      :  rotate_group
+Purpose   :  Rotate GROUP source dotlines over a range of byte columns
+Inputs    :  rows      : GROUP source dotlines, in rotated dot order
+             bx0, bx1  : byte columns to rotate
+             width     : source width in dots
+             dst       : first byte of rotated dotline 0 for this group
+             dst_bpl   : bytes per rotated dotline
+             direction : ROTATE_CW or ROTATE_CCW
+Outputs   :  Writes GROUP/8 bytes in rotated dotlines
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void rotate_group(const unsigned char **rows,int bx0,int bx1,int width,
+                         unsigned char *dst,int dst_bpl,int direction)
+{
+        int bx;
+        int k;
+
+        for (bx = bx0; bx<bx1; bx++) {
+#ifdef __SSE2__
+                /*first dotline in top byte, MSB of each byte moves out first*/
+                __m128i v = _mm_set_epi8(rows[0][bx],rows[1][bx],rows[2][bx],rows[3][bx],
+                                         rows[4][bx],rows[5][bx],rows[6][bx],rows[7][bx],
+                                         rows[8][bx],rows[9][bx],rows[10][bx],rows[11][bx],
+                                         rows[12][bx],rows[13][bx],rows[14][bx],rows[15][bx]);
+
+                for (k = 0; k<8 && bx*8+k<width; k++) {
+                        int x = bx*8+k;
+                        unsigned char *d = dst+(long)(direction==ROTATE_CW ? x : width-1-x)*dst_bpl;
+                        int bits = _mm_movemask_epi8(v);
+
+                        d[0] = bits>>8;
+                        d[1] = bits&0xff;
+                        v = _mm_slli_epi64(v,1);
+                }
+#else
+                unsigned char in[8];
+                unsigned char out[8];
+
+                for (k = 0; k<8; k++)
+                        in[k] = rows[k][bx];
+                transpose8(in,out);
+
+                for (k = 0; k<8 && bx*8+k<width; k++) {
+                        int x = bx*8+k;
+
+                        dst[(long)(direction==ROTATE_CW ? x : width-1-x)*dst_bpl] = out[k];
+                }
+#endif
+        }
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  rotate_page
+Purpose   :  Rotate packed page by 90 degrees
+             Rotated page has width dotlines of height dots, padded with
+             white dots up to dst_bpl bytes
+Inputs    :  src       : packed page
+             width     : page width in dots
+             height    : page height in dotlines
+             bpl       : bytes per page dotline
+             dst       : rotated page, width dotlines of dst_bpl bytes
+             dst_bpl   : bytes per rotated dotline, at least ROTATE_BPL(height)
+             direction : ROTATE_CW or ROTATE_CCW
+Outputs   :  Fills dst
+Return    :  0 if successful, -1 on error
+-----------------------------------------------------------------------------*/
+int rotate_page(const unsigned char *src,int width,int height,int bpl,
+                unsigned char *dst,int dst_bpl,int direction)
+{
+        const unsigned char *rows[GROUP];
+        unsigned char *zero;
+        int padded = (height+GROUP-1)/GROUP*GROUP;
+        int nbytes = (width+7)/8;
+        int c0, bx0;
+        int c, bx1;
+        int i;
+
+        if (dst_bpl<ROTATE_BPL(height) || nbytes>bpl)
+                return -1;
+
+        /*dotlines past page end rotate to white dots*/
+        zero = calloc(bpl,1);
+        if (zero==NULL)
+                return -1;
+
+        for (c0 = 0; c0<padded; c0 += BLOCK_ROWS) {
+                for (bx0 = 0; bx0<nbytes; bx0 += BLOCK_BYTES) {
+                        bx1 = bx0+BLOCK_BYTES<nbytes ? bx0+BLOCK_BYTES : nbytes;
+
+                        /*rotated dot c comes from last dotline first when clockwise*/
+                        for (c = c0; c<c0+BLOCK_ROWS && c<padded; c += GROUP) {
+                                for (i = 0; i<GROUP; i++) {
+                                        if (c+i>=height)
+                                                rows[i] = zero;
+                                        else if (direction==ROTATE_CW)
+                                                rows[i] = src+(long)(height-1-c-i)*bpl;
+                                        else
+                                                rows[i] = src+(long)(c+i)*bpl;
+                                }
+
+                                rotate_group(rows,bx0,bx1,width,dst+c/8,dst_bpl,direction);
+                        }
+                }
+        }
+
+        /*padding bytes of rotated dotlines*/
+        for (c = padded/8; c<dst_bpl; c++)
+                for (i = 0; i<width; i++)
+                        dst[(long)i*dst_bpl+c] = 0;
+
+        free(zero);
+
+        return 0;
+}
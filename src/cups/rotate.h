@@ -0,0 +1,49 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : rotate.h
+* DESCRIPTION   : Rotation of raster pages to the printer head orientation
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _ROTATE_H
+#define _ROTATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*rotate option*/
+#define ROTATE_NONE             0
+#define ROTATE_CW               1       /*90 degrees clockwise*/
+#define ROTATE_CCW              2       /*90 degrees counterclockwise*/
+
+/*bytes per rotated dotline, padded to 16 dots*/
+#define ROTATE_BPL(height)      (((height)+15)/16*2)
+
+int     rotate_page(const unsigned char *src,int width,int height,int bpl,
+                    unsigned char *dst,int dst_bpl,int direction);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_ROTATE_H*/
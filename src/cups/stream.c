@@ -0,0 +1,422 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : stream.c
+* DESCRIPTION   : Framed command stream between filters and backend
+*
+*                 Filters batch printer commands into DATA records and mark
+*                 page, cut and copy boundaries; the backend reads the
+*                 stream in large reads (see stream.h for the layout).
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <aps/aps.h>
+
+#include "stream.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define BATCH_SIZE      16384   /*bytes of commands per DATA record*/
+#define READ_SIZE       65536   /*bytes per read*/
+
+/*writer state*/
+static unsigned char    batch[BATCH_SIZE];
+static int              batch_len;
+static FILE             *batch_file;
+static int              stream_flags;
+
+static uint32_t         crc_table[256];
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  put_le32, get_le32
+Purpose   :  Store and load little-endian 32-bit integer
+Inputs    :  p : bytes
+             v : value
+Outputs   :  <>
+Return    :  value
+-----------------------------------------------------------------------------*/
+static void put_le32(unsigned char *p,uint32_t v)
+{
+        p[0] = v;
+        p[1] = v>>8;
+        p[2] = v>>16;
+        p[3] = v>>24;
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+        return p[0]|(p[1]<<8)|(p[2]<<16)|((uint32_t)p[3]<<24);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_record
+Purpose   :  Write record to stream
+             CRC covers record header and payload
+Inputs    :  f       : stream file
+             type    : record type
+             payload : record payload
+             size    : payload size in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void write_record(FILE *f,int type,const void *payload,uint32_t size)
+{
+        unsigned char hdr[STREAM_RECORD_SIZE];
+        unsigned char crc[4];
+
+        memset(hdr,0,sizeof(hdr));
+        hdr[0] = type;
+        put_le32(hdr+4,size);
+
+        fwrite(hdr,sizeof(hdr),1,f);
+        if (size>0)
+                fwrite(payload,size,1,f);
+
+        if (stream_flags&STREAM_CRC) {
+                put_le32(crc,stream_crc32(stream_crc32(0,hdr,sizeof(hdr)),payload,size));
+                fwrite(crc,sizeof(crc),1,f);
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  fill
+Purpose   :  Read until given number of bytes is available after record start
+Inputs    :  r    : stream reader
+             need : number of bytes
+Outputs   :  Buffer is compacted and grown as needed
+Return    :  1 if bytes are available, 0 on end of file, or error code
+-----------------------------------------------------------------------------*/
+static int fill(stream_reader_t *r,int need)
+{
+        int n;
+
+        if (r->len-r->pos>=need)
+                return 1;
+
+        if (r->pos>0) {
+                memmove(r->buf,r->buf+r->pos,r->len-r->pos);
+                r->len -= r->pos;
+                r->pos = 0;
+        }
+
+        if (need>r->max) {
+                unsigned char *p = realloc(r->buf,need);
+
+                if (p==NULL)
+                        return APS_IO_ERROR;
+                r->buf = p;
+                r->max = need;
+        }
+
+        while (r->len<need) {
+                n = read(r->fd,r->buf+r->len,r->max-r->len);
+                if (n<0)
+                        return APS_IO_ERROR;
+                if (n==0)
+                        return 0;
+                r->len += n;
+        }
+
+        return 1;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_crc32
+Purpose   :  Update CRC-32 (IEEE 802.3) of data
+Inputs    :  crc  : CRC of previous data, 0 to start
+             buf  : data
+             size : data size in bytes
+Outputs   :  <>
+Return    :  CRC
+-----------------------------------------------------------------------------*/
+uint32_t stream_crc32(uint32_t crc,const void *buf,int size)
+{
+        const unsigned char *p = buf;
+        int i;
+
+        if (crc_table[1]==0) {
+                for (i = 0; i<256; i++) {
+                        uint32_t c = i;
+                        int k;
+
+                        for (k = 0; k<8; k++)
+                                c = c&1 ? 0xedb88320^(c>>1) : c>>1;
+                        crc_table[i] = c;
+                }
+        }
+
+        crc = ~crc;
+        while (size-->0)
+                crc = crc_table[(crc^*p++)&0xff]^(crc>>8);
+
+        return ~crc;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_is_framed
+Purpose   :  Tell if data starts with a framed stream header
+Inputs    :  buf  : first bytes of stream
+             size : number of bytes, at least STREAM_MAGIC_SIZE
+Outputs   :  <>
+Return    :  1 if stream is framed, 0 for legacy streams
+-----------------------------------------------------------------------------*/
+int stream_is_framed(const void *buf,int size)
+{
+        return size>=STREAM_MAGIC_SIZE && memcmp(buf,STREAM_MAGIC,STREAM_MAGIC_SIZE)==0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_start
+Purpose   :  Write stream header
+Inputs    :  f     : stream file
+             flags : header flags (STREAM_CRC)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void stream_start(FILE *f,int flags)
+{
+        unsigned char hdr[STREAM_HEADER_SIZE];
+
+        stream_flags = flags;
+        batch_len = 0;
+        batch_file = f;
+
+        memset(hdr,0,sizeof(hdr));
+        memcpy(hdr,STREAM_MAGIC,STREAM_MAGIC_SIZE);
+        hdr[4] = STREAM_VERSION;
+        hdr[5] = flags;
+
+        fwrite(hdr,sizeof(hdr),1,f);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_flush
+Purpose   :  Write batched commands as DATA record
+Inputs    :  f : stream file
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void stream_flush(FILE *f)
+{
+        if (batch_len>0) {
+                write_record(batch_file!=NULL ? batch_file : f,STREAM_DATA,batch,batch_len);
+                batch_len = 0;
+        }
+
+        batch_file = f;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_data
+Purpose   :  Append printer commands to stream
+             Commands are batched, DATA records hold up to BATCH_SIZE bytes
+             (larger buffers are split in STREAM_RECORD_MAX records)
+Inputs    :  f    : stream file
+             buf  : command bytes
+             size : number of bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void stream_data(FILE *f,const void *buf,int size)
+{
+        if (f!=batch_file || batch_len+size>BATCH_SIZE) {
+                stream_flush(f);
+        }
+
+        if (size>=BATCH_SIZE) {
+                const unsigned char *p = buf;
+
+                while (size>0) {
+                        int n = size>STREAM_RECORD_MAX ? STREAM_RECORD_MAX : size;
+
+                        write_record(f,STREAM_DATA,p,n);
+                        p += n;
+                        size -= n;
+                }
+                return;
+        }
+
+        memcpy(batch+batch_len,buf,size);
+        batch_len += size;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_mark
+Purpose   :  Write marker record after batched commands
+Inputs    :  f     : stream file
+             type  : record type (STREAM_PAGE, STREAM_CUT, STREAM_COPY)
+             value : marker value
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void stream_mark(FILE *f,int type,uint32_t value)
+{
+        unsigned char v[4];
+
+        stream_flush(f);
+
+        put_le32(v,value);
+        write_record(f,type,v,sizeof(v));
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_end
+Purpose   :  Write batched commands and END record
+Inputs    :  f : stream file
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void stream_end(FILE *f)
+{
+        stream_flush(f);
+        write_record(f,STREAM_END,NULL,0);
+        fflush(f);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_value
+Purpose   :  Get value of marker record
+Inputs    :  payload : record payload
+             size    : payload size in bytes
+Outputs   :  <>
+Return    :  marker value, 0 if record has no value
+-----------------------------------------------------------------------------*/
+uint32_t stream_value(const unsigned char *payload,uint32_t size)
+{
+        return size>=4 ? get_le32(payload) : 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_reader_init
+Purpose   :  Start reading framed stream, check header
+Inputs    :  r      : stream reader
+             fd     : input file descriptor
+             prefix : bytes already read from stream (at least the magic)
+             n      : number of bytes already read
+Outputs   :  Fills stream reader
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int stream_reader_init(stream_reader_t *r,int fd,const void *prefix,int n)
+{
+        memset(r,0,sizeof(stream_reader_t));
+
+        r->fd = fd;
+        r->max = READ_SIZE>n ? READ_SIZE : n;
+        r->buf = malloc(r->max);
+        if (r->buf==NULL)
+                return APS_IO_ERROR;
+
+        memcpy(r->buf,prefix,n);
+        r->len = n;
+
+        if (fill(r,STREAM_HEADER_SIZE)!=1 || !stream_is_framed(r->buf,r->len)) {
+                stream_reader_free(r);
+                return APS_IO_ERROR;
+        }
+
+        r->version = r->buf[4];
+        r->flags = r->buf[5];
+        r->pos = STREAM_HEADER_SIZE;
+
+        /*later versions only add record types*/
+        if (r->version<1) {
+                stream_reader_free(r);
+                return APS_IO_ERROR;
+        }
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_read
+Purpose   :  Read next record
+             Payload stays valid until next call
+Inputs    :  r       : stream reader
+             type    : record type
+             payload : record payload
+             size    : payload size in bytes
+Outputs   :  <>
+Return    :  1 if a record was read, 0 at end of file, or error code
+             (truncated record, oversized record, checksum error)
+-----------------------------------------------------------------------------*/
+int stream_read(stream_reader_t *r,int *type,const unsigned char **payload,
+                uint32_t *size)
+{
+        int crc = r->flags&STREAM_CRC ? 4 : 0;
+        uint32_t sum;
+        uint32_t n;
+        int res;
+
+        res = fill(r,STREAM_RECORD_SIZE);
+        if (res<=0)
+                return res==0 && r->len==r->pos ? 0 : APS_IO_ERROR;
+
+        /*a corrupted size must not make the reader allocate gigabytes*/
+        n = get_le32(r->buf+r->pos+4);
+        if (n>STREAM_RECORD_MAX)
+                return APS_IO_ERROR;
+
+        res = fill(r,STREAM_RECORD_SIZE+n+crc);
+        if (res<=0)
+                return APS_IO_ERROR;
+
+        *type = r->buf[r->pos];
+        *payload = r->buf+r->pos+STREAM_RECORD_SIZE;
+        *size = n;
+
+        if (crc) {
+                sum = 0;
+                if (r->version>=2)
+                        sum = stream_crc32(sum,r->buf+r->pos,STREAM_RECORD_SIZE);
+                sum = stream_crc32(sum,*payload,n);
+
+                if (get_le32(*payload+n)!=sum)
+                        return APS_IO_ERROR;
+        }
+
+        r->pos += STREAM_RECORD_SIZE+n+crc;
+        r->records++;
+
+        return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  stream_reader_free
+Purpose   :  Release stream reader
+Inputs    :  r : stream reader
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void stream_reader_free(stream_reader_t *r)
+{
+        free(r->buf);
+        r->buf = NULL;
+}
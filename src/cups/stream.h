@@ -0,0 +1,103 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : stream.h
+* DESCRIPTION   : Framed command stream between filters and backend
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stream layout, all integers are little-endian:
+ *
+ *   header : magic "APSF" (4), version (1), flags (1), reserved (2)
+ *   record : type (1), reserved (3), payload size (4), payload,
+ *            CRC-32 of record header and payload (4) if STREAM_CRC is set
+ *            (version 1 streams: CRC-32 of payload only)
+ *
+ * DATA records batch many printer commands. Marker records carry a 32-bit
+ * value. The stream ends with an END record. Payloads are at most
+ * STREAM_RECORD_MAX bytes. Streams without this header
+ * are legacy streams: a host-endian int size before every block, or -1
+ * followed by raw data.
+ */
+
+#define STREAM_MAGIC            "APSF"
+#define STREAM_MAGIC_SIZE       4
+#define STREAM_VERSION          2
+#define STREAM_HEADER_SIZE      8
+#define STREAM_RECORD_SIZE      8       /*record header*/
+#define STREAM_RECORD_MAX       (4096*1024)     /*bytes of record payload*/
+
+/*header flags*/
+#define STREAM_CRC              0x01    /*records end with CRC-32*/
+
+/*record types*/
+typedef enum {
+        STREAM_DATA     = 1,    /*printer commands*/
+        STREAM_PAGE     = 2,    /*start of page, value: page number*/
+        STREAM_CUT      = 3,    /*paper was cut by previous data*/
+        STREAM_COPY     = 4,    /*start of copy, value: copy number*/
+        STREAM_END      = 5     /*end of stream*/
+} stream_record_t;
+
+typedef struct {
+        int             fd;
+        int             flags;
+        int             version;
+        unsigned char   *buf;
+        int             max;
+        int             len;            /*bytes in buffer*/
+        int             pos;            /*start of next record*/
+        long            records;
+} stream_reader_t;
+
+uint32_t stream_crc32(uint32_t crc,const void *buf,int size);
+
+int     stream_is_framed(const void *buf,int size);
+
+void    stream_start(FILE *f,int flags);
+void    stream_data(FILE *f,const void *buf,int size);
+void    stream_mark(FILE *f,int type,uint32_t value);
+void    stream_flush(FILE *f);
+void    stream_end(FILE *f);
+
+uint32_t stream_value(const unsigned char *payload,uint32_t size);
+
+int     stream_reader_init(stream_reader_t *r,int fd,const void *prefix,int n);
+int     stream_read(stream_reader_t *r,int *type,const unsigned char **payload,
+                    uint32_t *size);
+void    stream_reader_free(stream_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_STREAM_H*/
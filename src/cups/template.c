@@ -0,0 +1,533 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : template.c
+* DESCRIPTION   : Receipt templates with pre-encoded static lines
+*
+*                 A template is a text file of texttoaps input where
+*                 <FIELD name> marks where job values are spliced in. Lines
+*                 without fields are encoded once and the commands are kept
+*                 in an on-disk cache, keyed by template, printer model and
+*                 text settings; lines holding fields are kept as text and
+*                 rendered for every job.
+*
+*                 Compiled templates are a list of records: a type byte
+*                 (TEMPLATE_STATIC or TEMPLATE_LINE), a 32-bit size, then
+*                 the commands or the template line.
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <aps/aps.h>
+
+#include "command.h"
+#include "barcode.h"
+#include "cache.h"
+#include "options.h"
+#include "template.h"
+#include "ticket.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+#define TEMPLATE_ENTRIES        16
+#define TEMPLATE_BYTES          (4*1024*1024)
+#define TEMPLATE_MAX            (1024*1024)     /*bytes of template file*/
+#define ID_MAX                  64              /*characters*/
+#define FIELDS_MAX              64
+
+#define FIELD_TAG               "<FIELD "
+
+/*cache key, followed by template id and font path*/
+typedef struct {
+        int             printer_type;
+        int             printer_width;
+        int             optprint;
+        int             font;
+        int             charspacing;
+        int             linespacing;
+        long            font_size;
+        long            font_mtime;
+        long            size;                   /*template file*/
+        long            mtime;
+} template_key_t;
+
+typedef struct {
+        char            *name;
+        unsigned char   *value;
+        int             size;
+} field_t;
+
+static cache_t          *tpl_cache = NULL;
+static unsigned char    *key_buf = NULL;
+static int              key_len;
+static char             path[1024];             /*template file*/
+
+static unsigned char    *source = NULL;         /*template file contents*/
+
+static unsigned char    *blob = NULL;           /*template being compiled*/
+static int              blob_len;
+static int              blob_max;
+static int              blob_ok;                /*every static line captured*/
+
+static FILE             *capture_file = NULL;   /*while capturing commands*/
+static FILE             *saved_output;
+static char             *capture_buf;
+static size_t           capture_len;
+
+static field_t          fields[FIELDS_MAX];
+static int              num_fields = 0;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  valid_id
+Purpose   :  Check template id, used as file name
+Inputs    :  id : template id
+Outputs   :  <>
+Return    :  1 if id has letters, digits, '-', '_' or '.' only and does not
+             start with '.', 0 otherwise
+-----------------------------------------------------------------------------*/
+static int valid_id(const char *id)
+{
+        int i;
+
+        if (id[0]==0 || id[0]=='.' || strlen(id)>ID_MAX)
+                return 0;
+
+        for (i = 0; id[i]; i++) {
+                char c = id[i];
+
+                if (!((c>='a' && c<='z') || (c>='A' && c<='Z') ||
+                      (c>='0' && c<='9') || c=='-' || c=='_' || c=='.'))
+                        return 0;
+        }
+
+        return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  add_record
+Purpose   :  Append record to compiled template
+Inputs    :  type : TEMPLATE_STATIC or TEMPLATE_LINE
+             data : record data
+             size : record data size in bytes
+Outputs   :  Updates blob
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void add_record(int type,const void *data,int size)
+{
+        uint32_t n = size;
+
+        if (blob_len+5+size>blob_max) {
+                unsigned char *p;
+                int max = 2*(blob_len+5+size);
+
+                p = realloc(blob,max);
+                if (p==NULL) {
+                        blob_ok = 0;
+                        return;
+                }
+                blob = p;
+                blob_max = max;
+        }
+
+        blob[blob_len] = type;
+        memcpy(blob+blob_len+1,&n,4);
+        memcpy(blob+blob_len+5,data,size);
+        blob_len += 5+size;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  find_field
+Purpose   :  Find field value
+Inputs    :  name : field name
+             len  : field name length
+Outputs   :  <>
+Return    :  field or NULL if not set
+-----------------------------------------------------------------------------*/
+static field_t *find_field(const char *name,int len)
+{
+        int i;
+
+        for (i = 0; i<num_fields; i++)
+                if ((int)strlen(fields[i].name)==len && memcmp(fields[i].name,name,len)==0)
+                        return &fields[i];
+
+        return NULL;
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  template_open
+Purpose   :  Open template and build its cache key
+Inputs    :  id        : template id
+             dir       : template directory, NULL for TEMPLATE_DIR
+             font_file : font file used to render text, NULL for printer font
+Outputs   :  <>
+Return    :  0 if successful, -1 if template does not exist
+-----------------------------------------------------------------------------*/
+int template_open(const char *id,const char *dir,const char *font_file)
+{
+        template_key_t key;
+        struct stat st;
+        char *cache_path;
+        int id_len;
+        int font_len;
+
+        if (!valid_id(id))
+                return -1;
+
+        snprintf(path,sizeof(path),"%s/%s.txt",dir!=NULL ? dir : TEMPLATE_DIR,id);
+        if (stat(path,&st)<0 || st.st_size>TEMPLATE_MAX)
+                return -1;
+
+        /*same text settings give the same commands*/
+        memset(&key,0,sizeof(key));
+        key.printer_type = printer_type;
+        key.printer_width = printer_width;
+        key.optprint = optprint;
+        key.charspacing = charspacing;
+        key.linespacing = linespacing;
+        key.size = st.st_size;
+        key.mtime = st.st_mtime;
+        key.font = font;
+        if (font_file!=NULL && stat(font_file,&st)==0) {
+                key.font_size = st.st_size;
+                key.font_mtime = st.st_mtime;
+        }
+
+        id_len = strlen(id)+1;
+        font_len = font_file!=NULL ? strlen(font_file)+1 : 0;
+        key_len = sizeof(key)+id_len+font_len;
+
+        free(key_buf);
+        key_buf = malloc(key_len);
+        if (key_buf==NULL)
+                return -1;
+
+        memcpy(key_buf,&key,sizeof(key));
+        memcpy(key_buf+sizeof(key),id,id_len);
+        if (font_file!=NULL)
+                memcpy(key_buf+sizeof(key)+id_len,font_file,font_len);
+
+        if (tpl_cache==NULL) {
+                cache_path = cache_queue_dir(cache_dir!=NULL ? cache_dir : CACHE_DIR,"template");
+                tpl_cache = cache_create(TEMPLATE_ENTRIES,TEMPLATE_BYTES,cache_path);
+                free(cache_path);
+        }
+
+        return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_close
+Purpose   :  Free template, compiled template and field values
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void template_close(void)
+{
+        int i;
+
+        for (i = 0; i<num_fields; i++) {
+                free(fields[i].name);
+                free(fields[i].value);
+        }
+        num_fields = 0;
+
+        cache_free(tpl_cache);
+        tpl_cache = NULL;
+        free(key_buf);
+        key_buf = NULL;
+        free(source);
+        source = NULL;
+        free(blob);
+        blob = NULL;
+        blob_len = 0;
+        blob_max = 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_lookup
+Purpose   :  Look up compiled template in cache
+Inputs    :  <>
+Outputs   :  data : compiled template (valid until template_close)
+             size : compiled template size in bytes
+Return    :  1 if template was found, 0 if it must be compiled
+-----------------------------------------------------------------------------*/
+int template_lookup(const unsigned char **data,int *size)
+{
+        return cache_lookup(tpl_cache,key_buf,key_len,data,size);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_record
+Purpose   :  Get next record of compiled template
+Inputs    :  data : compiled template
+             size : compiled template size in bytes
+             pos  : offset of record, updated to next record
+Outputs   :  rec  : record data
+             len  : record data size in bytes
+Return    :  record type, 0 at end of template or on corrupted record
+-----------------------------------------------------------------------------*/
+int template_record(const unsigned char *data,int size,int *pos,
+                    const unsigned char **rec,int *len)
+{
+        uint32_t n;
+
+        if (*pos+5>size)
+                return 0;
+
+        memcpy(&n,data+*pos+1,4);
+        if (n>(uint32_t)(size-*pos-5))
+                return 0;
+
+        *rec = data+*pos+5;
+        *len = n;
+        *pos += 5+n;
+
+        return data[*pos-5-n];
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_source
+Purpose   :  Read template file to compile it
+Inputs    :  <>
+Outputs   :  size : template file size in bytes
+Return    :  template file contents (valid until template_close) or NULL
+-----------------------------------------------------------------------------*/
+const unsigned char *template_source(int *size)
+{
+        FILE *f;
+        long n;
+
+        f = fopen(path,"rb");
+        if (f==NULL)
+                return NULL;
+
+        free(source);
+        source = malloc(TEMPLATE_MAX);
+        n = source!=NULL ? (long)fread(source,1,TEMPLATE_MAX,f) : -1;
+        fclose(f);
+
+        if (n<0)
+                return NULL;
+
+        blob_len = 0;
+        blob_ok = 1;
+        *size = n;
+
+        return source;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_has_field
+Purpose   :  Check if template line holds fields
+Inputs    :  line : template line
+             size : line size in bytes
+Outputs   :  <>
+Return    :  1 if line holds a field tag, 0 otherwise
+-----------------------------------------------------------------------------*/
+int template_has_field(const unsigned char *line,int size)
+{
+        int n = strlen(FIELD_TAG);
+        int i;
+
+        for (i = 0; i+n<=size; i++)
+                if (line[i]=='<' && memcmp(line+i,FIELD_TAG,n)==0)
+                        return 1;
+
+        return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_begin_static
+Purpose   :  Start capturing commands of static lines
+             Ticket output goes to a memory stream until template_end_static
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void template_begin_static(void)
+{
+        FILE *f;
+
+        fflush(stdout);
+
+        capture_buf = NULL;
+        f = open_memstream(&capture_buf,&capture_len);
+        if (f==NULL) {
+                blob_ok = 0;
+                return;
+        }
+
+        capture_file = f;
+        saved_output = set_ticket_output(f);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_end_static
+Purpose   :  Stop capturing commands, add them to compiled template and
+             write them to the previous ticket output
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void template_end_static(void)
+{
+        if (capture_file==NULL)
+                return;
+
+        set_ticket_output(saved_output);
+        fclose(capture_file);
+        capture_file = NULL;
+
+        write_captured(capture_buf,capture_len);
+        fflush(stdout);
+
+        add_record(TEMPLATE_STATIC,capture_buf,capture_len);
+        free(capture_buf);
+        capture_buf = NULL;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_add_line
+Purpose   :  Add line holding fields to compiled template
+Inputs    :  line : template line
+             size : line size in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void template_add_line(const unsigned char *line,int size)
+{
+        add_record(TEMPLATE_LINE,line,size);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_store
+Purpose   :  Store compiled template in cache
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void template_store(void)
+{
+        if (blob_ok && blob_len>0)
+                cache_store(tpl_cache,key_buf,key_len,blob,blob_len);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_set_field
+Purpose   :  Set field value, replacing previous value
+Inputs    :  name  : field name
+             value : field value, as read from the job
+             size  : field value size in bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void template_set_field(const char *name,const unsigned char *value,int size)
+{
+        field_t *f = find_field(name,strlen(name));
+        unsigned char *v;
+
+        v = malloc(size>0 ? size : 1);
+        if (v==NULL)
+                return;
+        memcpy(v,value,size);
+
+        if (f==NULL) {
+                if (num_fields==FIELDS_MAX) {
+                        free(v);
+                        return;
+                }
+                f = &fields[num_fields];
+                f->name = strdup(name);
+                if (f->name==NULL) {
+                        free(v);
+                        return;
+                }
+                num_fields++;
+        }
+        else {
+                free(f->value);
+        }
+
+        f->value = v;
+        f->size = size;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  template_expand
+Purpose   :  Replace field tags of template line by field values
+             Fields without value are removed
+Inputs    :  line : template line
+             size : line size in bytes
+Outputs   :  out  : allocated expanded line
+Return    :  expanded line size in bytes, -1 if out of memory
+-----------------------------------------------------------------------------*/
+int template_expand(const unsigned char *line,int size,unsigned char **out)
+{
+        int tag_len = strlen(FIELD_TAG);
+        unsigned char *buf;
+        field_t *f;
+        int max = size;
+        int len = 0;
+        int i, j;
+
+        /*room for every field value once per field tag*/
+        for (i = 0; i<num_fields; i++)
+                max += fields[i].size*(size/(tag_len+2)+1);
+
+        buf = malloc(max>0 ? max : 1);
+        if (buf==NULL)
+                return -1;
+
+        for (i = 0; i<size; ) {
+                if (line[i]=='<' && i+tag_len<=size && memcmp(line+i,FIELD_TAG,tag_len)==0) {
+                        for (j = i+tag_len; j<size && line[j]!='>'; j++)
+                                ;
+
+                        if (j<size) {
+                                f = find_field((const char *)line+i+tag_len,j-i-tag_len);
+                                if (f!=NULL) {
+                                        memcpy(buf+len,f->value,f->size);
+                                        len += f->size;
+                                }
+                                i = j+1;
+                                continue;
+                        }
+                }
+
+                buf[len++] = line[i++];
+        }
+
+        *out = buf;
+
+        return len;
+}
@@ -0,0 +1,62 @@
+/******************************************************************************
+* COMPANY       : APS ENGINEERING
+* PROJECT       : LINUX DRIVER
+*******************************************************************************
+* NAME          : template.h
+* DESCRIPTION   : Receipt templates with pre-encoded static lines
+*******************************************************************************
+*   Copyright (C) 2006  APS Engineering
+*   
+*   This file is part of the APS Linux Driver.
+*
+*   APS Linux Driver is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   APS Linux Driver is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with APS Linux Driver; if not, write to the Free Software
+*   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+******************************************************************************/
+
+#ifndef _TEMPLATE_H
+#define _TEMPLATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*default template directory, one <id>.txt file per template*/
+#define TEMPLATE_DIR            "/etc/aps/templates"
+
+/*records of compiled templates*/
+#define TEMPLATE_STATIC         'S'     /*encoded commands of static lines*/
+#define TEMPLATE_LINE           'L'     /*template line holding fields*/
+
+int     template_open(const char *id,const char *dir,const char *font_file);
+void    template_close(void);
+
+int     template_lookup(const unsigned char **data,int *size);
+int     template_record(const unsigned char *data,int size,int *pos,
+                        const unsigned char **rec,int *len);
+
+const unsigned char *template_source(int *size);
+int     template_has_field(const unsigned char *line,int size);
+void    template_begin_static(void);
+void    template_end_static(void);
+void    template_add_line(const unsigned char *line,int size);
+void    template_store(void);
+
+void    template_set_field(const char *name,const unsigned char *value,int size);
+int     template_expand(const unsigned char *line,int size,unsigned char **out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_TEMPLATE_H*/
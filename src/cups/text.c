@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
@@ -43,20 +44,56 @@
 #include <cups/raster.h>
 
 #include <aps/aps.h>
+#include <aps/aps_fnt.h>
 
 #include "command.h"
 #include "options.h"
+#include "barcode.h"
 #include "ticket.h"
-#include "aps_fnt.h"
+#include "cache.h"
+#include "encstats.h"
 
 #include "text.h"
 
 /* PRIVATE DEFINITIONS ------------------------------------------------------*/
-void*   fnt = NULL;
-uint8_t *graphic_buf = NULL;
-int     graphic_high;
-int     pix_pos;
-int     raw;
+static  void*   fnt = NULL;
+static  aps_fnt_line_t text_line;       /*current line, shared with libaps*/
+static  int     raw;
+
+static  int     shift_amount;
+
+#define CACHE_ENTRIES   512
+#define CACHE_BYTES     (2*1024*1024)   /*bytes*/
+#define CACHE_DISK_BYTES (16*1024*1024) /*bytes of on-disk entries*/
+#define CACHE_VERSION   1               /*layout of cache entries*/
+
+/*text line cache key header, followed by font path and codepoints*/
+typedef struct {
+    int     printer_type;
+    int     printer_width;
+    int     optprint;
+    int     charspacing;
+    int     linespacing;
+    int     raw;
+    int     shift_in;
+    long    font_size;
+    long    font_mtime;
+} line_key_t;
+
+/*text line cache entry header, followed by encoded commands*/
+typedef struct {
+    int     version;                    /*CACHE_VERSION*/
+    int     shift_out;                  /*shift amount after the line*/
+} line_entry_t;
+
+static  cache_t *line_cache = NULL;
+static  int     *line_buf = NULL;       /*codepoints of current line*/
+static  int     line_len;
+static  int     line_max;
+static  unsigned char *key_buf = NULL;
+static  int     key_max;
+static  line_key_t key_hdr;
+static  char    *key_font;
 
 #define BLANK_BUFSIZE   256             /*bytes*/
 
@@ -79,7 +116,7 @@ static void print_blank_normal(int nbytes)
         errnum = cmd_print_dotline(printer_type,&cmd,nbytes);
 
         if (errnum<0) {
-                error(aps_strerror(errnum));
+                job_error(aps_strerror(errnum),errnum);
         }
         else {
                 write_command(raw,&cmd,blank_buf,nbytes);
@@ -105,7 +142,7 @@ static void print_blank_opt(void)
         errnum = cmd_print_dotline(printer_type,&cmd,1);
 
         if (errnum<0) {
-                error(aps_strerror(errnum));
+                job_error(aps_strerror(errnum),errnum);
         }
         else {
                 write_command(raw,&cmd,blank_buf,1);
@@ -127,8 +164,11 @@ static void print_blank_opt(void)
 static void print_blank(int n,int nbytes)
 {
     while (n--) {
+        enc_stats.dotlines++;
+        enc_stats.blank++;
 
         if (optprint) {
+            enc_stats.saved += nbytes-1;
             print_blank_opt();
         }
         else {
@@ -155,7 +195,7 @@ static void print_dotline(const unsigned char *buf,int nbytes)
     errnum = cmd_print_dotline(printer_type,&cmd,nbytes);
 
     if (errnum<0) {
-        error(aps_strerror(errnum));
+        job_error(aps_strerror(errnum),errnum);
     }
     else {
         write_command(raw,&cmd,buf,nbytes);
@@ -164,6 +204,122 @@ static void print_dotline(const unsigned char *buf,int nbytes)
     fflush(stdout);
 }
 
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  shift_dotline
+ * Purpose   :  Write APS command to shift dotlines
+ * Inputs    :  nbytes : right shift amount in bytes
+ * Outputs   :  <>
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+static void shift_dotline(int nbytes)
+{
+    aps_error_t errnum;
+    command_t cmd;
+
+    errnum = cmd_shift_dotline(printer_type,&cmd,nbytes);
+
+    if (errnum<0) {
+        job_error(aps_strerror(errnum),errnum);
+    }
+    else {
+        write_command(raw,&cmd,NULL,0);
+        enc_stats.shifts++;
+    }
+
+    fflush(stdout);
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  count_leading_blank
+ * Purpose   :  Count number of leading blank bytes in dotline
+ * Inputs    :  buf    : dotline buffer
+ * nbytes    :  width of dotline in bytes
+ * Outputs   :  <>
+ * Return    :  Number of leading blank bytes
+ * -----------------------------------------------------------------------------
+ */
+static int count_leading_blank(const unsigned char *buf,int nbytes)
+{
+    int n = 0;
+
+    while (n<nbytes && buf[n]==0) {
+        n++;
+    }
+
+    return n;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  count_trailing_blank
+ * Purpose   :  Count number of trailing blank bytes in dotline
+ * Inputs    :  buf    : dotline buffer
+ * nbytes    :  width of dotline in bytes
+ * Outputs   :  <>
+ * Return    :  Number of trailing blank bytes
+ * -----------------------------------------------------------------------------
+ */
+static int count_trailing_blank(const unsigned char *buf,int nbytes)
+{
+    int n = 0;
+
+    while (n<nbytes && buf[nbytes-n-1]==0) {
+        n++;
+    }
+
+    return n;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  print_dotline_opt
+ * Purpose   :  Write APS commands to print dotline, skipping leading and
+ *              trailing blank bytes (shift command is used when available)
+ * Inputs    :  buf    : dotline buffer
+ * nbytes    :  width of drawn part of dotline in bytes
+ * Outputs   :  Updates global shift_amount
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+static void print_dotline_opt(const unsigned char *buf,int nbytes)
+{
+    int n1;
+    int n2;
+
+    n1 = count_leading_blank(buf,nbytes);
+
+    if (n1==nbytes) {
+        enc_stats.blank++;
+        enc_stats.saved += printer_width-1;
+        print_blank_opt();
+        return;
+    }
+
+    switch (printer_type) {
+    case APS_MRS:
+    case APS_HRS:
+    case APS_KCP:
+        if (shift_amount!=n1) {
+            shift_dotline(n1);
+            shift_amount = n1;
+        }
+        break;
+    default:
+        n1 = 0;
+        break;
+    }
+
+    n2 = count_trailing_blank(buf,nbytes);
+
+    /*bytes outside the drawn span are trimmed too*/
+    enc_stats.trimmed += printer_width-nbytes+n1+n2;
+
+    print_dotline(&buf[n1],nbytes-n1-n2);
+}
+
 /*
  * -----------------------------------------------------------------------------
  * Name      :  print_text_line
@@ -179,12 +335,18 @@ static void print_text_line(void)
     int i;
     uint8_t *p;
     
-    i = graphic_high;
-    p = graphic_buf;
+    i = text_line.high;
+    p = text_line.buf;
 
     while (i--)
     {
-        print_dotline(p,printer_width);
+        enc_stats.dotlines++;
+
+        /* only the drawn span may hold black dots */
+        if (optprint)
+            print_dotline_opt(p,text_line.span);
+        else
+            print_dotline(p,printer_width);
         p+=printer_width;
     }
     if (linespacing < 0)
@@ -195,37 +357,234 @@ static void print_text_line(void)
 
 /*
  * -----------------------------------------------------------------------------
- * Name      :  clear_text_line
- * Purpose   :  prepare the new text line
+ * Name      :  do_new_line
+ * Purpose   :  send to the printer the current line
+ *              end prepare to build an new one
  *
  * Inputs    :  <>
  * Outputs   :  <>
  * Return    :  <>
  * -----------------------------------------------------------------------------
  */
-static void clear_text_line(void)
+static void do_new_line(void)
 {
-    pix_pos = 0;
-    memset(graphic_buf,0,printer_width*graphic_high);
+    print_text_line();
+    aps_fnt_line_clear(&text_line);
 }
 
+
 /*
  * -----------------------------------------------------------------------------
- * Name      :  do_new_line
- * Purpose   :  send to the printer the current line
- *              end prepare to build an new one
+ * Name      :  draw_char
+ * Purpose   :  draw a character in the text line, a character without
+ *              bitmap ends the line (see aps_fnt_line_draw)
+ *
+ * Inputs    :  c code of character to draw
+ * Outputs   :  <>
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+static void draw_char(int c)
+{
+    int res;
+    res = aps_fnt_line_draw(&text_line,c);
+    
+    if (res != fntERR_OK){
+        fprintf(stderr,"DEBUG: TextToAPS.font_error : %d \n",aps_fnt_error(fnt));
+    }
+
+    if (res == fntERR_CHAR_BIPMAP_PTR_NULL)
+    {
+        do_new_line();
+
+        /* try again */
+        res = aps_fnt_line_draw(&text_line,c);
+        if (res != fntERR_OK){
+            fprintf(stderr,"DEBUG: TextToAPS.font_error : %d \n",aps_fnt_error(fnt));
+        }
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  render_line
+ * Purpose   :  draw the buffered characters and send the text line
  *
  * Inputs    :  <>
  * Outputs   :  <>
  * Return    :  <>
  * -----------------------------------------------------------------------------
  */
-static void do_new_line(void)
+static void render_line(void)
 {
-    print_text_line();
-    clear_text_line();
+    int i;
+
+    for (i = 0; i < line_len; i++)
+        draw_char(line_buf[i]);
+
+    do_new_line();
 }
 
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  build_key
+ * Purpose   :  build the cache key of the current text line
+ *
+ * Inputs    :  <>
+ * Outputs   :  Updates global key_buf
+ * Return    :  key size in bytes, or error code
+ * -----------------------------------------------------------------------------
+ */
+static int build_key(void)
+{
+    int font_len;
+    int n;
+
+    font_len = strlen(key_font) + 1;
+    n = sizeof(line_key_t) + font_len + line_len * sizeof(int);
+
+    if (n > key_max)
+    {
+        unsigned char *p;
+
+        p = realloc(key_buf,n);
+        if (p == NULL)
+            return job_error("Cannot allocate text cache key",APS_NO_MEMORY);
+
+        key_buf = p;
+        key_max = n;
+    }
+
+    /* shift state changes the encoded commands of the line */
+    key_hdr.shift_in = shift_amount;
+
+    memcpy(key_buf,&key_hdr,sizeof(line_key_t));
+    memcpy(key_buf + sizeof(line_key_t),key_font,font_len);
+    memcpy(key_buf + sizeof(line_key_t) + font_len,line_buf,line_len * sizeof(int));
+
+    return n;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  flush_line
+ * Purpose   :  send the current text line, from the line cache if the
+ *              same line was already encoded with the same settings
+ *
+ *              cache entry data is a line_entry_t header followed by
+ *              the encoded commands, which already hold their block
+ *              headers
+ *
+ * Inputs    :  <>
+ * Outputs   :  <>
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+static void flush_line(void)
+{
+    const unsigned char *data;
+    line_entry_t hdr;
+    int keylen;
+    int size;
+    FILE *f;
+    FILE *old;
+    char *buf;
+    char *entry;
+    size_t len;
+
+    if (line_cache == NULL)
+    {
+        render_line();
+        line_len = 0;
+        return;
+    }
+
+    keylen = build_key();
+    if (keylen < 0)
+    {
+        render_line();
+        line_len = 0;
+        return;
+    }
+
+    if (cache_lookup(line_cache,key_buf,keylen,&data,&size) &&
+        size >= (int)sizeof(line_entry_t))
+    {
+        memcpy(&hdr,data,sizeof(line_entry_t));
+
+        /* entries of another layout are encoded again */
+        if (hdr.version == CACHE_VERSION)
+        {
+            shift_amount = hdr.shift_out;
+            write_data(1,data + sizeof(line_entry_t),size - sizeof(line_entry_t));
+            enc_stats.cached++;
+            fflush(stdout);
+            line_len = 0;
+            return;
+        }
+    }
+
+    /* encode line in memory */
+    buf = NULL;
+    f = open_memstream(&buf,&len);
+    if (f == NULL)
+    {
+        render_line();
+        line_len = 0;
+        return;
+    }
+
+    old = set_ticket_output(f);
+    render_line();
+    set_ticket_output(old);
+
+    fclose(f);
+
+    write_captured(buf,len);
+    fflush(stdout);
+
+    /* store shift amount after the line in front of encoded commands */
+    entry = malloc(sizeof(line_entry_t) + len);
+    if (entry != NULL)
+    {
+        hdr.version = CACHE_VERSION;
+        hdr.shift_out = shift_amount;
+        memcpy(entry,&hdr,sizeof(line_entry_t));
+        memcpy(entry + sizeof(line_entry_t),buf,len);
+        cache_store(line_cache,key_buf,keylen,entry,sizeof(line_entry_t) + len);
+        free(entry);
+    }
+
+    free(buf);
+    line_len = 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  restore_margin
+ * Purpose   :  shift dotlines back to the left margin
+ *
+ * Inputs    :  <>
+ * Outputs   :  <>
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+static void restore_margin(void)
+{
+    if (optprint && shift_amount > 0)
+    {
+        switch (printer_type) {
+        case APS_MRS:
+        case APS_HRS:
+        case APS_KCP:
+            shift_dotline(0);
+            break;
+        default:
+            break;
+        }
+        shift_amount = 0;
+    }
+}
 
 /* PUBLIC DEFINITIONS ------------------------------------------------------*/
 
@@ -236,13 +595,13 @@ static void do_new_line(void)
  *
  * Inputs    :  <>
  * Outputs   :  <>
- * Return    :  <>
+ * Return    :  APS_OK or error code (the module is then left unloaded)
  * -----------------------------------------------------------------------------
  */
-void text_create(int _raw,char *_font_path)
+int text_create(int _raw,char *_font_path)
 {
     if (_font_path == NULL)
-        return ;
+        return APS_OK;
 
     raw = _raw;
 
@@ -268,24 +627,77 @@ void text_create(int _raw,char *_font_path)
     {
         fprintf(stderr,"ERROR: TextToAPS.font_path  : %s \n",_font_path);
         fprintf(stderr,"ERROR: TextToAPS.font_error : (%d) str: %s \n",aps_fnt_error(fnt),aps_fnt_error_str(fnt));
-        error("Impossible to load aps font.");
-        return;
+        aps_fnt_free(fnt);
+        fnt = NULL;
+        return job_error("Impossible to load aps font.",APS_INVALID_FONT);
     }
 
-    graphic_high = aps_fnt_get_high(fnt);
-    graphic_buf = malloc(printer_width * graphic_high);
+    if (aps_fnt_line_init(&text_line,fnt,printer_width) < 0)
+    {
+        text_free();
+        return job_error("Cannot allocate text line buffer",APS_NO_MEMORY);
+    }
 
-    clear_text_line();
+    /* spacing character */
+    if (charspacing >= 0)
+        text_line.charspacing = charspacing;
+    shift_amount = 0;
 
     /*do a blank buffer*/
     memset(blank_buf,0,sizeof(blank_buf));
 
+    line_len = 0;
+    line_max = 256;
+    line_buf = malloc(line_max * sizeof(int));
+    if (line_buf == NULL)
+    {
+        text_free();
+        return job_error("Cannot allocate text line buffer",APS_NO_MEMORY);
+    }
+
+    /* encoded line cache */
+    if (textcache != 0)
+    {
+        struct stat st;
+        char *dir = NULL;
+
+        memset(&key_hdr,0,sizeof(key_hdr));
+        key_hdr.printer_type = printer_type;
+        key_hdr.printer_width = printer_width;
+        key_hdr.optprint = optprint;
+        key_hdr.charspacing = charspacing;
+        key_hdr.linespacing = linespacing;
+        key_hdr.raw = raw;
+
+        /* a rebuilt font file must not hit old entries */
+        if (stat(_font_path,&st) == 0)
+        {
+            key_hdr.font_size = st.st_size;
+            key_hdr.font_mtime = st.st_mtime;
+        }
+        key_font = _font_path;
+
+        if (textcachedisk > 0)
+        {
+            dir = cache_queue_dir(cache_dir != NULL ? cache_dir : CACHE_DIR,"text");
+            if (dir == NULL)
+                debug("Cannot create on-disk text cache, using memory only",NULL);
+        }
+
+        line_cache = cache_create(CACHE_ENTRIES,CACHE_BYTES,dir);
+        if (dir != NULL)
+            cache_set_disk_limit(line_cache,CACHE_DISK_BYTES);
+        free(dir);
+    }
+
+    return APS_OK;
 }
 
 /*
  * -----------------------------------------------------------------------------
  * Name      :  text_putc
- * Purpose   :  put a character in graphic buffer
+ * Purpose   :  put a character in current text line
+ *              the line is rendered when it is finished
  *
  * Inputs    :  c code of character to put in text line
  * Outputs   :  <>
@@ -299,36 +711,69 @@ void text_putc(int c)
 
     if ((c == LF) || (c == CR))
     {
-        do_new_line();
+        flush_line();
     }
     else
     {
-        int res;
-        res = aps_fnt_draw_char(fnt, graphic_buf, &pix_pos,printer_width,c);
-        
-        if (res != fntERR_OK){
-	        fprintf(stderr,"DEBUG: TextToAPS.font_error : %d \n",aps_fnt_error(fnt));
-        }
-
-        if (res == fntERR_CHAR_BIPMAP_PTR_NULL)
+        if (line_len == line_max)
         {
-            do_new_line();
+            int *p;
 
-            /* try again */
-            res = aps_fnt_draw_char(fnt,graphic_buf,&pix_pos,printer_width,c);
-            if (res != fntERR_OK){
-                fprintf(stderr,"DEBUG: TextToAPS.font_error : %d \n",aps_fnt_error(fnt));
-            }
-            if (res == fntERR_LINE_FULL)
+            p = realloc(line_buf,2 * line_max * sizeof(int));
+            if (p == NULL)
+            {
+                job_error("Cannot allocate text line buffer",APS_NO_MEMORY);
                 return;
+            }
+
+            line_buf = p;
+            line_max *= 2;
         }
-        if (charspacing < 0)
-            pix_pos += 1; /* spacing character */
-        else
-            pix_pos += charspacing; /* spacing character */
+        line_buf[line_len++] = c;
     }
 }
 
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  text_flush
+ * Purpose   :  send the current text line if it is not empty
+ *
+ * Inputs    :  <>
+ * Outputs   :  <>
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+void text_flush(void)
+{
+    if (fnt == NULL || line_len == 0)
+        return;
+
+    flush_line();
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * Name      :  text_sync
+ * Purpose   :  send the current text line and restore the left margin, so
+ *              that following commands do not depend on previous text
+ *              (commands encoded apart can then be spliced in)
+ *
+ * Inputs    :  <>
+ * Outputs   :  <>
+ * Return    :  <>
+ * -----------------------------------------------------------------------------
+ */
+void text_sync(void)
+{
+    if (fnt == NULL)
+        return;
+
+    if (line_len > 0)
+        flush_line();
+
+    restore_margin();
+}
+
 /*
  * -----------------------------------------------------------------------------
  * Name      :  text_finish
@@ -341,10 +786,20 @@ void text_putc(int c)
  */
 void text_free(void)
 {
+    /* restore left margin for following commands */
+    if (fnt != NULL)
+        restore_margin();
+
     aps_fnt_free(fnt);
-    if (graphic_buf != NULL)
-    {
-        free(graphic_buf);
-    }
+    fnt = NULL;
+    aps_fnt_line_free(&text_line);
+
+    cache_free(line_cache);
+    line_cache = NULL;
+    free(line_buf);
+    line_buf = NULL;
+    free(key_buf);
+    key_buf = NULL;
+    key_max = 0;
 }
 
@@ -1,9 +1,11 @@
 
 
 
-void text_create(int _raw, char *font_path);
+int text_create(int _raw, char *font_path);
 
 void text_putc(int c);
+void text_flush(void);
+void text_sync(void);
 
 void text_free(void);
 
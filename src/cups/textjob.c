@@ -0,0 +1,1105 @@
+/******************************************************************************
+ * COMPANY       : APS ENGINEERING
+ * PROJECT       : LINUX DRIVER
+ *******************************************************************************
+ * NAME          : textjob.c
+ *
+ * DESCRIPTION   : Text job of the texttoaps filter
+ *                 Converts plain text into APS commands
+ *                 APS command set is selected depending on cupsModelNumber
+ *                 attribute of the PPD file
+ *                 text_job() encodes a whole job to the ticket output and
+ *                 returns on errors, it is shared by texttoaps and by
+ *                 aps-print (see direct.c)
+ *
+ * CVS           : $Id: texttoaps.c,v 1.12 2008/07/09 14:22:29 pierre Exp $
+ *******************************************************************************
+ *   Copyright (C) 2006  APS Engineering
+ *   
+ *   This file is part of the APS Linux Driver.
+ *
+ *   APS Linux Driver is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   APS Linux Driver is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with APS Linux Driver; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *******************************************************************************
+ * HISTORY       :
+ *   31jan2006   nico    Initial revision
+ *   12jun2006   nico    Added cancel support
+ *   03mar2008   nico    Modified text processing state machine ('<<LF>' bug)
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include <cups/cups.h>
+#include <cups/raster.h>
+
+#include <aps/aps.h>
+
+#include "command.h"
+#include "options.h"
+#include "barcode.h"
+#include "encstats.h"
+#include "ticket.h"
+#include "utf8.h"
+#include "text.h"
+#include "template.h"
+#include "textjob.h"
+
+/* PRIVATE DEFINITIONS ------------------------------------------------------*/
+
+static  sig_atomic_t    cancel_flag;
+
+#define BUFSIZE 4096    /*bytes*/
+
+static enum {
+    PROCESSING_IDLE = 0,
+	PROCESSING_TAG,
+	QRCODE_READING_VER0,
+	QRCODE_READING_VER1,
+	QRCODE_READING_LEVEL,
+	QRCODE_READING_MODE,
+	QRCODE_READING_CASE_SENSITIVITY,
+	QRCODE_READING_DATA,
+	PROCESSING_BARCODE,
+	PROCESSING_FIELD,
+} state;
+
+#define TAG_BUFSIZE 256         /*bytes*/
+
+static int      tag_index;
+static char     tag_buf[TAG_BUFSIZE+1];
+
+typedef struct {
+    char *  text;
+    int     value;
+} alias_t;
+
+static const alias_t alias_table[] = {
+    {"NUL", NUL},
+    {"SOH", SOH},
+    {"STX", STX},
+    {"ETX", ETX},
+    {"EOT", EOT},
+    {"ENQ", ENQ},
+    {"ACK", ACK},
+    {"BEL", BEL},
+    {"BS",  BS},
+    {"TAB", TAB},
+    {"LF",  LF},
+    {"VT",  VT},
+    {"FF",  FF},
+    {"CR",  CR},
+    {"SO",  SO},
+    {"SI",  SI},
+    {"DLE", DLE},
+    {"DC1", DC1},
+    {"DC2", DC2},
+    {"DC3", DC3},
+    {"DC4", DC4},
+    {"NAK", NAK},
+    {"SYN", SYN},
+    {"ETB", ETB},
+    {"CAN", CAN},
+    {"EM",  EM},
+    {"SUB", SUB},
+    {"ESC", ESC},
+    {"FS",  FS},
+    {"GS",  GS},
+    {"RS",  RS},
+    {"US",  US}
+};
+
+#define ALIAS_TABLE_SIZE    (int)(sizeof(alias_table)/sizeof(alias_table[0]))
+
+/*
+ * barcode tags, data is enclosed in start and end tags:
+ *   <QR [level] [scale] [version]>data</QR>
+ *   <PDF417 [ecc] [cols] [height] [width]>data</PDF417>
+ *   <EAN13 [height] [width]>data</EAN13> (same for other 1D symbologies)
+ */
+static const alias_t barcode_table[] = {
+    {"UPCA",    BARCODE_UPCA},
+    {"UPCE",    BARCODE_UPCE},
+    {"EAN13",   BARCODE_EAN13},
+    {"EAN8",    BARCODE_EAN8},
+    {"CODE39",  BARCODE_CODE39},
+    {"ITF",     BARCODE_ITF},
+    {"CODABAR", BARCODE_CODABAR},
+    {"PDF417",  BARCODE_PDF417},
+    {"QR",      BARCODE_QRCODE}
+};
+
+#define BARCODE_TABLE_SIZE  (int)(sizeof(barcode_table)/sizeof(barcode_table[0]))
+
+static int              bc_symbology;
+static barcode_opt_t    bc_opt;
+static char             *bc_buf = NULL;
+static int              bc_len;
+static int              bc_size;
+static char             bc_end[TAG_BUFSIZE+4];  /*end tag*/
+static int              bc_end_len;
+
+/*
+ * receipt templates, the job selects a template and only carries field
+ * values, the template is printed at the end of the job:
+ *   <TEMPLATE id><FIELD name>value</FIELD>...
+ * (field values share the barcode data buffer)
+ * Text before <TEMPLATE> is printed first; text and tags other than FIELD
+ * after it are skipped, skipped tags are logged and a WARNING: line counts
+ * what was skipped at end of job (white space between fields is ignored)
+ */
+static char             *tpl_id = NULL;
+static char             field_name[TAG_BUFSIZE+1];
+static int              tpl_skipped_chars;
+static int              tpl_skipped_tags;
+
+/* PRIVATE FUNCTIONS --------------------------------------------------------*/
+
+
+/*-----------------------------------------------------------------------------
+Name      :  job_stopped
+Purpose   :  Check if current job must stop
+Inputs    :  <>
+Outputs   :  <>
+Return    :  1 if job was cancelled or failed, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int job_stopped(void)
+{
+    return cancel_flag || job_errnum<0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_char
+Purpose   :  Send character to printer through ticket output
+             (internal printer font, or unknown tag)
+Inputs    :  c : character code
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void put_char(int c)
+{
+    unsigned char b = c;
+
+    write_data(1,&b,1);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_tag
+Purpose   :  Send unknown tag to printer as text
+Inputs    :  end : closing '>' was read
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void put_tag(int end)
+{
+    put_char('<');
+    write_data(1,tag_buf,strlen(tag_buf));
+    if (end)
+        put_char('>');
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  tag_to_char
+Purpose   :  Convert current tag to character value
+Inputs    :  <>
+Outputs   :  <>
+Return    :  character value or -1 if conversion is impossible
+-----------------------------------------------------------------------------*/
+static int tag_to_char(void)
+{
+    int i;
+    int n;
+
+    /*lookup tag in alias table*/
+    for (i=0; i<ALIAS_TABLE_SIZE; i++)
+        if (strcmp(alias_table[i].text,tag_buf)==0)
+            return alias_table[i].value;
+
+    /*try converting numerical value*/
+    if (sscanf(tag_buf,"%i",&n)==1) {
+        if (n<0 || n>255)
+            return -1;
+        else
+            return n;
+    }
+
+    /*we tried everything we could*/
+    return -1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  start_data
+Purpose   :  Prepare data buffer for tag enclosed data
+Inputs    :  name : name of start tag
+Outputs   :  Updates barcode globals
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void start_data(const char *name)
+{
+    bc_end_len = sprintf(bc_end,"</%s>",name);
+    bc_len = 0;
+
+    if (bc_buf == NULL) {
+        bc_size = 1024;
+        bc_buf = malloc(bc_size);
+        if (bc_buf == NULL)
+            job_error("Cannot allocate barcode buffer",APS_NO_MEMORY);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  append_data
+Purpose   :  Append bytes to tag enclosed data
+Inputs    :  b : bytes
+             n : number of bytes
+Outputs   :  Updates barcode globals
+Return    :  1 if end tag was reached, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int append_data(const unsigned char *b,int n)
+{
+    char *buf;
+    int i;
+
+    if (bc_buf == NULL)
+        return 0;
+
+    if (bc_len + n > bc_size) {
+        buf = realloc(bc_buf,bc_size * 2);
+        if (buf == NULL) {
+            job_error("Cannot allocate barcode buffer",APS_NO_MEMORY);
+            return 0;
+        }
+        bc_buf = buf;
+        bc_size *= 2;
+    }
+
+    for (i=0; i<n; i++)
+        bc_buf[bc_len++] = b[i];
+
+    return bc_len >= bc_end_len &&
+           memcmp(bc_buf + bc_len - bc_end_len,bc_end,bc_end_len) == 0;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  start_barcode
+Purpose   :  Check if current tag starts a barcode and prepare barcode data
+Inputs    :  <>
+Outputs   :  Updates barcode globals
+Return    :  1 if tag is a barcode tag, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int start_barcode(void)
+{
+    char name[TAG_BUFSIZE+1];
+    int p[4] = {-1,-1,-1,-1};
+    int i;
+
+    if (sscanf(tag_buf,"%256s %i %i %i %i",name,&p[0],&p[1],&p[2],&p[3]) < 1)
+        return 0;
+
+    for (i=0; i<BARCODE_TABLE_SIZE; i++)
+        if (strcmp(barcode_table[i].text,name)==0)
+            break;
+
+    if (i==BARCODE_TABLE_SIZE)
+        return 0;
+
+    bc_symbology = barcode_table[i].value;
+    barcode_default_opt(&bc_opt);
+
+    switch (bc_symbology) {
+        case BARCODE_QRCODE:
+            bc_opt.ecc = p[0];
+            bc_opt.module = p[1];
+            bc_opt.version = p[2] < 0 ? 0 : p[2];
+            break;
+        case BARCODE_PDF417:
+            bc_opt.ecc = p[0];
+            bc_opt.cols = p[1];
+            bc_opt.height = p[2];
+            bc_opt.module = p[3];
+            break;
+        default:
+            bc_opt.height = p[0];
+            bc_opt.module = p[1];
+            break;
+    }
+
+    start_data(name);
+
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  barcode_putc
+Purpose   :  Append character to barcode data
+             Characters above 255 are stored UTF-8 encoded
+Inputs    :  c : character code
+Outputs   :  Updates barcode globals
+Return    :  1 if barcode end tag was reached, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int barcode_putc(int c)
+{
+    unsigned char b[4];
+    int n;
+
+    if (c < 0x100) {
+        b[0] = c;
+        n = 1;
+    }
+    else if (c < 0x800) {
+        b[0] = 0xc0 | (c >> 6);
+        b[1] = 0x80 | (c & 0x3f);
+        n = 2;
+    }
+    else if (c < 0x10000) {
+        b[0] = 0xe0 | (c >> 12);
+        b[1] = 0x80 | ((c >> 6) & 0x3f);
+        b[2] = 0x80 | (c & 0x3f);
+        n = 3;
+    }
+    else {
+        b[0] = 0xf0 | (c >> 18);
+        b[1] = 0x80 | ((c >> 12) & 0x3f);
+        b[2] = 0x80 | ((c >> 6) & 0x3f);
+        b[3] = 0x80 | (c & 0x3f);
+        n = 4;
+    }
+
+    return append_data(b,n);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  start_template
+Purpose   :  Check if current tag selects a template
+Inputs    :  <>
+Outputs   :  Updates template globals
+Return    :  1 if tag is a template tag, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int start_template(void)
+{
+    char id[TAG_BUFSIZE+1];
+
+    if (strncmp(tag_buf,"TEMPLATE ",9) != 0 || sscanf(tag_buf + 9,"%256s",id) != 1)
+        return 0;
+
+    free(tpl_id);
+    tpl_id = strdup(id);
+
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  start_field
+Purpose   :  Check if current tag starts a template field value
+Inputs    :  <>
+Outputs   :  Updates template globals
+Return    :  1 if tag is a field tag, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int start_field(void)
+{
+    if (strncmp(tag_buf,"FIELD ",6) != 0 || sscanf(tag_buf + 6,"%256s",field_name) != 1)
+        return 0;
+
+    start_data("FIELD");
+
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  field_putc
+Purpose   :  Append character to field value
+             Value is kept as read from the job (UTF-8 if a font is used)
+Inputs    :  c : character code
+Outputs   :  Updates barcode globals
+Return    :  1 if field end tag was reached, 0 otherwise
+-----------------------------------------------------------------------------*/
+static int field_putc(int c)
+{
+    unsigned char b[4];
+
+    return append_data(b,utf8_put_code(c,b));
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  print_barcode
+Purpose   :  Print barcode
+             Pending text line is printed first
+Inputs    :  symbology : barcode symbology
+             data      : barcode data
+             len       : data length
+             opt       : barcode parameters
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void print_barcode(int symbology,const char *data,int len,
+                          const barcode_opt_t *opt)
+{
+    int errnum;
+
+    if (font_path != NULL)
+        text_flush();
+    else
+        fflush(stdout);
+
+    errnum = write_barcode(1,symbology,data,len,opt);
+
+    if (errnum != APS_OK) {
+        fprintf(stderr,"DEBUG: Cannot print barcode %d (%s)\n",
+                symbology,aps_strerror(errnum));
+    }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  process_code
+Purpose   :  Interpret one character of text with tags
+Inputs    :  c : character code
+Outputs   :  Updates processing state
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void process_code(int c)
+{
+    switch (state) {
+        case PROCESSING_IDLE:
+            if (c == '<') 
+            {
+                tag_index = 0;
+                state = PROCESSING_TAG;
+            }
+            else if (tpl_id != NULL) {
+                /*only fields follow a template*/
+                if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+                    tpl_skipped_chars++;
+            }
+            else
+                if (font_path != NULL) 
+                    text_putc(c);
+                else
+                    put_char(c);
+            break;
+
+			default:
+        case PROCESSING_TAG:
+            if (c=='>') {
+                int n;
+
+                tag_buf[tag_index] = 0;
+
+                if (start_template()) {
+                    state = PROCESSING_IDLE;
+                    break;
+                }
+
+                if (start_field()) {
+                    state = PROCESSING_FIELD;
+                    break;
+                }
+
+                if (tpl_id != NULL) {
+                    fprintf(stderr,"DEBUG: Template %s: tag <%s> not printed\n",
+                            tpl_id,tag_buf);
+                    tpl_skipped_tags++;
+                    state = PROCESSING_IDLE;
+                    break;
+                }
+
+                if (start_barcode()) {
+                    state = PROCESSING_BARCODE;
+                    break;
+                }
+
+                n = tag_to_char();
+
+                if (n==-1)
+                    put_tag(1);
+                else
+                    put_char(n);
+
+                state = PROCESSING_IDLE;
+            }
+            else if (c=='<') {
+                /*reset tag index in case of '<<LF>'*/
+                if (tpl_id != NULL)
+                    tpl_skipped_chars++;
+                else
+                    put_char('<');
+                tag_index = 0;
+            }
+            else {
+                if (tag_index==TAG_BUFSIZE) {
+                    tag_buf[tag_index] = 0;
+                    if (tpl_id != NULL)
+                        tpl_skipped_chars += tag_index + 1;
+                    else
+                        put_tag(0);
+
+                    state = PROCESSING_IDLE;
+                }
+                else {
+                    tag_buf[tag_index] = c;
+                    tag_index++;
+                }
+            }
+            break;
+
+        case PROCESSING_BARCODE:
+            if (barcode_putc(c)) {
+                print_barcode(bc_symbology,bc_buf,bc_len - bc_end_len,&bc_opt);
+                state = PROCESSING_IDLE;
+            }
+            break;
+
+        case PROCESSING_FIELD:
+            if (field_putc(c)) {
+                template_set_field(field_name,(unsigned char *)bc_buf,bc_len - bc_end_len);
+                state = PROCESSING_IDLE;
+            }
+            break;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  sync_output
+Purpose   :  Send pending text so that following commands can be encoded
+             apart
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void sync_output(void)
+{
+    if (font_path != NULL)
+        text_sync();
+    else
+        fflush(stdout);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  process_text
+Purpose   :  Interpret text with tags held in memory
+Inputs    :  text : text bytes (UTF-8 if a font is used)
+             size : number of bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void process_text(const unsigned char *text,int size)
+{
+    int c;
+
+    utf8_set_buffer(text,size,font_path != NULL);
+
+    while ((c = utf8_get_code()) >= 0)
+        process_code(c);
+
+    state = PROCESSING_IDLE;
+    sync_output();
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  print_static
+Purpose   :  Print template lines without fields, keep encoded commands
+Inputs    :  text : template lines
+             size : number of bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void print_static(const unsigned char *text,int size)
+{
+    if (size <= 0)
+        return;
+
+    template_begin_static();
+    process_text(text,size);
+    template_end_static();
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  print_fields
+Purpose   :  Print template line holding fields
+Inputs    :  line : template line
+             size : number of bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void print_fields(const unsigned char *line,int size)
+{
+    unsigned char *buf;
+    int n;
+
+    n = template_expand(line,size,&buf);
+    if (n < 0) {
+        job_error("Cannot allocate template line",APS_NO_MEMORY);
+        return;
+    }
+
+    process_text(buf,n);
+    free(buf);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  print_template
+Purpose   :  Print template selected by the job
+             Commands of static lines come from the template cache when
+             possible, only lines holding fields are encoded
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void print_template(void)
+{
+    const unsigned char *data;
+    const unsigned char *rec;
+    char *id = tpl_id;
+    int size;
+    int start;
+    int pos;
+    int end;
+    int len;
+    int type;
+
+    /*template text is printed, not skipped as job text*/
+    tpl_id = NULL;
+
+    if (template_open(id,template_dir,font_path) < 0) {
+        fprintf(stderr,"DEBUG: Template %s not found\n",id);
+        free(id);
+        return;
+    }
+    free(id);
+
+    sync_output();
+
+    if (template_lookup(&data,&size)) {
+        debug("Printing cached template",NULL);
+
+        pos = 0;
+        while (!job_stopped() && (type = template_record(data,size,&pos,&rec,&len)) != 0) {
+            if (type == TEMPLATE_STATIC) {
+                write_data(1,rec,len);
+                fflush(stdout);
+            }
+            else
+                print_fields(rec,len);
+        }
+    }
+    else if ((data = template_source(&size)) != NULL) {
+        debug("Compiling template",NULL);
+
+        /*runs of lines without fields are encoded together*/
+        start = 0;
+        for (pos = 0; pos < size && !job_stopped(); pos = end) {
+            for (end = pos; end < size && data[end] != '\n'; end++)
+                ;
+            if (end < size)
+                end++;
+
+            if (template_has_field(data + pos,end - pos)) {
+                print_static(data + start,pos - start);
+                template_add_line(data + pos,end - pos);
+                print_fields(data + pos,end - pos);
+                start = end;
+            }
+        }
+
+        if (!job_stopped()) {
+            print_static(data + start,size - start);
+            template_store();
+        }
+    }
+
+    template_close();
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  process_and_write
+Purpose   :  read data from "fd" and WITH Esc sentence interpretation 
+             and convert it (if font_path!=NULL) and put it on stdout
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void process_and_write(void)
+{
+    int c;
+
+    debug("Processing esc sentence.",NULL);
+    
+    while ((c = utf8_get_code()) >= 0)
+    {
+        if (job_stopped())
+            break;
+
+        process_code(c);
+    }
+
+    if (tpl_id != NULL && (tpl_skipped_chars > 0 || tpl_skipped_tags > 0))
+        fprintf(stderr,"WARNING: Template %s: %d characters and %d tags after "
+                "<TEMPLATE> not printed\n",tpl_id,tpl_skipped_chars,tpl_skipped_tags);
+    tpl_skipped_chars = 0;
+    tpl_skipped_tags = 0;
+
+    if (tpl_id != NULL && !job_stopped())
+        print_template();
+
+    free(tpl_id);
+    tpl_id = NULL;
+
+    free(bc_buf);
+    bc_buf = NULL;
+}
+
+
+static int fromascii(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	else
+		return -1;
+}
+
+
+/*-----------------------------------------------------------------------------
+Name      :  noprocess_and_write
+Purpose   :  read data from "fd" and WITHOUT Esc sentence interpretation 
+             and convert it (if font_path!=NULL) and put it on stdout
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void noprocess_and_write(void)
+{
+    int c;
+	char * qrbuf = NULL;
+	int size, idx;
+
+	int ver, level, mode, casesensitivity;
+
+    debug("NOT processing esc sentence.",NULL);
+    
+    while ((c = utf8_get_code()) >= 0)
+    {
+        if (job_stopped())
+            break;
+
+		switch (state)
+		{
+			case PROCESSING_TAG:
+				if (c == '.')
+				{
+					state = QRCODE_READING_VER0;
+					qrbuf = malloc((size = 1024) + 1);
+					idx = 0;
+					if (!qrbuf)
+						state = PROCESSING_IDLE;
+					break;
+				}
+				/* fall out */
+				state = PROCESSING_IDLE;
+				break;
+			default:
+			case PROCESSING_IDLE:
+				if (c == ESC) 
+				{
+					tag_index = 0;
+					state = PROCESSING_TAG;
+				}
+				else
+        if (font_path != NULL) 
+            text_putc(c);
+        else
+						put_char(c);
+				break;
+			case QRCODE_READING_VER0:
+				ver = level = mode = casesensitivity = 0;
+				if ((c = fromascii(c)) == -1)
+				{
+					state = PROCESSING_IDLE;
+					break;
+				}
+				else
+				{
+					ver = c * 10;
+					state = QRCODE_READING_VER1;
+				}
+				break;
+			case QRCODE_READING_VER1:
+				if ((c = fromascii(c)) == -1)
+				{
+					state = PROCESSING_IDLE;
+					break;
+				}
+				else
+				{
+					ver += c;
+					state = QRCODE_READING_LEVEL;
+				}
+				break;
+			case QRCODE_READING_LEVEL:
+				if ((c = fromascii(c)) == -1)
+				{
+					state = PROCESSING_IDLE;
+					break;
+				}
+				else
+				{
+					level = c;
+					state = QRCODE_READING_MODE;
+				}
+				break;
+			case QRCODE_READING_MODE:
+				if ((c = fromascii(c)) == -1)
+				{
+					state = PROCESSING_IDLE;
+					break;
+				}
+				else
+				{
+					mode = c;
+					state = QRCODE_READING_CASE_SENSITIVITY;
+				}
+				break;
+			case QRCODE_READING_CASE_SENSITIVITY:
+				if ((c = fromascii(c)) == -1)
+				{
+					state = PROCESSING_IDLE;
+					break;
+				}
+				else
+				{
+					casesensitivity = c;
+					state = QRCODE_READING_DATA;
+				}
+				break;
+			case QRCODE_READING_DATA:
+				if (c == ESC)
+				{
+					char * qr_data;
+					int qrlen;
+					command_t cmd;
+
+					qrbuf[idx] = 0;
+
+					fprintf(stderr,"DEBUG: %s() ver = %i, level = %i, mode = %i, case = %i\n", __func__, ver, level, mode, casesensitivity);
+
+
+					if (cmd_mrs_qrcode_scaled(printer_model, 0, ver, level, mode, casesensitivity, qrbuf, &qr_data, &qrlen, &cmd) == APS_OK)
+					{
+						write_command(1, &cmd, qr_data, qrlen);
+
+						fflush(stdout);
+						free(qr_data);
+					}
+
+					free(qrbuf);
+
+					state = PROCESSING_IDLE;
+
+				}
+#if 0
+				{
+					int i, j, k, x, bcnt, len;
+					QRcode *qrcode;
+					unsigned char * p, cb;
+#if 1
+					qrbuf[idx] = 0;
+					qrcode = QRcode_encodeString(qrbuf, 0, QR_ECLEVEL_L, QR_MODE_8, 0);
+					if (!qrcode)
+					{
+						state = PROCESSING_IDLE;
+						break;
+					}
+
+					//p = malloc(len = ((qrcode->width + 7) / 8) * 8);
+					len = (qrcode->width + 7) / 8;
+					p = malloc(len * qrcode->width);
+					memset(p, 0x5a, 10 * len * qrcode->width);
+
+					for (idx = x = i = 0; i < qrcode->width; i ++)
+					{
+						for (bcnt = cb = j = 0; j < qrcode->width; j ++, x ++)
+						{
+							cb <<= 1;
+							if (qrcode->data[x] & 1)
+								cb |= 0x80 >> 7;
+							if (++ bcnt == 8)
+							{
+								p[idx ++] = cb;
+								cb = 0;
+								bcnt = 0;
+							}
+						}
+						if (bcnt)
+						{
+							cb <<= 8 - bcnt;
+							p[idx ++] = cb;
+						}
+					}
+
+					command_t cmd;
+					cmd.size = 4;
+					cmd.buf[0] = GS;
+					cmd.buf[1] = 'k';
+					cmd.buf[2] = 8;
+					cmd.buf[3] = qrcode->width;
+#endif
+					//write_command(0, &cmd, p, idx);
+					write_command(1, &cmd, p, idx);
+
+					fflush(stdout);
+
+					QRcode_free(qrcode);
+
+					free(qrbuf);
+					free(p);
+
+					state = PROCESSING_IDLE;
+
+				}
+#endif
+				else
+				{
+					if (idx == size)
+        {
+						qrbuf = realloc(qrbuf, (size *= 2) + 1);
+						if (!qrbuf)
+						{
+							state = PROCESSING_IDLE;
+							break;
+						}
+        }
+					qrbuf[idx ++] = c;
+    }
+
+				break;
+
+		}
+	}
+
+	/*QR code data left by a stopped job*/
+	if (state >= QRCODE_READING_VER0)
+		free(qrbuf);
+}
+
+/* PUBLIC FUNCTIONS ---------------------------------------------------------*/
+
+/*-----------------------------------------------------------------------------
+Name      :  text_cancel
+Purpose   :  Cancel current job, the job function returns as soon as
+             possible; may be called from a signal handler
+Inputs    :  <>
+Outputs   :  Updates global cancel_flag
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void text_cancel(void)
+{
+    cancel_flag = 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  text_job
+Purpose   :  Encode text job to the ticket output (stdout or the output
+             set by set_ticket_output)
+             Options must have been read (get_options, read_options); the
+             job is encoded once and replayed for every copy
+             Errors are logged and the job is left at the first one; the
+             font and barcode buffers are freed before returning, so jobs
+             may follow in the same process
+Inputs    :  fd     : text stream
+             copies : number of copies
+Outputs   :  <>
+Return    :  APS_OK (also when cancelled) or error code
+-----------------------------------------------------------------------------*/
+int text_job(int fd,int copies)
+{
+    int loaded;
+
+    job_errnum = APS_OK;
+    state = PROCESSING_IDLE;
+
+    /*enter raw ticket mode*/
+    enter_raw_mode();
+
+    /*encode job once, it is replayed for every copy*/
+    if (start_copies(copies)<0) {
+        debug("Cannot spool job, printing one copy",NULL);
+        copies = 1;
+    }
+
+    /*write ticket prolog*/
+    write_prolog(1);
+
+    /*perform simple page accounting*/
+    fprintf(stderr,"PAGE: 1 %d\n",copies);
+    encstats_page_begin();
+
+
+    /*pipe text file to standard output*/
+    if(font_path != NULL)
+        utf8_set_file(fd,1);
+    else
+        utf8_set_file(fd,0);
+
+    /*load external font if needed */
+    loaded = 0;
+    if (font_path != NULL) {
+        debug("Font used is :",NULL);
+        debug(font_path,NULL);
+        loaded = text_create(1,font_path)>=0;
+    }
+    else {
+        debug("No font Setted used internal printer font.",NULL);
+    }
+
+    if (!job_stopped()) {
+        if (process)
+            process_and_write();
+        else
+            noprocess_and_write();
+    }
+
+    encstats_page_end(1);
+
+    /*Unload external font if needed */
+    if (loaded)
+        text_free();
+
+    free_barcode_cache();
+
+    if (job_errnum<0) {
+        debug("Print job failed",NULL);
+    }
+    else if (cancel_flag) {
+        debug("Print job was cancelled",NULL);
+    }
+    else {
+        /*write ticket epilog*/
+        write_epilog(1);
+    }
+
+    /*send all copies, a stopped job is sent once*/
+    if (end_copies(job_stopped() ? 1 : copies)<0) {
+        debug("Cannot replay spooled job",NULL);
+    }
+
+    /*report what dotline optimizations saved*/
+    encstats_job_end("texttoaps");
+
+    /*a cancel stops the current job only*/
+    cancel_flag = 0;
+
+    return job_errnum;
+}
@@ -8,6 +8,7 @@
  *                 Converts plain text into APS commands
  *                 APS command set is selected depending on cupsModelNumber
  *                 attribute of the PPD file
+ *                 The job is encoded by text_job() (textjob.c)
  *
  * CVS           : $Id: texttoaps.c,v 1.12 2008/07/09 14:22:29 pierre Exp $
  *******************************************************************************
@@ -37,6 +38,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
@@ -44,423 +46,26 @@
 #include <sys/stat.h>
 
 #include <cups/cups.h>
-#include <cups/raster.h>
 
 #include <aps/aps.h>
 
-#include "command.h"
 #include "options.h"
-#include "ticket.h"
-#include "utf8.h"
-#include "text.h"
-
-/* PRIVATE DEFINITIONS ------------------------------------------------------*/
-
-static  sig_atomic_t    cancel_flag;
-
-#define BUFSIZE 4096    /*bytes*/
-
-static enum {
-    PROCESSING_IDLE = 0,
-	PROCESSING_TAG,
-	QRCODE_READING_VER0,
-	QRCODE_READING_VER1,
-	QRCODE_READING_LEVEL,
-	QRCODE_READING_MODE,
-	QRCODE_READING_CASE_SENSITIVITY,
-	QRCODE_READING_DATA,
-} state;
-
-#define TAG_BUFSIZE 256         /*bytes*/
-
-static int      tag_index;
-static char     tag_buf[TAG_BUFSIZE+1];
-
-typedef struct {
-    char *  text;
-    int     value;
-} alias_t;
-
-static const alias_t alias_table[] = {
-    {"NUL", NUL},
-    {"SOH", SOH},
-    {"STX", STX},
-    {"ETX", ETX},
-    {"EOT", EOT},
-    {"ENQ", ENQ},
-    {"ACK", ACK},
-    {"BEL", BEL},
-    {"BS",  BS},
-    {"TAB", TAB},
-    {"LF",  LF},
-    {"VT",  VT},
-    {"FF",  FF},
-    {"CR",  CR},
-    {"SO",  SO},
-    {"SI",  SI},
-    {"DLE", DLE},
-    {"DC1", DC1},
-    {"DC2", DC2},
-    {"DC3", DC3},
-    {"DC4", DC4},
-    {"NAK", NAK},
-    {"SYN", SYN},
-    {"ETB", ETB},
-    {"CAN", CAN},
-    {"EM",  EM},
-    {"SUB", SUB},
-    {"ESC", ESC},
-    {"FS",  FS},
-    {"GS",  GS},
-    {"RS",  RS},
-    {"US",  US}
-};
-
-#define ALIAS_TABLE_SIZE    (int)(sizeof(alias_table)/sizeof(alias_table[0]))
+#include "textjob.h"
 
 /* PRIVATE FUNCTIONS --------------------------------------------------------*/
 
-
 /*-----------------------------------------------------------------------------
 Name      :  cancel_handler
 Purpose   :  Cancel signal handler (traps SIGTERM)
 Inputs    :  signum : signal number
-Outputs   :  Updates global cancel_flag
+Outputs   :  <>
 Return    :  <>
 -----------------------------------------------------------------------------*/
 static void cancel_handler(int signum)
 {
     (void)signum;
 
-    cancel_flag = 1;
-}
-
-/*-----------------------------------------------------------------------------
-Name      :  tag_to_char
-Purpose   :  Convert current tag to character value
-Inputs    :  <>
-Outputs   :  <>
-Return    :  character value or -1 if conversion is impossible
------------------------------------------------------------------------------*/
-static int tag_to_char(void)
-{
-    int i;
-    int n;
-
-    /*lookup tag in alias table*/
-    for (i=0; i<ALIAS_TABLE_SIZE; i++)
-        if (strcmp(alias_table[i].text,tag_buf)==0)
-            return alias_table[i].value;
-
-    /*try converting numerical value*/
-    if (sscanf(tag_buf,"%i",&n)==1) {
-        if (n<0 || n>255)
-            return -1;
-        else
-            return n;
-    }
-
-    /*we tried everything we could*/
-    return -1;
-}
-
-/*-----------------------------------------------------------------------------
-Name      :  process_and_write
-Purpose   :  read data from "fd" and WITH Esc sentence interpretation 
-             and convert it (if font_path!=NULL) and put it on stdout
-Inputs    :  <>
-Outputs   :  <>
-Return    :  <>
------------------------------------------------------------------------------*/
-static void process_and_write(void)
-{
-    int c;
-
-    debug("Processing esc sentence.",NULL);
-    
-    while ((c = utf8_get_code()) >= 0)
-    {
-        if (cancel_flag)
-            break;
-
-        switch (state) {
-            case PROCESSING_IDLE:
-                if (c == '<') 
-                {
-                    tag_index = 0;
-                    state = PROCESSING_TAG;
-                }
-                else
-                    if (font_path != NULL) 
-                        text_putc(c);
-                    else
-                        fputc(c,stdout);
-                break;
-
-			default:
-            case PROCESSING_TAG:
-                if (c=='>') {
-                    int n;
-
-                    tag_buf[tag_index] = 0;
-                    n = tag_to_char();
-
-                    if (n==-1)
-                        printf("<%s>",tag_buf);
-                    else
-                        fputc(n,stdout);
-
-                    state = PROCESSING_IDLE;
-                }
-                else if (c=='<') {
-                    /*reset tag index in case of '<<LF>'*/
-                    fputc('<',stdout);
-                    tag_index = 0;
-                }
-                else {
-                    if (tag_index==TAG_BUFSIZE) {
-                        tag_buf[tag_index] = 0;
-                        printf("<%s",tag_buf);
-
-                        state = PROCESSING_IDLE;
-                    }
-                    else {
-                        tag_buf[tag_index] = c;
-                        tag_index++;
-                    }
-                }
-                break;
-        }
-    }
-}
-
-
-static int fromascii(int c)
-{
-	if (c >= '0' && c <= '9')
-		return c - '0';
-	else
-		return -1;
-}
-
-
-/*-----------------------------------------------------------------------------
-Name      :  noprocess_and_write
-Purpose   :  read data from "fd" and WITHOUT Esc sentence interpretation 
-             and convert it (if font_path!=NULL) and put it on stdout
-Inputs    :  <>
-Outputs   :  <>
-Return    :  <>
------------------------------------------------------------------------------*/
-static void noprocess_and_write(void)
-{
-    int c;
-	char * qrbuf;
-	int size, idx;
-
-	int ver, level, mode, casesensitivity;
-
-    debug("NOT processing esc sentence.",NULL);
-    
-    while ((c = utf8_get_code()) >= 0)
-    {
-        if (cancel_flag)
-            break;
-
-		switch (state)
-		{
-			case PROCESSING_TAG:
-				if (c == '.')
-				{
-					state = QRCODE_READING_VER0;
-					qrbuf = malloc((size = 1024) + 1);
-					idx = 0;
-					if (!qrbuf)
-						state = PROCESSING_IDLE;
-					break;
-				}
-				/* fall out */
-				state = PROCESSING_IDLE;
-				break;
-			default:
-			case PROCESSING_IDLE:
-				if (c == ESC) 
-				{
-					tag_index = 0;
-					state = PROCESSING_TAG;
-				}
-				else
-        if (font_path != NULL) 
-            text_putc(c);
-        else
-						fputc(c,stdout);
-				break;
-			case QRCODE_READING_VER0:
-				ver = level = mode = casesensitivity = 0;
-				if ((c = fromascii(c)) == -1)
-				{
-					state = PROCESSING_IDLE;
-					break;
-				}
-				else
-				{
-					ver = c * 10;
-					state = QRCODE_READING_VER1;
-				}
-				break;
-			case QRCODE_READING_VER1:
-				if ((c = fromascii(c)) == -1)
-				{
-					state = PROCESSING_IDLE;
-					break;
-				}
-				else
-				{
-					ver += c;
-					state = QRCODE_READING_LEVEL;
-				}
-				break;
-			case QRCODE_READING_LEVEL:
-				if ((c = fromascii(c)) == -1)
-				{
-					state = PROCESSING_IDLE;
-					break;
-				}
-				else
-				{
-					level = c;
-					state = QRCODE_READING_MODE;
-				}
-				break;
-			case QRCODE_READING_MODE:
-				if ((c = fromascii(c)) == -1)
-				{
-					state = PROCESSING_IDLE;
-					break;
-				}
-				else
-				{
-					mode = c;
-					state = QRCODE_READING_CASE_SENSITIVITY;
-				}
-				break;
-			case QRCODE_READING_CASE_SENSITIVITY:
-				if ((c = fromascii(c)) == -1)
-				{
-					state = PROCESSING_IDLE;
-					break;
-				}
-				else
-				{
-					casesensitivity = c;
-					state = QRCODE_READING_DATA;
-				}
-				break;
-			case QRCODE_READING_DATA:
-				if (c == ESC)
-				{
-					char * qr_data;
-					int qrlen;
-					command_t cmd;
-
-					qrbuf[idx] = 0;
-
-					fprintf(stderr,"DEBUG: %s() ver = %i, level = %i, mode = %i, case = %i\n", __func__, ver, level, mode, casesensitivity);
-
-
-					if (cmd_mrs_qrcode(ver, level, mode, casesensitivity, qrbuf, &qr_data, &qrlen, &cmd) == APS_OK)
-					{
-						write_command(1, &cmd, qr_data, qrlen);
-
-						fflush(stdout);
-						free(qr_data);
-					}
-
-					free(qrbuf);
-
-					state = PROCESSING_IDLE;
-
-				}
-#if 0
-				{
-					int i, j, k, x, bcnt, len;
-					QRcode *qrcode;
-					unsigned char * p, cb;
-#if 1
-					qrbuf[idx] = 0;
-					qrcode = QRcode_encodeString(qrbuf, 0, QR_ECLEVEL_L, QR_MODE_8, 0);
-					if (!qrcode)
-					{
-						state = PROCESSING_IDLE;
-						break;
-					}
-
-					//p = malloc(len = ((qrcode->width + 7) / 8) * 8);
-					len = (qrcode->width + 7) / 8;
-					p = malloc(len * qrcode->width);
-					memset(p, 0x5a, 10 * len * qrcode->width);
-
-					for (idx = x = i = 0; i < qrcode->width; i ++)
-					{
-						for (bcnt = cb = j = 0; j < qrcode->width; j ++, x ++)
-						{
-							cb <<= 1;
-							if (qrcode->data[x] & 1)
-								cb |= 0x80 >> 7;
-							if (++ bcnt == 8)
-							{
-								p[idx ++] = cb;
-								cb = 0;
-								bcnt = 0;
-							}
-						}
-						if (bcnt)
-						{
-							cb <<= 8 - bcnt;
-							p[idx ++] = cb;
-						}
-					}
-
-					command_t cmd;
-					cmd.size = 4;
-					cmd.buf[0] = GS;
-					cmd.buf[1] = 'k';
-					cmd.buf[2] = 8;
-					cmd.buf[3] = qrcode->width;
-#endif
-					//write_command(0, &cmd, p, idx);
-					write_command(1, &cmd, p, idx);
-
-					fflush(stdout);
-
-					QRcode_free(qrcode);
-
-					free(qrbuf);
-					free(p);
-
-					state = PROCESSING_IDLE;
-
-				}
-#endif
-				else
-				{
-					if (idx == size)
-        {
-						qrbuf = realloc(qrbuf, (size *= 2) + 1);
-						if (!qrbuf)
-						{
-							state = PROCESSING_IDLE;
-							break;
-						}
-        }
-					qrbuf[idx ++] = c;
-    }
-
-				break;
-
-		}
-	}
-
+    text_cancel();
 }
 
 /* PUBLIC FUNCTIONS ---------------------------------------------------------*/
@@ -477,6 +82,8 @@ int main(int argc,char** argv)
 {
     struct sigaction sa;
     int fd;
+    int copies;
+    int errnum;
 
     setbuf(stderr,NULL);
 
@@ -497,6 +104,10 @@ int main(int argc,char** argv)
     /*retrieve options*/
     get_options(argv[5]);
 
+    copies = atoi(argv[4]);
+    if (copies<1)
+        copies = 1;
+
     /*print real and effective user ID*/
     fprintf(stderr, "DEBUG: Real uid = %d\n", getuid());
     fprintf(stderr, "DEBUG: Effective uid = %d\n", geteuid());
@@ -530,54 +141,12 @@ int main(int argc,char** argv)
         fd = 0; /*stdin*/
 
     /*install cancel handler*/
-    cancel_flag = 0;
-
     memset(&sa,0,sizeof(sa));
     sa.sa_handler = &cancel_handler;
     sigaction(SIGTERM,&sa,NULL);
 
-    /*enter raw ticket mode*/
-    enter_raw_mode();
-
-    /*write ticket prolog*/
-    write_prolog(1);
-
-    /*perform simple page accounting*/
-    fprintf(stderr,"PAGE: 1 1\n");
-
-
-    /*pipe text file to standard output*/
-    if(font_path != NULL)
-        utf8_set_file(fd,1);
-    else
-        utf8_set_file(fd,0);
-
-    /*load external font if needed */
-    if (font_path != NULL) {
-        debug("Font used is :",NULL);
-        debug(font_path,NULL);
-        text_create(1,font_path);
-    }
-    else {
-        debug("No font Setted used internal printer font.",NULL);
-    }
-
-    if (process)
-        process_and_write();
-    else
-        noprocess_and_write();
-
-    /*Unload external font if needed */
-    if (font_path != NULL)
-        text_free();
-
-    if (cancel_flag) {
-        debug("Print job was cancelled",NULL);
-    }
-    else {
-        /*write ticket epilog*/
-        write_epilog(1);
-    }
+    /*read, encode and write text*/
+    errnum = text_job(fd,copies);
 
     /*uninstall cancel handler*/
     memset(&sa,0,sizeof(sa));
@@ -593,7 +162,5 @@ int main(int argc,char** argv)
 
     debug("textttoaps filter finished",NULL);
 
-    return 0;
+    return errnum<0 ? 1 : 0;
 }
-
-
@@ -31,19 +31,291 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <aps/aps.h>
 
 #include "command.h"
 #include "options.h"
+#include "barcode.h"
+#include "cache.h"
+#include "encstats.h"
+#include "stream.h"
 #include "ticket.h"
 
 /* PRIVATE DEFINITIONS ------------------------------------------------------*/
 
+static FILE     *ticket_out = NULL;     /*NULL means stdout*/
+static int      framed = 0;             /*stdout is a framed stream*/
+static int      direct = 0;             /*output is the printer port*/
+
+#define SYMBOL_CACHE_ENTRIES    64
+#define SYMBOL_CACHE_BYTES      (1024*1024)     /*bytes*/
+#define SYMBOL_CACHE_DISK_BYTES (4*1024*1024)   /*bytes of on-disk entries*/
+#define SYMBOL_CACHE_VERSION    1               /*encoding of cached symbols*/
+
+/*barcode symbol cache key header, followed by barcode data*/
+typedef struct {
+        int     cache_version;
+        int     symbology;
+        int     printer_type;
+        int     printer_model;
+        int     printer_width;
+        int     raw;
+        int     height;
+        int     module;
+        int     ecc;
+        int     cols;
+        int     version;
+        int     mode;
+} symbol_key_t;
+
+static cache_t  *symbol_cache = NULL;
+
+/*job copies, the job is spooled once then replayed*/
+#define COPY_BUFSIZE    4096    /*bytes*/
+
+static FILE     *copies_file = NULL;    /*spooled job*/
+static int      copies_fd = -1;         /*saved standard output*/
+static FILE     *copies_out = NULL;     /*saved ticket output (direct mode)*/
+
 /* PRIVATE FUNCTIONS --------------------------------------------------------*/
 
+/*-----------------------------------------------------------------------------
+Name      :  output
+Purpose   :  Get current ticket output stream
+Inputs    :  <>
+Outputs   :  <>
+Return    :  output stream
+-----------------------------------------------------------------------------*/
+static FILE *output(void)
+{
+        return ticket_out!=NULL ? ticket_out : stdout;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  put_data
+Purpose   :  Write printer commands to current ticket output
+             Commands sent to a framed stdout are batched in DATA records,
+             commands captured in memory are kept plain
+Inputs    :  buf  : command bytes
+             size : number of bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+static void put_data(const void *buf,int size)
+{
+        if (framed && output()==stdout)
+                stream_data(stdout,buf,size);
+        else
+                fwrite(buf,size,1,output());
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_bitmap
+Purpose   :  Write bitmap as dotlines, centered on paper
+Inputs    :  raw : issue raw commands if true
+             bmp : bitmap
+Outputs   :  <>
+Return    :  APS_OK or error code (APS_INVALID_BITMAP if wider than paper)
+-----------------------------------------------------------------------------*/
+static int write_bitmap(int raw,const barcode_bitmap_t *bmp)
+{
+        command_t cmd;
+        unsigned char *line;
+        int pad;
+        int nbytes;
+        int errnum;
+        int y;
+
+        /*a cropped barcode would not scan*/
+        if (bmp->width>printer_width)
+                return APS_INVALID_BITMAP;
+
+        nbytes = bmp->width;
+        pad = (printer_width-nbytes)/2;
+
+        line = calloc(1,pad+nbytes);
+        if (line==NULL)
+                return APS_NO_MEMORY;
+
+        errnum = cmd_print_dotline(printer_type,&cmd,pad+nbytes);
+
+        for (y = 0; y<bmp->height && errnum==APS_OK; y++) {
+                memcpy(line+pad,bmp->buf+y*bmp->width,nbytes);
+                write_command(raw,&cmd,line,pad+nbytes);
+        }
+
+        free(line);
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_native_barcode
+Purpose   :  Write native barcode commands
+Inputs    :  raw       : issue raw commands if true
+             symbology : barcode symbology
+             data      : barcode data
+             len       : data length in bytes
+             opt       : barcode parameters
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int write_native_barcode(int raw,int symbology,const char *data,int len,
+                                const barcode_opt_t *opt)
+{
+        command_t cmd;
+        char *buf;
+        int size;
+        int width;
+        int errnum;
+
+        switch (symbology) {
+        case BARCODE_QRCODE:
+                buf = NULL;
+                errnum = cmd_mrs_qrcode_bindata(opt->version,
+                                opt->ecc<0 ? 1 : opt->ecc,
+                                opt->mode<0 ? 2 : opt->mode,
+                                (char *)data,len,&buf,&size,&cmd,&width);
+                if (errnum==APS_OK)
+                        write_command(raw,&cmd,buf,size);
+                free(buf);
+                return errnum;
+
+        case BARCODE_PDF417:
+                errnum = cmd_print_pdf417(printer_type,&cmd,
+                                opt->ecc<0 ? BARCODE_PDF417_ECC : opt->ecc,
+                                opt->cols<0 ? BARCODE_PDF417_COLS : opt->cols,
+                                len);
+                if (errnum==APS_OK)
+                        write_command(raw,&cmd,data,len);
+                return errnum;
+
+        default:
+                errnum = cmd_print_barcode(printer_type,&cmd,symbology,len);
+                if (errnum!=APS_OK)
+                        return errnum;
+
+                /*data is NUL terminated*/
+                buf = malloc(len+1);
+                if (buf==NULL)
+                        return APS_NO_MEMORY;
+                memcpy(buf,data,len);
+                buf[len] = NUL;
+
+                write_command(raw,&cmd,buf,len+1);
+                free(buf);
+                return APS_OK;
+        }
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  encode_barcode
+Purpose   :  Write barcode, using native printer command when the model
+             supports the symbology, host rasterization otherwise
+             Rasterized barcodes wider than the paper get smaller modules
+Inputs    :  raw       : issue raw commands if true
+             symbology : barcode symbology (see barcode_t)
+             data      : barcode data
+             len       : data length in bytes
+             opt       : barcode parameters
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+static int encode_barcode(int raw,int symbology,const char *data,int len,
+                          const barcode_opt_t *opt)
+{
+        barcode_bitmap_t bmp;
+        command_t cmd;
+        int errnum;
+
+        if (cmd_barcode_native(printer_type,symbology)) {
+
+                if (symbology!=BARCODE_QRCODE) {
+                        if (opt->height>0) {
+                                cmd_set_barcode_height(printer_type,&cmd,opt->height);
+                                write_command(raw,&cmd,NULL,0);
+                        }
+                        if (opt->module>0) {
+                                cmd_set_barcode_width(printer_type,&cmd,opt->module);
+                                write_command(raw,&cmd,NULL,0);
+                        }
+                }
+
+                errnum = write_native_barcode(raw,symbology,data,len,opt);
+        }
+        else if (symbology==BARCODE_QRCODE) {
+                char *modules;
+                int scale;
+                int size;
+                int width;
+
+                /*module bitmap is scaled on host*/
+                modules = NULL;
+                errnum = cmd_mrs_qrcode_bindata(opt->version,
+                                opt->ecc<0 ? 1 : opt->ecc,
+                                opt->mode<0 ? 2 : opt->mode,
+                                (char *)data,len,&modules,&size,&cmd,&width);
+
+                scale = opt->module>0 ? opt->module : cmd_qrcode_scale(printer_model);
+                if (errnum==APS_OK && width*scale>printer_width*8)
+                        scale = printer_width*8/width;
+                if (errnum==APS_OK && scale<1)
+                        errnum = APS_INVALID_BITMAP;
+
+                if (errnum==APS_OK)
+                        errnum = barcode_raster_qrcode((unsigned char *)modules,width,
+                                        scale,&bmp);
+                free(modules);
+
+                if (errnum==APS_OK) {
+                        errnum = write_bitmap(raw,&bmp);
+                        barcode_bitmap_free(&bmp);
+                }
+        }
+        else {
+                barcode_opt_t fit = *opt;
+
+                if (fit.module<=0)
+                        fit.module = BARCODE_MODULE;
+
+                for (;;) {
+                        errnum = barcode_raster_1d(symbology,data,len,&fit,&bmp);
+                        if (errnum!=APS_OK || bmp.width<=printer_width || fit.module==1)
+                                break;
+                        barcode_bitmap_free(&bmp);
+                        fit.module--;
+                }
+
+                if (errnum==APS_OK) {
+                        errnum = write_bitmap(raw,&bmp);
+                        barcode_bitmap_free(&bmp);
+                }
+        }
+
+        return errnum;
+}
+
 /* PUBLIC FUNCTIONS ---------------------------------------------------------*/
 
+/*-----------------------------------------------------------------------------
+Name      :  set_ticket_output
+Purpose   :  Redirect ticket commands to another stream
+             (used to capture encoded commands in memory)
+Inputs    :  f : output stream (NULL for stdout)
+Outputs   :  <>
+Return    :  previous output stream (NULL for stdout)
+-----------------------------------------------------------------------------*/
+FILE *set_ticket_output(FILE *f)
+{
+        FILE *old = ticket_out;
+
+        ticket_out = f;
+
+        return old;
+}
+
 /*-----------------------------------------------------------------------------
 Name      :  enter_raw_mode
 Purpose   :  Signal backend that ticket data will be sent in raw mode
@@ -56,12 +328,76 @@ void enter_raw_mode(void)
 {
         int n = -1;
 
-        fwrite(&n,sizeof(int),1,stdout);
+        if (direct)
+                return;
+
+        fwrite(&n,sizeof(int),1,output());
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  enter_direct_mode
+Purpose   :  Send commands without block headers nor stream framing
+             stdout is then written to the printer port by the caller
+             (see direct.c)
+Inputs    :  on : direct mode flag
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void enter_direct_mode(int on)
+{
+        direct = on;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  start_stream
+Purpose   :  Start framed stream on stdout
+             Must be called before start_copies() so the header is sent once
+Inputs    :  flags : stream header flags (STREAM_CRC)
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void start_stream(int flags)
+{
+        if (direct)
+                return;
+
+        stream_start(stdout,flags);
+        framed = 1;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_marker
+Purpose   :  Mark page or cut in framed stream, nothing in legacy streams
+Inputs    :  type  : record type (STREAM_PAGE, STREAM_CUT)
+             value : marker value
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void write_marker(int type,int value)
+{
+        if (framed && output()==stdout)
+                stream_mark(stdout,type,value);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  end_stream
+Purpose   :  End framed stream on stdout
+             Must be called after end_copies()
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void end_stream(void)
+{
+        if (framed) {
+                stream_end(stdout);
+                framed = 0;
+        }
 }
 
 /*-----------------------------------------------------------------------------
 Name      :  write_command
-Purpose   :  Write command to stdout
+Purpose   :  Write command to stdout (or current ticket output)
 Inputs    :  raw  : issue raw command if true
              cmd  : command structure
              buf  : command data buffer
@@ -71,19 +407,62 @@ Return    :  <>
 -----------------------------------------------------------------------------*/
 void write_command(int raw,const command_t *cmd,const void *buf,int size)
 {
-        /*send block header in non-raw mode*/
-        if (!raw) {
+        /*send block header in non-raw mode, framed streams have none*/
+        if (!raw && !framed && !direct) {
                 int n = cmd->size+size;
-                fwrite(&n,sizeof(int),1,stdout);
+                fwrite(&n,sizeof(int),1,output());
         }
 
         /*send command header*/
-        fwrite(cmd->buf,cmd->size,1,stdout);
+        put_data(cmd->buf,cmd->size);
 
         /*send command data only if buffer is specified*/
         if (buf!=NULL) {
-                fwrite(buf,size,1,stdout);
+                put_data(buf,size);
         }
+
+        enc_stats.bytes += cmd->size+(buf!=NULL ? size : 0);
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_data
+Purpose   :  Write encoded commands to stdout (or current ticket output)
+Inputs    :  raw  : issue raw commands if true
+             buf  : command bytes
+             size : number of bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void write_data(int raw,const void *buf,int size)
+{
+        if (size<=0)
+                return;
+
+        /*send block header in non-raw mode, framed streams have none*/
+        if (!raw && !framed && !direct) {
+                fwrite(&size,sizeof(int),1,output());
+        }
+
+        put_data(buf,size);
+
+        enc_stats.bytes += size;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_captured
+Purpose   :  Write commands captured in memory (see set_ticket_output) to
+             current ticket output
+             Captured commands already hold their block headers and were
+             counted when written
+Inputs    :  buf  : captured commands
+             size : number of bytes
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void write_captured(const void *buf,int size)
+{
+        if (size>0)
+                put_data(buf,size);
 }
 
 /*-----------------------------------------------------------------------------
@@ -139,7 +518,7 @@ void write_prolog(int raw)
                 write_command(raw,&cmd,NULL,0);
         }
 
-        fflush(stdout);
+        fflush(output());
 }
 
 /*-----------------------------------------------------------------------------
@@ -171,10 +550,12 @@ void write_epilog(int raw)
         case FINALCUT_PARTIAL:
                 cmd_partial_cut(printer_type,&cmd);
                 write_command(raw,&cmd,NULL,0);
+                write_marker(STREAM_CUT,0);
                 break;
         case FINALCUT_FULL:
                 cmd_full_cut(printer_type,&cmd);
                 write_command(raw,&cmd,NULL,0);
+                write_marker(STREAM_CUT,0);
                 break;
         }
 
@@ -185,6 +566,213 @@ void write_epilog(int raw)
         }
     }
 
-    fflush(stdout);
+    fflush(output());
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  write_barcode
+Purpose   :  Write barcode, using native printer command when the model
+             supports the symbology, host rasterization otherwise
+             Encoded symbols are kept in memory, and on disk (per queue,
+             in <cache_dir>/<queue>/symbol) with the symbolcachedisk option,
+             so a barcode repeated on every ticket is encoded only once
+Inputs    :  raw       : issue raw commands if true
+             symbology : barcode symbology (see barcode_t)
+             data      : barcode data
+             len       : data length in bytes
+             opt       : barcode parameters
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int write_barcode(int raw,int symbology,const char *data,int len,
+                  const barcode_opt_t *opt)
+{
+        const unsigned char *cached;
+        symbol_key_t *hdr;
+        unsigned char *key;
+        char *buf;
+        size_t size;
+        FILE *f;
+        FILE *old;
+        int keylen;
+        int n;
+        int errnum;
+
+        if (symbol_cache==NULL) {
+                char *dir = NULL;
+
+                /*unique symbols (e.g. tax stamps) are not kept by default*/
+                if (symbolcachedisk>0)
+                        dir = cache_queue_dir(cache_dir!=NULL ? cache_dir : CACHE_DIR,"symbol");
+                symbol_cache = cache_create(SYMBOL_CACHE_ENTRIES,
+                                            SYMBOL_CACHE_BYTES,dir);
+                if (dir!=NULL)
+                        cache_set_disk_limit(symbol_cache,SYMBOL_CACHE_DISK_BYTES);
+                free(dir);
+        }
+
+        keylen = sizeof(symbol_key_t)+len;
+        key = calloc(1,keylen);
+        if (symbol_cache==NULL || key==NULL) {
+                free(key);
+                errnum = encode_barcode(raw,symbology,data,len,opt);
+                fflush(output());
+                return errnum;
+        }
+
+        hdr = (symbol_key_t *)key;
+        hdr->cache_version = SYMBOL_CACHE_VERSION;
+        hdr->symbology = symbology;
+        hdr->printer_type = printer_type;
+        hdr->printer_model = printer_model;
+        hdr->printer_width = printer_width;
+        hdr->raw = raw;
+        hdr->height = opt->height;
+        hdr->module = opt->module;
+        hdr->ecc = opt->ecc;
+        hdr->cols = opt->cols;
+        hdr->version = opt->version;
+        hdr->mode = opt->mode;
+        memcpy(key+sizeof(symbol_key_t),data,len);
+
+        if (cache_lookup(symbol_cache,key,keylen,&cached,&n)) {
+                put_data(cached,n);
+                fflush(output());
+                free(key);
+                return APS_OK;
+        }
+
+        /*encode symbol in memory*/
+        buf = NULL;
+        f = open_memstream(&buf,&size);
+        if (f==NULL) {
+                free(key);
+                errnum = encode_barcode(raw,symbology,data,len,opt);
+                fflush(output());
+                return errnum;
+        }
+
+        old = set_ticket_output(f);
+        errnum = encode_barcode(raw,symbology,data,len,opt);
+        set_ticket_output(old);
+
+        fclose(f);
+
+        put_data(buf,size);
+        fflush(output());
+
+        if (errnum==APS_OK)
+                cache_store(symbol_cache,key,keylen,buf,size);
+
+        free(buf);
+        free(key);
+
+        return errnum;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  free_barcode_cache
+Purpose   :  Release encoded barcode symbols
+Inputs    :  <>
+Outputs   :  <>
+Return    :  <>
+-----------------------------------------------------------------------------*/
+void free_barcode_cache(void)
+{
+        cache_free(symbol_cache);
+        symbol_cache = NULL;
 }
 
+/*-----------------------------------------------------------------------------
+Name      :  start_copies
+Purpose   :  Spool job output so it can be replayed for each copy
+             Everything written to stdout until end_copies() is kept in a
+             temporary file, including text and barcodes sent directly
+             In direct mode the output has no file descriptor, the ticket
+             output is redirected instead
+Inputs    :  copies : number of copies requested
+Outputs   :  <>
+Return    :  APS_OK or error code (job is then printed once, unspooled)
+-----------------------------------------------------------------------------*/
+int start_copies(int copies)
+{
+        if (copies<=1)
+                return APS_OK;
+
+        fflush(output());
+
+        copies_file = tmpfile();
+        if (copies_file==NULL)
+                return APS_IO_ERROR;
+
+        if (direct) {
+                copies_out = set_ticket_output(copies_file);
+                return APS_OK;
+        }
+
+        copies_fd = dup(STDOUT_FILENO);
+        if (copies_fd<0 || dup2(fileno(copies_file),STDOUT_FILENO)<0) {
+                if (copies_fd>=0)
+                        close(copies_fd);
+                copies_fd = -1;
+                fclose(copies_file);
+                copies_file = NULL;
+                return APS_IO_ERROR;
+        }
+
+        return APS_OK;
+}
+
+/*-----------------------------------------------------------------------------
+Name      :  end_copies
+Purpose   :  Restore standard output and replay the spooled job
+             Each copy of a framed stream starts with a COPY marker
+Inputs    :  copies : number of times the job is written (each copy ends
+                      with the ticket epilog, hence with the final cut)
+Outputs   :  <>
+Return    :  APS_OK or error code
+-----------------------------------------------------------------------------*/
+int end_copies(int copies)
+{
+        char buf[COPY_BUFSIZE];
+        size_t n;
+        int errnum = APS_OK;
+        int i;
+
+        if (copies_file==NULL)
+                return APS_OK;
+
+        if (framed)
+                stream_flush(stdout);
+        fflush(output());
+
+        if (direct) {
+                set_ticket_output(copies_out);
+                copies_out = NULL;
+        }
+        else {
+                if (dup2(copies_fd,STDOUT_FILENO)<0)
+                        errnum = APS_IO_ERROR;
+                close(copies_fd);
+                copies_fd = -1;
+        }
+
+        for (i = 0; i<copies && errnum==APS_OK; i++) {
+                rewind(copies_file);
+                write_marker(STREAM_COPY,i+1);
+
+                while ((n = fread(buf,1,sizeof(buf),copies_file))>0) {
+                        if (fwrite(buf,1,n,output())!=n) {
+                                errnum = APS_IO_ERROR;
+                                break;
+                        }
+                }
+        }
+
+        fclose(copies_file);
+        copies_file = NULL;
+
+        fflush(output());
+
+        return errnum;
+}
@@ -35,13 +35,29 @@
 extern "C" {
 #endif
 
+FILE    *set_ticket_output(FILE *f);
+
 void    enter_raw_mode(void);
+void    enter_direct_mode(int on);
+
+void    start_stream(int flags);
+void    write_marker(int type,int value);
+void    end_stream(void);
 
 void    write_command(int raw,const command_t *cmd,const void *buf,int size);
+void    write_data(int raw,const void *buf,int size);
+void    write_captured(const void *buf,int size);
 
 void    write_prolog(int raw);
 void    write_epilog(int raw);
 
+int     write_barcode(int raw,int symbology,const char *data,int len,
+                      const barcode_opt_t *opt);
+void    free_barcode_cache(void);
+
+int     start_copies(int copies);
+int     end_copies(int copies);
+
 #ifdef __cplusplus
 }
 #endif
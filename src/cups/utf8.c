@@ -14,6 +14,7 @@ unsigned char *p;
 int size;
 int fd;
 int utf8;
+int from_buffer;
 
 
 
@@ -23,6 +24,12 @@ static unsigned char get_char(void)
 
     if (size == 0)
     {
+        if (from_buffer)
+        {
+            from_buffer = 0;
+            fd = -1;
+        }
+
         if (fd < 0)
             return (unsigned char)-1;
 
@@ -49,6 +56,46 @@ void utf8_set_file(int _fd,int _utf8)
     fd = _fd;
     size = 0;
     utf8 = _utf8;
+    from_buffer = 0;
+}
+
+/* read codes from memory instead of a file, until end of buffer */
+void utf8_set_buffer(const unsigned char *_buf,int _size,int _utf8)
+{
+    fd = -1;
+    p = (unsigned char *)_buf;
+    size = _size;
+    utf8 = _utf8;
+    from_buffer = 1;
+}
+
+/* store code as read by utf8_get_code, return number of bytes */
+int utf8_put_code(int c,unsigned char *out)
+{
+    if (!utf8 || c < 0x80)
+    {
+        out[0] = c;
+        return 1;
+    }
+    else if (c < 0x800)
+    {
+        out[0] = 0xc0 | (c >> 6);
+        out[1] = 0x80 | (c & 0x3f);
+        return 2;
+    }
+    else if (c < 0x10000)
+    {
+        out[0] = 0xe0 | (c >> 12);
+        out[1] = 0x80 | ((c >> 6) & 0x3f);
+        out[2] = 0x80 | (c & 0x3f);
+        return 3;
+    }
+
+    out[0] = 0xf0 | (c >> 18);
+    out[1] = 0x80 | ((c >> 12) & 0x3f);
+    out[2] = 0x80 | ((c >> 6) & 0x3f);
+    out[3] = 0x80 | (c & 0x3f);
+    return 4;
 }
 
 int utf8_get_code(void)
@@ -92,7 +139,7 @@ int utf8_get_code(void)
     fprintf(stderr,"DEBUG: i:%i \n",i);
 #endif
 
-    if (fd < 0)
+    if (fd < 0 && !from_buffer)
         return -1;
 
     return i;
@@ -5,6 +5,8 @@
 
 void    utf8_set_file(int _fd, int _utf8);
 int     utf8_get_code(void);
+void    utf8_set_buffer(const unsigned char *_buf, int _size, int _utf8);
+int     utf8_put_code(int c, unsigned char *out);
 
 
 